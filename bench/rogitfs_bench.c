@@ -0,0 +1,665 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+// Drives the fuse handlers directly, without mounting.
+//
+// The repository is opened like rogitfs does and every worker thread calls
+// the handlers of one workload for --ops operations, picking paths from the
+// tree of HEAD, references or commits with its own seeded random generator.
+// Throughput and latency percentiles of all threads are written to stdout.
+//
+//   make bench
+//   ./rogitfs-bench --repopath=/path/to/repository --threads=4 --ops=100000 stat
+//
+// Workloads:
+//   stat         getattr of files and directories below /commit/<HEAD>
+//   read         reads of --block-size bytes, every thread reads the files in order
+//   random-read  reads of --block-size bytes at random offsets of random files
+//   readdir      readdir of directories below /commit/<HEAD>
+//   readdir-obj  readdir of /obj, listing every object of the repository
+//   refs         readlink of references below /refs
+//   inherit      readdir of commits below /inherit
+//   history      reads like read of the largest file of HEAD in every commit
+//                having it, newest first, for the delta cache
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <git2.h>
+#include "rogitfs_common.h"
+#include "rogitfs_mount.h"
+#include "rogitfs_memory.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_commit.h"
+#include "rogitfs_obj.h"
+#include "rogitfs_refs.h"
+#include "rogitfs_inherit.h"
+
+#define ROGITFS_BENCH_DEFAULT_OPS 10000
+#define ROGITFS_BENCH_DEFAULT_BLOCK_SIZE 65536
+#define ROGITFS_BENCH_MAX_COMMITS 100000
+
+enum rogitfs_bench_workload {
+	ROGITFS_BENCH_STAT,
+	ROGITFS_BENCH_READ,
+	ROGITFS_BENCH_RANDOM_READ,
+	ROGITFS_BENCH_READDIR,
+	ROGITFS_BENCH_READDIR_OBJ,
+	ROGITFS_BENCH_REFS,
+	ROGITFS_BENCH_INHERIT,
+	ROGITFS_BENCH_HISTORY
+};
+
+static const char *rogitfs_bench_workload_names[] = {
+	"stat",
+	"read",
+	"random-read",
+	"readdir",
+	"readdir-obj",
+	"refs",
+	"inherit",
+	"history",
+	NULL
+};
+
+// Paths handed to the handlers, relative like after the dispatch in rogitfs.c
+struct rogitfs_bench_paths {
+	char **paths;
+	size_t *sizes;
+	size_t count;
+	size_t capacity;
+};
+
+struct rogitfs_bench {
+	enum rogitfs_bench_workload workload;
+	struct rogitfs_private private;
+	struct rogitfs_bench_paths paths;
+	unsigned long ops;
+	size_t block_size;
+	unsigned long seed;
+	pthread_barrier_t barrier;
+};
+
+struct rogitfs_bench_thread {
+	struct rogitfs_bench *bench;
+	pthread_t thread;
+	unsigned int index;
+	uint64_t state;
+	// position of the sequential reader
+	size_t file;
+	size_t offset;
+	unsigned long errors;
+	uint64_t *latencies;
+	struct timespec start;
+	struct timespec end;
+};
+
+// The handlers only take their private data from the fuse context
+static struct fuse_context rogitfs_bench_context = {};
+
+struct fuse_context *fuse_get_context(void) {
+
+	return &rogitfs_bench_context;
+}
+
+static uint64_t rogitfs_bench_random(struct rogitfs_bench_thread *thread) {
+
+	// xorshift64*
+	uint64_t x = thread->state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	thread->state = x;
+	return x * 0x2545f4914f6cdd1dull;
+}
+
+static uint64_t rogitfs_bench_ns(const struct timespec *start, const struct timespec *end) {
+
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ull + end->tv_nsec - start->tv_nsec;
+}
+
+static int rogitfs_bench_before(const struct timespec *a, const struct timespec *b) {
+
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static int rogitfs_bench_paths_add(struct rogitfs_bench_paths *paths, char *path, size_t size) {
+
+	if (path == NULL) {
+		return -1;
+	}
+	if (paths->count == paths->capacity) {
+		size_t capacity = paths->capacity == 0 ? 1024 : paths->capacity * 2;
+		char **new_paths = (char **) realloc(paths->paths, capacity * sizeof(char *));
+		if (new_paths == NULL) {
+			free(path);
+			return -1;
+		}
+		paths->paths = new_paths;
+		size_t *new_sizes = (size_t *) realloc(paths->sizes, capacity * sizeof(size_t));
+		if (new_sizes == NULL) {
+			free(path);
+			return -1;
+		}
+		paths->sizes = new_sizes;
+		paths->capacity = capacity;
+	}
+	paths->paths[paths->count] = path;
+	paths->sizes[paths->count] = size;
+	paths->count++;
+	return 0;
+}
+
+static void rogitfs_bench_paths_free(struct rogitfs_bench_paths *paths) {
+
+	for (size_t i = 0; i < paths->count; i++) {
+		free(paths->paths[i]);
+	}
+	free(paths->paths);
+	free(paths->sizes);
+}
+
+static char *rogitfs_bench_path(const char *prefix, const char *root, const char *name) {
+
+	struct rogitfs_buffer path = {};
+	if (rogitfs_buffer_printf(&path, "%s%s%s", prefix, root, name) != 0 || rogitfs_buffer_append(&path, "", 1) != 0) {
+		rogitfs_buffer_free(&path);
+		return NULL;
+	}
+	return path.data;
+}
+
+struct rogitfs_bench_walk_payload {
+	struct rogitfs_bench *bench;
+	const char *prefix;
+	int error;
+};
+
+static int rogitfs_bench_walk_cb(const char *root, const git_tree_entry *entry, void *payload) {
+
+	struct rogitfs_bench_walk_payload *walk = (struct rogitfs_bench_walk_payload *)payload;
+	struct rogitfs_bench *bench = walk->bench;
+	git_object_t type = git_tree_entry_type(entry);
+	size_t size = 0;
+
+	switch (bench->workload) {
+	case ROGITFS_BENCH_STAT:
+		break;
+	case ROGITFS_BENCH_READDIR:
+		if (type != GIT_OBJECT_TREE) {
+			return 0;
+		}
+		break;
+	default:
+		if (type != GIT_OBJECT_BLOB || (git_tree_entry_filemode(entry) & GIT_FILEMODE_LINK) == GIT_FILEMODE_LINK) {
+			return 0;
+		}
+		git_object_t header_type = GIT_OBJECT_INVALID;
+		int error = git_odb_read_header(&size, &header_type, bench->private.odb, git_tree_entry_id(entry));
+		if (error != 0) {
+			fprintf(stderr, "git_odb_read_header %d %s\n", error, git_error_last()->message);
+			walk->error = -1;
+			return -1;
+		}
+		if (size == 0) {
+			return 0;
+		}
+		break;
+	}
+
+	if (rogitfs_bench_paths_add(&bench->paths, rogitfs_bench_path(walk->prefix, root, git_tree_entry_name(entry)), size) != 0) {
+		walk->error = -1;
+		return -1;
+	}
+	return 0;
+}
+
+// Files or directories of the tree of HEAD
+static int rogitfs_bench_collect_tree(struct rogitfs_bench *bench) {
+
+	git_object *head = NULL;
+	int error = git_revparse_single(&head, bench->private.repo, "HEAD^{commit}");
+	if (error != 0) {
+		fprintf(stderr, "git_revparse_single %d %s\n", error, git_error_last()->message);
+		return -1;
+	}
+	git_tree *tree = NULL;
+	error = git_commit_tree(&tree, (git_commit *)head);
+	if (error != 0) {
+		fprintf(stderr, "git_commit_tree %d %s\n", error, git_error_last()->message);
+		git_object_free(head);
+		return -1;
+	}
+
+	char hash[GIT_OID_HEXSZ+1];
+	git_oid_tostr(hash, sizeof(hash), git_object_id(head));
+	// readdir paths start with /, the other handlers get them without
+	char prefix[GIT_OID_HEXSZ+3];
+	snprintf(prefix, sizeof(prefix), "%s%s/", bench->workload == ROGITFS_BENCH_READDIR ? "/" : "", hash);
+
+	int res = 0;
+	if (bench->workload == ROGITFS_BENCH_READDIR) {
+		res = rogitfs_bench_paths_add(&bench->paths, rogitfs_bench_path("/", hash, ""), 0);
+	}
+	struct rogitfs_bench_walk_payload walk = {bench, prefix, 0};
+	if (res == 0) {
+		error = git_tree_walk(tree, GIT_TREEWALK_PRE, &rogitfs_bench_walk_cb, &walk);
+		if (error != 0 && walk.error == 0) {
+			fprintf(stderr, "git_tree_walk %d %s\n", error, git_error_last()->message);
+			res = -1;
+		} else {
+			res = walk.error;
+		}
+	}
+	git_tree_free(tree);
+	git_object_free(head);
+	return res;
+}
+
+static int rogitfs_bench_collect_refs(struct rogitfs_bench *bench) {
+
+	git_strarray refs = {};
+	int error = git_reference_list(&refs, bench->private.repo);
+	if (error != 0) {
+		fprintf(stderr, "git_reference_list %d %s\n", error, git_error_last()->message);
+		return -1;
+	}
+	int res = 0;
+	for (size_t i = 0; i < refs.count && res == 0; i++) {
+		if (strncmp(refs.strings[i], "refs/", 5) != 0) {
+			continue;
+		}
+		res = rogitfs_bench_paths_add(&bench->paths, strdup(refs.strings[i]+5), 0);
+	}
+	git_strarray_dispose(&refs);
+	return res;
+}
+
+// Commits reachable from HEAD, at most ROGITFS_BENCH_MAX_COMMITS
+static int rogitfs_bench_collect_commits(struct rogitfs_bench *bench) {
+
+	git_revwalk *walk = NULL;
+	int error = git_revwalk_new(&walk, bench->private.repo);
+	if (error != 0) {
+		fprintf(stderr, "git_revwalk_new %d %s\n", error, git_error_last()->message);
+		return -1;
+	}
+	error = git_revwalk_push_head(walk);
+	if (error != 0) {
+		fprintf(stderr, "git_revwalk_push_head %d %s\n", error, git_error_last()->message);
+		git_revwalk_free(walk);
+		return -1;
+	}
+	int res = 0;
+	git_oid oid = {};
+	while (res == 0 && bench->paths.count < ROGITFS_BENCH_MAX_COMMITS && git_revwalk_next(&oid, walk) == 0) {
+		char hash[GIT_OID_HEXSZ+1];
+		git_oid_tostr(hash, sizeof(hash), &oid);
+		res = rogitfs_bench_paths_add(&bench->paths, rogitfs_bench_path("/", hash, ""), 0);
+	}
+	git_revwalk_free(walk);
+	return res;
+}
+
+// The largest file of HEAD in every commit reachable from HEAD having it
+static int rogitfs_bench_collect_history(struct rogitfs_bench *bench) {
+
+	int res = rogitfs_bench_collect_tree(bench);
+	if (res != 0 || bench->paths.count == 0) {
+		return res;
+	}
+	size_t largest = 0;
+	for (size_t i = 1; i < bench->paths.count; i++) {
+		if (bench->paths.sizes[i] > bench->paths.sizes[largest]) {
+			largest = i;
+		}
+	}
+	// path within the tree, without <hash>/
+	char *file = strdup(bench->paths.paths[largest] + GIT_OID_HEXSZ + 1);
+	rogitfs_bench_paths_free(&bench->paths);
+	memset(&bench->paths, 0, sizeof(bench->paths));
+	if (file == NULL) {
+		return -1;
+	}
+
+	git_revwalk *walk = NULL;
+	int error = git_revwalk_new(&walk, bench->private.repo);
+	if (error == 0) {
+		error = git_revwalk_push_head(walk);
+	}
+	if (error != 0) {
+		fprintf(stderr, "git_revwalk %d %s\n", error, git_error_last()->message);
+		git_revwalk_free(walk);
+		free(file);
+		return -1;
+	}
+	git_oid oid = {};
+	while (res == 0 && bench->paths.count < ROGITFS_BENCH_MAX_COMMITS && git_revwalk_next(&oid, walk) == 0) {
+		git_commit *commit = NULL;
+		git_tree *tree = NULL;
+		git_tree_entry *entry = NULL;
+		char hash[GIT_OID_HEXSZ+1];
+		git_oid_tostr(hash, sizeof(hash), &oid);
+		if (git_commit_lookup(&commit, bench->private.repo, &oid) != 0 || git_commit_tree(&tree, commit) != 0) {
+			fprintf(stderr, "commit %s could not be read\n", hash);
+			res = -1;
+		} else if (git_tree_entry_bypath(&entry, tree, file) == 0 && git_tree_entry_type(entry) == GIT_OBJECT_BLOB) {
+			size_t size = 0;
+			git_object_t type = GIT_OBJECT_INVALID;
+			if (git_odb_read_header(&size, &type, bench->private.odb, git_tree_entry_id(entry)) == 0 && size > 0) {
+				res = rogitfs_bench_paths_add(&bench->paths, rogitfs_bench_path(hash, "/", file), size);
+			}
+		}
+		git_tree_entry_free(entry);
+		git_tree_free(tree);
+		git_commit_free(commit);
+	}
+	git_revwalk_free(walk);
+	free(file);
+	return res;
+}
+
+static int rogitfs_bench_fill(void *buf, const char *name, const struct stat *stbuf, off_t off, enum fuse_fill_dir_flags flags) {
+
+	(*(unsigned long *)buf)++;
+	return 0;
+}
+
+static int rogitfs_bench_op(struct rogitfs_bench_thread *thread, char *buf) {
+
+	struct rogitfs_bench *bench = thread->bench;
+	struct rogitfs_bench_paths *paths = &bench->paths;
+	size_t index = 0;
+	if (bench->workload == ROGITFS_BENCH_READ || bench->workload == ROGITFS_BENCH_HISTORY) {
+		index = thread->file;
+	} else {
+		index = rogitfs_bench_random(thread) % paths->count;
+	}
+
+	struct stat st = {};
+	unsigned long entries = 0;
+	switch (bench->workload) {
+	case ROGITFS_BENCH_STAT:
+		return rogitfs_commit_getattr(paths->paths[index], &st, NULL);
+	case ROGITFS_BENCH_READ:
+	case ROGITFS_BENCH_HISTORY: {
+		int res = rogitfs_commit_read(paths->paths[index], buf, bench->block_size, thread->offset, NULL);
+		thread->offset += bench->block_size;
+		if (thread->offset >= paths->sizes[index]) {
+			thread->offset = 0;
+			thread->file = (thread->file + 1) % paths->count;
+		}
+		return res < 0 ? res : 0;
+	}
+	case ROGITFS_BENCH_RANDOM_READ: {
+		off_t offset = (off_t)(rogitfs_bench_random(thread) % paths->sizes[index]);
+		int res = rogitfs_commit_read(paths->paths[index], buf, bench->block_size, offset, NULL);
+		return res < 0 ? res : 0;
+	}
+	case ROGITFS_BENCH_READDIR:
+		return rogitfs_commit_readdir(paths->paths[index], &entries, &rogitfs_bench_fill, 0, NULL, 0);
+	case ROGITFS_BENCH_READDIR_OBJ:
+		return rogitfs_obj_readdir("", &entries, &rogitfs_bench_fill, 0, NULL, 0);
+	case ROGITFS_BENCH_REFS: {
+		char link[PATH_MAX];
+		return rogitfs_refs_readlink(paths->paths[index], link, sizeof(link));
+	}
+	case ROGITFS_BENCH_INHERIT:
+		return rogitfs_inherit_readdir(paths->paths[index], &entries, &rogitfs_bench_fill, 0, NULL, 0);
+	}
+	return -1;
+}
+
+static void *rogitfs_bench_worker(void *data) {
+
+	struct rogitfs_bench_thread *thread = (struct rogitfs_bench_thread *)data;
+	struct rogitfs_bench *bench = thread->bench;
+	rogitfs_private_set(&bench->private);
+
+	char *buf = (char *) malloc(bench->block_size);
+	if (buf == NULL) {
+		thread->errors = bench->ops;
+		pthread_barrier_wait(&bench->barrier);
+		return NULL;
+	}
+
+	pthread_barrier_wait(&bench->barrier);
+	clock_gettime(CLOCK_MONOTONIC, &thread->start);
+	for (unsigned long i = 0; i < bench->ops; i++) {
+		struct timespec op_start = {};
+		struct timespec op_end = {};
+		clock_gettime(CLOCK_MONOTONIC, &op_start);
+		if (rogitfs_bench_op(thread, buf) != 0) {
+			thread->errors++;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &op_end);
+		thread->latencies[i] = rogitfs_bench_ns(&op_start, &op_end);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &thread->end);
+	free(buf);
+	return NULL;
+}
+
+static int rogitfs_bench_compare(const void *a, const void *b) {
+
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void rogitfs_bench_report(struct rogitfs_bench *bench, struct rogitfs_bench_thread *threads, unsigned int thread_count) {
+
+	unsigned long total = bench->ops * thread_count;
+	unsigned long errors = 0;
+	struct timespec start = threads[0].start;
+	struct timespec end = threads[0].end;
+	uint64_t *latencies = threads[0].latencies;
+	// the threads run from the first start until the last end
+	for (unsigned int t = 0; t < thread_count; t++) {
+		errors += threads[t].errors;
+		if (rogitfs_bench_before(&threads[t].start, &start)) {
+			start = threads[t].start;
+		}
+		if (rogitfs_bench_before(&end, &threads[t].end)) {
+			end = threads[t].end;
+		}
+	}
+	// the latencies of all threads are one array
+	qsort(latencies, total, sizeof(uint64_t), &rogitfs_bench_compare);
+
+	uint64_t sum = 0;
+	for (unsigned long i = 0; i < total; i++) {
+		sum += latencies[i];
+	}
+	double seconds = rogitfs_bench_ns(&start, &end) / 1e9;
+
+	printf("workload %s\n", rogitfs_bench_workload_names[bench->workload]);
+	printf("threads %u\n", thread_count);
+	printf("paths %zu\n", bench->paths.count);
+	printf("ops %lu\n", total);
+	printf("errors %lu\n", errors);
+	printf("seconds %.3f\n", seconds);
+	printf("ops_per_second %.0f\n", seconds > 0 ? total / seconds : 0.0);
+	printf("latency_ns mean %llu p50 %llu p90 %llu p99 %llu p999 %llu max %llu\n",
+		(unsigned long long)(sum / total),
+		(unsigned long long)latencies[total * 50 / 100],
+		(unsigned long long)latencies[total * 90 / 100],
+		(unsigned long long)latencies[total * 99 / 100],
+		(unsigned long long)latencies[total * 999 / 1000],
+		(unsigned long long)latencies[total - 1]);
+}
+
+static void show_help(const char *progname) {
+
+	printf("usage: %s [options] <workload>\n\n", progname);
+	printf("Workloads: stat, read, random-read, readdir, readdir-obj, refs, inherit, history\n\n");
+	printf("Options:\n"
+	       "    --repopath=<s>      Path of the git repository (default .)\n"
+	       "    --threads=<n>       Worker threads (default 1)\n"
+	       "    --ops=<n>           Operations per thread (default %d)\n"
+	       "    --block-size=<n>    Bytes per read (default %d)\n"
+	       "    --cache-size=<n>    Size of all caches in MiB\n"
+	       "    --delta-cache-size=<n> Size of the delta cache in MiB\n"
+	       "    --memory-limit=<n>  Memory of all caches together in MiB\n"
+	       "    --seed=<n>          Seed of the path selection (default 1)\n"
+	       "\n", ROGITFS_BENCH_DEFAULT_OPS, ROGITFS_BENCH_DEFAULT_BLOCK_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+
+	static const struct option long_options[] = {
+		{"repopath", required_argument, NULL, 'r'},
+		{"threads", required_argument, NULL, 't'},
+		{"ops", required_argument, NULL, 'o'},
+		{"block-size", required_argument, NULL, 'b'},
+		{"cache-size", required_argument, NULL, 'c'},
+		{"delta-cache-size", required_argument, NULL, 'd'},
+		{"memory-limit", required_argument, NULL, 'm'},
+		{"seed", required_argument, NULL, 's'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	const char *repopath = ".";
+	unsigned int thread_count = 1;
+	size_t budget = 0;
+	struct rogitfs_bench bench = {
+		.ops = ROGITFS_BENCH_DEFAULT_OPS,
+		.block_size = ROGITFS_BENCH_DEFAULT_BLOCK_SIZE,
+		.seed = 1
+	};
+
+	int opt = 0;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'r':
+			repopath = optarg;
+			break;
+		case 't':
+			thread_count = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			bench.ops = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			bench.block_size = (size_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			budget = (size_t)strtoul(optarg, NULL, 10) * 1024 * 1024;
+			break;
+		case 'd':
+			bench.private.delta_cache_size = (size_t)strtoul(optarg, NULL, 10) * 1024 * 1024;
+			break;
+		case 'm':
+			rogitfs_memory_set_limit((size_t)strtoul(optarg, NULL, 10) * 1024 * 1024);
+			break;
+		case 's':
+			bench.seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		default:
+			show_help(argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 1 != argc || thread_count == 0 || bench.ops == 0 || bench.block_size == 0) {
+		show_help(argv[0]);
+		return 1;
+	}
+	int found = 0;
+	for (int i = 0; rogitfs_bench_workload_names[i] != NULL; i++) {
+		if (strcmp(argv[optind], rogitfs_bench_workload_names[i]) == 0) {
+			bench.workload = (enum rogitfs_bench_workload)i;
+			found = 1;
+		}
+	}
+	if (found == 0) {
+		fprintf(stderr, "unknown workload %s\n", argv[optind]);
+		return 1;
+	}
+
+	git_libgit2_init();
+	if (rogitfs_private_open(&bench.private, repopath) != 0) {
+		fprintf(stderr, "repository %s could not be opened\n", repopath);
+		return 1;
+	}
+	if (rogitfs_caches_new(&bench.private, budget) != 0) {
+		return 1;
+	}
+	bench.private.ref_ttl = ROGITFS_REFTREE_DEFAULT_TTL;
+	rogitfs_bench_context.private_data = &bench.private;
+
+	int res = 0;
+	switch (bench.workload) {
+	case ROGITFS_BENCH_READDIR_OBJ:
+		res = rogitfs_bench_paths_add(&bench.paths, strdup(""), 0);
+		break;
+	case ROGITFS_BENCH_REFS:
+		res = rogitfs_bench_collect_refs(&bench);
+		break;
+	case ROGITFS_BENCH_INHERIT:
+		res = rogitfs_bench_collect_commits(&bench);
+		break;
+	case ROGITFS_BENCH_HISTORY:
+		res = rogitfs_bench_collect_history(&bench);
+		break;
+	default:
+		res = rogitfs_bench_collect_tree(&bench);
+		break;
+	}
+	if (res == 0 && bench.paths.count == 0) {
+		fprintf(stderr, "no paths for workload %s\n", rogitfs_bench_workload_names[bench.workload]);
+		res = -1;
+	}
+
+	struct rogitfs_bench_thread *threads = NULL;
+	uint64_t *latencies = NULL;
+	if (res == 0) {
+		threads = (struct rogitfs_bench_thread *) calloc(thread_count, sizeof(struct rogitfs_bench_thread));
+		latencies = (uint64_t *) calloc(bench.ops * thread_count, sizeof(uint64_t));
+		if (threads == NULL || latencies == NULL) {
+			fputs("calloc failed\n", stderr);
+			res = -1;
+		}
+	}
+	unsigned int started = 0;
+	if (res == 0) {
+		pthread_barrier_init(&bench.barrier, NULL, thread_count);
+		for (; started < thread_count; started++) {
+			struct rogitfs_bench_thread *thread = &threads[started];
+			thread->bench = &bench;
+			thread->index = started;
+			// xorshift needs a state other than 0
+			thread->state = (bench.seed + 1) * 0x9e3779b97f4a7c15ull + started;
+			// sequential readers go through all files, each starting at another one
+			thread->file = (size_t)started * bench.paths.count / thread_count;
+			thread->latencies = latencies + bench.ops * started;
+			int error = pthread_create(&thread->thread, NULL, &rogitfs_bench_worker, thread);
+			if (error != 0) {
+				fprintf(stderr, "pthread_create %d %s\n", error, strerror(error));
+				// the barrier waits for every thread, the run cannot start
+				exit(1);
+			}
+		}
+		for (unsigned int t = 0; t < started; t++) {
+			pthread_join(threads[t].thread, NULL);
+		}
+		pthread_barrier_destroy(&bench.barrier);
+		rogitfs_bench_report(&bench, threads, thread_count);
+	}
+
+	free(latencies);
+	free(threads);
+	rogitfs_bench_paths_free(&bench.paths);
+	rogitfs_private_close(&bench.private);
+	rogitfs_caches_free(&bench.private);
+	git_libgit2_shutdown();
+	return res == 0 ? 0 : 1;
+}
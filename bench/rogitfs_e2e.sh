@@ -0,0 +1,156 @@
+#!/bin/bash
+# Copyright 2019, aw32
+# SPDX-License-Identifier: GPL-3.0-only
+#
+# Mounts rogitfs on a repository and times standard tools on the tree of HEAD.
+#
+#   bench/rogitfs_e2e.sh [options] <repository> [-- <rogitfs options>]
+#
+#   --runs=<n>       Runs per workload (default 5)
+#   --jobs=<n>       Parallel grep processes (default nproc)
+#   --rogitfs=<s>    rogitfs binary (default ./rogitfs)
+#   --mounted=<s>    Use an existing mount instead of mounting
+#   --report=<s>     JSON report file (default stdout)
+#
+# Workloads are find, ls -lR, cat of the largest files, parallel grep and
+# tar. The first run of every workload is reported as cold run, the
+# percentiles are taken over the remaining runs. With a report file
+# /.rogitfs/stats of the mount is written next to it.
+
+set -eu
+
+runs=5
+jobs=$(nproc)
+rogitfs=./rogitfs
+mounted=""
+report=""
+repo=""
+rogitfs_args=()
+
+while [ $# -gt 0 ]; do
+	case "$1" in
+	--runs=*) runs="${1#*=}" ;;
+	--jobs=*) jobs="${1#*=}" ;;
+	--rogitfs=*) rogitfs="${1#*=}" ;;
+	--mounted=*) mounted="${1#*=}" ;;
+	--report=*) report="${1#*=}" ;;
+	--) shift; rogitfs_args=("$@"); break ;;
+	-*) echo "unknown option $1" >&2; exit 1 ;;
+	*) repo="$1" ;;
+	esac
+	shift
+done
+if [ -z "$repo" ] || [ "$runs" -lt 2 ]; then
+	sed -n '5,13p' "$0" | sed 's/^# \{0,1\}//' >&2
+	exit 1
+fi
+
+head=$(git -C "$repo" rev-parse HEAD)
+
+mnt="$mounted"
+if [ -z "$mnt" ]; then
+	mnt=$(mktemp -d)
+	"$rogitfs" "$mnt" --repopath="$repo" "${rogitfs_args[@]}"
+	trap 'fusermount3 -u "$mnt"; rmdir "$mnt"' EXIT
+	for i in $(seq 100); do
+		[ -d "$mnt/commit" ] && break
+		sleep 0.1
+	done
+fi
+root="$mnt/commit/$head"
+if [ ! -d "$root" ]; then
+	echo "$root not found" >&2
+	exit 1
+fi
+
+# regular files of HEAD as <size> <path>, to know the expected amount of data
+files=$(git -C "$repo" ls-tree -r -l HEAD | awk '$1 != "120000" && $1 != "160000" { size = $4; sub(/^[^\t]*\t/, ""); print size, $0 }')
+file_count=$(printf '%s\n' "$files" | grep -c . || true)
+file_bytes=$(printf '%s\n' "$files" | awk '{ sum += $1 } END { print sum + 0 }')
+large=$(printf '%s\n' "$files" | sort -n -r | head -n 4)
+large_count=$(printf '%s\n' "$large" | grep -c . || true)
+large_bytes=$(printf '%s\n' "$large" | awk '{ sum += $1 } END { print sum + 0 }')
+
+workload_find() {
+	find "$root" > /dev/null
+}
+
+workload_ls() {
+	ls -lR "$root" > /dev/null
+}
+
+workload_cat() {
+	printf '%s\n' "$large" | cut -d ' ' -f 2- | (cd "$root" && xargs -d '\n' cat) > /dev/null
+}
+
+workload_grep() {
+	(cd "$root" && find . -type f -print0 | xargs -0 -P "$jobs" -n 64 grep -c "rev" > /dev/null) || true
+}
+
+workload_tar() {
+	# tar skips reading files when writing to /dev/null itself
+	tar -cf - -C "$root" . | cat > /dev/null
+}
+
+now_ns() {
+	date +%s%N
+}
+
+# <sorted values> <percent>, nearest rank
+percentile() {
+	local values=($1)
+	local rank=$(( (${#values[@]} * $2 + 99) / 100 ))
+	echo "${values[$((rank - 1))]}"
+}
+
+results=()
+# <name> <function> <items> <bytes>
+run_workload() {
+	local name=$1 function=$2 items=$3 bytes=$4
+	local cold=0 warm=()
+	for run in $(seq "$runs"); do
+		local start end
+		start=$(now_ns)
+		$function
+		end=$(now_ns)
+		if [ "$run" -eq 1 ]; then
+			cold=$((end - start))
+		else
+			warm+=($((end - start)))
+		fi
+	done
+	local sorted p50 p99
+	sorted=$(printf '%s\n' "${warm[@]}" | sort -n | tr '\n' ' ')
+	p50=$(percentile "$sorted" 50)
+	p99=$(percentile "$sorted" 99)
+	results+=("$(printf '{"name":"%s","items":%s,"bytes":%s,"cold_ns":%s,"p50_ns":%s,"p99_ns":%s,"items_per_second":%s,"bytes_per_second":%s}' \
+		"$name" "$items" "$bytes" "$cold" "$p50" "$p99" \
+		"$(awk -v n="$items" -v t="$p50" 'BEGIN { printf "%.0f", (t > 0 ? n * 1e9 / t : 0) }')" \
+		"$(awk -v n="$bytes" -v t="$p50" 'BEGIN { printf "%.0f", (t > 0 ? n * 1e9 / t : 0) }')")")
+	echo "$name cold $((cold / 1000000)) ms p50 $((p50 / 1000000)) ms p99 $((p99 / 1000000)) ms" >&2
+}
+
+run_workload find workload_find "$file_count" 0
+run_workload ls-lR workload_ls "$file_count" 0
+run_workload cat workload_cat "$large_count" "$large_bytes"
+run_workload grep workload_grep "$file_count" "$file_bytes"
+run_workload tar workload_tar "$file_count" "$file_bytes"
+
+source_commit=$(git -C "$(dirname "$0")" rev-parse HEAD 2> /dev/null || echo unknown)
+json=$(printf '{"rogitfs":"%s","repository":"%s","head":"%s","runs":%s,"jobs":%s,"workloads":[' \
+	"$source_commit" "$repo" "$head" "$runs" "$jobs")
+separator=""
+for result in "${results[@]}"; do
+	json="$json$separator$result"
+	separator=","
+done
+json="$json]}"
+
+if [ -n "$report" ]; then
+	echo "$json" > "$report"
+	if [ -f "$mnt/.rogitfs/stats" ]; then
+		cat "$mnt/.rogitfs/stats" > "${report%.json}.stats"
+	fi
+else
+	echo "$json"
+fi
@@ -0,0 +1,299 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+// Writes a synthetic repository of a given shape as git fast-import stream.
+//
+//   git init --bare /tmp/generated
+//   ./rogitfs-genrepo --commits=1000 --depth=4 --tags=100000 | git -C /tmp/generated fast-import --quiet
+//
+// The first commit adds a tree of --depth levels, each directory holding
+// --width text files and --fanout subdirectories, plus --large-files files
+// of random bytes. Every following commit changes --changes text files and
+// chain.txt by one line, so repacking with a large --depth gives long delta
+// chains. Branches and tags point to random commits. The same options and
+// --seed always give the same repository.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+#define ROGITFS_GENREPO_TIME 1500000000
+#define ROGITFS_GENREPO_LINE_SIZE 40
+
+struct rogitfs_genrepo {
+	unsigned long commits;
+	unsigned int width;
+	unsigned int fanout;
+	unsigned int depth;
+	unsigned long blob_size;
+	unsigned int changes;
+	unsigned int large_files;
+	unsigned long large_size;
+	unsigned long branches;
+	unsigned long tags;
+	uint64_t seed;
+	// text files of the tree and the version each was last written with
+	char **paths;
+	unsigned long *versions;
+	size_t count;
+	size_t capacity;
+	char *content;
+};
+
+static const char *rogitfs_genrepo_words[] = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+	"india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa",
+	"quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray",
+	"yankee", "zulu", "tree", "blob", "commit", "tag", "index", "object"
+};
+
+// splitmix64 of the seed and two values, content only depends on its position
+static uint64_t rogitfs_genrepo_hash(uint64_t seed, uint64_t a, uint64_t b) {
+
+	uint64_t x = seed ^ (a * 0x9e3779b97f4a7c15ull) ^ (b * 0xc2b2ae3d27d4eb4full);
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+static int rogitfs_genrepo_add_path(struct rogitfs_genrepo *gen, const char *path) {
+
+	if (gen->count == gen->capacity) {
+		size_t capacity = gen->capacity == 0 ? 1024 : gen->capacity * 2;
+		char **new_paths = (char **) realloc(gen->paths, capacity * sizeof(char *));
+		if (new_paths == NULL) {
+			return -1;
+		}
+		gen->paths = new_paths;
+		gen->capacity = capacity;
+	}
+	gen->paths[gen->count] = strdup(path);
+	if (gen->paths[gen->count] == NULL) {
+		return -1;
+	}
+	gen->count++;
+	return 0;
+}
+
+static int rogitfs_genrepo_add_dir(struct rogitfs_genrepo *gen, const char *dir, unsigned int level) {
+
+	char path[4096];
+	for (unsigned int i = 0; i < gen->width; i++) {
+		snprintf(path, sizeof(path), "%sf%u.txt", dir, i);
+		if (rogitfs_genrepo_add_path(gen, path) != 0) {
+			return -1;
+		}
+	}
+	if (level + 1 >= gen->depth) {
+		return 0;
+	}
+	for (unsigned int i = 0; i < gen->fanout; i++) {
+		int len = snprintf(path, sizeof(path), "%sd%u/", dir, i);
+		if (len < 0 || (size_t)len >= sizeof(path)) {
+			return -1;
+		}
+		if (rogitfs_genrepo_add_dir(gen, path, level + 1) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Text of a file in a version, versions differ in one line
+static size_t rogitfs_genrepo_text(struct rogitfs_genrepo *gen, uint64_t file, unsigned long version) {
+
+	size_t lines = gen->blob_size / ROGITFS_GENREPO_LINE_SIZE + 1;
+	size_t changed = (version * 7919) % lines;
+	size_t size = 0;
+	for (size_t line = 0; line < lines; line++) {
+		char *out = gen->content + size;
+		size_t left = gen->blob_size + 2 * ROGITFS_GENREPO_LINE_SIZE - size;
+		int len = 0;
+		if (line == changed && version > 0) {
+			len = snprintf(out, left, "%06zu rev %lu\n", line, version);
+		} else {
+			uint64_t h = rogitfs_genrepo_hash(gen->seed, file, line);
+			len = snprintf(out, left, "%06zu %s %s %s\n", line,
+				rogitfs_genrepo_words[h & 31], rogitfs_genrepo_words[(h >> 5) & 31], rogitfs_genrepo_words[(h >> 10) & 31]);
+		}
+		size += len;
+	}
+	return size;
+}
+
+static void rogitfs_genrepo_data(const char *data, size_t size) {
+
+	printf("data %zu\n", size);
+	fwrite(data, 1, size, stdout);
+	putchar('\n');
+}
+
+static void rogitfs_genrepo_modify(struct rogitfs_genrepo *gen, const char *path, uint64_t file, unsigned long version) {
+
+	printf("M 100644 inline %s\n", path);
+	rogitfs_genrepo_data(gen->content, rogitfs_genrepo_text(gen, file, version));
+}
+
+static void rogitfs_genrepo_large(struct rogitfs_genrepo *gen, unsigned int index) {
+
+	printf("M 100644 inline large%u.bin\n", index);
+	printf("data %lu\n", gen->large_size);
+	uint64_t block[512];
+	for (unsigned long offset = 0; offset < gen->large_size; offset += sizeof(block)) {
+		for (unsigned int i = 0; i < 512; i++) {
+			block[i] = rogitfs_genrepo_hash(gen->seed, ((uint64_t)index << 48) | offset, i);
+		}
+		size_t size = gen->large_size - offset < sizeof(block) ? gen->large_size - offset : sizeof(block);
+		fwrite(block, 1, size, stdout);
+	}
+	putchar('\n');
+}
+
+static void rogitfs_genrepo_commit(struct rogitfs_genrepo *gen, unsigned long commit) {
+
+	unsigned long long time = ROGITFS_GENREPO_TIME + commit * 3600;
+	printf("commit refs/heads/master\n");
+	printf("mark :%lu\n", commit + 1);
+	printf("author Generator <generator@example.com> %llu +0000\n", time);
+	printf("committer Generator <generator@example.com> %llu +0000\n", time);
+	char message[64];
+	int len = snprintf(message, sizeof(message), "Commit %lu\n", commit);
+	rogitfs_genrepo_data(message, len);
+	if (commit > 0) {
+		printf("from :%lu\n", commit);
+	}
+
+	// chain.txt gets a new version in every commit
+	rogitfs_genrepo_modify(gen, "chain.txt", gen->count, commit);
+
+	if (commit == 0) {
+		for (size_t i = 0; i < gen->count; i++) {
+			rogitfs_genrepo_modify(gen, gen->paths[i], i, 0);
+		}
+		for (unsigned int i = 0; i < gen->large_files; i++) {
+			rogitfs_genrepo_large(gen, i);
+		}
+	} else {
+		for (unsigned int c = 0; c < gen->changes && gen->count > 0; c++) {
+			size_t i = rogitfs_genrepo_hash(gen->seed, commit, c) % gen->count;
+			gen->versions[i]++;
+			rogitfs_genrepo_modify(gen, gen->paths[i], i, gen->versions[i]);
+		}
+	}
+	putchar('\n');
+}
+
+static void rogitfs_genrepo_refs(struct rogitfs_genrepo *gen, const char *prefix, unsigned long count, uint64_t kind) {
+
+	for (unsigned long i = 0; i < count; i++) {
+		unsigned long commit = rogitfs_genrepo_hash(gen->seed, kind, i) % gen->commits;
+		printf("reset refs/%s%08lu\nfrom :%lu\n\n", prefix, i, commit + 1);
+	}
+}
+
+static void show_help(const char *progname) {
+
+	printf("usage: %s [options] | git fast-import\n\n", progname);
+	printf("Options:\n"
+	       "    --commits=<n>       Commits on master (default 100)\n"
+	       "    --depth=<n>         Directory levels (default 3)\n"
+	       "    --width=<n>         Files per directory (default 16)\n"
+	       "    --fanout=<n>        Subdirectories per directory (default 4)\n"
+	       "    --blob-size=<n>     Bytes per text file (default 4096)\n"
+	       "    --changes=<n>       Files changed per commit (default 8)\n"
+	       "    --large-files=<n>   Files of random bytes (default 0)\n"
+	       "    --large-size=<n>    Bytes per large file (default 67108864)\n"
+	       "    --branches=<n>      Branches besides master (default 0)\n"
+	       "    --tags=<n>          Tags (default 0)\n"
+	       "    --seed=<n>          Seed of names and content (default 1)\n"
+	       "\n");
+}
+
+int main(int argc, char *argv[]) {
+
+	static const struct option long_options[] = {
+		{"commits", required_argument, NULL, 'c'},
+		{"depth", required_argument, NULL, 'd'},
+		{"width", required_argument, NULL, 'w'},
+		{"fanout", required_argument, NULL, 'f'},
+		{"blob-size", required_argument, NULL, 'b'},
+		{"changes", required_argument, NULL, 'n'},
+		{"large-files", required_argument, NULL, 'l'},
+		{"large-size", required_argument, NULL, 'L'},
+		{"branches", required_argument, NULL, 'B'},
+		{"tags", required_argument, NULL, 'T'},
+		{"seed", required_argument, NULL, 's'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	struct rogitfs_genrepo gen = {
+		.commits = 100,
+		.width = 16,
+		.fanout = 4,
+		.depth = 3,
+		.blob_size = 4096,
+		.changes = 8,
+		.large_size = 64 * 1024 * 1024,
+		.seed = 1
+	};
+
+	int opt = 0;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'c': gen.commits = strtoul(optarg, NULL, 10); break;
+		case 'd': gen.depth = (unsigned int)strtoul(optarg, NULL, 10); break;
+		case 'w': gen.width = (unsigned int)strtoul(optarg, NULL, 10); break;
+		case 'f': gen.fanout = (unsigned int)strtoul(optarg, NULL, 10); break;
+		case 'b': gen.blob_size = strtoul(optarg, NULL, 10); break;
+		case 'n': gen.changes = (unsigned int)strtoul(optarg, NULL, 10); break;
+		case 'l': gen.large_files = (unsigned int)strtoul(optarg, NULL, 10); break;
+		case 'L': gen.large_size = strtoul(optarg, NULL, 10); break;
+		case 'B': gen.branches = strtoul(optarg, NULL, 10); break;
+		case 'T': gen.tags = strtoul(optarg, NULL, 10); break;
+		case 's': gen.seed = strtoull(optarg, NULL, 10); break;
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		default:
+			show_help(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc || gen.commits == 0 || gen.depth == 0) {
+		show_help(argv[0]);
+		return 1;
+	}
+
+	if (rogitfs_genrepo_add_dir(&gen, "", 0) != 0) {
+		fputs("too many files\n", stderr);
+		return 1;
+	}
+	gen.versions = (unsigned long *) calloc(gen.count + 1, sizeof(unsigned long));
+	gen.content = (char *) malloc(gen.blob_size + 2 * ROGITFS_GENREPO_LINE_SIZE);
+	if (gen.versions == NULL || gen.content == NULL) {
+		fputs("malloc failed\n", stderr);
+		return 1;
+	}
+
+	static char output[1 << 20];
+	setvbuf(stdout, output, _IOFBF, sizeof(output));
+	for (unsigned long commit = 0; commit < gen.commits; commit++) {
+		rogitfs_genrepo_commit(&gen, commit);
+	}
+	rogitfs_genrepo_refs(&gen, "heads/b", gen.branches, 1);
+	rogitfs_genrepo_refs(&gen, "tags/v", gen.tags, 2);
+	printf("done\n");
+	fflush(stdout);
+
+	for (size_t i = 0; i < gen.count; i++) {
+		free(gen.paths[i]);
+	}
+	free(gen.paths);
+	free(gen.versions);
+	free(gen.content);
+	return ferror(stdout) ? 1 : 0;
+}
@@ -0,0 +1,553 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+// Replays a log written by rogitfs --record=<file>.
+//
+//   ./rogitfs-replay --mount=/mnt/repository --speed=1 record.log
+//   ./rogitfs-replay --repopath=/path/to/repository --speed=0 record.log
+//
+// Every thread of the recording gets its own replay thread issuing its
+// operations in the recorded order, either as system calls on a mount or
+// as direct calls of the operations of rogitfs.c, which is linked without
+// main. With --speed=1 operations start at their recorded time, larger
+// values replay faster and 0 starts every operation right after the last.
+// Latency percentiles of the replay and of the recording are written to
+// stdout per operation, results differing in success count as mismatches.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#define FUSE_USE_VERSION 31
+#include <fuse3/fuse.h>
+#include <git2.h>
+#include "rogitfs_common.h"
+#include "rogitfs_mount.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_record.h"
+
+// operations of rogitfs.c, see rogitfs.h
+int rogitfs_open(const char *path, struct fuse_file_info *fi);
+int rogitfs_release(const char *path, struct fuse_file_info *fi);
+int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+int rogitfs_readlink(const char *path, char *buf, size_t size);
+int rogitfs_getxattr(const char *path, const char *name, char *value, size_t size);
+int rogitfs_listxattr(const char *path, char *list, size_t size);
+int rogitfs_mount_open(const char *path, struct fuse_file_info *fi);
+int rogitfs_mount_release(const char *path, struct fuse_file_info *fi);
+int rogitfs_mount_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+int rogitfs_mount_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+int rogitfs_mount_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+int rogitfs_mount_readlink(const char *path, char *buf, size_t size);
+int rogitfs_mount_getxattr(const char *path, const char *name, char *value, size_t size);
+int rogitfs_mount_listxattr(const char *path, char *list, size_t size);
+
+struct rogitfs_replay_op {
+	struct rogitfs_record_entry entry;
+	char *path;
+	// attribute name of getxattr, NULL otherwise
+	const char *name;
+	unsigned int thread;
+	uint64_t replay_ns;
+	int result;
+};
+
+struct rogitfs_replay {
+	struct rogitfs_replay_op *ops;
+	size_t count;
+	// mounted directory, NULL replays in-process
+	const char *mount_path;
+	// in-process with several repositories
+	int multiple;
+	double speed;
+	size_t buffer_size;
+	struct timespec start;
+	pthread_barrier_t barrier;
+};
+
+struct rogitfs_replay_thread {
+	struct rogitfs_replay *replay;
+	pthread_t thread;
+	unsigned int index;
+	// file opened last, reads of the same path use it
+	char *open_path;
+	int fd;
+	struct fuse_file_info fi;
+};
+
+// The operations only take their private data from the fuse context
+static struct fuse_context rogitfs_replay_context = {};
+
+struct fuse_context *fuse_get_context(void) {
+
+	return &rogitfs_replay_context;
+}
+
+static uint64_t rogitfs_replay_ns(const struct timespec *start, const struct timespec *end) {
+
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ull + end->tv_nsec - start->tv_nsec;
+}
+
+static int rogitfs_replay_load(struct rogitfs_replay *replay, const char *path) {
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "fopen %s %s\n", path, strerror(errno));
+		return -1;
+	}
+	char magic[ROGITFS_RECORD_MAGIC_SIZE];
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, ROGITFS_RECORD_MAGIC, sizeof(magic)) != 0) {
+		fprintf(stderr, "%s is no rogitfs record\n", path);
+		fclose(file);
+		return -1;
+	}
+
+	size_t capacity = 0;
+	int res = 0;
+	struct rogitfs_record_entry entry = {};
+	while (fread(&entry, sizeof(entry), 1, file) == 1) {
+		if (replay->count == capacity) {
+			capacity = capacity == 0 ? 4096 : capacity * 2;
+			struct rogitfs_replay_op *ops = (struct rogitfs_replay_op *) realloc(replay->ops, capacity * sizeof(struct rogitfs_replay_op));
+			if (ops == NULL) {
+				res = -1;
+				break;
+			}
+			replay->ops = ops;
+		}
+		struct rogitfs_replay_op *op = &replay->ops[replay->count];
+		memset(op, 0, sizeof(struct rogitfs_replay_op));
+		op->entry = entry;
+		op->path = (char *) malloc(entry.path_size + 1);
+		if (op->path == NULL) {
+			res = -1;
+			break;
+		}
+		if (fread(op->path, 1, entry.path_size, file) != entry.path_size || entry.op >= ROGITFS_STATS_OP_COUNT) {
+			fprintf(stderr, "%s is truncated or damaged\n", path);
+			free(op->path);
+			res = -1;
+			break;
+		}
+		op->path[entry.path_size] = 0;
+		size_t path_size = strlen(op->path);
+		if (path_size < entry.path_size) {
+			op->name = op->path + path_size + 1;
+		}
+		if (entry.size > replay->buffer_size) {
+			replay->buffer_size = entry.size;
+		}
+		replay->count++;
+	}
+	fclose(file);
+	return res;
+}
+
+// Number the recorded threads in order of their first operation
+static unsigned int rogitfs_replay_threads(struct rogitfs_replay *replay) {
+
+	uint32_t *ids = NULL;
+	unsigned int count = 0;
+	for (size_t i = 0; i < replay->count; i++) {
+		unsigned int t = 0;
+		while (t < count && ids[t] != replay->ops[i].entry.thread) {
+			t++;
+		}
+		if (t == count) {
+			uint32_t *new_ids = (uint32_t *) realloc(ids, (count + 1) * sizeof(uint32_t));
+			if (new_ids == NULL) {
+				free(ids);
+				return 0;
+			}
+			ids = new_ids;
+			ids[count++] = replay->ops[i].entry.thread;
+		}
+		replay->ops[i].thread = t;
+	}
+	free(ids);
+	return count;
+}
+
+static int rogitfs_replay_fill(void *buf, const char *name, const struct stat *stbuf, off_t off, enum fuse_fill_dir_flags flags) {
+
+	(*(unsigned long *)buf)++;
+	return 0;
+}
+
+// Results of system calls as the operation would return them
+static int rogitfs_replay_errno(int res) {
+
+	return res < 0 ? -errno : res;
+}
+
+static int rogitfs_replay_mounted(struct rogitfs_replay_thread *thread, const struct rogitfs_replay_op *op, char *buf) {
+
+	char path[PATH_MAX];
+	int len = snprintf(path, sizeof(path), "%s%s", thread->replay->mount_path, op->path);
+	if (len < 0 || (size_t)len >= sizeof(path)) {
+		return -ENAMETOOLONG;
+	}
+
+	struct stat st = {};
+	switch ((enum rogitfs_stats_op)op->entry.op) {
+	case ROGITFS_STATS_GETATTR:
+		return rogitfs_replay_errno(lstat(path, &st));
+	case ROGITFS_STATS_READDIR: {
+		DIR *dir = opendir(path);
+		if (dir == NULL) {
+			return -errno;
+		}
+		while (readdir(dir) != NULL);
+		closedir(dir);
+		return 0;
+	}
+	case ROGITFS_STATS_OPEN:
+	case ROGITFS_STATS_READ:
+		if (thread->open_path == NULL || strcmp(thread->open_path, op->path) != 0 || op->entry.op == ROGITFS_STATS_OPEN) {
+			if (thread->open_path != NULL) {
+				close(thread->fd);
+				free(thread->open_path);
+				thread->open_path = NULL;
+			}
+			thread->fd = open(path, O_RDONLY);
+			if (thread->fd < 0) {
+				return -errno;
+			}
+			thread->open_path = strdup(op->path);
+		}
+		if (op->entry.op == ROGITFS_STATS_OPEN) {
+			return 0;
+		}
+		return rogitfs_replay_errno((int)pread(thread->fd, buf, op->entry.size, (off_t)op->entry.offset));
+	case ROGITFS_STATS_READLINK: {
+		ssize_t size = readlink(path, buf, op->entry.size);
+		return size < 0 ? -errno : 0;
+	}
+	case ROGITFS_STATS_GETXATTR:
+		return rogitfs_replay_errno((int)lgetxattr(path, op->name != NULL ? op->name : "", buf, op->entry.size));
+	case ROGITFS_STATS_LISTXATTR:
+		return rogitfs_replay_errno((int)llistxattr(path, buf, op->entry.size));
+	default:
+		return -ENOSYS;
+	}
+}
+
+static int rogitfs_replay_direct(struct rogitfs_replay_thread *thread, const struct rogitfs_replay_op *op, char *buf) {
+
+	int multiple = thread->replay->multiple;
+	struct stat st = {};
+	unsigned long entries = 0;
+	switch ((enum rogitfs_stats_op)op->entry.op) {
+	case ROGITFS_STATS_GETATTR:
+		return multiple ? rogitfs_mount_getattr(op->path, &st, NULL) : rogitfs_getattr(op->path, &st, NULL);
+	case ROGITFS_STATS_READDIR:
+		return multiple ? rogitfs_mount_readdir(op->path, &entries, &rogitfs_replay_fill, 0, NULL, 0) : rogitfs_readdir(op->path, &entries, &rogitfs_replay_fill, 0, NULL, 0);
+	case ROGITFS_STATS_OPEN:
+	case ROGITFS_STATS_READ:
+		// files generated when opened keep their content in fi until released
+		if (thread->open_path == NULL || strcmp(thread->open_path, op->path) != 0 || op->entry.op == ROGITFS_STATS_OPEN) {
+			if (thread->open_path != NULL) {
+				multiple ? rogitfs_mount_release(thread->open_path, &thread->fi) : rogitfs_release(thread->open_path, &thread->fi);
+				free(thread->open_path);
+				thread->open_path = NULL;
+			}
+			memset(&thread->fi, 0, sizeof(thread->fi));
+			int res = multiple ? rogitfs_mount_open(op->path, &thread->fi) : rogitfs_open(op->path, &thread->fi);
+			if (res != 0) {
+				return res;
+			}
+			thread->open_path = strdup(op->path);
+		}
+		if (op->entry.op == ROGITFS_STATS_OPEN) {
+			return 0;
+		}
+		return multiple ? rogitfs_mount_read(op->path, buf, op->entry.size, (off_t)op->entry.offset, &thread->fi) : rogitfs_read(op->path, buf, op->entry.size, (off_t)op->entry.offset, &thread->fi);
+	case ROGITFS_STATS_READLINK:
+		return multiple ? rogitfs_mount_readlink(op->path, buf, op->entry.size) : rogitfs_readlink(op->path, buf, op->entry.size);
+	case ROGITFS_STATS_GETXATTR: {
+		const char *name = op->name != NULL ? op->name : "";
+		char *value = op->entry.size > 0 ? buf : NULL;
+		return multiple ? rogitfs_mount_getxattr(op->path, name, value, op->entry.size) : rogitfs_getxattr(op->path, name, value, op->entry.size);
+	}
+	case ROGITFS_STATS_LISTXATTR: {
+		char *list = op->entry.size > 0 ? buf : NULL;
+		return multiple ? rogitfs_mount_listxattr(op->path, list, op->entry.size) : rogitfs_listxattr(op->path, list, op->entry.size);
+	}
+	default:
+		return -ENOSYS;
+	}
+}
+
+static void *rogitfs_replay_worker(void *data) {
+
+	struct rogitfs_replay_thread *thread = (struct rogitfs_replay_thread *)data;
+	struct rogitfs_replay *replay = thread->replay;
+	char *buf = (char *) malloc(replay->buffer_size);
+
+	pthread_barrier_wait(&replay->barrier);
+	for (size_t i = 0; i < replay->count && buf != NULL; i++) {
+		struct rogitfs_replay_op *op = &replay->ops[i];
+		if (op->thread != thread->index) {
+			continue;
+		}
+		if (replay->speed > 0) {
+			uint64_t target_ns = (uint64_t)(op->entry.start_ns / replay->speed);
+			struct timespec target = {
+				.tv_sec = replay->start.tv_sec + (time_t)(target_ns / 1000000000ull),
+				.tv_nsec = replay->start.tv_nsec + (long)(target_ns % 1000000000ull)
+			};
+			if (target.tv_nsec >= 1000000000l) {
+				target.tv_sec++;
+				target.tv_nsec -= 1000000000l;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) == EINTR);
+		}
+		struct timespec op_start = {};
+		struct timespec op_end = {};
+		clock_gettime(CLOCK_MONOTONIC, &op_start);
+		if (replay->mount_path != NULL) {
+			op->result = rogitfs_replay_mounted(thread, op, buf);
+		} else {
+			op->result = rogitfs_replay_direct(thread, op, buf);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &op_end);
+		op->replay_ns = rogitfs_replay_ns(&op_start, &op_end);
+	}
+
+	if (thread->open_path != NULL) {
+		if (replay->mount_path != NULL) {
+			close(thread->fd);
+		} else {
+			replay->multiple ? rogitfs_mount_release(thread->open_path, &thread->fi) : rogitfs_release(thread->open_path, &thread->fi);
+		}
+		free(thread->open_path);
+	}
+	free(buf);
+	return NULL;
+}
+
+static int rogitfs_replay_compare(const void *a, const void *b) {
+
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Nearest rank percentile of sorted values
+static unsigned long long rogitfs_replay_percentile(const uint64_t *values, size_t count, unsigned int percent) {
+
+	size_t rank = (count * percent + 99) / 100;
+	return (unsigned long long)values[rank > 0 ? rank - 1 : 0];
+}
+
+static int rogitfs_replay_report(struct rogitfs_replay *replay, unsigned int thread_count, const struct timespec *end) {
+
+	uint64_t *replayed = (uint64_t *) malloc(replay->count * sizeof(uint64_t));
+	uint64_t *recorded = (uint64_t *) malloc(replay->count * sizeof(uint64_t));
+	if (replayed == NULL || recorded == NULL) {
+		free(replayed);
+		free(recorded);
+		return -1;
+	}
+
+	const struct rogitfs_replay_op *last = &replay->ops[replay->count - 1];
+	printf("ops %zu\n", replay->count);
+	printf("threads %u\n", thread_count);
+	printf("seconds %.3f\n", rogitfs_replay_ns(&replay->start, end) / 1e9);
+	printf("recorded_seconds %.3f\n", (last->entry.start_ns + last->entry.duration_ns) / 1e9);
+
+	for (unsigned int o = 0; o < ROGITFS_STATS_OP_COUNT; o++) {
+		size_t count = 0;
+		unsigned long errors = 0;
+		unsigned long mismatches = 0;
+		for (size_t i = 0; i < replay->count; i++) {
+			const struct rogitfs_replay_op *op = &replay->ops[i];
+			if (op->entry.op != o) {
+				continue;
+			}
+			replayed[count] = op->replay_ns;
+			recorded[count] = op->entry.duration_ns;
+			count++;
+			if (op->result < 0) {
+				errors++;
+			}
+			if ((op->result < 0) != (op->entry.result < 0)) {
+				mismatches++;
+			}
+		}
+		if (count == 0) {
+			continue;
+		}
+		qsort(replayed, count, sizeof(uint64_t), &rogitfs_replay_compare);
+		qsort(recorded, count, sizeof(uint64_t), &rogitfs_replay_compare);
+		printf("op %s count %zu errors %lu mismatches %lu p50 %llu p99 %llu max %llu recorded_p50 %llu recorded_p99 %llu recorded_max %llu\n",
+			rogitfs_stats_op_name((enum rogitfs_stats_op)o), count, errors, mismatches,
+			rogitfs_replay_percentile(replayed, count, 50), rogitfs_replay_percentile(replayed, count, 99), (unsigned long long)replayed[count - 1],
+			rogitfs_replay_percentile(recorded, count, 50), rogitfs_replay_percentile(recorded, count, 99), (unsigned long long)recorded[count - 1]);
+	}
+	free(replayed);
+	free(recorded);
+	return 0;
+}
+
+static void show_help(const char *progname) {
+
+	printf("usage: %s [options] <record>\n\n", progname);
+	printf("Options:\n"
+	       "    --mount=<s>         Replay on a mounted rogitfs\n"
+	       "    --repopath=<s>      Replay in-process on the repository\n"
+	       "    --config=<s>        Replay in-process on the repositories of a mount\n"
+	       "                        configuration\n"
+	       "    --cache-size=<n>    Size of all caches in MiB, in-process only\n"
+	       "    --speed=<x>         Speed relative to the recording, 0 replays without\n"
+	       "                        waiting (default 1)\n"
+	       "\n");
+}
+
+int main(int argc, char *argv[]) {
+
+	static const struct option long_options[] = {
+		{"mount", required_argument, NULL, 'm'},
+		{"repopath", required_argument, NULL, 'r'},
+		{"config", required_argument, NULL, 'c'},
+		{"cache-size", required_argument, NULL, 'C'},
+		{"speed", required_argument, NULL, 's'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	const char *repopath = NULL;
+	const char *config = NULL;
+	size_t budget = 0;
+	struct rogitfs_replay replay = {
+		.speed = 1.0,
+		.buffer_size = 65536
+	};
+
+	int opt = 0;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'm':
+			replay.mount_path = optarg;
+			break;
+		case 'r':
+			repopath = optarg;
+			break;
+		case 'c':
+			config = optarg;
+			break;
+		case 'C':
+			budget = (size_t)strtoul(optarg, NULL, 10) * 1024 * 1024;
+			break;
+		case 's':
+			replay.speed = strtod(optarg, NULL);
+			break;
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		default:
+			show_help(argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 1 != argc || (replay.mount_path != NULL) + (repopath != NULL) + (config != NULL) != 1 || replay.speed < 0) {
+		show_help(argv[0]);
+		return 1;
+	}
+
+	if (rogitfs_replay_load(&replay, argv[optind]) != 0) {
+		return 1;
+	}
+	if (replay.count == 0) {
+		fprintf(stderr, "%s has no operations\n", argv[optind]);
+		return 1;
+	}
+	unsigned int thread_count = rogitfs_replay_threads(&replay);
+	if (thread_count == 0) {
+		return 1;
+	}
+	if (replay.buffer_size < PATH_MAX) {
+		replay.buffer_size = PATH_MAX;
+	}
+
+	struct rogitfs_private private = {};
+	struct rogitfs_mount *mount = NULL;
+	if (replay.mount_path == NULL) {
+		git_libgit2_init();
+		private.ref_ttl = ROGITFS_REFTREE_DEFAULT_TTL;
+		if (config != NULL) {
+			mount = rogitfs_mount_load(config, budget, &private);
+			if (mount == NULL) {
+				return 1;
+			}
+			rogitfs_replay_context.private_data = mount;
+			replay.multiple = 1;
+		} else {
+			if (rogitfs_private_open(&private, repopath) != 0) {
+				fprintf(stderr, "repository %s could not be opened\n", repopath);
+				return 1;
+			}
+			if (rogitfs_caches_new(&private, budget) != 0) {
+				return 1;
+			}
+			rogitfs_replay_context.private_data = &private;
+		}
+	}
+
+	struct rogitfs_replay_thread *threads = (struct rogitfs_replay_thread *) calloc(thread_count, sizeof(struct rogitfs_replay_thread));
+	if (threads == NULL) {
+		fputs("calloc failed\n", stderr);
+		return 1;
+	}
+	pthread_barrier_init(&replay.barrier, NULL, thread_count + 1);
+	for (unsigned int t = 0; t < thread_count; t++) {
+		threads[t].replay = &replay;
+		threads[t].index = t;
+		int error = pthread_create(&threads[t].thread, NULL, &rogitfs_replay_worker, &threads[t]);
+		if (error != 0) {
+			fprintf(stderr, "pthread_create %d %s\n", error, strerror(error));
+			// the barrier waits for every thread, the replay cannot start
+			exit(1);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &replay.start);
+	pthread_barrier_wait(&replay.barrier);
+	for (unsigned int t = 0; t < thread_count; t++) {
+		pthread_join(threads[t].thread, NULL);
+	}
+	struct timespec end = {};
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_barrier_destroy(&replay.barrier);
+
+	int res = rogitfs_replay_report(&replay, thread_count, &end);
+
+	free(threads);
+	for (size_t i = 0; i < replay.count; i++) {
+		free(replay.ops[i].path);
+	}
+	free(replay.ops);
+	if (mount != NULL) {
+		rogitfs_mount_free(mount);
+	} else if (replay.mount_path == NULL) {
+		rogitfs_private_close(&private);
+		rogitfs_caches_free(&private);
+	}
+	if (replay.mount_path == NULL) {
+		git_libgit2_shutdown();
+	}
+	return res == 0 ? 0 : 1;
+}
@@ -16,11 +16,55 @@
 #include "rogitfs_refs.h"
 #include "rogitfs_inherit.h"
 #include "rogitfs_head.h"
+#include "rogitfs_manifest.h"
+#include "rogitfs_changes.h"
+#include "rogitfs_diff.h"
+#include "rogitfs_log.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_ancestors.h"
+#include "rogitfs_bydate.h"
+#include "rogitfs_history.h"
+#include "rogitfs_trigram.h"
+#include "rogitfs_search.h"
+#include "rogitfs_submodule.h"
+#include "rogitfs_mount.h"
+#include "rogitfs_shm.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_treeobj.h"
+#include "rogitfs_control.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_trace.h"
+#include "rogitfs_logging.h"
+#include "rogitfs_record.h"
+#include "rogitfs_startup.h"
+#include "rogitfs_memory.h"
+
+// rogitfs-replay links the operations without main and option parsing
+#ifndef ROGITFS_NO_MAIN
 
 #define OPTION(t, p)                           \
     { t, offsetof(struct options, p), 1 }
+#define KEY_INCLUDE 1
+#define KEY_EXCLUDE 2
 static const struct fuse_opt option_spec[] = {
     OPTION("--repopath=%s", repopath),
+    OPTION("--trigram-index=%s", trigram_index),
+    OPTION("--config=%s", config),
+    OPTION("--cache-size=%u", cache_size),
+    OPTION("--shared-cache=%s", shared_cache),
+    OPTION("--shared-cache-size=%u", shared_cache_size),
+    OPTION("--delta-cache-size=%u", delta_cache_size),
+    OPTION("--memory-limit=%u", memory_limit),
+    OPTION("--ref-ttl=%u", ref_ttl),
+    OPTION("--trace=%u", trace),
+    OPTION("--trace-file=%s", trace_file),
+    OPTION("--log-level=%s", log_level),
+    OPTION("--negative-timeout=%u", negative_timeout),
+    OPTION("--record=%s", record),
+    OPTION("--startup-threads=%u", startup_threads),
+    FUSE_OPT_KEY("--include=", KEY_INCLUDE),
+    FUSE_OPT_KEY("--exclude=", KEY_EXCLUDE),
     OPTION("-h", show_help),
     OPTION("--help", show_help),
     FUSE_OPT_END
@@ -28,7 +72,81 @@ static const struct fuse_opt option_spec[] = {
 
 static struct rogitfs_private rogitfs_private = {};
 
-int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+static struct rogitfs_filter rogitfs_filter = {};
+
+// Collect the repeatable --include and --exclude options
+static int rogitfs_opt_proc(void *data, const char *arg, int key, struct fuse_args *outargs) {
+
+	switch(key) {
+	case KEY_INCLUDE:
+	case KEY_EXCLUDE:
+		if (rogitfs_filter_add(&rogitfs_filter, index(arg, '=') + 1, key == KEY_EXCLUDE) != 0) {
+			fprintf(stderr, "invalid pattern %s\n", arg);
+			return -1;
+		}
+		return 0;
+	break;
+	}
+	return 1;
+}
+
+#endif
+
+static int rogitfs_open_path(const char *path, struct fuse_file_info *fi) {
+
+	if (strncmp(path, "/.rogitfs/", 10) == 0) {
+
+		return rogitfs_control_open(path+10, fi);
+
+	} else if (strncmp(path, "/manifest/", 10) == 0) {
+
+		return rogitfs_manifest_open(path+10, fi);
+
+	} else if (strncmp(path, "/diff/", 6) == 0) {
+
+		return rogitfs_diff_open(path+6, fi);
+
+	} else if (strncmp(path, "/log/", 5) == 0) {
+
+		return rogitfs_log_open(path+5, fi);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_open(path+6, fi);
+
+	}
+
+	return 0;
+}
+
+static int rogitfs_release_path(const char *path, struct fuse_file_info *fi) {
+
+	if (strncmp(path, "/.rogitfs/", 10) == 0) {
+
+		return rogitfs_control_release(path+10, fi);
+
+	} else if (strncmp(path, "/manifest/", 10) == 0) {
+
+		return rogitfs_manifest_release(path+10, fi);
+
+	} else if (strncmp(path, "/diff/", 6) == 0) {
+
+		return rogitfs_diff_release(path+6, fi);
+
+	} else if (strncmp(path, "/log/", 5) == 0) {
+
+		return rogitfs_log_release(path+5, fi);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_release(path+6, fi);
+
+	}
+
+	return 0;
+}
+
+static int rogitfs_read_path(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
 
 
 	if (strncmp(path, "/obj/", 5) == 0) {
@@ -36,7 +154,7 @@ int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct
 		long len = strlen(path);
 		if (len != GIT_OID_HEXSZ + 5)
 		{
-			fputs("wrong format\n", stderr);
+			rogitfs_log(ROGITFS_LOGGING_DEBUG, "wrong format %s", path);
 			return -1;
 		}
 
@@ -46,6 +164,38 @@ int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct
 
 		return rogitfs_commit_read((const char *)path+8, buf, size, offset, fi);
 
+	} else if (strncmp(path, "/manifest/", 10) == 0) {
+
+		return rogitfs_manifest_read(path+10, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/changes/", 9) == 0) {
+
+		return rogitfs_changes_read(path+9, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/diff/", 6) == 0) {
+
+		return rogitfs_diff_read(path+6, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/log/", 5) == 0) {
+
+		return rogitfs_log_read(path+5, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/search/", 8) == 0) {
+
+		return rogitfs_search_read(path+8, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_read(path+6, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/.rogitfs/", 10) == 0) {
+
+		return rogitfs_control_read(path+10, buf, size, offset, fi);
+
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_read(path+10, buf, size, offset, fi);
+
 	} else {
 
 		return -1;
@@ -54,7 +204,7 @@ int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct
 	return -1;
 }
 
-int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+static int rogitfs_getattr_path(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
 
 	int res = 0;
 	memset(stbuf, 0, sizeof(struct stat));
@@ -113,6 +263,114 @@ int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info
 	} else if (strncmp(path, "/commit/", 8) == 0) {
 
 		return rogitfs_commit_getattr((const char *)path+8, stbuf, fi);
+	} else if (strcmp(path, "/manifest") == 0) {
+		struct stat manifest_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = manifest_stat;
+	} else if (strncmp(path, "/manifest/", 10) == 0) {
+
+		return rogitfs_manifest_getattr(path+10, stbuf, fi);
+
+	} else if (strcmp(path, "/changes") == 0) {
+		struct stat changes_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = changes_stat;
+	} else if (strncmp(path, "/changes/", 9) == 0) {
+
+		return rogitfs_changes_getattr(path+9, stbuf, fi);
+
+	} else if (strcmp(path, "/diff") == 0 || strcmp(path, "/log") == 0) {
+		struct stat stream_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = stream_stat;
+	} else if (strncmp(path, "/diff/", 6) == 0) {
+
+		return rogitfs_diff_getattr(path+6, stbuf, fi);
+
+	} else if (strncmp(path, "/log/", 5) == 0) {
+
+		return rogitfs_log_getattr(path+5, stbuf, fi);
+
+	} else if (strcmp(path, "/ancestors") == 0 || strcmp(path, "/mergebase") == 0) {
+		struct stat graph_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = graph_stat;
+	} else if (strncmp(path, "/ancestors/", 11) == 0) {
+
+		return rogitfs_ancestors_getattr(path+11, stbuf, fi);
+
+	} else if (strncmp(path, "/mergebase/", 11) == 0) {
+
+		return rogitfs_mergebase_getattr(path+11, stbuf, fi);
+
+	} else if (strcmp(path, "/by-date") == 0) {
+		struct stat bydate_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = bydate_stat;
+	} else if (strncmp(path, "/by-date/", 9) == 0) {
+
+		return rogitfs_bydate_getattr(path+9, stbuf, fi);
+
+	} else if (strcmp(path, "/history") == 0) {
+		struct stat history_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = history_stat;
+	} else if (strncmp(path, "/history/", 9) == 0) {
+
+		return rogitfs_history_getattr(path+9, stbuf, fi);
+
+	} else if (strcmp(path, "/search") == 0) {
+		struct stat search_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = search_stat;
+	} else if (strncmp(path, "/search/", 8) == 0) {
+
+		return rogitfs_search_getattr(path+8, stbuf, fi);
+
+	} else if (strcmp(path, "/tree") == 0) {
+		struct stat tree_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = tree_stat;
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_getattr(path+6, stbuf, fi);
+
+	} else if (strcmp(path, "/tree-obj") == 0) {
+		struct stat tree_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = tree_stat;
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_getattr(path+10, stbuf, fi);
+
+	} else if (strcmp(path, "/.rogitfs") == 0) {
+		struct stat control_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = control_stat;
+	} else if (strncmp(path, "/.rogitfs/", 10) == 0) {
+
+		return rogitfs_control_getattr(path+10, stbuf, fi);
+
 	} else {
 		res = -ENOENT;
 	}
@@ -120,7 +378,7 @@ int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info
 	return res;
 }
 
-int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+static int rogitfs_readdir_path(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
 
 	if (strcmp(path, "/") == 0) {
 
@@ -162,6 +420,65 @@ int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
 		if (res != 0) {
 			return -ENOENT;
 		}
+		struct stat manifest_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "manifest", &manifest_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat changes_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "changes", &changes_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat diff_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "diff", &diff_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat log_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "log", &log_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat ancestors_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "ancestors", &ancestors_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat mergebase_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "mergebase", &mergebase_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat bydate_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "by-date", &bydate_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat history_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "history", &history_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat search_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "search", &search_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat tree_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, "tree", &tree_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		res = filler(buf, "tree-obj", &tree_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+		struct stat control_stat = {.st_mode = S_IFDIR | 0755};
+		res = filler(buf, ".rogitfs", &control_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
 
 	} else if (strcmp(path, "/obj") == 0) {
 
@@ -179,6 +496,59 @@ int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
 
 		return rogitfs_inherit_readdir(path+8, buf, filler, offset, fi, flags);
 
+	} else if (strncmp(path, "/manifest", 9) == 0) {
+
+		return rogitfs_manifest_readdir(path+9, buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/changes", 8) == 0) {
+
+		return rogitfs_changes_readdir(path+8, buf, filler, offset, fi, flags);
+
+	} else if (strcmp(path, "/diff") == 0 || strcmp(path, "/log") == 0) {
+
+		// entries are only reachable by name
+		return 0;
+
+	} else if (strncmp(path, "/ancestors", 10) == 0) {
+
+		return rogitfs_ancestors_readdir(path+10, buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/mergebase", 10) == 0) {
+
+		return rogitfs_mergebase_readdir(path+10, buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/by-date", 8) == 0) {
+
+		return rogitfs_bydate_readdir(path+8, buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/history", 8) == 0) {
+
+		return rogitfs_history_readdir(path+8, buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/search", 7) == 0) {
+
+		return rogitfs_search_readdir(path+7, buf, filler, offset, fi, flags);
+
+	} else if (strcmp(path, "/tree") == 0) {
+
+		return rogitfs_reftree_readdir("", buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_readdir(path+6, buf, filler, offset, fi, flags);
+
+	} else if (strcmp(path, "/tree-obj") == 0) {
+
+		return rogitfs_treeobj_readdir("", buf, filler, offset, fi, flags);
+
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_readdir(path+10, buf, filler, offset, fi, flags);
+
+	} else if (strcmp(path, "/.rogitfs") == 0) {
+
+		return rogitfs_control_readdir("", buf, filler, offset, fi, flags);
+
 	} else {
 		return -ENOENT;
 	}
@@ -186,7 +556,7 @@ int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
 	return 0;
 }
 
-int rogitfs_readlink(const char *path, char *buf, size_t size) {
+static int rogitfs_readlink_path(const char *path, char *buf, size_t size) {
 
 	if (strncmp(path, "/commit/", 8) == 0)
 	{
@@ -200,6 +570,34 @@ int rogitfs_readlink(const char *path, char *buf, size_t size) {
 
 		return rogitfs_inherit_readlink(path+9, buf, size);
 
+	} else if (strncmp(path, "/changes/", 9) == 0) {
+
+		return rogitfs_changes_readlink(path+9, buf, size);
+
+	} else if (strncmp(path, "/ancestors/", 11) == 0) {
+
+		return rogitfs_ancestors_readlink(path+11, buf, size);
+
+	} else if (strncmp(path, "/mergebase/", 11) == 0) {
+
+		return rogitfs_mergebase_readlink(path+11, buf, size);
+
+	} else if (strncmp(path, "/by-date/", 9) == 0) {
+
+		return rogitfs_bydate_readlink(path+9, buf, size);
+
+	} else if (strncmp(path, "/history/", 9) == 0) {
+
+		return rogitfs_history_readlink(path+9, buf, size);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_readlink(path+6, buf, size);
+
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_readlink(path+10, buf, size);
+
 	} else if (strcmp(path, "/HEAD") == 0) {
 
 		return rogitfs_head_readlink(path+5, buf, size);
@@ -211,31 +609,434 @@ int rogitfs_readlink(const char *path, char *buf, size_t size) {
 	return -1;
 }
 
+static int rogitfs_getxattr_path(const char *path, const char *name, char *value, size_t size) {
+
+	if (strncmp(path, "/commit/", 8) == 0) {
+
+		return rogitfs_commit_getxattr(path+8, name, value, size);
+
+	} else if (strncmp(path, "/obj/", 5) == 0) {
+
+		return rogitfs_obj_getxattr(path+5, name, value, size);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_getxattr(path+6, name, value, size);
+
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_getxattr(path+10, name, value, size);
+
+	}
+
+	return -ENODATA;
+}
+
+static int rogitfs_listxattr_path(const char *path, char *list, size_t size) {
+
+	if (strncmp(path, "/commit/", 8) == 0) {
+
+		return rogitfs_commit_listxattr(path+8, list, size);
+
+	} else if (strncmp(path, "/obj/", 5) == 0) {
+
+		return rogitfs_obj_listxattr(path+5, list, size);
+
+	} else if (strncmp(path, "/tree/", 6) == 0) {
+
+		return rogitfs_reftree_listxattr(path+6, list, size);
+
+	} else if (strncmp(path, "/tree-obj/", 10) == 0) {
+
+		return rogitfs_treeobj_listxattr(path+10, list, size);
+
+	}
+
+	return 0;
+}
+
+// Operations of a single repository, timed for /.rogitfs/stats and /.rogitfs/trace
+// and written to the --record log
+
+int rogitfs_open(const char *path, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_open_path(path, fi);
+	rogitfs_stats_finish(ROGITFS_STATS_OPEN, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_OPEN, path, NULL, 0, 0, &start, res);
+	rogitfs_trace_span("open", path, &start);
+	return res;
+}
+
+int rogitfs_release(const char *path, struct fuse_file_info *fi) {
+
+	return rogitfs_release_path(path, fi);
+}
+
+int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_read_path(path, buf, size, offset, fi);
+	rogitfs_stats_finish(ROGITFS_STATS_READ, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_READ, path, NULL, offset, size, &start, res);
+	rogitfs_trace_span("read", path, &start);
+	if (res > 0) {
+		rogitfs_stats_count(ROGITFS_STATS_BYTES_SERVED, res);
+	}
+	return res;
+}
+
+int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_getattr_path(path, stbuf, fi);
+	rogitfs_stats_finish(ROGITFS_STATS_GETATTR, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_GETATTR, path, NULL, 0, 0, &start, res);
+	rogitfs_trace_span("getattr", path, &start);
+	return res;
+}
+
+int rogitfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_readdir_path(path, buf, filler, offset, fi, flags);
+	rogitfs_stats_finish(ROGITFS_STATS_READDIR, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_READDIR, path, NULL, offset, 0, &start, res);
+	rogitfs_trace_span("readdir", path, &start);
+	return res;
+}
+
+int rogitfs_readlink(const char *path, char *buf, size_t size) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_readlink_path(path, buf, size);
+	rogitfs_stats_finish(ROGITFS_STATS_READLINK, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_READLINK, path, NULL, 0, size, &start, res);
+	rogitfs_trace_span("readlink", path, &start);
+	return res;
+}
+
+int rogitfs_getxattr(const char *path, const char *name, char *value, size_t size) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_getxattr_path(path, name, value, size);
+	rogitfs_stats_finish(ROGITFS_STATS_GETXATTR, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_GETXATTR, path, name, 0, size, &start, res);
+	rogitfs_trace_span("getxattr", path, &start);
+	return res;
+}
+
+int rogitfs_listxattr(const char *path, char *list, size_t size) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	int res = rogitfs_listxattr_path(path, list, size);
+	rogitfs_stats_finish(ROGITFS_STATS_LISTXATTR, path, &start, res);
+	rogitfs_record(ROGITFS_STATS_LISTXATTR, path, NULL, 0, size, &start, res);
+	rogitfs_trace_span("listxattr", path, &start);
+	return res;
+}
+
+// Setup shared by mounts of one and of several repositories
+static void rogitfs_init_connection(struct fuse_config *cfg) {
+
+	// threads started before fuse daemonized are gone
+	rogitfs_logging_start();
+	rogitfs_trace_start_dumper();
+	rogitfs_memory_start_monitor();
+
+	// lets the kernel answer repeated lookups of missing names itself
+	if (options.negative_timeout > 0) {
+		cfg->negative_timeout = options.negative_timeout;
+	}
+}
+
+void *rogitfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+
+	rogitfs_init_connection(cfg);
+	struct rogitfs_private *private = (struct rogitfs_private *)fuse_get_context()->private_data;
+	rogitfs_startup_start(private, 1, options.startup_threads);
+	return private;
+}
+
 void rogitfs_destroy(void *private_data) {
 
 	struct rogitfs_private *private = (struct rogitfs_private *)private_data;
 
-	if (private->odb != NULL) {
-		git_odb_free(private->odb);
-		private->odb = NULL;
+	rogitfs_startup_stop();
+	rogitfs_memory_stop_monitor();
+	rogitfs_caches_free(private);
+	if (private->shm != NULL) {
+		rogitfs_shm_detach(private->shm);
+		private->shm = NULL;
 	}
+	rogitfs_private_close(private);
+
+	git_libgit2_shutdown();
+
+	rogitfs_record_close();
+	rogitfs_logging_stop();
 
-	if (private->repo != NULL) {
-		git_repository_free(private->repo);
-		private->repo = NULL;
+}
+
+// Operations of a mount with several repositories, the first path component
+// selects the repository and the rest is handled like a single repository mount
+
+// Record an operation the mount answers without a repository
+static int rogitfs_mount_record(enum rogitfs_stats_op op, const char *path, const char *name, uint64_t offset, uint32_t size, const struct timespec *start, int res) {
+
+	rogitfs_record(op, path, name, offset, size, start, res);
+	return res;
+}
+
+int rogitfs_mount_open(const char *path, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_OPEN, path, NULL, 0, 0, &start, -ENOENT);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_open(repo_path, fi);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_release(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return 0;
+	}
+	rogitfs_private_set(private);
+	int res = rogitfs_release(repo_path, fi);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_READ, path, NULL, offset, size, &start, -ENOENT);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_read(repo_path, buf, size, offset, fi);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	if (strcmp(path, "/") == 0) {
+		struct stat root_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = root_stat;
+		return rogitfs_mount_record(ROGITFS_STATS_GETATTR, path, NULL, 0, 0, &start, 0);
+	}
+
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_GETATTR, path, NULL, 0, 0, &start, -ENOENT);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_getattr(repo_path, stbuf, fi);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+// Names of the repositories and of the control directory
+static int rogitfs_mount_readdir_root(struct rogitfs_mount *mount, void *buf, fuse_fill_dir_t filler) {
+
+	int res = filler(buf, ".", NULL, 0, 0);
+	if (res != 0) {
+		return -ENOENT;
+	}
+	res = filler(buf, "..", NULL, 0, 0);
+	if (res != 0) {
+		return -ENOENT;
+	}
+	struct stat repo_stat = {
+		.st_mode = S_IFDIR | 0755,
+		.st_size = 1337
+	};
+	for (unsigned int i = 0; i < mount->count; i++) {
+		res = filler(buf, mount->names[i], &repo_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+	}
+	res = filler(buf, ".rogitfs", &repo_stat, 0, 0);
+	if (res != 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+int rogitfs_mount_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+
+	if (strcmp(path, "/") == 0) {
+		return rogitfs_mount_record(ROGITFS_STATS_READDIR, path, NULL, offset, 0, &start, rogitfs_mount_readdir_root(mount, buf, filler));
+	}
+
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_READDIR, path, NULL, offset, 0, &start, -ENOENT);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_readdir(repo_path, buf, filler, offset, fi, flags);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_readlink(const char *path, char *buf, size_t size) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_READLINK, path, NULL, 0, size, &start, -ENOENT);
 	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_readlink(repo_path, buf, size);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_getxattr(const char *path, const char *name, char *value, size_t size) {
 
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_GETXATTR, path, name, 0, size, &start, -ENODATA);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_getxattr(repo_path, name, value, size);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+int rogitfs_mount_listxattr(const char *path, char *list, size_t size) {
+
+	struct timespec start = {};
+	rogitfs_stats_start(&start);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	const char *repo_path = NULL;
+	struct rogitfs_private *private = rogitfs_mount_lookup(mount, path, &repo_path);
+	if (private == NULL) {
+		return rogitfs_mount_record(ROGITFS_STATS_LISTXATTR, path, NULL, 0, size, &start, 0);
+	}
+	rogitfs_private_set(private);
+	rogitfs_record_set_path(path);
+	int res = rogitfs_listxattr(repo_path, list, size);
+	rogitfs_record_set_path(NULL);
+	rogitfs_private_set(NULL);
+	return res;
+}
+
+void *rogitfs_mount_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+
+	rogitfs_init_connection(cfg);
+	struct rogitfs_mount *mount = (struct rogitfs_mount *)fuse_get_context()->private_data;
+	rogitfs_startup_start(mount->repos, mount->count, options.startup_threads);
+	return mount;
+}
+
+void rogitfs_mount_destroy(void *private_data) {
+
+	rogitfs_startup_stop();
+	rogitfs_memory_stop_monitor();
+	rogitfs_mount_free((struct rogitfs_mount *)private_data);
 
 	git_libgit2_shutdown();
 
+	rogitfs_record_close();
+	rogitfs_logging_stop();
 }
 
+#ifndef ROGITFS_NO_MAIN
+
 static void show_help(const char *progname)
 {   
     printf("usage: %s [options] <mountpoint>\n\n", progname);
     printf("File-system specific options:\n"
 		   "    --repopath=<s>      Path to repository\n"
 		   "                        (default: working dir)\n"
+		   "    --trigram-index=<s> File for the trigram index used by /search\n"
+		   "                        (default: search without index)\n"
+		   "    --config=<s>        File listing repositories as <name> <path> lines,\n"
+		   "                        mounted below /<name> instead of --repopath\n"
+		   "    --cache-size=<n>    Memory for caches in MiB, shared by all repositories\n"
+		   "                        (default: 112 plus the libgit2 object cache)\n"
+		   "    --shared-cache=<s>  Name of a blob cache in shared memory used by all\n"
+		   "                        rogitfs processes with the same name, a path\n"
+		   "                        starting with / is used as file (default: off)\n"
+		   "    --shared-cache-size=<n> Size of a new shared cache in MiB\n"
+		   "                        (default: 256)\n"
+		   "    --delta-cache-size=<n> Memory in MiB for objects of packs stored as\n"
+		   "                        deltas, shared by all repositories (default: 64)\n"
+		   "    --memory-limit=<n>  Memory in MiB for all caches together, evicting\n"
+		   "                        across them (default: off, each cache its size)\n"
+		   "    --include=<s>       Show only paths matching the pattern below commit\n"
+		   "                        trees and the directories leading to them, repeatable\n"
+		   "    --exclude=<s>       Hide paths matching the pattern, repeatable\n"
+		   "    --ref-ttl=<n>       Seconds references below /tree are reused\n"
+		   "                        (default: 1)\n"
+		   "    --trace=<n>         Keep the last n spans per thread for /.rogitfs/trace\n"
+		   "                        (default: 0, tracing off)\n"
+		   "    --trace-file=<s>    File the trace is written to on SIGUSR1\n"
+		   "                        (default: /tmp/rogitfs-trace-<pid>.json)\n"
+		   "    --log-level=<s>     Least severity of messages written to stderr:\n"
+		   "                        debug, info, warning or error (default: info)\n"
+		   "    --negative-timeout=<n> Seconds the kernel remembers missing names,\n"
+		   "                        also for new references and objects (default: 0)\n"
+		   "    --record=<s>        File every operation is logged to for rogitfs-replay\n"
+		   "                        (default: off)\n"
+		   "    --startup-threads=<n> Threads loading packs and commit graphs after\n"
+		   "                        mounting (default: one per processor)\n"
            "\n");
 }
 
@@ -246,8 +1047,9 @@ int main(int argc, char *argv[]) {
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	options.repopath = strdup(".");
+	options.ref_ttl = ROGITFS_REFTREE_DEFAULT_TTL;
 	
-	if (fuse_opt_parse(&args, &options, option_spec, NULL) == -1)
+	if (fuse_opt_parse(&args, &options, option_spec, &rogitfs_opt_proc) == -1)
 		return 1;
 	char *rpath = realpath(options.repopath, NULL);
 	if (rpath == NULL) {
@@ -264,20 +1066,66 @@ int main(int argc, char *argv[]) {
 		args.argv[0][0] = '\0';
 	}
 
+	if (options.log_level != NULL && rogitfs_logging_parse_level(options.log_level, &rogitfs_logging_level) != 0) {
+		fprintf(stderr, "invalid log level %s\n", options.log_level);
+		exit(1);
+	}
+
 	git_libgit2_init();
 
-	int error = git_repository_open(&rogitfs_private.repo, repopath);
+	if (rogitfs_trace_setup(options.trace, options.trace_file) != 0) {
+		exit(1);
+	}
+	if (options.record != NULL && rogitfs_record_open(options.record) != 0) {
+		exit(1);
+	}
+
+	size_t budget = (size_t)options.cache_size * 1024 * 1024;
+	rogitfs_memory_set_limit((size_t)options.memory_limit * 1024 * 1024);
+
+	// settings for every repository
+	if (options.shared_cache != NULL) {
+		size_t shm_size = ROGITFS_SHM_DEFAULT_SIZE;
+		if (options.shared_cache_size > 0) {
+			shm_size = (size_t)options.shared_cache_size * 1024 * 1024;
+		}
+		rogitfs_private.shm = rogitfs_shm_attach(options.shared_cache, shm_size);
+		if (rogitfs_private.shm == NULL) {
+			exit(1);
+		}
+	}
+	rogitfs_private.filter = &rogitfs_filter;
+	rogitfs_private.ref_ttl = options.ref_ttl;
+	rogitfs_private.delta_cache_size = (size_t)options.delta_cache_size * 1024 * 1024;
+
+	if (options.config != NULL) {
+		if (options.trigram_index != NULL) {
+			fputs("--trigram-index is not supported with --config\n", stderr);
+			exit(1);
+		}
+		struct rogitfs_mount *mount = rogitfs_mount_load(options.config, budget, &rogitfs_private);
+		if (mount == NULL) {
+			exit(1);
+		}
+		ret = fuse_main(args.argc, args.argv, &rogitfs_mount_operations, mount);
+		fuse_opt_free_args(&args);
+		free(repopath);
+		repopath = NULL;
+		return ret;
+	}
 
-	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_error %d %s\n", giterr->klass, giterr->message);
+	if (rogitfs_private_open(&rogitfs_private, repopath) != 0) {
+		exit(1);
+	}
+	if (rogitfs_caches_new(&rogitfs_private, budget) != 0) {
 		exit(1);
 	}
 
-	error = git_repository_odb(&rogitfs_private.odb, rogitfs_private.repo);
-	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_repository_odb %d %s\n", giterr->klass, giterr->message);
+	if (options.trigram_index != NULL) {
+		rogitfs_private.trigram_index = rogitfs_trigram_open(options.trigram_index);
+		if (rogitfs_private.trigram_index == NULL) {
+			exit(1);
+		}
 	}
 
 	ret = fuse_main(args.argc, args.argv, &rogitfs_operations, &rogitfs_private);
@@ -290,10 +1138,29 @@ int main(int argc, char *argv[]) {
 }
 
 static struct fuse_operations rogitfs_operations = {
+	.init			= rogitfs_init,
 	.destroy 		= rogitfs_destroy,
+	.open			= rogitfs_open,
+	.release		= rogitfs_release,
 	.read			= rogitfs_read,
 	.readdir		= rogitfs_readdir,
 	.getattr		= rogitfs_getattr,
 	.readlink		= rogitfs_readlink,
+	.getxattr		= rogitfs_getxattr,
+	.listxattr		= rogitfs_listxattr,
+};
+
+static struct fuse_operations rogitfs_mount_operations = {
+	.init			= rogitfs_mount_init,
+	.destroy 		= rogitfs_mount_destroy,
+	.open			= rogitfs_mount_open,
+	.release		= rogitfs_mount_release,
+	.read			= rogitfs_mount_read,
+	.readdir		= rogitfs_mount_readdir,
+	.getattr		= rogitfs_mount_getattr,
+	.readlink		= rogitfs_mount_readlink,
+	.getxattr		= rogitfs_mount_getxattr,
+	.listxattr		= rogitfs_mount_listxattr,
 };
 
+#endif
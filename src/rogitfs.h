@@ -11,20 +11,46 @@
 #include <git2.h>
 #include "rogitfs_common.h"
 
+#ifndef ROGITFS_NO_MAIN
+
 static struct rogitfs_private rogitfs_private;
 
 static char* repopath = NULL;
 
+#endif
+
 
 static struct options {
     const char *repopath;
+    const char *trigram_index;
+    const char *config;
+    unsigned int cache_size;
+    const char *shared_cache;
+    unsigned int shared_cache_size;
+    unsigned int delta_cache_size;
+    unsigned int memory_limit;
+    unsigned int ref_ttl;
+    unsigned int trace;
+    const char *trace_file;
+    const char *log_level;
+    unsigned int negative_timeout;
+    const char *record;
+    unsigned int startup_threads;
     int show_help;
 } options;
 
+#ifndef ROGITFS_NO_MAIN
+
 static struct fuse_operations rogitfs_operations;
 
+static struct fuse_operations rogitfs_mount_operations;
+
+#endif
+
 int rogitfs_open(const char *path, struct fuse_file_info *file_info);
 
+int rogitfs_release(const char *path, struct fuse_file_info *file_info);
+
 int rogitfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
 
 int rogitfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
@@ -45,6 +71,30 @@ int rogitfs_readlink(const char *path, char *buf, size_t size);
 
 int rogitfs_getxattr(const char *path, const char *name, char *value, size_t size);
 
+int rogitfs_listxattr(const char *path, char *list, size_t size);
+
+
+int rogitfs_mount_open(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_mount_release(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_mount_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_mount_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_mount_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+	off_t offset, struct fuse_file_info *fi,
+	enum fuse_readdir_flags flags);
+
+int rogitfs_mount_readlink(const char *path, char *buf, size_t size);
+
+int rogitfs_mount_getxattr(const char *path, const char *name, char *value, size_t size);
+
+int rogitfs_mount_listxattr(const char *path, char *list, size_t size);
+
+void *rogitfs_mount_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
+
+void rogitfs_mount_destroy(void *private_data);
 
 void *rogitfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
 
@@ -0,0 +1,385 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_ancestors.h"
+#include "rogitfs_logging.h"
+
+// Returns the referenced graph and the node of the commit named by comp
+static struct rogitfs_graph *rogitfs_ancestors_node(const char *comp, unsigned int comp_size, unsigned int *result_index, struct rogitfs_private *private) {
+
+	if (comp_size != GIT_OID_HEXSZ) {
+		return NULL;
+	}
+	git_oid oid = {};
+	int error = git_oid_fromstrn(&oid, comp, comp_size);
+	if (error != 0) {
+		rogitfs_log_giterr("git_oid_fromstrn", error);
+		return NULL;
+	}
+	struct rogitfs_graph *graph = rogitfs_graph_get(private, &oid);
+	if (graph == NULL) {
+		return NULL;
+	}
+	if (rogitfs_graph_lookup(graph, &oid, result_index) != 0) {
+		rogitfs_graph_release(private, graph);
+		return NULL;
+	}
+	return graph;
+}
+
+// Node of path component index, graph must contain it already
+static int rogitfs_ancestors_component_node(const char *path, unsigned int index, const struct rogitfs_graph *graph, unsigned int *result_index) {
+
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	int error = path_component(path, index, &comp, &comp_size);
+	if (error != 0 || comp_size != GIT_OID_HEXSZ) {
+		return -1;
+	}
+	git_oid oid = {};
+	if (git_oid_fromstrn(&oid, comp, comp_size) != 0) {
+		return -1;
+	}
+	return rogitfs_graph_lookup(graph, &oid, result_index);
+}
+
+// Resolve <oid>/all/<hash> and <oid>/first-parent/<n> to a node
+static int rogitfs_ancestors_target(const char *path, struct rogitfs_graph *graph, unsigned int index, unsigned int *result_index) {
+
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	int error = path_component(path, 1, &comp, &comp_size);
+	if (error != 0) {
+		return -1;
+	}
+	if (comp_size == 3 && strncmp(comp, "all", 3) == 0) {
+
+		unsigned int ancestor = 0;
+		if (rogitfs_ancestors_component_node(path, 2, graph, &ancestor) != 0) {
+			return -1;
+		}
+		if (rogitfs_graph_is_ancestor(graph, ancestor, index) != 1) {
+			return -1;
+		}
+		*result_index = ancestor;
+		return 0;
+
+	} else if (comp_size == 12 && strncmp(comp, "first-parent", 12) == 0) {
+
+		error = path_component(path, 2, &comp, &comp_size);
+		if (error != 0 || comp_size == 0 || comp_size > 10 || strspn(comp, "0123456789") < comp_size) {
+			return -1;
+		}
+		unsigned long steps = strtoul(comp, NULL, 10);
+		unsigned int node = index;
+		for (unsigned long i = 0; i < steps; i++) {
+			if (graph->parent_start[node] == graph->parent_start[node+1]) {
+				return -1;
+			}
+			node = graph->parents[graph->parent_start[node]];
+		}
+		*result_index = node;
+		return 0;
+
+	}
+	return -1;
+}
+
+static int rogitfs_ancestors_commits_fill(void *buf, fuse_fill_dir_t filler) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct odb_fill_payload payload = {
+		.buf = buf,
+		.filler = filler,
+		.type = GIT_OBJECT_COMMIT,
+		.private = private
+	};
+	int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
+	if (error != 0) {
+		rogitfs_log_giterr("git_odb_foreach", error);
+		return -ENOENT;
+	}
+	return 0;
+}
+
+int rogitfs_ancestors_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] == 0) {
+		return rogitfs_ancestors_commits_fill(buf, filler);
+	}
+	if (path[0] != '/') {
+		return -ENOENT;
+	}
+	path = path + 1;
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0 || comp_count < 1 || comp_count > 2) {
+		return -ENOENT;
+	}
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	error = path_component(path, 0, &comp, &comp_size);
+	if (error != 0) {
+		return -ENOENT;
+	}
+	unsigned int index = 0;
+	struct rogitfs_graph *graph = rogitfs_ancestors_node(comp, comp_size, &index, private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+
+	struct stat dir_stat = {
+		.st_mode = S_IFDIR | 0755,
+		.st_size = 1337
+	};
+	struct stat link_stat = {
+		.st_mode = S_IFLNK | 0644
+	};
+
+	int res = 0;
+	if (comp_count == 1) {
+		if (filler(buf, "all", &dir_stat, 0, 0) != 0 || filler(buf, "first-parent", &dir_stat, 0, 0) != 0) {
+			res = -ENOENT;
+		}
+		rogitfs_graph_release(private, graph);
+		return res;
+	}
+
+	error = path_component(path, 1, &comp, &comp_size);
+	int first_parent = 0;
+	if (error == 0 && comp_size == 12 && strncmp(comp, "first-parent", 12) == 0) {
+		first_parent = 1;
+	} else if (error != 0 || comp_size != 3 || strncmp(comp, "all", 3) != 0) {
+		rogitfs_graph_release(private, graph);
+		return -ENOENT;
+	}
+
+	unsigned int *nodes = NULL;
+	unsigned int count = 0;
+	error = rogitfs_graph_ancestors(graph, index, first_parent, &nodes, &count);
+	if (error != 0) {
+		rogitfs_graph_release(private, graph);
+		return -ENOENT;
+	}
+	char name[GIT_OID_HEXSZ+1] = {};
+	for (unsigned int i = 0; i < count; i++) {
+		if (first_parent) {
+			snprintf(name, sizeof(name), "%u", i);
+		} else {
+			git_oid_tostr(name, sizeof(name), &graph->oids[nodes[i]]);
+		}
+		if (filler(buf, name, &link_stat, 0, 0) != 0) {
+			res = -ENOENT;
+			break;
+		}
+	}
+	free(nodes);
+	rogitfs_graph_release(private, graph);
+	return res;
+}
+
+int rogitfs_ancestors_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0 || comp_count < 1 || comp_count > 3) {
+		return -ENOENT;
+	}
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	error = path_component(path, 0, &comp, &comp_size);
+	if (error != 0) {
+		return -ENOENT;
+	}
+	unsigned int index = 0;
+	struct rogitfs_graph *graph = rogitfs_ancestors_node(comp, comp_size, &index, private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+
+	int res = 0;
+	if (comp_count == 1) {
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337,
+			.st_mtime = graph->times[index]
+		};
+		*stbuf = dir_stat;
+	} else if (comp_count == 2) {
+		error = path_component(path, 1, &comp, &comp_size);
+		if (error == 0 && ((comp_size == 3 && strncmp(comp, "all", 3) == 0) || (comp_size == 12 && strncmp(comp, "first-parent", 12) == 0))) {
+			struct stat dir_stat = {
+				.st_mode = S_IFDIR | 0755,
+				.st_size = 1337
+			};
+			*stbuf = dir_stat;
+		} else {
+			res = -ENOENT;
+		}
+	} else {
+		unsigned int target = 0;
+		if (rogitfs_ancestors_target(path, graph, index, &target) == 0) {
+			struct stat link_stat = {
+				.st_mode = S_IFLNK | 0644
+			};
+			*stbuf = link_stat;
+		} else {
+			res = -ENOENT;
+		}
+	}
+	rogitfs_graph_release(private, graph);
+	return res;
+}
+
+int rogitfs_ancestors_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0 || comp_count != 3) {
+		return -ENOENT;
+	}
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	error = path_component(path, 0, &comp, &comp_size);
+	if (error != 0) {
+		return -ENOENT;
+	}
+	unsigned int index = 0;
+	struct rogitfs_graph *graph = rogitfs_ancestors_node(comp, comp_size, &index, private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+	unsigned int target = 0;
+	if (rogitfs_ancestors_target(path, graph, index, &target) != 0) {
+		rogitfs_graph_release(private, graph);
+		return -ENOENT;
+	}
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, sizeof(hash), &graph->oids[target]);
+	rogitfs_graph_release(private, graph);
+
+	snprintf(buf, size, "../../../commit/%s", hash);
+	return 0;
+}
+
+int rogitfs_mergebase_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] == 0) {
+		return rogitfs_ancestors_commits_fill(buf, filler);
+	}
+	// /mergebase/<a>/ entries are only reachable by name
+	return 0;
+}
+
+// Merge base of <a>/<b>, returns -1 if there is none
+static int rogitfs_mergebase_get(const char *path, git_oid *result_oid, struct rogitfs_private *private) {
+
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	int error = path_component(path, 0, &comp, &comp_size);
+	if (error != 0) {
+		return -1;
+	}
+	unsigned int a = 0;
+	struct rogitfs_graph *graph = rogitfs_ancestors_node(comp, comp_size, &a, private);
+	if (graph == NULL) {
+		return -1;
+	}
+	unsigned int b = 0;
+	if (rogitfs_ancestors_component_node(path, 1, graph, &b) != 0) {
+		// b may not have been part of the graph yet
+		error = path_component(path, 1, &comp, &comp_size);
+		rogitfs_graph_release(private, graph);
+		if (error != 0) {
+			return -1;
+		}
+		graph = rogitfs_ancestors_node(comp, comp_size, &b, private);
+		if (graph == NULL || rogitfs_ancestors_component_node(path, 0, graph, &a) != 0) {
+			rogitfs_graph_release(private, graph);
+			return -1;
+		}
+	}
+	unsigned int base = 0;
+	error = rogitfs_graph_merge_base(graph, a, b, &base);
+	if (error == 0) {
+		git_oid_cpy(result_oid, &graph->oids[base]);
+	}
+	rogitfs_graph_release(private, graph);
+	return error;
+}
+
+int rogitfs_mergebase_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0) {
+		return -ENOENT;
+	}
+	if (comp_count == 1) {
+		const char *comp = NULL;
+		unsigned int comp_size = 0;
+		error = path_component(path, 0, &comp, &comp_size);
+		if (error != 0) {
+			return -ENOENT;
+		}
+		unsigned int index = 0;
+		struct rogitfs_graph *graph = rogitfs_ancestors_node(comp, comp_size, &index, private);
+		if (graph == NULL) {
+			return -ENOENT;
+		}
+		rogitfs_graph_release(private, graph);
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = dir_stat;
+		return 0;
+	}
+	if (comp_count != 2) {
+		return -ENOENT;
+	}
+	git_oid base = {};
+	if (rogitfs_mergebase_get(path, &base, private) != 0) {
+		return -ENOENT;
+	}
+	struct stat link_stat = {
+		.st_mode = S_IFLNK | 0644
+	};
+	*stbuf = link_stat;
+	return 0;
+}
+
+int rogitfs_mergebase_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0 || comp_count != 2) {
+		return -ENOENT;
+	}
+	git_oid base = {};
+	if (rogitfs_mergebase_get(path, &base, private) != 0) {
+		return -ENOENT;
+	}
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, sizeof(hash), &base);
+	snprintf(buf, size, "../../commit/%s", hash);
+	return 0;
+}
@@ -0,0 +1,28 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_ANCESTORS_H__
+#define __ROGITFS_ANCESTORS_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /ancestors/<oid>/all/<hash>          every ancestor, links to /commit/<hash>
+// /ancestors/<oid>/first-parent/<n>    n-th commit of the first parent chain, 0 is <oid>
+// /mergebase/<a>/<b>                   link to the best merge base of a and b
+
+int rogitfs_ancestors_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+int rogitfs_ancestors_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_ancestors_readlink(const char *path, char *buf, size_t size);
+
+int rogitfs_mergebase_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+int rogitfs_mergebase_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_mergebase_readlink(const char *path, char *buf, size_t size);
+
+#endif
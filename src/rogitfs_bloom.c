@@ -0,0 +1,127 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rogitfs_bloom.h"
+
+static uint32_t rogitfs_bloom_rotate(uint32_t value, int count) {
+
+	return (value << count) | (value >> (32 - count));
+}
+
+// Byte i of data, sign extended for hash version 1
+static uint32_t rogitfs_bloom_byte(const char *data, size_t i, uint32_t hash_version) {
+
+	if (hash_version == 1) {
+		return (uint32_t)(signed char)data[i];
+	}
+	return (uint32_t)(unsigned char)data[i];
+}
+
+uint32_t rogitfs_bloom_murmur3(uint32_t seed, const char *data, size_t len, uint32_t hash_version) {
+
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	size_t blocks = len / 4;
+
+	for (size_t i = 0; i < blocks; i++) {
+		uint32_t k = rogitfs_bloom_byte(data, 4*i, hash_version)
+			| (rogitfs_bloom_byte(data, 4*i + 1, hash_version) << 8)
+			| (rogitfs_bloom_byte(data, 4*i + 2, hash_version) << 16)
+			| (rogitfs_bloom_byte(data, 4*i + 3, hash_version) << 24);
+		k *= c1;
+		k = rogitfs_bloom_rotate(k, 15);
+		k *= c2;
+		seed ^= k;
+		seed = rogitfs_bloom_rotate(seed, 13) * 5 + 0xe6546b64;
+	}
+
+	uint32_t k1 = 0;
+	size_t tail = blocks * 4;
+	switch (len & 3) {
+	case 3:
+		k1 ^= rogitfs_bloom_byte(data, tail + 2, hash_version) << 16;
+		// fall through
+	case 2:
+		k1 ^= rogitfs_bloom_byte(data, tail + 1, hash_version) << 8;
+		// fall through
+	case 1:
+		k1 ^= rogitfs_bloom_byte(data, tail, hash_version);
+		k1 *= c1;
+		k1 = rogitfs_bloom_rotate(k1, 15);
+		k1 *= c2;
+		seed ^= k1;
+	break;
+	}
+
+	seed ^= (uint32_t)len;
+	seed ^= (seed >> 16);
+	seed *= 0x85ebca6b;
+	seed ^= (seed >> 13);
+	seed *= 0xc2b2ae35;
+	seed ^= (seed >> 16);
+	return seed;
+}
+
+int rogitfs_bloom_key_new(const char *path, const struct rogitfs_bloom_settings *settings, struct rogitfs_bloom_key *result_key) {
+
+	size_t path_len = strlen(path);
+	unsigned int count = 1;
+	for (size_t i = 0; i < path_len; i++) {
+		if (path[i] == '/') {
+			count++;
+		}
+	}
+	struct rogitfs_bloom_key key = {
+		.count = 0,
+		.hash0 = (uint32_t *) calloc(count, sizeof(uint32_t)),
+		.hash1 = (uint32_t *) calloc(count, sizeof(uint32_t))
+	};
+	if (key.hash0 == NULL || key.hash1 == NULL) {
+		rogitfs_bloom_key_free(&key);
+		return -1;
+	}
+	for (size_t i = 0; i <= path_len; i++) {
+		if (i < path_len && path[i] != '/') {
+			continue;
+		}
+		if (i == 0) {
+			continue;
+		}
+		key.hash0[key.count] = rogitfs_bloom_murmur3(ROGITFS_BLOOM_SEED0, path, i, settings->hash_version);
+		key.hash1[key.count] = rogitfs_bloom_murmur3(ROGITFS_BLOOM_SEED1, path, i, settings->hash_version);
+		key.count++;
+	}
+	*result_key = key;
+	return 0;
+}
+
+void rogitfs_bloom_key_free(struct rogitfs_bloom_key *key) {
+
+	free(key->hash0);
+	free(key->hash1);
+	key->hash0 = NULL;
+	key->hash1 = NULL;
+	key->count = 0;
+}
+
+// Returns 0 if the path was definitely not changed, 1 if it may have been
+int rogitfs_bloom_contains(const unsigned char *filter, size_t filter_size, const struct rogitfs_bloom_key *key, const struct rogitfs_bloom_settings *settings) {
+
+	uint64_t bits = (uint64_t)filter_size * 8;
+	if (bits == 0) {
+		return 1;
+	}
+	for (unsigned int k = 0; k < key->count; k++) {
+		for (uint32_t i = 0; i < settings->num_hashes; i++) {
+			uint32_t hash = key->hash0[k] + i * key->hash1[k];
+			uint64_t bit = hash % bits;
+			if ((filter[bit / 8] & (1 << (bit % 8))) == 0) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,37 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_BLOOM_H__
+#define __ROGITFS_BLOOM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Changed-path Bloom filters as written by `git commit-graph write --changed-paths`.
+// A path changed by a commit adds the path itself and all of its leading directories.
+#define ROGITFS_BLOOM_SEED0 0x293ae76f
+#define ROGITFS_BLOOM_SEED1 0x7e646e2c
+
+struct rogitfs_bloom_settings {
+	// 1 hashes bytes as signed char like older git versions, 2 is plain murmur3
+	uint32_t hash_version;
+	uint32_t num_hashes;
+	uint32_t bits_per_entry;
+};
+
+// Hashes of a path and its leading directories
+struct rogitfs_bloom_key {
+	unsigned int count;
+	uint32_t *hash0;
+	uint32_t *hash1;
+};
+
+uint32_t rogitfs_bloom_murmur3(uint32_t seed, const char *data, size_t len, uint32_t hash_version);
+
+int rogitfs_bloom_key_new(const char *path, const struct rogitfs_bloom_settings *settings, struct rogitfs_bloom_key *result_key);
+
+void rogitfs_bloom_key_free(struct rogitfs_bloom_key *key);
+
+int rogitfs_bloom_contains(const unsigned char *filter, size_t filter_size, const struct rogitfs_bloom_key *key, const struct rogitfs_bloom_settings *settings);
+
+#endif
@@ -0,0 +1,294 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include "rogitfs_common.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_bydate.h"
+
+#define ROGITFS_BYDATE_MAX_DEPTH 3
+
+// Parsed /by-date path: date components select a time range, name is latest or a hash
+struct rogitfs_bydate_path {
+	unsigned int depth;
+	int date[ROGITFS_BYDATE_MAX_DEPTH];
+	long long start;
+	long long end;
+	const char *name;
+	unsigned int name_size;
+};
+
+static const unsigned int rogitfs_bydate_width[ROGITFS_BYDATE_MAX_DEPTH] = {4, 2, 2};
+
+static long long rogitfs_bydate_time(int year, int month, int day) {
+
+	struct tm date = {
+		.tm_year = year - 1900,
+		.tm_mon = month - 1,
+		.tm_mday = day
+	};
+	return timegm(&date);
+}
+
+// Time range [start, end) of the first depth date values
+static void rogitfs_bydate_range(const int *date, unsigned int depth, long long *result_start, long long *result_end) {
+
+	switch(depth) {
+	case 0:
+		*result_start = LLONG_MIN;
+		*result_end = LLONG_MAX;
+	break;
+	case 1:
+		*result_start = rogitfs_bydate_time(date[0], 1, 1);
+		*result_end = rogitfs_bydate_time(date[0] + 1, 1, 1);
+	break;
+	case 2:
+		*result_start = rogitfs_bydate_time(date[0], date[1], 1);
+		*result_end = rogitfs_bydate_time(date[0], date[1] + 1, 1);
+	break;
+	default:
+		*result_start = rogitfs_bydate_time(date[0], date[1], date[2]);
+		*result_end = rogitfs_bydate_time(date[0], date[1], date[2] + 1);
+	break;
+	}
+}
+
+static int rogitfs_bydate_parse(const char *path, struct rogitfs_bydate_path *result_path) {
+
+	unsigned int comp_count = 0;
+	int error = path_component_count(path, &comp_count);
+	if (error != 0 || comp_count > ROGITFS_BYDATE_MAX_DEPTH + 1) {
+		return -1;
+	}
+	struct rogitfs_bydate_path parsed = {};
+	for (unsigned int i = 0; i < comp_count; i++) {
+		const char *comp = NULL;
+		unsigned int comp_size = 0;
+		error = path_component(path, i, &comp, &comp_size);
+		if (error != 0) {
+			return -1;
+		}
+		if (i < ROGITFS_BYDATE_MAX_DEPTH && comp_size == rogitfs_bydate_width[i] && strspn(comp, "0123456789") >= comp_size) {
+			parsed.date[i] = (int) strtol(comp, NULL, 10);
+			parsed.depth++;
+			continue;
+		}
+		if (i + 1 != comp_count) {
+			return -1;
+		}
+		parsed.name = comp;
+		parsed.name_size = comp_size;
+	}
+	if (parsed.depth >= 2 && (parsed.date[1] < 1 || parsed.date[1] > 12)) {
+		return -1;
+	}
+	if (parsed.depth == 3) {
+		// reject days that timegm would move into the next month
+		time_t day_time = rogitfs_bydate_time(parsed.date[0], parsed.date[1], parsed.date[2]);
+		struct tm day = {};
+		if (parsed.date[2] < 1 || gmtime_r(&day_time, &day) == NULL || day.tm_mon != parsed.date[1] - 1) {
+			return -1;
+		}
+	}
+	rogitfs_bydate_range(parsed.date, parsed.depth, &parsed.start, &parsed.end);
+	*result_path = parsed;
+	return 0;
+}
+
+// Newest commit in the range or the commit named by hash if it lies in the range
+static int rogitfs_bydate_target(const struct rogitfs_graph *graph, const struct rogitfs_bydate_path *parsed, unsigned int *result_index) {
+
+	unsigned int first = rogitfs_graph_time_bound(graph, parsed->start);
+	unsigned int last = rogitfs_graph_time_bound(graph, parsed->end);
+	if (first >= last) {
+		return -1;
+	}
+	if (parsed->name_size == 6 && strncmp(parsed->name, "latest", 6) == 0) {
+		*result_index = graph->by_time[last - 1];
+		return 0;
+	}
+	if (parsed->depth != ROGITFS_BYDATE_MAX_DEPTH || parsed->name_size != GIT_OID_HEXSZ) {
+		return -1;
+	}
+	git_oid oid = {};
+	unsigned int index = 0;
+	if (git_oid_fromstrn(&oid, parsed->name, parsed->name_size) != 0 || rogitfs_graph_lookup(graph, &oid, &index) != 0) {
+		return -1;
+	}
+	if (graph->times[index] < parsed->start || graph->times[index] >= parsed->end) {
+		return -1;
+	}
+	*result_index = index;
+	return 0;
+}
+
+// Graph containing the commits the references point to now. The references
+// come from the snapshot of /tree, commits made since the graph was built are added.
+static struct rogitfs_graph *rogitfs_bydate_graph(struct rogitfs_private *private) {
+
+	struct rogitfs_graph *graph = rogitfs_graph_get(private, NULL);
+	struct rogitfs_reftree_snapshot *snapshot = rogitfs_reftree_get(private);
+	if (snapshot == NULL) {
+		return graph;
+	}
+	for (unsigned int i = 0; graph != NULL && i < snapshot->count; i++) {
+		unsigned int index = 0;
+		if (rogitfs_graph_lookup(graph, &snapshot->targets[i], &index) == 0) {
+			continue;
+		}
+		// the graph is returned unchanged for tags of trees
+		rogitfs_graph_release(private, graph);
+		graph = rogitfs_graph_get(private, &snapshot->targets[i]);
+	}
+	rogitfs_reftree_put(private, snapshot);
+	return graph;
+}
+
+int rogitfs_bydate_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] == '/') {
+		path = path + 1;
+	}
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_bydate_path parsed = {};
+	if (rogitfs_bydate_parse(path, &parsed) != 0 || parsed.name != NULL) {
+		return -ENOENT;
+	}
+	struct rogitfs_graph *graph = rogitfs_bydate_graph(private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+
+	struct stat dir_stat = {
+		.st_mode = S_IFDIR | 0755,
+		.st_size = 1337
+	};
+	struct stat link_stat = {
+		.st_mode = S_IFLNK | 0644
+	};
+	char name[GIT_OID_HEXSZ+1] = {};
+	int res = 0;
+
+	unsigned int pos = rogitfs_graph_time_bound(graph, parsed.start);
+	unsigned int last = rogitfs_graph_time_bound(graph, parsed.end);
+	if (pos < last && filler(buf, "latest", &link_stat, 0, 0) != 0) {
+		res = -ENOENT;
+	}
+
+	while (res == 0 && pos < last) {
+		unsigned int index = graph->by_time[pos];
+		if (parsed.depth == ROGITFS_BYDATE_MAX_DEPTH) {
+			git_oid_tostr(name, sizeof(name), &graph->oids[index]);
+			if (filler(buf, name, &link_stat, 0, 0) != 0) {
+				res = -ENOENT;
+			}
+			pos++;
+			continue;
+		}
+
+		// list the year, month or day of this commit and skip ahead to the next one
+		time_t commit_time = graph->times[index];
+		struct tm date = {};
+		if (gmtime_r(&commit_time, &date) == NULL) {
+			res = -ENOENT;
+			break;
+		}
+		int child[ROGITFS_BYDATE_MAX_DEPTH] = {date.tm_year + 1900, date.tm_mon + 1, date.tm_mday};
+		long long child_start = 0;
+		long long child_end = 0;
+		rogitfs_bydate_range(child, parsed.depth + 1, &child_start, &child_end);
+		snprintf(name, sizeof(name), "%0*d", rogitfs_bydate_width[parsed.depth], child[parsed.depth]);
+		if (filler(buf, name, &dir_stat, 0, 0) != 0) {
+			res = -ENOENT;
+			break;
+		}
+		unsigned int next = rogitfs_graph_time_bound(graph, child_end);
+		pos = next > pos ? next : pos + 1;
+	}
+
+	rogitfs_graph_release(private, graph);
+	return res;
+}
+
+int rogitfs_bydate_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_bydate_path parsed = {};
+	if (rogitfs_bydate_parse(path, &parsed) != 0) {
+		return -ENOENT;
+	}
+	struct rogitfs_graph *graph = rogitfs_bydate_graph(private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+
+	int res = 0;
+	if (parsed.name == NULL) {
+		unsigned int first = rogitfs_graph_time_bound(graph, parsed.start);
+		unsigned int last = rogitfs_graph_time_bound(graph, parsed.end);
+		if (first < last) {
+			struct stat dir_stat = {
+				.st_mode = S_IFDIR | 0755,
+				.st_size = 1337,
+				.st_mtime = graph->times[graph->by_time[last - 1]]
+			};
+			*stbuf = dir_stat;
+		} else {
+			res = -ENOENT;
+		}
+	} else {
+		unsigned int index = 0;
+		if (rogitfs_bydate_target(graph, &parsed, &index) == 0) {
+			struct stat link_stat = {
+				.st_mode = S_IFLNK | 0644,
+				.st_mtime = graph->times[index]
+			};
+			*stbuf = link_stat;
+		} else {
+			res = -ENOENT;
+		}
+	}
+	rogitfs_graph_release(private, graph);
+	return res;
+}
+
+int rogitfs_bydate_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_bydate_path parsed = {};
+	if (rogitfs_bydate_parse(path, &parsed) != 0 || parsed.name == NULL) {
+		return -ENOENT;
+	}
+	struct rogitfs_graph *graph = rogitfs_bydate_graph(private);
+	if (graph == NULL) {
+		return -ENOENT;
+	}
+	unsigned int index = 0;
+	if (rogitfs_bydate_target(graph, &parsed, &index) != 0) {
+		rogitfs_graph_release(private, graph);
+		return -ENOENT;
+	}
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, sizeof(hash), &graph->oids[index]);
+	rogitfs_graph_release(private, graph);
+
+	// one step up per date component and one out of /by-date
+	size_t len = 0;
+	for (unsigned int i = 0; i <= parsed.depth && len + 3 < size; i++) {
+		memcpy(buf + len, "../", 3);
+		len = len + 3;
+	}
+	snprintf(buf + len, size - len, "commit/%s", hash);
+	return 0;
+}
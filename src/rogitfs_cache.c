@@ -0,0 +1,360 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "rogitfs_cache.h"
+#include "rogitfs_logging.h"
+#include "rogitfs_memory.h"
+
+#define ROGITFS_CACHE_MIN_BUCKETS 64
+
+static unsigned int rogitfs_cache_hash(const void *key, size_t key_size) {
+
+	// FNV-1a
+	const unsigned char *cur = (const unsigned char *)key;
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < key_size; i++) {
+		hash ^= cur[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Offset of the data from the start of the entry, callers cast the data to
+// their structs, so it gets the alignment of malloc
+static size_t rogitfs_cache_data_offset(size_t key_size) {
+
+	size_t align = _Alignof(max_align_t);
+	return (offsetof(struct rogitfs_cache_entry, key) + key_size + align - 1) / align * align;
+}
+
+static size_t rogitfs_cache_entry_cost(struct rogitfs_cache_entry *entry) {
+
+	return rogitfs_cache_data_offset(entry->key_size) + entry->data_size;
+}
+
+// unlink from the lru or the protected list, whichever holds entry
+static void rogitfs_cache_lru_unlink(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry) {
+
+	struct rogitfs_cache_entry **head = entry->is_protected ? &cache->protected_head : &cache->lru_head;
+	struct rogitfs_cache_entry **tail = entry->is_protected ? &cache->protected_tail : &cache->lru_tail;
+	if (entry->lru_prev != NULL) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	} else {
+		*head = entry->lru_next;
+	}
+	if (entry->lru_next != NULL) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	} else {
+		*tail = entry->lru_prev;
+	}
+	entry->lru_prev = NULL;
+	entry->lru_next = NULL;
+}
+
+static void rogitfs_cache_lru_push(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry) {
+
+	struct rogitfs_cache_entry **head = entry->is_protected ? &cache->protected_head : &cache->lru_head;
+	struct rogitfs_cache_entry **tail = entry->is_protected ? &cache->protected_tail : &cache->lru_tail;
+	entry->lru_prev = NULL;
+	entry->lru_next = *head;
+	if (*head != NULL) {
+		(*head)->lru_prev = entry;
+	}
+	*head = entry;
+	if (*tail == NULL) {
+		*tail = entry;
+	}
+}
+
+static struct rogitfs_cache_entry *rogitfs_cache_find(struct rogitfs_cache *cache, const void *key, size_t key_size, unsigned int hash) {
+
+	struct rogitfs_cache_entry *entry = cache->buckets[hash & (cache->bucket_count - 1)];
+	while (entry != NULL) {
+		if (entry->hash == hash && entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0) {
+			return entry;
+		}
+		entry = entry->next;
+	}
+	return NULL;
+}
+
+static void rogitfs_cache_unref(struct rogitfs_cache_entry *entry) {
+
+	entry->refcount--;
+	if (entry->refcount == 0) {
+		free(entry);
+	}
+}
+
+// remove entry from table and drop the reference held by the cache
+static void rogitfs_cache_remove(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry) {
+
+	struct rogitfs_cache_entry **link = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+	while (*link != NULL) {
+		if (*link == entry) {
+			*link = entry->next;
+			break;
+		}
+		link = &(*link)->next;
+	}
+	rogitfs_cache_lru_unlink(cache, entry);
+	if (entry->is_protected) {
+		cache->protected_size -= rogitfs_cache_entry_cost(entry);
+	}
+	if (cache->memory_cost > 0) {
+		rogitfs_memory_charge(-(ssize_t)rogitfs_cache_entry_cost(entry));
+	}
+	cache->size -= rogitfs_cache_entry_cost(entry);
+	cache->entry_count--;
+	rogitfs_cache_unref(entry);
+}
+
+static void rogitfs_cache_grow(struct rogitfs_cache *cache) {
+
+	unsigned int new_count = cache->bucket_count * 2;
+	struct rogitfs_cache_entry **new_buckets = (struct rogitfs_cache_entry **) calloc(new_count, sizeof(struct rogitfs_cache_entry *));
+	if (new_buckets == NULL) {
+		return;
+	}
+	for (unsigned int i = 0; i < cache->bucket_count; i++) {
+		struct rogitfs_cache_entry *entry = cache->buckets[i];
+		while (entry != NULL) {
+			struct rogitfs_cache_entry *next = entry->next;
+			unsigned int index = entry->hash & (new_count - 1);
+			entry->next = new_buckets[index];
+			new_buckets[index] = entry;
+			entry = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = new_buckets;
+	cache->bucket_count = new_count;
+}
+
+struct rogitfs_cache *rogitfs_cache_new(const char *name, size_t max_size) {
+
+	struct rogitfs_cache *cache = (struct rogitfs_cache *) calloc(1, sizeof(struct rogitfs_cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->buckets = (struct rogitfs_cache_entry **) calloc(ROGITFS_CACHE_MIN_BUCKETS, sizeof(struct rogitfs_cache_entry *));
+	if (cache->buckets == NULL) {
+		free(cache);
+		return NULL;
+	}
+	cache->name = name;
+	cache->bucket_count = ROGITFS_CACHE_MIN_BUCKETS;
+	cache->max_size = max_size;
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+void rogitfs_cache_free(struct rogitfs_cache *cache) {
+
+	if (cache == NULL) {
+		return;
+	}
+	while (cache->lru_head != NULL) {
+		rogitfs_cache_remove(cache, cache->lru_head);
+	}
+	while (cache->protected_head != NULL) {
+		rogitfs_cache_remove(cache, cache->protected_head);
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->buckets);
+	free(cache);
+}
+
+// Returns a referenced entry or NULL, release with rogitfs_cache_release
+struct rogitfs_cache_entry *rogitfs_cache_get(struct rogitfs_cache *cache, const void *key, size_t key_size) {
+
+	unsigned int hash = rogitfs_cache_hash(key, key_size);
+
+	pthread_mutex_lock(&cache->lock);
+	struct rogitfs_cache_entry *entry = rogitfs_cache_find(cache, key, key_size, hash);
+	if (entry != NULL) {
+		entry->refcount++;
+		entry->used_ms = rogitfs_memory_now_ms();
+		rogitfs_cache_lru_unlink(cache, entry);
+		rogitfs_cache_lru_push(cache, entry);
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return entry;
+}
+
+// Copies key and data into a new entry and returns it referenced.
+// If another thread inserted the same key first, that entry is returned instead.
+struct rogitfs_cache_entry *rogitfs_cache_put(struct rogitfs_cache *cache, const void *key, size_t key_size, const void *data, size_t data_size) {
+
+	unsigned int hash = rogitfs_cache_hash(key, key_size);
+
+	size_t data_offset = rogitfs_cache_data_offset(key_size);
+	struct rogitfs_cache_entry *new_entry = (struct rogitfs_cache_entry *) malloc(data_offset + data_size);
+	if (new_entry == NULL) {
+		rogitfs_log_error("rogitfs_cache_put malloc failed");
+		return NULL;
+	}
+	memset(new_entry, 0, sizeof(struct rogitfs_cache_entry));
+	new_entry->hash = hash;
+	new_entry->key_size = key_size;
+	new_entry->data_size = data_size;
+	new_entry->data = (unsigned char *)new_entry + data_offset;
+	// one reference for the cache and one for the caller
+	new_entry->refcount = 2;
+	new_entry->used_ms = rogitfs_memory_now_ms();
+	memcpy(new_entry->key, key, key_size);
+	if (data_size > 0) {
+		memcpy(new_entry->data, data, data_size);
+	}
+
+	pthread_mutex_lock(&cache->lock);
+
+	struct rogitfs_cache_entry *entry = rogitfs_cache_find(cache, key, key_size, hash);
+	if (entry != NULL) {
+		entry->refcount++;
+		pthread_mutex_unlock(&cache->lock);
+		free(new_entry);
+		return entry;
+	}
+
+	unsigned int index = hash & (cache->bucket_count - 1);
+	new_entry->next = cache->buckets[index];
+	cache->buckets[index] = new_entry;
+	rogitfs_cache_lru_push(cache, new_entry);
+	cache->size += rogitfs_cache_entry_cost(new_entry);
+	cache->entry_count++;
+	if (cache->memory_cost > 0) {
+		rogitfs_memory_charge((ssize_t)rogitfs_cache_entry_cost(new_entry));
+	}
+
+	// evict least recently used entries, protected ones last, never the new one
+	while (cache->size > cache->max_size) {
+		struct rogitfs_cache_entry *victim = cache->lru_tail;
+		if (victim == NULL || victim == new_entry) {
+			victim = cache->protected_tail;
+		}
+		if (victim == NULL) {
+			break;
+		}
+		rogitfs_cache_remove(cache, victim);
+	}
+
+	if (cache->entry_count > cache->bucket_count) {
+		rogitfs_cache_grow(cache);
+	}
+
+	unsigned int memory_cost = cache->memory_cost;
+	pthread_mutex_unlock(&cache->lock);
+
+	// over the memory limit the inserting thread evicts, without holding a cache lock
+	if (memory_cost > 0) {
+		rogitfs_memory_balance();
+	}
+
+	return new_entry;
+}
+
+// Last use of the entry evicted next, returns -1 if the cache is empty
+int rogitfs_cache_oldest(struct rogitfs_cache *cache, uint64_t *result_used_ms) {
+
+	pthread_mutex_lock(&cache->lock);
+	struct rogitfs_cache_entry *entry = cache->lru_tail != NULL ? cache->lru_tail : cache->protected_tail;
+	if (entry != NULL) {
+		*result_used_ms = entry->used_ms;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return entry != NULL ? 0 : -1;
+}
+
+// Evict the least recently used entry, protected ones last, returns its size
+size_t rogitfs_cache_evict(struct rogitfs_cache *cache) {
+
+	pthread_mutex_lock(&cache->lock);
+	struct rogitfs_cache_entry *entry = cache->lru_tail != NULL ? cache->lru_tail : cache->protected_tail;
+	size_t size = 0;
+	if (entry != NULL) {
+		size = rogitfs_cache_entry_cost(entry);
+		rogitfs_cache_remove(cache, entry);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return size;
+}
+
+// Move a referenced entry to the protected list, entries protected longest
+// ago go back to the lru list when protected_max_size is exceeded.
+// Does nothing while protected_max_size is 0.
+void rogitfs_cache_protect(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry) {
+
+	pthread_mutex_lock(&cache->lock);
+	// an entry evicted meanwhile is no longer linked
+	if (cache->protected_max_size == 0 || rogitfs_cache_find(cache, entry->key, entry->key_size, entry->hash) != entry) {
+		pthread_mutex_unlock(&cache->lock);
+		return;
+	}
+	rogitfs_cache_lru_unlink(cache, entry);
+	if (entry->is_protected == 0) {
+		entry->is_protected = 1;
+		cache->protected_size += rogitfs_cache_entry_cost(entry);
+	}
+	rogitfs_cache_lru_push(cache, entry);
+	while (cache->protected_size > cache->protected_max_size && cache->protected_tail != entry) {
+		struct rogitfs_cache_entry *demoted = cache->protected_tail;
+		rogitfs_cache_lru_unlink(cache, demoted);
+		demoted->is_protected = 0;
+		cache->protected_size -= rogitfs_cache_entry_cost(demoted);
+		rogitfs_cache_lru_push(cache, demoted);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void rogitfs_cache_release(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry) {
+
+	if (entry == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&cache->lock);
+	rogitfs_cache_unref(entry);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+// Copies the data of a fixed size entry, returns 0 on hit
+int rogitfs_cache_lookup(struct rogitfs_cache *cache, const void *key, size_t key_size, void *data, size_t data_size) {
+
+	unsigned int hash = rogitfs_cache_hash(key, key_size);
+
+	pthread_mutex_lock(&cache->lock);
+	struct rogitfs_cache_entry *entry = rogitfs_cache_find(cache, key, key_size, hash);
+	if (entry == NULL || entry->data_size != data_size) {
+		cache->misses++;
+		pthread_mutex_unlock(&cache->lock);
+		return -1;
+	}
+	cache->hits++;
+	entry->used_ms = rogitfs_memory_now_ms();
+	if (data_size > 0) {
+		memcpy(data, entry->data, data_size);
+	}
+	rogitfs_cache_lru_unlink(cache, entry);
+	rogitfs_cache_lru_push(cache, entry);
+	pthread_mutex_unlock(&cache->lock);
+
+	return 0;
+}
+
+int rogitfs_cache_insert(struct rogitfs_cache *cache, const void *key, size_t key_size, const void *data, size_t data_size) {
+
+	struct rogitfs_cache_entry *entry = rogitfs_cache_put(cache, key, key_size, data, data_size);
+	if (entry == NULL) {
+		return -1;
+	}
+	rogitfs_cache_release(cache, entry);
+	return 0;
+}
@@ -0,0 +1,72 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_CACHE_H__
+#define __ROGITFS_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Reference counted cache entry, key and data are stored inline
+struct rogitfs_cache_entry {
+	struct rogitfs_cache_entry *next;
+	struct rogitfs_cache_entry *lru_prev;
+	struct rogitfs_cache_entry *lru_next;
+	unsigned int refcount;
+	unsigned int hash;
+	// on the protected list, see rogitfs_cache_protect
+	unsigned int is_protected;
+	// last use in milliseconds of rogitfs_memory_now_ms
+	uint64_t used_ms;
+	size_t key_size;
+	size_t data_size;
+	void *data;
+	unsigned char key[];
+};
+
+// Thread-safe LRU cache limited by the sum of key and data sizes
+struct rogitfs_cache {
+	const char *name;
+	pthread_mutex_t lock;
+	struct rogitfs_cache_entry **buckets;
+	unsigned int bucket_count;
+	unsigned int entry_count;
+	size_t size;
+	size_t max_size;
+	struct rogitfs_cache_entry *lru_head;
+	struct rogitfs_cache_entry *lru_tail;
+	// entries worth keeping, evicted only when lru is empty, moved back to lru
+	// when they take more than protected_max_size
+	struct rogitfs_cache_entry *protected_head;
+	struct rogitfs_cache_entry *protected_tail;
+	size_t protected_size;
+	size_t protected_max_size;
+	// lookups, counted under lock
+	unsigned long long hits;
+	unsigned long long misses;
+	// cost of rebuilding entries while registered with the memory governor, else 0
+	unsigned int memory_cost;
+};
+
+struct rogitfs_cache *rogitfs_cache_new(const char *name, size_t max_size);
+
+void rogitfs_cache_free(struct rogitfs_cache *cache);
+
+struct rogitfs_cache_entry *rogitfs_cache_get(struct rogitfs_cache *cache, const void *key, size_t key_size);
+
+struct rogitfs_cache_entry *rogitfs_cache_put(struct rogitfs_cache *cache, const void *key, size_t key_size, const void *data, size_t data_size);
+
+void rogitfs_cache_protect(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry);
+
+int rogitfs_cache_oldest(struct rogitfs_cache *cache, uint64_t *result_used_ms);
+
+size_t rogitfs_cache_evict(struct rogitfs_cache *cache);
+
+void rogitfs_cache_release(struct rogitfs_cache *cache, struct rogitfs_cache_entry *entry);
+
+int rogitfs_cache_lookup(struct rogitfs_cache *cache, const void *key, size_t key_size, void *data, size_t data_size);
+
+int rogitfs_cache_insert(struct rogitfs_cache *cache, const void *key, size_t key_size, const void *data, size_t data_size);
+
+#endif
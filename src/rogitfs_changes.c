@@ -0,0 +1,266 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_pathset.h"
+#include "rogitfs_changes.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_logging.h"
+
+// Parse <commit> or <old>..<new>, a missing old tree is reported as zero oid.
+// Paths are only filtered if both sides are commits.
+static int rogitfs_changes_spec(const char *spec, size_t spec_len, git_oid *result_old, git_oid *result_new, const struct rogitfs_filter **result_filter, struct rogitfs_private *private) {
+
+	char hash[GIT_OID_HEXSZ+1] = {};
+
+	if (spec_len == GIT_OID_HEXSZ) {
+
+		memcpy(hash, spec, GIT_OID_HEXSZ);
+		struct rogitfs_entry entry = {};
+		int error = rogitfs_resolve_component(NULL, hash, &entry, private);
+		if (error == 0 && entry.type == GIT_OBJECT_TAG) {
+			error = rogitfs_peel_tag(&entry.oid, &entry, private);
+		}
+		if (error != 0 || entry.type != GIT_OBJECT_COMMIT) {
+			return -1;
+		}
+		*result_filter = private->filter;
+		error = rogitfs_commit_tree_id(&entry.oid, result_new, private);
+		if (error != 0) {
+			return -1;
+		}
+
+		git_commit *commit = NULL;
+		error = git_commit_lookup(&commit, private->repo, &entry.oid);
+		if (error != 0) {
+			rogitfs_log_giterr("git_commit_lookup", error);
+			return -1;
+		}
+		memset(result_old, 0, sizeof(git_oid));
+		if (git_commit_parentcount(commit) > 0) {
+			error = rogitfs_commit_tree_id(git_commit_parent_id(commit, 0), result_old, private);
+		}
+		git_commit_free(commit);
+		return error;
+
+	} else if (spec_len == 2 * GIT_OID_HEXSZ + 2 && strncmp(spec + GIT_OID_HEXSZ, "..", 2) == 0) {
+
+		const struct rogitfs_filter *old_filter = NULL;
+		const struct rogitfs_filter *new_filter = NULL;
+		memcpy(hash, spec, GIT_OID_HEXSZ);
+		if (rogitfs_resolve_tree_id(hash, result_old, &old_filter, private) != 0) {
+			return -1;
+		}
+		memcpy(hash, spec + GIT_OID_HEXSZ + 2, GIT_OID_HEXSZ);
+		if (rogitfs_resolve_tree_id(hash, result_new, &new_filter, private) != 0) {
+			return -1;
+		}
+		*result_filter = old_filter != NULL ? new_filter : NULL;
+		return 0;
+
+	}
+
+	return -1;
+}
+
+static struct rogitfs_cache_entry *rogitfs_changes_build(const git_oid *old_id, const git_oid *new_id, const struct rogitfs_filter *filter, struct rogitfs_private *private) {
+
+	unsigned char key[2 + 2 * GIT_OID_RAWSZ];
+	key[0] = 'd';
+	key[1] = filter != NULL;
+	memcpy(key+2, old_id->id, GIT_OID_RAWSZ);
+	memcpy(key+2+GIT_OID_RAWSZ, new_id->id, GIT_OID_RAWSZ);
+
+	struct rogitfs_cache_entry *entry = rogitfs_cache_get(private->changes_cache, key, sizeof(key));
+	if (entry != NULL) {
+		return entry;
+	}
+
+	git_tree *old_tree = NULL;
+	git_tree *new_tree = NULL;
+	int error = 0;
+	if (git_oid_is_zero(old_id) == 0) {
+		error = git_tree_lookup(&old_tree, private->repo, old_id);
+		if (error != 0) {
+			rogitfs_log_giterr("git_tree_lookup", error);
+			return NULL;
+		}
+	}
+	error = git_tree_lookup(&new_tree, private->repo, new_id);
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		git_tree_free(old_tree);
+		return NULL;
+	}
+
+	// tree to tree diffs compare entry ids and skip equal subtrees, no blob is read
+	git_diff *diff = NULL;
+	error = git_diff_tree_to_tree(&diff, private->repo, old_tree, new_tree, NULL);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	if (error != 0) {
+		rogitfs_log_giterr("git_diff_tree_to_tree", error);
+		return NULL;
+	}
+
+	struct rogitfs_pathset_builder builder = {};
+	size_t delta_count = git_diff_num_deltas(diff);
+	for (size_t i = 0; i < delta_count; i++) {
+		const git_diff_delta *delta = git_diff_get_delta(diff, i);
+		switch(delta->status) {
+		case GIT_DELTA_ADDED:
+		case GIT_DELTA_MODIFIED:
+		case GIT_DELTA_TYPECHANGE:
+		break;
+		default:
+			continue;
+		break;
+		}
+		if (rogitfs_filter_visible(filter, delta->new_file.path, strlen(delta->new_file.path)) == 0) {
+			continue;
+		}
+		struct rogitfs_entry path_entry = {
+			.mode = delta->new_file.mode
+		};
+		git_oid_cpy(&path_entry.oid, &delta->new_file.id);
+		path_entry.type = path_entry.mode == GIT_FILEMODE_COMMIT ? GIT_OBJECT_COMMIT : GIT_OBJECT_BLOB;
+		if (rogitfs_pathset_add(&builder, delta->new_file.path, &path_entry) != 0) {
+			rogitfs_pathset_builder_free(&builder);
+			git_diff_free(diff);
+			return NULL;
+		}
+	}
+	git_diff_free(diff);
+
+	struct rogitfs_buffer data = {};
+	if (rogitfs_pathset_finish(&builder, &data) == 0) {
+		entry = rogitfs_cache_put(private->changes_cache, key, sizeof(key), data.data, data.size);
+	}
+	rogitfs_buffer_free(&data);
+	rogitfs_pathset_builder_free(&builder);
+
+	return entry;
+}
+
+// Split path into change set and the path inside it
+static struct rogitfs_cache_entry *rogitfs_changes_get(const char *path, const char **result_rest, struct rogitfs_private *private) {
+
+	const char *rest = index(path, '/');
+	size_t spec_len = 0;
+	if (rest == NULL) {
+		spec_len = strlen(path);
+		rest = path + spec_len;
+	} else {
+		spec_len = rest - path;
+		rest++;
+	}
+
+	git_oid old_id = {};
+	git_oid new_id = {};
+	const struct rogitfs_filter *filter = NULL;
+	if (rogitfs_changes_spec(path, spec_len, &old_id, &new_id, &filter, private) != 0) {
+		return NULL;
+	}
+
+	*result_rest = rest;
+	return rogitfs_changes_build(&old_id, &new_id, filter, private);
+}
+
+static int rogitfs_changes_lookup(const char *path, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
+
+	const char *rest = NULL;
+	struct rogitfs_cache_entry *cache_entry = rogitfs_changes_get(path, &rest, private);
+	if (cache_entry == NULL) {
+		return -1;
+	}
+	int res = rogitfs_pathset_lookup(cache_entry->data, rest, result_entry);
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	return res;
+}
+
+int rogitfs_changes_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_changes_lookup(path, &entry, private) != 0) {
+		return -ENOENT;
+	}
+	if (entry.type != GIT_OBJECT_BLOB) {
+		return -1;
+	}
+
+	return rogitfs_blob_read(&entry.oid, buf, size, offset, private);
+}
+
+int rogitfs_changes_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_changes_lookup(path, &entry, private) != 0) {
+		return -ENOENT;
+	}
+	if (entry.type == GIT_OBJECT_TREE) {
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755
+		};
+		*stbuf = dir_stat;
+		return 0;
+	}
+	if (rogitfs_entry_stat(&entry, private, stbuf) != 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+int rogitfs_changes_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_changes_lookup(path, &entry, private) != 0) {
+		return -1;
+	}
+	if (entry.type != GIT_OBJECT_BLOB || (entry.mode & GIT_FILEMODE_LINK) != GIT_FILEMODE_LINK) {
+		return -1;
+	}
+
+	return rogitfs_blob_readlink(&entry.oid, buf, size, private);
+}
+
+int rogitfs_changes_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (path[0] != '/') {
+		// commits can be listed, commit ranges are only reachable by name
+		struct odb_fill_payload payload = {
+			.buf = buf,
+			.filler = filler,
+			.type = GIT_OBJECT_COMMIT,
+			.private = private
+		};
+		int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
+		if (error != 0) {
+			rogitfs_log_giterr("git_odb_foreach", error);
+			return -ENOENT;
+		}
+		return 0;
+	}
+
+	const char *rest = NULL;
+	struct rogitfs_cache_entry *cache_entry = rogitfs_changes_get(path+1, &rest, private);
+	if (cache_entry == NULL) {
+		return -ENOENT;
+	}
+	int res = rogitfs_pathset_fill(cache_entry->data, rest, buf, filler, private);
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	if (res != 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
@@ -0,0 +1,23 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_CHANGES_H__
+#define __ROGITFS_CHANGES_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /changes/<commit>/...     paths added or modified relative to the first parent
+// /changes/<old>..<new>/... paths added or modified between two commits or trees
+
+int rogitfs_changes_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_changes_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_changes_readlink(const char *path, char *buf, size_t size);
+
+int rogitfs_changes_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+#endif
@@ -15,6 +15,10 @@ int rogitfs_commit_getattr(const char *path, struct stat *stbuf, struct fuse_fil
 
 int rogitfs_commit_readlink(const char *path, char *buf, size_t size);
 
+int rogitfs_commit_getxattr(const char *path, const char *name, char *value, size_t size);
+
+int rogitfs_commit_listxattr(const char *path, char *list, size_t size);
+
 int rogitfs_commit_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
 
 #endif
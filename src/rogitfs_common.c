@@ -2,11 +2,83 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <errno.h>
 #include "rogitfs_common.h"
+#include "rogitfs_submodule.h"
+#include "rogitfs_shm.h"
+#include "rogitfs_pack.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_trace.h"
+#include "rogitfs_logging.h"
+
+// Repository of the current operation when several repositories are mounted
+static __thread struct rogitfs_private *rogitfs_private_current = NULL;
+
+// Private data of the repository the current operation belongs to
+struct rogitfs_private *rogitfs_private_get(void) {
+
+	if (rogitfs_private_current != NULL) {
+		return rogitfs_private_current;
+	}
+	struct fuse_context *context = fuse_get_context();
+	return (struct rogitfs_private*)context->private_data;
+}
+
+void rogitfs_private_set(struct rogitfs_private *private) {
+
+	rogitfs_private_current = private;
+}
+
+// Fill stat for a tree entry, blob sizes are read from the object header only
+int rogitfs_tree_entry_stat(const git_tree_entry *entry, git_odb *odb, struct stat *result_stat) {
 
-int rogitfs_readdir_tree_fill(void *buf, fuse_fill_dir_t filler, git_tree *tree, git_odb *odb) {
+	struct stat entry_stat = {};
+	switch(git_tree_entry_type(entry)) {
+	case GIT_OBJECT_TREE:
+		entry_stat.st_mode = S_IFDIR | 0755;
+	break;
+	case GIT_OBJECT_BLOB:
+
+		// the size of a link is the length of its target, like lstat
+		if ((git_tree_entry_filemode(entry) & GIT_FILEMODE_LINK) == GIT_FILEMODE_LINK) {
+			entry_stat.st_mode = S_IFLNK | 0644;
+		} else {
+			entry_stat.st_mode = S_IFREG | 0644;
+		}
+
+		const git_oid *oid = git_tree_entry_id(entry);
+		size_t size = 0;
+		git_object_t type = GIT_OBJECT_INVALID;
+		struct timespec trace_start = {};
+		rogitfs_trace_start(&trace_start);
+		int error = git_odb_read_header(&size, &type, odb, oid);
+		rogitfs_trace_span("git_odb_read_header", NULL, &trace_start);
+		if (error != 0) {
+			rogitfs_log_giterr("git_odb_read_header", error);
+			return -1;
+		}
+		entry_stat.st_size = size;
+
+	break;
+	case GIT_OBJECT_COMMIT:
+		// gitlink, the submodule is resolved on lookup
+		entry_stat.st_mode = S_IFDIR | 0755;
+	break;
+	default:
+		return 1;
+	break;
+	}
+
+	*result_stat = entry_stat;
+	return 0;
+}
+
+// List the entries of tree, dir is the path of tree below the root tree for the filter
+int rogitfs_readdir_tree_fill(void *buf, fuse_fill_dir_t filler, git_tree *tree, git_odb *odb, const char *dir, const struct rogitfs_filter *filter) {
 
 	size_t entry_count = git_tree_entrycount(tree);
 	if (entry_count == 0) {
@@ -20,35 +92,16 @@ int rogitfs_readdir_tree_fill(void *buf, fuse_fill_dir_t filler, git_tree *tree,
 		}
 
 		const char *name = git_tree_entry_name(entry);
+		if (rogitfs_filter_visible_child(filter, dir, name) == 0) {
+			continue;
+		}
 		struct stat entry_stat = {};
-		switch(git_tree_entry_type(entry)) {
-		case GIT_OBJECT_TREE:
-			entry_stat.st_mode = S_IFDIR | 0755;
-		break;
-		case GIT_OBJECT_BLOB:
-
-			if ((git_tree_entry_filemode(entry) & GIT_FILEMODE_LINK) == GIT_FILEMODE_LINK) {
-				entry_stat.st_mode = S_IFLNK | 0644;
-			} else {
-
-				entry_stat.st_mode = S_IFREG | 0644;
-
-				const git_oid *oid = git_tree_entry_id(entry);
-				git_odb_object *odb_obj = NULL;
-				int error = git_odb_read(&odb_obj, odb, oid);
-				if (error != 0) {
-					const git_error *giterr = git_error_last();
-					fprintf(stderr, "git_odb_read %d %s\n", giterr->klass, giterr->message);
-					return -1;
-				}
-				entry_stat.st_size = git_odb_object_size(odb_obj);
-				git_odb_object_free(odb_obj);
-			}
-
-		break;
-		default:
+		int error = rogitfs_tree_entry_stat(entry, odb, &entry_stat);
+		if (error < 0) {
+			return -1;
+		}
+		if (error > 0) {
 			continue;
-		break;
 		}
 
 		int res = filler(buf, name, &entry_stat, 0, 0);
@@ -75,8 +128,7 @@ int rogitfs_readdir_odb_fill(const git_oid *id, void *fill_payload) {
 	}
 
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_foreach %d %d %s\n", error, giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_foreach", error);
 		git_object_free(obj);
 		return 0;
 	}
@@ -90,39 +142,71 @@ int rogitfs_readdir_odb_fill(const git_oid *id, void *fill_payload) {
 	return res;
 }
 
-int rogitfs_get_path_object(const char *path, git_object **result_obj, git_filemode_t *result_mode, git_repository *repo, git_odb *odb) {
+// Resolve a path starting with an object hash without loading the final object,
+// only trees and commits on the way are read, a leading tag hash is peeled. Gitlinks on the way are followed
+// into their submodule repository.
+int rogitfs_resolve_path(const char *path, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
 
-	char *rest = (char *)path;
-	git_object *obj = NULL;
-	git_filemode_t obj_mode = 0;
+	const char *rest = path;
+	struct rogitfs_entry entry = {};
+	int have_entry = 0;
 	size_t rest_len = strlen(rest);
+	// commit or tree the current repository was entered at, and the path below it
+	struct rogitfs_entry root = {};
+	const char *root_path = NULL;
+	// path below the first object, checked against the filter of commits
+	const struct rogitfs_filter *filter = NULL;
+	const char *filter_path = NULL;
 
 	while(rest_len > 0) {
 
 		// cut off next component
-		char *next_end = index(rest, '/');
+		const char *next_end = index(rest, '/');
 		size_t comp_len = 0;
 		if (next_end == NULL) {
 			comp_len = rest_len;
 		} else {
 			comp_len = next_end-rest;
 		}
-		char comp_buffer[comp_len + 1];
-		memset(comp_buffer, 0, comp_len + 1);
-		strncpy(comp_buffer, rest, comp_len);
 
-		// lookup next component
-		git_object *new_obj = NULL;
-		git_filemode_t new_mode = 0;
-		int error = rogitfs_check_path_component(obj, comp_buffer, &new_obj, &new_mode, repo, odb);
-		if (obj != NULL) {
-			git_object_free(obj);
-		}
-		if (error != 0) {
-			return -ENOENT;
+		if (comp_len > 0) {
+			char comp_buffer[comp_len + 1];
+			memcpy(comp_buffer, rest, comp_len);
+			comp_buffer[comp_len] = 0;
+
+			if (have_entry && entry.mode == GIT_FILEMODE_COMMIT && (entry.flags & ROGITFS_ENTRY_SUBMODULE) == 0) {
+				if (rogitfs_submodule_enter(&root, root_path, rest - 1 - root_path, &entry, private) != 0) {
+					return -ENOENT;
+				}
+				root = entry;
+				root_path = rest;
+			}
+
+			if (have_entry && rogitfs_filter_visible(filter, filter_path, rest + comp_len - filter_path) == 0) {
+				return -ENOENT;
+			}
+
+			// lookup next component
+			struct rogitfs_entry new_entry = {};
+			int error = rogitfs_resolve_component(have_entry ? &entry : NULL, comp_buffer, &new_entry, private);
+			if (error != 0) {
+				return -ENOENT;
+			}
+			entry = new_entry;
+			if (have_entry == 0) {
+				if (entry.type == GIT_OBJECT_TAG && rogitfs_peel_tag(&entry.oid, &entry, private) != 0) {
+					return -ENOENT;
+				}
+				root = entry;
+				root_path = rest + comp_len;
+				if (root_path[0] == '/') {
+					root_path++;
+				}
+				filter = rogitfs_root_filter(&entry, private);
+				filter_path = root_path;
+			}
+			have_entry = 1;
 		}
-		obj = new_obj;
-		obj_mode = new_mode;
 
 		// advance rest
 		if (next_end == NULL) {
@@ -132,98 +216,520 @@ int rogitfs_get_path_object(const char *path, git_object **result_obj, git_filem
 		}
 		rest_len = strlen(rest);
 	}
-	if (obj == NULL) {
+	if (have_entry == 0) {
 		return -ENOENT;
 	}
 
-	*result_obj = obj;
-	*result_mode = obj_mode;
+	if (entry.mode == GIT_FILEMODE_COMMIT && (entry.flags & ROGITFS_ENTRY_SUBMODULE) == 0) {
+		// a submodule that is not available stays an empty directory
+		size_t path_len = strlen(root_path);
+		while (path_len > 0 && root_path[path_len-1] == '/') {
+			path_len--;
+		}
+		rogitfs_submodule_enter(&root, root_path, path_len, &entry, private);
+	}
+
+	*result_entry = entry;
 	return 0;
 }
 
-int rogitfs_check_path_component(git_object *parent_obj, const char *component, git_object **result_obj, git_filemode_t *result_mode, git_repository *repo, git_odb *odb) {
+// Resolve a revision like HEAD, a branch name or a hash to a commit
+int rogitfs_resolve_revision(const char *revision, git_oid *result_oid, git_repository *repo) {
 
-	int error = 0;
+	git_object *obj = NULL;
+	int error = git_revparse_single(&obj, repo, revision);
+	if (error != 0) {
+		return -1;
+	}
+	git_object *commit = NULL;
+	error = git_object_peel(&commit, obj, GIT_OBJECT_COMMIT);
+	git_object_free(obj);
+	if (error != 0) {
+		return -1;
+	}
+	git_oid_cpy(result_oid, git_object_id(commit));
+	git_object_free(commit);
+	return 0;
+}
 
-	if (parent_obj == NULL) {
-		// assume component is an object hash
+git_repository *rogitfs_entry_repo(const struct rogitfs_entry *entry, struct rogitfs_private *private) {
 
-		size_t comp_len = strlen(component);
-		if (comp_len != GIT_OID_HEXSZ) {
+	return entry->repo != NULL ? entry->repo->repo : private->repo;
+}
+
+git_odb *rogitfs_entry_odb(const struct rogitfs_entry *entry, struct rogitfs_private *private) {
+
+	return entry->repo != NULL ? entry->repo->odb : private->odb;
+}
+
+// Key of an object in the resolve cache. Mounted repositories share the
+// cache but not their objects, so keys name the repository, which stays
+// open until unmount.
+#define ROGITFS_RESOLVE_KEY_SIZE (1 + sizeof(git_repository *) + GIT_OID_RAWSZ)
+
+static void rogitfs_resolve_key(unsigned char *key, char kind, git_repository *repo, const git_oid *oid) {
+
+	key[0] = kind;
+	memcpy(key+1, &repo, sizeof(git_repository *));
+	memcpy(key+1+sizeof(git_repository *), oid->id, GIT_OID_RAWSZ);
+}
+
+// Root tree of a commit or tree entry, commit trees are cached in the resolve cache
+int rogitfs_entry_tree_id(const struct rogitfs_entry *entry, git_oid *result_tree_id, struct rogitfs_private *private) {
+
+	switch(entry->type) {
+	case GIT_OBJECT_TREE:
+		git_oid_cpy(result_tree_id, &entry->oid);
+		return 0;
+	break;
+	case GIT_OBJECT_COMMIT:
+		if (entry->mode == GIT_FILEMODE_COMMIT && (entry->flags & ROGITFS_ENTRY_SUBMODULE) == 0) {
+			// submodule commits are not part of this repository
 			return -1;
 		}
+	break;
+	default:
+		return -1;
+	break;
+	}
 
-		git_oid oid = {};
-		error = git_oid_fromstr(&oid, component);
-		if (error != 0) {
-			const git_error *giterr = git_error_last();
-			fprintf(stderr, "git_oid_fromstr %d %s\n", giterr->klass, giterr->message);
+	unsigned char key[ROGITFS_RESOLVE_KEY_SIZE];
+	rogitfs_resolve_key(key, 't', rogitfs_entry_repo(entry, private), &entry->oid);
+	if (rogitfs_cache_lookup(private->resolve_cache, key, sizeof(key), result_tree_id, sizeof(git_oid)) == 0) {
+		return 0;
+	}
+
+	git_commit *commit = NULL;
+	struct timespec trace_start = {};
+	rogitfs_trace_start(&trace_start);
+	int error = git_commit_lookup(&commit, rogitfs_entry_repo(entry, private), &entry->oid);
+	rogitfs_trace_span("git_commit_lookup", NULL, &trace_start);
+	if (error != 0) {
+		rogitfs_log_giterr("git_commit_lookup", error);
+		return -1;
+	}
+	git_oid_cpy(result_tree_id, git_commit_tree_id(commit));
+	git_commit_free(commit);
+	rogitfs_cache_insert(private->resolve_cache, key, sizeof(key), result_tree_id, sizeof(git_oid));
+
+	return 0;
+}
+
+// Root tree of a commit of the mounted repository
+int rogitfs_commit_tree_id(const git_oid *commit_id, git_oid *result_tree_id, struct rogitfs_private *private) {
+
+	struct rogitfs_entry entry = {
+		.type = GIT_OBJECT_COMMIT
+	};
+	git_oid_cpy(&entry.oid, commit_id);
+	return rogitfs_entry_tree_id(&entry, result_tree_id, private);
+}
+
+// Commit or tree an annotated tag points to, following tags of tags.
+// Tags never change, the peeled target is kept in the resolve cache.
+int rogitfs_peel_tag(const git_oid *tag_id, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
+
+	unsigned char key[ROGITFS_RESOLVE_KEY_SIZE];
+	rogitfs_resolve_key(key, 'g', private->repo, tag_id);
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_cache_lookup(private->resolve_cache, key, sizeof(key), &entry, sizeof(entry)) == 0) {
+		*result_entry = entry;
+		return 0;
+	}
+
+	git_oid_cpy(&entry.oid, tag_id);
+	entry.type = GIT_OBJECT_TAG;
+	for (unsigned int depth = 0; entry.type == GIT_OBJECT_TAG; depth++) {
+		if (depth == ROGITFS_TAG_DEPTH) {
+			rogitfs_log_error("rogitfs_peel_tag too many nested tags");
 			return -1;
 		}
-
-		git_object *obj = NULL;
-		error = git_object_lookup(&obj, repo, &oid, GIT_OBJECT_ANY);
+		git_tag *tag = NULL;
+		int error = git_tag_lookup(&tag, private->repo, &entry.oid);
 		if (error != 0) {
-			const git_error *giterr = git_error_last();
-			fprintf(stderr, "git_object_lookup %d %s\n", giterr->klass, giterr->message);
+			rogitfs_log_giterr("git_tag_lookup", error);
 			return -1;
 		}
+		git_oid_cpy(&entry.oid, git_tag_target_id(tag));
+		entry.type = git_tag_target_type(tag);
+		git_tag_free(tag);
+	}
+	if (entry.type != GIT_OBJECT_COMMIT && entry.type != GIT_OBJECT_TREE) {
+		return -1;
+	}
+	rogitfs_cache_insert(private->resolve_cache, key, sizeof(key), &entry, sizeof(entry));
+
+	*result_entry = entry;
+	return 0;
+}
 
-		*result_obj = obj;
+// Object of a hash at the start of a path, a tag is peeled
+int rogitfs_resolve_root(const char *hash, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
 
+	struct rogitfs_entry entry = {};
+	int error = rogitfs_resolve_component(NULL, hash, &entry, private);
+	if (error != 0) {
+		return -1;
+	}
+	if (entry.type == GIT_OBJECT_TAG && rogitfs_peel_tag(&entry.oid, &entry, private) != 0) {
+		return -1;
+	}
+	*result_entry = entry;
+	return 0;
+}
+
+// Filter for the paths below a root object, the rules are relative to the root tree of commits
+// so a tree given by hash could be at any depth and is not filtered
+const struct rogitfs_filter *rogitfs_root_filter(const struct rogitfs_entry *root, struct rogitfs_private *private) {
+
+	if (root->type != GIT_OBJECT_COMMIT) {
+		return NULL;
+	}
+	return private->filter;
+}
+
+// Tree of a commit, tree or tag hash, result_filter is set to the filter for paths below it if not NULL
+int rogitfs_resolve_tree_id(const char *hash, git_oid *result_tree_id, const struct rogitfs_filter **result_filter, struct rogitfs_private *private) {
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_resolve_root(hash, &entry, private) != 0) {
+		return -1;
+	}
+	if (result_filter != NULL) {
+		*result_filter = rogitfs_root_filter(&entry, private);
+	}
+	switch(entry.type) {
+	case GIT_OBJECT_COMMIT:
+		return rogitfs_commit_tree_id(&entry.oid, result_tree_id, private);
+	break;
+	case GIT_OBJECT_TREE:
+		git_oid_cpy(result_tree_id, &entry.oid);
 		return 0;
+	break;
+	default:
+		return -1;
+	break;
+	}
+	return -1;
+}
 
-	} else {
+// Resolve one component below parent, or an object hash if parent is NULL.
+// Results are kept in the resolve cache, keys are prefixed by the lookup kind.
+int rogitfs_resolve_component(const struct rogitfs_entry *parent, const char *component, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
+
+	int error = 0;
+	size_t comp_len = strlen(component);
 
-		git_object_t parent_type = git_object_type(parent_obj);
+	if (parent == NULL) {
+		// assume component is an object hash
 
-		git_tree *tree = NULL;
+		if (comp_len != GIT_OID_HEXSZ) {
+			return -1;
+		}
 
-		switch(parent_type) {
-		case GIT_OBJECT_COMMIT:
-			error = git_commit_tree(&tree, (git_commit *)parent_obj);
+		struct rogitfs_entry entry = {};
+		error = git_oid_fromstr(&entry.oid, component);
+		if (error != 0) {
+			rogitfs_log_giterr("git_oid_fromstr", error);
+			return -1;
+		}
+
+		unsigned char key[ROGITFS_RESOLVE_KEY_SIZE];
+		rogitfs_resolve_key(key, 'o', private->repo, &entry.oid);
+		if (rogitfs_cache_lookup(private->resolve_cache, key, sizeof(key), &entry.type, sizeof(entry.type)) != 0) {
+			size_t size = 0;
+			struct timespec trace_start = {};
+			rogitfs_trace_start(&trace_start);
+			error = git_odb_read_header(&size, &entry.type, private->odb, &entry.oid);
+			rogitfs_trace_span("git_odb_read_header", component, &trace_start);
 			if (error != 0) {
-				const git_error *giterr = git_error_last();
-				fprintf(stderr, "git_commit_tree %d %s\n", giterr->klass, giterr->message);
+				rogitfs_log_giterr("git_odb_read_header", error);
 				return -1;
 			}
-		break;
-		case GIT_OBJECT_TREE:
-			tree = (git_tree *)parent_obj;
-		break;
-		default:
-			// wrong object type
-			return -1;
-		break;
+			rogitfs_cache_insert(private->resolve_cache, key, sizeof(key), &entry.type, sizeof(entry.type));
 		}
 
-		const git_tree_entry *entry = git_tree_entry_byname(tree, component);
-		if (entry == NULL) {
-			if ((git_tree *)parent_obj != tree) {
-				git_tree_free(tree);
-			}
+		*result_entry = entry;
+		return 0;
+	}
+
+	git_oid tree_id = {};
+	if (rogitfs_entry_tree_id(parent, &tree_id, private) != 0) {
+		return -1;
+	}
+
+	unsigned char key[ROGITFS_RESOLVE_KEY_SIZE + comp_len];
+	rogitfs_resolve_key(key, 'e', rogitfs_entry_repo(parent, private), &tree_id);
+	memcpy(key+ROGITFS_RESOLVE_KEY_SIZE, component, comp_len);
+
+	// cached entries are stored without repository, children live in the repository of parent.
+	// Trees never change, so names missing in a tree are cached as entries without type.
+	struct rogitfs_entry entry = {};
+	if (rogitfs_cache_lookup(private->resolve_cache, key, sizeof(key), &entry, sizeof(entry)) == 0) {
+		if (entry.type == GIT_OBJECT_INVALID) {
+			rogitfs_stats_count(ROGITFS_STATS_NEGATIVE_HITS, 1);
 			return -1;
 		}
+		entry.repo = parent->repo;
+		*result_entry = entry;
+		return 0;
+	}
+
+	git_tree *tree = NULL;
+	struct timespec trace_start = {};
+	rogitfs_trace_start(&trace_start);
+	error = git_tree_lookup(&tree, rogitfs_entry_repo(parent, private), &tree_id);
+	rogitfs_trace_span("git_tree_lookup", component, &trace_start);
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		return -1;
+	}
+
+	const git_tree_entry *tree_entry = git_tree_entry_byname(tree, component);
+	if (tree_entry == NULL) {
+		git_tree_free(tree);
+		entry.type = GIT_OBJECT_INVALID;
+		rogitfs_cache_insert(private->resolve_cache, key, sizeof(key), &entry, sizeof(entry));
+		return -1;
+	}
+	git_oid_cpy(&entry.oid, git_tree_entry_id(tree_entry));
+	entry.type = git_tree_entry_type(tree_entry);
+	entry.mode = git_tree_entry_filemode(tree_entry);
+	git_tree_free(tree);
+
+	rogitfs_cache_insert(private->resolve_cache, key, sizeof(key), &entry, sizeof(entry));
 
-		git_object *obj = NULL;
-		error = git_tree_entry_to_object(&obj, repo, entry);
+	entry.repo = parent->repo;
+	*result_entry = entry;
+	return 0;
+}
+
+// Stat for a resolved entry, commit directories carry the commit time
+int rogitfs_entry_stat(const struct rogitfs_entry *entry, struct rogitfs_private *private, struct stat *result_stat) {
+
+	struct stat entry_stat = {};
+
+	git_commit *commit = NULL;
+	size_t size = 0;
+	git_object_t type = GIT_OBJECT_INVALID;
+	int error = 0;
+	struct timespec trace_start = {};
+	switch(entry->type) {
+	case GIT_OBJECT_COMMIT:
+		entry_stat.st_mode = S_IFDIR | 0755;
+
+		if (entry->mode == GIT_FILEMODE_COMMIT && (entry->flags & ROGITFS_ENTRY_SUBMODULE) == 0) {
+			// submodule that is not available
+			break;
+		}
+		rogitfs_trace_start(&trace_start);
+		error = git_commit_lookup(&commit, rogitfs_entry_repo(entry, private), &entry->oid);
+		rogitfs_trace_span("git_commit_lookup", NULL, &trace_start);
 		if (error != 0) {
-			const git_error *giterr = git_error_last();
-			fprintf(stderr, "git_tree_entry_to_object %d %s\n", giterr->klass, giterr->message);
-			if ((git_tree *)parent_obj != tree) {
-				git_tree_free(tree);
-			}
+			rogitfs_log_giterr("git_commit_lookup", error);
 			return -1;
 		}
-		*result_mode = git_tree_entry_filemode(entry);
+		entry_stat.st_mtim.tv_sec = git_commit_time(commit);
+		git_commit_free(commit);
+	break;
+	case GIT_OBJECT_TREE:
+		entry_stat.st_mode = S_IFDIR | 0755;
+	break;
+	case GIT_OBJECT_BLOB:
+		if ((entry->mode & GIT_FILEMODE_LINK) == GIT_FILEMODE_LINK) {
+			entry_stat.st_mode = S_IFLNK | 0644;
+		} else {
+
+			entry_stat.st_mode = S_IFREG | 0644;
+
+			rogitfs_trace_start(&trace_start);
+			error = git_odb_read_header(&size, &type, rogitfs_entry_odb(entry, private), &entry->oid);
+			rogitfs_trace_span("git_odb_read_header", NULL, &trace_start);
+			if (error != 0) {
+				rogitfs_log_giterr("git_odb_read_header", error);
+				return -1;
+			}
+
+			entry_stat.st_size = size;
+
+		}
+	break;
+	default:
+		return -1;
+	break;
+	}
+
+	*result_stat = entry_stat;
+	return 0;
+}
+
+// Read an object, objects of the mounted repository are taken from shared
+// alternates first, so objects of forks are inflated and cached only once
+int rogitfs_odb_read(git_odb_object **result_obj, git_odb *odb, const git_oid *oid, struct rogitfs_private *private) {
+
+	rogitfs_stats_count(ROGITFS_STATS_ODB_READS, 1);
+	if (odb == private->odb) {
+		for (unsigned int i = 0; i < private->alternate_count; i++) {
+			// a miss must not rescan the pack directory of the alternate
+			if (git_odb_exists_ext(private->alternates[i], oid, GIT_ODB_LOOKUP_NO_REFRESH) == 1) {
+				odb = private->alternates[i];
+				break;
+			}
+		}
+	}
+	struct timespec trace_start = {};
+	rogitfs_trace_start(&trace_start);
+	int error = git_odb_read(result_obj, odb, oid);
+	rogitfs_trace_span("git_odb_read", NULL, &trace_start);
+	if (error == 0) {
+		rogitfs_stats_count(ROGITFS_STATS_BYTES_INFLATED, git_odb_object_size(*result_obj));
+	}
+	return error;
+}
+
+static int rogitfs_odb_blob_read(git_odb *odb, const git_oid *oid, char *buf, size_t size, off_t offset, struct rogitfs_private *private) {
 
-		if ((git_tree *)parent_obj != tree) {
-			git_tree_free(tree);
+	if (private->shm != NULL) {
+		int res = rogitfs_shm_read(private->shm, oid, buf, size, offset);
+		if (res >= 0) {
+			rogitfs_stats_count(ROGITFS_STATS_SHM_HITS, 1);
+			return res;
 		}
+		rogitfs_stats_count(ROGITFS_STATS_SHM_MISSES, 1);
+	} else if (odb == private->odb) {
+		// objects of the packs are read without libgit2, the shared cache
+		// needs the whole blob and takes the way through libgit2
+		size_t read_size = 0;
+		if (rogitfs_pack_read(private->packs, private->delta_cache, oid, buf, size, offset, &read_size) == 0) {
+			return read_size;
+		}
+	}
+
+	git_odb_object *odb_obj = NULL;
+	int error = rogitfs_odb_read(&odb_obj, odb, oid, private);
+	if (error != 0) {
+		rogitfs_log_giterr("git_odb_read", error);
+		return -1;
+	}
 
-		*result_obj = obj;
+	const void *data = git_odb_object_data(odb_obj);
+	if (data == NULL) {
+		rogitfs_log_error("git_odb_object_data is NULL");
+		git_odb_object_free(odb_obj);
+		return -1;
+	}
+
+	size_t objlen = git_odb_object_size(odb_obj);
+	if (private->shm != NULL) {
+		rogitfs_shm_insert(private->shm, oid, data, objlen);
+	}
+
+	if (offset >= objlen) {
+		git_odb_object_free(odb_obj);
 		return 0;
 	}
+	size_t toread = size;
+	size_t end = offset + toread;
+	if (end > objlen) {
+		toread = toread-(end-objlen);
+	}
+
+	memcpy(buf, data+offset, toread);
+
+	git_odb_object_free(odb_obj);
+
+	return toread;
+}
+
+static int rogitfs_odb_blob_readlink(git_odb *odb, const git_oid *oid, char *buf, size_t size, struct rogitfs_private *private) {
+
+	if (size == 0) {
+		return -1;
+	}
+	int res = rogitfs_odb_blob_read(odb, oid, buf, size-1, 0, private);
+	if (res < 0) {
+		return -1;
+	}
+	buf[res] = 0;
+	return 0;
+}
+
+// Copy a slice of blob content, returns the number of bytes read
+int rogitfs_blob_read(const git_oid *oid, char *buf, size_t size, off_t offset, struct rogitfs_private *private) {
+
+	return rogitfs_odb_blob_read(private->odb, oid, buf, size, offset, private);
+}
+
+// Copy symlink target stored in a blob as NUL terminated string
+int rogitfs_blob_readlink(const git_oid *oid, char *buf, size_t size, struct rogitfs_private *private) {
+
+	return rogitfs_odb_blob_readlink(private->odb, oid, buf, size, private);
+}
+
+// Like rogitfs_blob_read for a blob of any repository
+int rogitfs_entry_read(const struct rogitfs_entry *entry, char *buf, size_t size, off_t offset, struct rogitfs_private *private) {
+
+	return rogitfs_odb_blob_read(rogitfs_entry_odb(entry, private), &entry->oid, buf, size, offset, private);
+}
+
+int rogitfs_entry_readlink(const struct rogitfs_entry *entry, char *buf, size_t size, struct rogitfs_private *private) {
+
+	return rogitfs_odb_blob_readlink(rogitfs_entry_odb(entry, private), &entry->oid, buf, size, private);
+}
+
+int rogitfs_buffer_append(struct rogitfs_buffer *buffer, const void *data, size_t size) {
+
+	if (buffer->size + size > buffer->capacity) {
+		size_t new_capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+		while (new_capacity < buffer->size + size) {
+			new_capacity = new_capacity * 2;
+		}
+		char *new_data = (char *) realloc(buffer->data, new_capacity);
+		if (new_data == NULL) {
+			rogitfs_log_error("rogitfs_buffer_append realloc failed");
+			return -1;
+		}
+		buffer->data = new_data;
+		buffer->capacity = new_capacity;
+	}
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	return 0;
+}
+
+int rogitfs_buffer_printf(struct rogitfs_buffer *buffer, const char *format, ...) {
+
+	char line[512];
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if (len < 0) {
+		return -1;
+	}
+	if (len < sizeof(line)) {
+		return rogitfs_buffer_append(buffer, line, len);
+	}
+
+	char *long_line = (char *) malloc(len + 1);
+	if (long_line == NULL) {
+		return -1;
+	}
+	va_start(args, format);
+	vsnprintf(long_line, len + 1, format, args);
+	va_end(args);
+	int res = rogitfs_buffer_append(buffer, long_line, len);
+	free(long_line);
+	return res;
+}
+
+void rogitfs_buffer_free(struct rogitfs_buffer *buffer) {
+
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->capacity = 0;
 }
 
 int path_component(const char *path, unsigned int find_index, const char **result_comp, unsigned int *result_comp_size) {
@@ -8,10 +8,88 @@
 
 #include <fuse3/fuse.h>
 #include <git2.h>
+#include <pthread.h>
+#include "rogitfs_cache.h"
+
+#define ROGITFS_MANIFEST_CACHE_SIZE (64 * 1024 * 1024)
+#define ROGITFS_RESOLVE_CACHE_SIZE (16 * 1024 * 1024)
+#define ROGITFS_CHANGES_CACHE_SIZE (32 * 1024 * 1024)
+#define ROGITFS_DELTA_CACHE_SIZE (64 * 1024 * 1024)
+// cost of rebuilding an entry for the memory governor, cheap caches give
+// up memory first
+#define ROGITFS_MANIFEST_CACHE_COST 8
+#define ROGITFS_RESOLVE_CACHE_COST 1
+#define ROGITFS_CHANGES_CACHE_COST 4
+#define ROGITFS_DELTA_CACHE_COST 2
+// tags of tags followed before giving up
+#define ROGITFS_TAG_DEPTH 16
+
+struct rogitfs_graph;
+struct rogitfs_repo;
+struct rogitfs_shm;
+struct rogitfs_filter;
+struct rogitfs_reftree_snapshot;
+struct rogitfs_trigram_index;
+struct rogitfs_packs;
 
 struct rogitfs_private {
 	git_repository *repo;
 	git_odb *odb;
+	// packs mapped for reading whole objects without libgit2, NULL without packs
+	struct rogitfs_packs *packs;
+	struct rogitfs_cache *manifest_cache;
+	struct rogitfs_cache *resolve_cache;
+	struct rogitfs_cache *changes_cache;
+	// objects of the packs with their deltas applied, sized by delta_cache_size
+	// or ROGITFS_DELTA_CACHE_SIZE when 0
+	struct rogitfs_cache *delta_cache;
+	size_t delta_cache_size;
+	// commit graph, replaced when commits appear that are not part of it
+	pthread_mutex_t graph_lock;
+	struct rogitfs_graph *graph;
+	// optional, enabled by --trigram-index
+	struct rogitfs_trigram_index *trigram_index;
+	// submodule repositories, opened on first use and kept until unmount
+	pthread_mutex_t repos_lock;
+	struct rogitfs_repo *repos;
+	// object databases of alternates shared with other mounted repositories
+	git_odb **alternates;
+	unsigned int alternate_count;
+	// optional blob cache shared with other processes, enabled by --shared-cache
+	struct rogitfs_shm *shm;
+	// paths hidden by --include and --exclude, NULL shows everything
+	const struct rogitfs_filter *filter;
+	// references resolved for /tree, taken again after ref_ttl seconds
+	pthread_mutex_t reftree_lock;
+	struct rogitfs_reftree_snapshot *reftree;
+	unsigned int ref_ttl;
+};
+
+// entry is a gitlink whose commit was found in the submodule repository
+#define ROGITFS_ENTRY_SUBMODULE 1
+
+// Result of a path resolution, the object itself is not loaded
+struct rogitfs_entry {
+	git_oid oid;
+	git_object_t type;
+	git_filemode_t mode;
+	unsigned int flags;
+	// repository holding the object, NULL for the mounted repository
+	struct rogitfs_repo *repo;
+};
+
+// An additional repository, like a submodule below .git/modules
+struct rogitfs_repo {
+	git_repository *repo;
+	git_odb *odb;
+	char *gitdir;
+	struct rogitfs_repo *next;
+};
+
+struct rogitfs_buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
 };
 
 struct odb_fill_payload {
@@ -21,13 +99,55 @@ struct odb_fill_payload {
 	struct rogitfs_private *private;
 };
 
-int rogitfs_readdir_tree_fill(void *buf, fuse_fill_dir_t filler, git_tree *tree, git_odb *odb);
+struct rogitfs_private *rogitfs_private_get(void);
+
+void rogitfs_private_set(struct rogitfs_private *private);
+
+int rogitfs_tree_entry_stat(const git_tree_entry *entry, git_odb *odb, struct stat *result_stat);
+
+int rogitfs_readdir_tree_fill(void *buf, fuse_fill_dir_t filler, git_tree *tree, git_odb *odb, const char *dir, const struct rogitfs_filter *filter);
 
 int rogitfs_readdir_odb_fill(const git_oid *id, void *payload);
 
-int rogitfs_get_path_object(const char *path, git_object **result_obj, git_filemode_t *result_mode, git_repository *repo, git_odb *odb);
+int rogitfs_resolve_path(const char *path, struct rogitfs_entry *result_entry, struct rogitfs_private *private);
+
+int rogitfs_resolve_component(const struct rogitfs_entry *parent, const char *component, struct rogitfs_entry *result_entry, struct rogitfs_private *private);
+
+int rogitfs_resolve_revision(const char *revision, git_oid *result_oid, git_repository *repo);
+
+git_repository *rogitfs_entry_repo(const struct rogitfs_entry *entry, struct rogitfs_private *private);
+
+git_odb *rogitfs_entry_odb(const struct rogitfs_entry *entry, struct rogitfs_private *private);
+
+int rogitfs_entry_tree_id(const struct rogitfs_entry *entry, git_oid *result_tree_id, struct rogitfs_private *private);
+
+int rogitfs_commit_tree_id(const git_oid *commit_id, git_oid *result_tree_id, struct rogitfs_private *private);
+
+int rogitfs_peel_tag(const git_oid *tag_id, struct rogitfs_entry *result_entry, struct rogitfs_private *private);
+
+int rogitfs_resolve_root(const char *hash, struct rogitfs_entry *result_entry, struct rogitfs_private *private);
+
+const struct rogitfs_filter *rogitfs_root_filter(const struct rogitfs_entry *root, struct rogitfs_private *private);
+
+int rogitfs_resolve_tree_id(const char *hash, git_oid *result_tree_id, const struct rogitfs_filter **result_filter, struct rogitfs_private *private);
+
+int rogitfs_entry_stat(const struct rogitfs_entry *entry, struct rogitfs_private *private, struct stat *result_stat);
+
+int rogitfs_odb_read(git_odb_object **result_obj, git_odb *odb, const git_oid *oid, struct rogitfs_private *private);
+
+int rogitfs_blob_read(const git_oid *oid, char *buf, size_t size, off_t offset, struct rogitfs_private *private);
+
+int rogitfs_blob_readlink(const git_oid *oid, char *buf, size_t size, struct rogitfs_private *private);
+
+int rogitfs_entry_read(const struct rogitfs_entry *entry, char *buf, size_t size, off_t offset, struct rogitfs_private *private);
+
+int rogitfs_entry_readlink(const struct rogitfs_entry *entry, char *buf, size_t size, struct rogitfs_private *private);
+
+int rogitfs_buffer_append(struct rogitfs_buffer *buffer, const void *data, size_t size);
+
+int rogitfs_buffer_printf(struct rogitfs_buffer *buffer, const char *format, ...);
 
-int rogitfs_check_path_component(git_object *obj, const char *component, git_object **result_obj, git_filemode_t *result_mode, git_repository *repo, git_odb *odb);
+void rogitfs_buffer_free(struct rogitfs_buffer *buffer);
 
 int path_component(const char *path, unsigned int index, const char **result_comp, unsigned int *result_comp_size);
 
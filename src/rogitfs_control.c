@@ -0,0 +1,111 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_control.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_trace.h"
+
+struct rogitfs_control_file {
+	const char *name;
+	int (*generate)(struct rogitfs_buffer *out, struct rogitfs_private *private);
+};
+
+static const struct rogitfs_control_file rogitfs_control_files[] = {
+	{"stats", &rogitfs_stats_report},
+	{"trace", &rogitfs_trace_report},
+};
+
+#define ROGITFS_CONTROL_FILE_COUNT (sizeof(rogitfs_control_files) / sizeof(rogitfs_control_files[0]))
+
+static const struct rogitfs_control_file *rogitfs_control_find(const char *path) {
+
+	for (unsigned int i = 0; i < ROGITFS_CONTROL_FILE_COUNT; i++) {
+		if (strcmp(rogitfs_control_files[i].name, path) == 0) {
+			return &rogitfs_control_files[i];
+		}
+	}
+	return NULL;
+}
+
+int rogitfs_control_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	if (rogitfs_control_find(path) == NULL) {
+		return -ENOENT;
+	}
+	// size is unknown until the content is generated
+	struct stat file_stat = {
+		.st_mode = S_IFREG | 0444
+	};
+	*stbuf = file_stat;
+	return 0;
+}
+
+int rogitfs_control_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] != 0) {
+		return -ENOENT;
+	}
+	struct stat file_stat = {.st_mode = S_IFREG | 0444};
+	for (unsigned int i = 0; i < ROGITFS_CONTROL_FILE_COUNT; i++) {
+		int res = filler(buf, rogitfs_control_files[i].name, &file_stat, 0, 0);
+		if (res != 0) {
+			return -ENOENT;
+		}
+	}
+	return 0;
+}
+
+int rogitfs_control_open(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	const struct rogitfs_control_file *file = rogitfs_control_find(path);
+	if (file == NULL) {
+		return -ENOENT;
+	}
+	struct rogitfs_buffer *content = (struct rogitfs_buffer *) calloc(1, sizeof(struct rogitfs_buffer));
+	if (content == NULL) {
+		return -ENOMEM;
+	}
+	if (file->generate(content, private) != 0) {
+		rogitfs_buffer_free(content);
+		free(content);
+		return -EIO;
+	}
+
+	fi->fh = (uint64_t)content;
+	fi->direct_io = 1;
+	return 0;
+}
+
+int rogitfs_control_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	if (fi == NULL || fi->fh == 0) {
+		return -EBADF;
+	}
+	struct rogitfs_buffer *content = (struct rogitfs_buffer *)fi->fh;
+	if (offset >= content->size) {
+		return 0;
+	}
+	if (size > content->size - offset) {
+		size = content->size - offset;
+	}
+	memcpy(buf, content->data + offset, size);
+	return size;
+}
+
+int rogitfs_control_release(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_buffer *content = (struct rogitfs_buffer *)fi->fh;
+	if (content != NULL) {
+		rogitfs_buffer_free(content);
+		free(content);
+	}
+	fi->fh = 0;
+	return 0;
+}
@@ -0,0 +1,28 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_CONTROL_H__
+#define __ROGITFS_CONTROL_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include "rogitfs_common.h"
+
+// /.rogitfs/stats         operation counters, latency histograms and cache hit rates
+// /.rogitfs/trace         recent spans as Chrome trace JSON, empty without --trace
+//
+// Files below /.rogitfs describe the running process, their content is
+// generated when they are opened.
+
+int rogitfs_control_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_control_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+int rogitfs_control_open(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_control_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_control_release(const char *path, struct fuse_file_info *fi);
+
+#endif
@@ -0,0 +1,188 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_stream.h"
+#include "rogitfs_diff.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_diff_state {
+	git_diff *diff;
+	size_t delta_index;
+	size_t delta_count;
+	const struct rogitfs_filter *filter;
+};
+
+// Parse <old>..<new>.patch into two trees, paths are only filtered if both are commits
+static int rogitfs_diff_spec(const char *path, git_oid *result_old, git_oid *result_new, const struct rogitfs_filter **result_filter, struct rogitfs_private *private) {
+
+	size_t path_len = strlen(path);
+	if (path_len != 2 * GIT_OID_HEXSZ + 2 + 6) {
+		return -1;
+	}
+	if (strncmp(path + GIT_OID_HEXSZ, "..", 2) != 0 || strcmp(path + 2 * GIT_OID_HEXSZ + 2, ".patch") != 0) {
+		return -1;
+	}
+
+	char hash[GIT_OID_HEXSZ+1] = {};
+	const struct rogitfs_filter *old_filter = NULL;
+	const struct rogitfs_filter *new_filter = NULL;
+	memcpy(hash, path, GIT_OID_HEXSZ);
+	if (rogitfs_resolve_tree_id(hash, result_old, &old_filter, private) != 0) {
+		return -1;
+	}
+	memcpy(hash, path + GIT_OID_HEXSZ + 2, GIT_OID_HEXSZ);
+	if (rogitfs_resolve_tree_id(hash, result_new, &new_filter, private) != 0) {
+		return -1;
+	}
+	*result_filter = old_filter != NULL ? new_filter : NULL;
+	return 0;
+}
+
+// One file patch per record
+static int rogitfs_diff_next(struct rogitfs_stream *stream, struct rogitfs_buffer *out) {
+
+	struct rogitfs_diff_state *state = (struct rogitfs_diff_state *)stream->state;
+
+	if (state->delta_index >= state->delta_count) {
+		return 1;
+	}
+
+	const git_diff_delta *delta = git_diff_get_delta(state->diff, state->delta_index);
+	const char *delta_path = delta->new_file.path != NULL ? delta->new_file.path : delta->old_file.path;
+	if (rogitfs_filter_visible(state->filter, delta_path, strlen(delta_path)) == 0
+		&& rogitfs_filter_visible(state->filter, delta->old_file.path, strlen(delta->old_file.path)) == 0) {
+		state->delta_index++;
+		return 0;
+	}
+
+	git_patch *patch = NULL;
+	int error = git_patch_from_diff(&patch, state->diff, state->delta_index);
+	if (error != 0) {
+		rogitfs_log_giterr("git_patch_from_diff", error);
+		return -1;
+	}
+	state->delta_index++;
+	if (patch == NULL) {
+		// unchanged entry
+		return 0;
+	}
+
+	git_buf patch_buf = {};
+	error = git_patch_to_buf(&patch_buf, patch);
+	git_patch_free(patch);
+	if (error != 0) {
+		rogitfs_log_giterr("git_patch_to_buf", error);
+		return -1;
+	}
+	int res = rogitfs_buffer_append(out, patch_buf.ptr, patch_buf.size);
+	git_buf_dispose(&patch_buf);
+
+	return res;
+}
+
+static int rogitfs_diff_seek(struct rogitfs_stream *stream, unsigned long long position) {
+
+	struct rogitfs_diff_state *state = (struct rogitfs_diff_state *)stream->state;
+	state->delta_index = position;
+	return 0;
+}
+
+static void rogitfs_diff_free(void *state_data) {
+
+	struct rogitfs_diff_state *state = (struct rogitfs_diff_state *)state_data;
+	git_diff_free(state->diff);
+	free(state);
+}
+
+int rogitfs_diff_open(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid old_id = {};
+	git_oid new_id = {};
+	const struct rogitfs_filter *filter = NULL;
+	if (rogitfs_diff_spec(path, &old_id, &new_id, &filter, private) != 0) {
+		return -ENOENT;
+	}
+
+	git_tree *old_tree = NULL;
+	git_tree *new_tree = NULL;
+	int error = git_tree_lookup(&old_tree, private->repo, &old_id);
+	if (error == 0) {
+		error = git_tree_lookup(&new_tree, private->repo, &new_id);
+	}
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		git_tree_free(old_tree);
+		return -ENOENT;
+	}
+
+	// only the list of changed files is computed here, patches follow the reader
+	git_diff *diff = NULL;
+	error = git_diff_tree_to_tree(&diff, private->repo, old_tree, new_tree, NULL);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	if (error != 0) {
+		rogitfs_log_giterr("git_diff_tree_to_tree", error);
+		return -EIO;
+	}
+
+	struct rogitfs_diff_state *state = (struct rogitfs_diff_state *) calloc(1, sizeof(struct rogitfs_diff_state));
+	if (state == NULL) {
+		git_diff_free(diff);
+		return -ENOMEM;
+	}
+	state->diff = diff;
+	state->delta_count = git_diff_num_deltas(diff);
+	state->filter = filter;
+
+	struct rogitfs_stream *stream = rogitfs_stream_new(state, &rogitfs_diff_next, &rogitfs_diff_seek, &rogitfs_diff_free);
+	if (stream == NULL) {
+		rogitfs_diff_free(state);
+		return -ENOMEM;
+	}
+
+	fi->fh = (uint64_t)stream;
+	// size is unknown until the end is generated
+	fi->direct_io = 1;
+	return 0;
+}
+
+int rogitfs_diff_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	if (fi == NULL || fi->fh == 0) {
+		return -EBADF;
+	}
+	return rogitfs_stream_read((struct rogitfs_stream *)fi->fh, buf, size, offset);
+}
+
+int rogitfs_diff_release(const char *path, struct fuse_file_info *fi) {
+
+	rogitfs_stream_free((struct rogitfs_stream *)fi->fh);
+	fi->fh = 0;
+	return 0;
+}
+
+int rogitfs_diff_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid old_id = {};
+	git_oid new_id = {};
+	const struct rogitfs_filter *filter = NULL;
+	if (rogitfs_diff_spec(path, &old_id, &new_id, &filter, private) != 0) {
+		return -ENOENT;
+	}
+
+	struct stat diff_stat = {
+		.st_mode = S_IFREG | 0444
+	};
+	*stbuf = diff_stat;
+	return 0;
+}
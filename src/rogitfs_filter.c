@@ -0,0 +1,148 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include "rogitfs_filter.h"
+
+int rogitfs_filter_add(struct rogitfs_filter *filter, const char *pattern, int exclude) {
+
+	// leading and trailing slashes are ignored
+	while (pattern[0] == '/') {
+		pattern++;
+	}
+	size_t size = strlen(pattern);
+	while (size > 0 && pattern[size-1] == '/') {
+		size--;
+	}
+	if (size == 0) {
+		return -1;
+	}
+
+	struct rogitfs_filter_rule rule = {
+		.size = size,
+		.literal = strpbrk(pattern, "*?[\\") == NULL || strpbrk(pattern, "*?[\\") >= pattern + size
+	};
+	rule.pattern = strndup(pattern, size);
+	rule.ends = (size_t *) malloc((size + 1) * sizeof(size_t));
+	if (rule.pattern == NULL || rule.ends == NULL) {
+		free(rule.pattern);
+		free(rule.ends);
+		return -1;
+	}
+	for (size_t i = 0; i <= size; i++) {
+		if (i == size || rule.pattern[i] == '/') {
+			rule.ends[rule.components++] = i;
+		}
+	}
+
+	struct rogitfs_filter_rule **rules = exclude ? &filter->excludes : &filter->includes;
+	unsigned int *count = exclude ? &filter->exclude_count : &filter->include_count;
+	struct rogitfs_filter_rule *new_rules = (struct rogitfs_filter_rule *) realloc(*rules, (*count + 1) * sizeof(struct rogitfs_filter_rule));
+	if (new_rules == NULL) {
+		free(rule.pattern);
+		free(rule.ends);
+		return -1;
+	}
+	new_rules[*count] = rule;
+	*rules = new_rules;
+	(*count)++;
+	return 0;
+}
+
+void rogitfs_filter_free(struct rogitfs_filter *filter) {
+
+	for (unsigned int i = 0; i < filter->include_count; i++) {
+		free(filter->includes[i].pattern);
+		free(filter->includes[i].ends);
+	}
+	for (unsigned int i = 0; i < filter->exclude_count; i++) {
+		free(filter->excludes[i].pattern);
+		free(filter->excludes[i].ends);
+	}
+	free(filter->includes);
+	free(filter->excludes);
+	memset(filter, 0, sizeof(struct rogitfs_filter));
+}
+
+// Match the first components of rule against a path with as many components
+static int rogitfs_filter_match(const struct rogitfs_filter_rule *rule, unsigned int components, const char *path, size_t path_size) {
+
+	size_t pattern_size = rule->ends[components-1];
+	if (rule->literal) {
+		return pattern_size == path_size && memcmp(rule->pattern, path, path_size) == 0;
+	}
+	char pattern[pattern_size + 1];
+	memcpy(pattern, rule->pattern, pattern_size);
+	pattern[pattern_size] = 0;
+	char string[path_size + 1];
+	memcpy(string, path, path_size);
+	string[path_size] = 0;
+	return fnmatch(pattern, string, FNM_PATHNAME) == 0;
+}
+
+// Whether path, relative to the root tree, may be listed and resolved
+int rogitfs_filter_visible(const struct rogitfs_filter *filter, const char *path, size_t path_size) {
+
+	if (filter == NULL || path_size == 0 || (filter->include_count == 0 && filter->exclude_count == 0)) {
+		return 1;
+	}
+
+	int included = filter->include_count == 0;
+	unsigned int components = 0;
+	for (size_t i = 0; i <= path_size; i++) {
+		if (i < path_size && path[i] != '/') {
+			continue;
+		}
+		// path[0..i) is the leading part with one more component
+		components++;
+		for (unsigned int r = 0; r < filter->exclude_count; r++) {
+			const struct rogitfs_filter_rule *rule = &filter->excludes[r];
+			if (rule->components == components && rogitfs_filter_match(rule, components, path, i)) {
+				return 0;
+			}
+		}
+		for (unsigned int r = 0; included == 0 && r < filter->include_count; r++) {
+			const struct rogitfs_filter_rule *rule = &filter->includes[r];
+			if (rule->components == components && rogitfs_filter_match(rule, components, path, i)) {
+				included = 1;
+			}
+		}
+	}
+	if (included) {
+		return 1;
+	}
+
+	// directories leading to included paths
+	for (unsigned int r = 0; r < filter->include_count; r++) {
+		const struct rogitfs_filter_rule *rule = &filter->includes[r];
+		if (rule->components > components && rogitfs_filter_match(rule, components, path, path_size)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int rogitfs_filter_visible_child(const struct rogitfs_filter *filter, const char *dir, const char *name) {
+
+	if (filter == NULL) {
+		return 1;
+	}
+	size_t dir_size = strlen(dir);
+	while (dir_size > 0 && dir[dir_size-1] == '/') {
+		dir_size--;
+	}
+	size_t name_size = strlen(name);
+	char path[dir_size + 1 + name_size + 1];
+	size_t path_size = 0;
+	if (dir_size > 0) {
+		memcpy(path, dir, dir_size);
+		path[dir_size] = '/';
+		path_size = dir_size + 1;
+	}
+	memcpy(path + path_size, name, name_size);
+	path_size += name_size;
+	return rogitfs_filter_visible(filter, path, path_size);
+}
@@ -0,0 +1,41 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_FILTER_H__
+#define __ROGITFS_FILTER_H__
+
+#include <stddef.h>
+
+// Path rules from --include and --exclude, applied to paths below the root tree of commits.
+//
+// Patterns are relative to the root tree, `*`, `?` and `[...]` do not match `/`.
+// A pattern matching a directory covers everything below it.
+// Without include rules every path is visible, otherwise only included paths
+// and the directories leading to them. Exclude rules take precedence.
+
+struct rogitfs_filter_rule {
+	char *pattern;
+	size_t size;
+	// end offsets of the components in pattern
+	size_t *ends;
+	unsigned int components;
+	// no wildcards, compared with memcmp
+	int literal;
+};
+
+struct rogitfs_filter {
+	struct rogitfs_filter_rule *includes;
+	unsigned int include_count;
+	struct rogitfs_filter_rule *excludes;
+	unsigned int exclude_count;
+};
+
+int rogitfs_filter_add(struct rogitfs_filter *filter, const char *pattern, int exclude);
+
+void rogitfs_filter_free(struct rogitfs_filter *filter);
+
+int rogitfs_filter_visible(const struct rogitfs_filter *filter, const char *path, size_t path_size);
+
+int rogitfs_filter_visible_child(const struct rogitfs_filter *filter, const char *dir, const char *name);
+
+#endif
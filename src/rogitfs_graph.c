@@ -0,0 +1,1125 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rogitfs_graph.h"
+#include "rogitfs_logging.h"
+
+#define ROGITFS_GRAPH_CHUNK_OIDF 0x4f494446
+#define ROGITFS_GRAPH_CHUNK_OIDL 0x4f49444c
+#define ROGITFS_GRAPH_CHUNK_CDAT 0x43444154
+#define ROGITFS_GRAPH_CHUNK_EDGE 0x45444745
+#define ROGITFS_GRAPH_CHUNK_BIDX 0x42494458
+#define ROGITFS_GRAPH_CHUNK_BDAT 0x42444154
+#define ROGITFS_GRAPH_BDAT_HEADER 12
+#define ROGITFS_GRAPH_PARENT_NONE 0x70000000
+#define ROGITFS_GRAPH_EXTRA_EDGES 0x80000000
+#define ROGITFS_GRAPH_EDGE_MASK 0x7fffffff
+#define ROGITFS_GRAPH_CDAT_SIZE (GIT_OID_RAWSZ + 16)
+// parent entries with this bit refer to builder->pending
+#define ROGITFS_GRAPH_PENDING 0x80000000u
+
+struct rogitfs_graph_builder {
+	struct rogitfs_graph *graph;
+	unsigned int capacity;
+	unsigned int parent_count;
+	unsigned int parent_capacity;
+	git_oid *pending;
+	unsigned int pending_count;
+	unsigned int pending_capacity;
+	git_oid *queue;
+	unsigned int queue_count;
+	unsigned int queue_capacity;
+	struct rogitfs_buffer bloom;
+	int have_bloom;
+	git_repository *repo;
+};
+
+static unsigned int rogitfs_graph_get32(const unsigned char *data) {
+
+	return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | (unsigned int)data[3];
+}
+
+static unsigned long long rogitfs_graph_get64(const unsigned char *data) {
+
+	return ((unsigned long long)rogitfs_graph_get32(data) << 32) | rogitfs_graph_get32(data + 4);
+}
+
+static unsigned int rogitfs_graph_hash(const git_oid *oid) {
+
+	return ((unsigned int)oid->id[0] << 24) | ((unsigned int)oid->id[1] << 16) | ((unsigned int)oid->id[2] << 8) | (unsigned int)oid->id[3];
+}
+
+static int rogitfs_graph_grow(void **array, unsigned int *capacity, unsigned int needed, size_t element_size) {
+
+	if (needed <= *capacity) {
+		return 0;
+	}
+	unsigned int new_capacity = *capacity == 0 ? 1024 : *capacity;
+	while (new_capacity < needed) {
+		new_capacity = new_capacity * 2;
+	}
+	void *new_array = realloc(*array, new_capacity * element_size);
+	if (new_array == NULL) {
+		rogitfs_log_error("rogitfs_graph realloc failed");
+		return -1;
+	}
+	*array = new_array;
+	*capacity = new_capacity;
+	return 0;
+}
+
+int rogitfs_graph_lookup(const struct rogitfs_graph *graph, const git_oid *oid, unsigned int *result_index) {
+
+	if (graph->table == NULL) {
+		return -1;
+	}
+	unsigned int slot = rogitfs_graph_hash(oid) & graph->table_mask;
+	while (graph->table[slot] != ROGITFS_GRAPH_NONE) {
+		unsigned int index = graph->table[slot];
+		if (git_oid_equal(&graph->oids[index], oid)) {
+			*result_index = index;
+			return 0;
+		}
+		slot = (slot + 1) & graph->table_mask;
+	}
+	return -1;
+}
+
+static int rogitfs_graph_table_insert(struct rogitfs_graph *graph, unsigned int index) {
+
+	// keep the load factor below one half
+	if (graph->table == NULL || (index + 1) * 2 > graph->table_mask + 1) {
+		unsigned int size = graph->table == NULL ? 4096 : (graph->table_mask + 1) * 2;
+		while (size < (index + 1) * 2) {
+			size = size * 2;
+		}
+		unsigned int *table = (unsigned int *) malloc(size * sizeof(unsigned int));
+		if (table == NULL) {
+			return -1;
+		}
+		memset(table, 0xff, size * sizeof(unsigned int));
+		free(graph->table);
+		graph->table = table;
+		graph->table_mask = size - 1;
+		for (unsigned int i = 0; i < index; i++) {
+			unsigned int slot = rogitfs_graph_hash(&graph->oids[i]) & graph->table_mask;
+			while (table[slot] != ROGITFS_GRAPH_NONE) {
+				slot = (slot + 1) & graph->table_mask;
+			}
+			table[slot] = i;
+		}
+	}
+	unsigned int slot = rogitfs_graph_hash(&graph->oids[index]) & graph->table_mask;
+	while (graph->table[slot] != ROGITFS_GRAPH_NONE) {
+		slot = (slot + 1) & graph->table_mask;
+	}
+	graph->table[slot] = index;
+	return 0;
+}
+
+static int rogitfs_graph_add_node(struct rogitfs_graph_builder *builder, const git_oid *oid, const git_oid *tree, long long time) {
+
+	struct rogitfs_graph *graph = builder->graph;
+	unsigned int capacity = builder->capacity;
+	unsigned int needed = graph->count + 2;
+	if (rogitfs_graph_grow((void **)&graph->oids, &capacity, needed, sizeof(git_oid)) != 0) {
+		return -1;
+	}
+	capacity = builder->capacity;
+	if (rogitfs_graph_grow((void **)&graph->trees, &capacity, needed, sizeof(git_oid)) != 0) {
+		return -1;
+	}
+	capacity = builder->capacity;
+	if (rogitfs_graph_grow((void **)&graph->times, &capacity, needed, sizeof(long long)) != 0) {
+		return -1;
+	}
+	capacity = builder->capacity;
+	if (rogitfs_graph_grow((void **)&graph->parent_start, &capacity, needed, sizeof(unsigned int)) != 0) {
+		return -1;
+	}
+	capacity = builder->capacity;
+	if (rogitfs_graph_grow((void **)&graph->bloom_start, &capacity, needed, sizeof(size_t)) != 0) {
+		return -1;
+	}
+	builder->capacity = capacity;
+
+	unsigned int index = graph->count;
+	git_oid_cpy(&graph->oids[index], oid);
+	git_oid_cpy(&graph->trees[index], tree);
+	graph->times[index] = time;
+	graph->parent_start[index] = builder->parent_count;
+	graph->count++;
+	graph->parent_start[graph->count] = builder->parent_count;
+	graph->bloom_start[index] = builder->bloom.size;
+	graph->bloom_start[graph->count] = builder->bloom.size;
+
+	return rogitfs_graph_table_insert(graph, index);
+}
+
+static int rogitfs_graph_add_parent(struct rogitfs_graph_builder *builder, unsigned int parent) {
+
+	struct rogitfs_graph *graph = builder->graph;
+	if (rogitfs_graph_grow((void **)&graph->parents, &builder->parent_capacity, builder->parent_count + 1, sizeof(unsigned int)) != 0) {
+		return -1;
+	}
+	graph->parents[builder->parent_count] = parent;
+	builder->parent_count++;
+	graph->parent_start[graph->count] = builder->parent_count;
+	return 0;
+}
+
+static int rogitfs_graph_add_pending(struct rogitfs_graph_builder *builder, const git_oid *parent) {
+
+	if (rogitfs_graph_grow((void **)&builder->pending, &builder->pending_capacity, builder->pending_count + 1, sizeof(git_oid)) != 0) {
+		return -1;
+	}
+	git_oid_cpy(&builder->pending[builder->pending_count], parent);
+	int res = rogitfs_graph_add_parent(builder, ROGITFS_GRAPH_PENDING | builder->pending_count);
+	builder->pending_count++;
+	return res;
+}
+
+// Add all commits of one commit-graph file, parents are positions in the whole chain
+static int rogitfs_graph_load_file(struct rogitfs_graph_builder *builder, const char *path) {
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat file_stat = {};
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 8) {
+		close(fd);
+		return -1;
+	}
+	size_t size = file_stat.st_size;
+	const unsigned char *data = (const unsigned char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return -1;
+	}
+
+	int res = -1;
+	const unsigned char *oidf = NULL;
+	const unsigned char *oidl = NULL;
+	const unsigned char *cdat = NULL;
+	const unsigned char *edge = NULL;
+	const unsigned char *bidx = NULL;
+	const unsigned char *bdat = NULL;
+	size_t bdat_size = 0;
+	unsigned int chunk_count = data[6];
+
+	if (memcmp(data, "CGPH", 4) != 0 || data[4] != 1 || data[5] != 1 || size < 8 + (chunk_count + 1) * 12) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "unsupported commit-graph %s", path);
+		goto out;
+	}
+	for (unsigned int i = 0; i < chunk_count; i++) {
+		const unsigned char *chunk = data + 8 + i * 12;
+		unsigned long long offset = rogitfs_graph_get64(chunk + 4);
+		if (offset >= size) {
+			goto out;
+		}
+		switch(rogitfs_graph_get32(chunk)) {
+		case ROGITFS_GRAPH_CHUNK_OIDF:
+			oidf = data + offset;
+		break;
+		case ROGITFS_GRAPH_CHUNK_OIDL:
+			oidl = data + offset;
+		break;
+		case ROGITFS_GRAPH_CHUNK_CDAT:
+			cdat = data + offset;
+		break;
+		case ROGITFS_GRAPH_CHUNK_EDGE:
+			edge = data + offset;
+		break;
+		case ROGITFS_GRAPH_CHUNK_BIDX:
+			bidx = data + offset;
+		break;
+		case ROGITFS_GRAPH_CHUNK_BDAT:
+			bdat = data + offset;
+			// chunks are stored in table order, the next entry ends this one
+			bdat_size = rogitfs_graph_get64(chunk + 16) - offset;
+		break;
+		}
+	}
+	if (oidf == NULL || oidl == NULL || cdat == NULL) {
+		goto out;
+	}
+
+	unsigned int count = rogitfs_graph_get32(oidf + 255 * 4);
+	if (cdat + (size_t)count * ROGITFS_GRAPH_CDAT_SIZE > data + size || oidl + (size_t)count * GIT_OID_RAWSZ > data + size) {
+		goto out;
+	}
+	if (bidx != NULL && bdat != NULL && bdat_size >= ROGITFS_GRAPH_BDAT_HEADER && bdat + bdat_size <= data + size && bidx + (size_t)count * 4 <= data + size) {
+		struct rogitfs_bloom_settings settings = {
+			.hash_version = rogitfs_graph_get32(bdat),
+			.num_hashes = rogitfs_graph_get32(bdat + 4),
+			.bits_per_entry = rogitfs_graph_get32(bdat + 8)
+		};
+		if (builder->have_bloom == 0 && (settings.hash_version == 1 || settings.hash_version == 2)) {
+			builder->graph->bloom_settings = settings;
+			builder->have_bloom = 1;
+		} else if (memcmp(&builder->graph->bloom_settings, &settings, sizeof(settings)) != 0) {
+			// layers with other settings are used without filters
+			bidx = NULL;
+		}
+	} else {
+		bidx = NULL;
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		const unsigned char *record = cdat + (size_t)i * ROGITFS_GRAPH_CDAT_SIZE;
+		git_oid oid = {};
+		git_oid tree = {};
+		git_oid_fromraw(&oid, oidl + (size_t)i * GIT_OID_RAWSZ);
+		git_oid_fromraw(&tree, record);
+		unsigned int parent1 = rogitfs_graph_get32(record + 20);
+		unsigned int parent2 = rogitfs_graph_get32(record + 24);
+		long long time = ((long long)(rogitfs_graph_get32(record + 28) & 3) << 32) | rogitfs_graph_get32(record + 32);
+
+		if (rogitfs_graph_add_node(builder, &oid, &tree, time) != 0) {
+			goto out;
+		}
+		if (bidx != NULL) {
+			size_t filter_start = i == 0 ? 0 : rogitfs_graph_get32(bidx + (size_t)(i - 1) * 4);
+			size_t filter_end = rogitfs_graph_get32(bidx + (size_t)i * 4);
+			if (filter_start <= filter_end && ROGITFS_GRAPH_BDAT_HEADER + filter_end <= bdat_size) {
+				if (rogitfs_buffer_append(&builder->bloom, bdat + ROGITFS_GRAPH_BDAT_HEADER + filter_start, filter_end - filter_start) != 0) {
+					goto out;
+				}
+				builder->graph->bloom_start[builder->graph->count] = builder->bloom.size;
+			}
+		}
+		if (parent1 != ROGITFS_GRAPH_PARENT_NONE && rogitfs_graph_add_parent(builder, parent1) != 0) {
+			goto out;
+		}
+		if (parent2 == ROGITFS_GRAPH_PARENT_NONE) {
+			continue;
+		}
+		if ((parent2 & ROGITFS_GRAPH_EXTRA_EDGES) == 0) {
+			if (rogitfs_graph_add_parent(builder, parent2) != 0) {
+				goto out;
+			}
+			continue;
+		}
+		if (edge == NULL) {
+			goto out;
+		}
+		// octopus merge, remaining parents are listed in the edge chunk
+		const unsigned char *cur = edge + (size_t)(parent2 & ROGITFS_GRAPH_EDGE_MASK) * 4;
+		while (cur + 4 <= data + size) {
+			unsigned int value = rogitfs_graph_get32(cur);
+			if (rogitfs_graph_add_parent(builder, value & ROGITFS_GRAPH_EDGE_MASK) != 0) {
+				goto out;
+			}
+			if ((value & ROGITFS_GRAPH_EXTRA_EDGES) != 0) {
+				break;
+			}
+			cur = cur + 4;
+		}
+	}
+	res = 0;
+
+out:
+	munmap((void *)data, size);
+	return res;
+}
+
+// Whether git wrote a commit-graph file, the graph then only walks newer commits
+int rogitfs_graph_has_file(git_repository *repo) {
+
+	const char *commondir = git_repository_commondir(repo);
+	size_t dir_len = strlen(commondir);
+	char path[dir_len + 128];
+
+	snprintf(path, sizeof(path), "%sobjects/info/commit-graph", commondir);
+	if (access(path, R_OK) == 0) {
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%sobjects/info/commit-graphs/commit-graph-chain", commondir);
+	return access(path, R_OK) == 0;
+}
+
+// Load objects/info/commit-graph or the layers of a split commit-graph chain
+static int rogitfs_graph_load_files(struct rogitfs_graph_builder *builder) {
+
+	const char *commondir = git_repository_commondir(builder->repo);
+	size_t dir_len = strlen(commondir);
+	char path[dir_len + 128];
+
+	snprintf(path, sizeof(path), "%sobjects/info/commit-graph", commondir);
+	if (access(path, R_OK) == 0) {
+		if (rogitfs_graph_load_file(builder, path) != 0) {
+			return -1;
+		}
+		return 0;
+	}
+
+	snprintf(path, sizeof(path), "%sobjects/info/commit-graphs/commit-graph-chain", commondir);
+	FILE *chain = fopen(path, "r");
+	if (chain == NULL) {
+		return 0;
+	}
+	char line[GIT_OID_HEXSZ + 8];
+	int res = 0;
+	while (fgets(line, sizeof(line), chain) != NULL) {
+		line[strcspn(line, "\n")] = 0;
+		if (strlen(line) != GIT_OID_HEXSZ) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%sobjects/info/commit-graphs/graph-%s.graph", commondir, line);
+		res = rogitfs_graph_load_file(builder, path);
+		if (res != 0) {
+			break;
+		}
+	}
+	fclose(chain);
+	return res;
+}
+
+static int rogitfs_graph_queue(struct rogitfs_graph_builder *builder, const git_oid *oid) {
+
+	unsigned int index = 0;
+	if (rogitfs_graph_lookup(builder->graph, oid, &index) == 0) {
+		return 0;
+	}
+	if (rogitfs_graph_grow((void **)&builder->queue, &builder->queue_capacity, builder->queue_count + 1, sizeof(git_oid)) != 0) {
+		return -1;
+	}
+	git_oid_cpy(&builder->queue[builder->queue_count], oid);
+	builder->queue_count++;
+	return 0;
+}
+
+static int rogitfs_graph_queue_ref(git_reference *ref, void *payload) {
+
+	struct rogitfs_graph_builder *builder = (struct rogitfs_graph_builder *)payload;
+
+	git_object *obj = NULL;
+	int error = git_reference_peel(&obj, ref, GIT_OBJECT_COMMIT);
+	git_reference_free(ref);
+	if (error != 0) {
+		// references to trees or blobs
+		return 0;
+	}
+	error = rogitfs_graph_queue(builder, git_object_id(obj));
+	git_object_free(obj);
+	return error;
+}
+
+// Add commits reachable from the queue that are not yet known
+static int rogitfs_graph_walk(struct rogitfs_graph_builder *builder) {
+
+	while (builder->queue_count > 0) {
+		builder->queue_count--;
+		git_oid oid = builder->queue[builder->queue_count];
+		unsigned int index = 0;
+		if (rogitfs_graph_lookup(builder->graph, &oid, &index) == 0) {
+			continue;
+		}
+
+		git_commit *commit = NULL;
+		int error = git_commit_lookup(&commit, builder->repo, &oid);
+		if (error != 0) {
+			// missing in shallow repositories
+			continue;
+		}
+		if (rogitfs_graph_add_node(builder, &oid, git_commit_tree_id(commit), git_commit_time(commit)) != 0) {
+			git_commit_free(commit);
+			return -1;
+		}
+		unsigned int parent_count = git_commit_parentcount(commit);
+		for (unsigned int i = 0; i < parent_count; i++) {
+			const git_oid *parent = git_commit_parent_id(commit, i);
+			if (rogitfs_graph_add_pending(builder, parent) != 0 || rogitfs_graph_queue(builder, parent) != 0) {
+				git_commit_free(commit);
+				return -1;
+			}
+		}
+		git_commit_free(commit);
+	}
+	return 0;
+}
+
+// Replace pending parent oids of the nodes from first on by node indices,
+// unknown parents are dropped
+static void rogitfs_graph_resolve_pending(struct rogitfs_graph_builder *builder, unsigned int first) {
+
+	struct rogitfs_graph *graph = builder->graph;
+	unsigned int write = graph->parent_start[first];
+	unsigned int read = write;
+	for (unsigned int i = first; i < graph->count; i++) {
+		unsigned int end = graph->parent_start[i+1];
+		graph->parent_start[i] = write;
+		for (; read < end; read++) {
+			unsigned int parent = graph->parents[read];
+			if ((parent & ROGITFS_GRAPH_PENDING) != 0) {
+				if (rogitfs_graph_lookup(graph, &builder->pending[parent & ~ROGITFS_GRAPH_PENDING], &parent) != 0) {
+					continue;
+				}
+			}
+			if (parent >= graph->count) {
+				continue;
+			}
+			graph->parents[write] = parent;
+			write++;
+		}
+	}
+	graph->parent_start[graph->count] = write;
+}
+
+// Topological levels, one more than the highest parent, of the nodes from
+// first on. Generations of earlier nodes are kept.
+static int rogitfs_graph_generations(struct rogitfs_graph *graph, unsigned int first) {
+
+	unsigned int *generations = (unsigned int *) realloc(graph->generations, (graph->count + 1) * sizeof(unsigned int));
+	if (generations == NULL) {
+		return -1;
+	}
+	graph->generations = generations;
+	memset(generations + first, 0, (graph->count + 1 - first) * sizeof(unsigned int));
+	unsigned int *stack = NULL;
+	unsigned int stack_capacity = 0;
+	unsigned int stack_count = 0;
+
+	for (unsigned int i = first; i < graph->count; i++) {
+		if (graph->generations[i] != 0) {
+			continue;
+		}
+		if (rogitfs_graph_grow((void **)&stack, &stack_capacity, 1, sizeof(unsigned int)) != 0) {
+			free(stack);
+			return -1;
+		}
+		stack[stack_count++] = i;
+		while (stack_count > 0) {
+			unsigned int node = stack[stack_count - 1];
+			if (graph->generations[node] != 0) {
+				stack_count--;
+				continue;
+			}
+			unsigned int max = 0;
+			int done = 1;
+			for (unsigned int p = graph->parent_start[node]; p < graph->parent_start[node+1]; p++) {
+				unsigned int generation = graph->generations[graph->parents[p]];
+				if (generation == 0) {
+					if (rogitfs_graph_grow((void **)&stack, &stack_capacity, stack_count + 1, sizeof(unsigned int)) != 0) {
+						free(stack);
+						return -1;
+					}
+					stack[stack_count++] = graph->parents[p];
+					done = 0;
+				} else if (generation > max) {
+					max = generation;
+				}
+			}
+			if (done) {
+				graph->generations[node] = max + 1;
+				stack_count--;
+			}
+		}
+	}
+	free(stack);
+	return 0;
+}
+
+static int rogitfs_graph_time_compare(const void *a, const void *b, void *arg) {
+
+	const struct rogitfs_graph *graph = (const struct rogitfs_graph *)arg;
+	unsigned int index_a = *(const unsigned int *)a;
+	unsigned int index_b = *(const unsigned int *)b;
+	if (graph->times[index_a] != graph->times[index_b]) {
+		return graph->times[index_a] < graph->times[index_b] ? -1 : 1;
+	}
+	// commits with equal time are ordered parents first
+	if (graph->generations[index_a] != graph->generations[index_b]) {
+		return graph->generations[index_a] < graph->generations[index_b] ? -1 : 1;
+	}
+	return index_a < index_b ? -1 : (index_a > index_b);
+}
+
+// Order the nodes by time, the first ones are merged from old_by_time
+// which is their order already
+static int rogitfs_graph_sort_time(struct rogitfs_graph *graph, const unsigned int *old_by_time, unsigned int first) {
+
+	graph->by_time = (unsigned int *) malloc((graph->count + 1) * sizeof(unsigned int));
+	if (graph->by_time == NULL) {
+		return -1;
+	}
+	unsigned int added_count = graph->count - first;
+	unsigned int *added = (unsigned int *) malloc((added_count + 1) * sizeof(unsigned int));
+	if (added == NULL) {
+		return -1;
+	}
+	for (unsigned int i = 0; i < added_count; i++) {
+		added[i] = first + i;
+	}
+	if (added_count > 0) {
+		qsort_r(added, added_count, sizeof(unsigned int), &rogitfs_graph_time_compare, graph);
+	}
+	unsigned int old_pos = 0;
+	unsigned int added_pos = 0;
+	for (unsigned int i = 0; i < graph->count; i++) {
+		if (added_pos == added_count || (old_pos < first && rogitfs_graph_time_compare(&old_by_time[old_pos], &added[added_pos], graph) < 0)) {
+			graph->by_time[i] = old_by_time[old_pos++];
+		} else {
+			graph->by_time[i] = added[added_pos++];
+		}
+	}
+	free(added);
+	return 0;
+}
+
+// Returns 0 if the commit did definitely not change the path of key relative to its first parent
+int rogitfs_graph_bloom_maybe(const struct rogitfs_graph *graph, unsigned int index, const struct rogitfs_bloom_key *key) {
+
+	size_t filter_size = graph->bloom_start[index+1] - graph->bloom_start[index];
+	if (filter_size == 0) {
+		return 1;
+	}
+	return rogitfs_bloom_contains(graph->bloom_data + graph->bloom_start[index], filter_size, key, &graph->bloom_settings);
+}
+
+// Position in by_time of the first commit not older than time
+unsigned int rogitfs_graph_time_bound(const struct rogitfs_graph *graph, long long time) {
+
+	unsigned int low = 0;
+	unsigned int high = graph->count;
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+		if (graph->times[graph->by_time[mid]] < time) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static struct rogitfs_graph *rogitfs_graph_new(void) {
+
+	struct rogitfs_graph *graph = (struct rogitfs_graph *) calloc(1, sizeof(struct rogitfs_graph));
+	if (graph == NULL) {
+		rogitfs_log_error("rogitfs_graph_new calloc failed");
+		return NULL;
+	}
+	pthread_mutex_init(&graph->memo_lock, NULL);
+	return graph;
+}
+
+static struct rogitfs_graph *rogitfs_graph_build(git_repository *repo, const git_oid *need) {
+
+	struct rogitfs_graph *graph = rogitfs_graph_new();
+	if (graph == NULL) {
+		return NULL;
+	}
+	struct rogitfs_graph_builder builder = {
+		.graph = graph,
+		.repo = repo
+	};
+
+	int res = rogitfs_graph_load_files(&builder);
+	if (res != 0) {
+		// fall back to walking everything
+		rogitfs_graph_free(graph);
+		rogitfs_buffer_free(&builder.bloom);
+		graph = rogitfs_graph_new();
+		if (graph == NULL) {
+			return NULL;
+		}
+		memset(&builder, 0, sizeof(builder));
+		builder.graph = graph;
+		builder.repo = repo;
+		res = 0;
+	}
+
+	git_reference *head = NULL;
+	if (git_repository_head(&head, repo) == 0) {
+		res = rogitfs_graph_queue_ref(head, &builder);
+	}
+	if (res == 0) {
+		res = git_reference_foreach(repo, &rogitfs_graph_queue_ref, &builder);
+	}
+	if (res == 0 && need != NULL) {
+		res = rogitfs_graph_queue(&builder, need);
+	}
+	if (res == 0) {
+		res = rogitfs_graph_walk(&builder);
+	}
+	free(builder.queue);
+	// the graph owns the filter data from here on
+	graph->bloom_data = (unsigned char *)builder.bloom.data;
+	if (res != 0) {
+		free(builder.pending);
+		rogitfs_graph_free(graph);
+		return NULL;
+	}
+	rogitfs_graph_resolve_pending(&builder, 0);
+	free(builder.pending);
+
+	if (rogitfs_graph_generations(graph, 0) != 0 || rogitfs_graph_sort_time(graph, NULL, 0) != 0) {
+		rogitfs_graph_free(graph);
+		return NULL;
+	}
+	graph->refcount = 1;
+	return graph;
+}
+
+// Copy of old with the commits reachable from need that it lacks, only
+// those are walked. Returns NULL if there are none or on errors.
+static struct rogitfs_graph *rogitfs_graph_extend(git_repository *repo, const struct rogitfs_graph *old, const git_oid *need) {
+
+	struct rogitfs_graph *graph = rogitfs_graph_new();
+	if (graph == NULL) {
+		return NULL;
+	}
+	struct rogitfs_graph_builder builder = {
+		.graph = graph,
+		.repo = repo
+	};
+	unsigned int first = old->count;
+	unsigned int parent_count = old->parent_start[first];
+	size_t bloom_size = old->bloom_start[first];
+
+	int res = -1;
+	unsigned int capacity = 0;
+	if (rogitfs_graph_grow((void **)&graph->oids, &capacity, first + 2, sizeof(git_oid)) != 0) {
+		goto out;
+	}
+	capacity = 0;
+	if (rogitfs_graph_grow((void **)&graph->trees, &capacity, first + 2, sizeof(git_oid)) != 0) {
+		goto out;
+	}
+	capacity = 0;
+	if (rogitfs_graph_grow((void **)&graph->times, &capacity, first + 2, sizeof(long long)) != 0) {
+		goto out;
+	}
+	capacity = 0;
+	if (rogitfs_graph_grow((void **)&graph->parent_start, &capacity, first + 2, sizeof(unsigned int)) != 0) {
+		goto out;
+	}
+	capacity = 0;
+	if (rogitfs_graph_grow((void **)&graph->bloom_start, &capacity, first + 2, sizeof(size_t)) != 0) {
+		goto out;
+	}
+	builder.capacity = capacity;
+	if (rogitfs_graph_grow((void **)&graph->parents, &builder.parent_capacity, parent_count + 1, sizeof(unsigned int)) != 0) {
+		goto out;
+	}
+	graph->generations = (unsigned int *) malloc((first + 1) * sizeof(unsigned int));
+	if (graph->generations == NULL) {
+		goto out;
+	}
+	memcpy(graph->oids, old->oids, first * sizeof(git_oid));
+	memcpy(graph->trees, old->trees, first * sizeof(git_oid));
+	memcpy(graph->times, old->times, first * sizeof(long long));
+	memcpy(graph->generations, old->generations, first * sizeof(unsigned int));
+	memcpy(graph->parent_start, old->parent_start, (first + 1) * sizeof(unsigned int));
+	memcpy(graph->parents, old->parents, parent_count * sizeof(unsigned int));
+	memcpy(graph->bloom_start, old->bloom_start, (first + 1) * sizeof(size_t));
+	if (bloom_size > 0 && rogitfs_buffer_append(&builder.bloom, old->bloom_data, bloom_size) != 0) {
+		goto out;
+	}
+	graph->bloom_settings = old->bloom_settings;
+	graph->count = first;
+	builder.parent_count = parent_count;
+	if (old->table != NULL) {
+		graph->table = (unsigned int *) malloc((old->table_mask + 1) * sizeof(unsigned int));
+		if (graph->table == NULL) {
+			goto out;
+		}
+		memcpy(graph->table, old->table, (old->table_mask + 1) * sizeof(unsigned int));
+		graph->table_mask = old->table_mask;
+	}
+
+	if (rogitfs_graph_queue(&builder, need) != 0 || rogitfs_graph_walk(&builder) != 0 || graph->count == first) {
+		goto out;
+	}
+	rogitfs_graph_resolve_pending(&builder, first);
+	if (rogitfs_graph_generations(graph, first) != 0 || rogitfs_graph_sort_time(graph, old->by_time, first) != 0) {
+		goto out;
+	}
+	res = 0;
+
+out:
+	free(builder.queue);
+	free(builder.pending);
+	// the graph owns the filter data from here on
+	graph->bloom_data = (unsigned char *)builder.bloom.data;
+	if (res != 0) {
+		rogitfs_graph_free(graph);
+		return NULL;
+	}
+	graph->refcount = 1;
+	return graph;
+}
+
+void rogitfs_graph_free(struct rogitfs_graph *graph) {
+
+	if (graph == NULL) {
+		return;
+	}
+	free(graph->oids);
+	free(graph->trees);
+	free(graph->times);
+	free(graph->generations);
+	free(graph->parent_start);
+	free(graph->parents);
+	free(graph->by_time);
+	free(graph->bloom_start);
+	free(graph->bloom_data);
+	free(graph->table);
+	for (unsigned int i = 0; i < ROGITFS_GRAPH_MEMO_SLOTS; i++) {
+		free(graph->reach[i].bits);
+	}
+	pthread_mutex_destroy(&graph->memo_lock);
+	free(graph);
+}
+
+// Drop one reference, graph_lock held
+static void rogitfs_graph_unref(struct rogitfs_graph *graph) {
+
+	graph->refcount--;
+	if (graph->refcount == 0) {
+		rogitfs_graph_free(graph);
+	}
+}
+
+// Returns the referenced graph, extended if need is a commit that is not
+// part of it yet. The first graph is built under graph_lock, extensions
+// walk without it so readers of the current graph are not held up.
+struct rogitfs_graph *rogitfs_graph_get(struct rogitfs_private *private, const git_oid *need) {
+
+	pthread_mutex_lock(&private->graph_lock);
+
+	struct rogitfs_graph *graph = private->graph;
+	unsigned int index = 0;
+	if (graph != NULL && (need == NULL || rogitfs_graph_lookup(graph, need, &index) == 0)) {
+		graph->refcount++;
+		pthread_mutex_unlock(&private->graph_lock);
+		return graph;
+	}
+	if (graph == NULL) {
+		graph = rogitfs_graph_build(private->repo, need);
+		if (graph != NULL) {
+			private->graph = graph;
+			graph->refcount++;
+		}
+		pthread_mutex_unlock(&private->graph_lock);
+		return graph;
+	}
+	graph->refcount++;
+	pthread_mutex_unlock(&private->graph_lock);
+
+	size_t size = 0;
+	git_object_t type = GIT_OBJECT_INVALID;
+	if (git_odb_read_header(&size, &type, private->odb, need) != 0 || type != GIT_OBJECT_COMMIT) {
+		return graph;
+	}
+
+	while (1) {
+		struct rogitfs_graph *new_graph = rogitfs_graph_extend(private->repo, graph, need);
+		if (new_graph == NULL) {
+			return graph;
+		}
+		pthread_mutex_lock(&private->graph_lock);
+		if (private->graph == graph) {
+			private->graph = new_graph;
+			new_graph->refcount++;
+			// the references of private and of this call
+			rogitfs_graph_unref(graph);
+			rogitfs_graph_unref(graph);
+			pthread_mutex_unlock(&private->graph_lock);
+			return new_graph;
+		}
+		// another thread extended the graph meanwhile, extend its graph
+		struct rogitfs_graph *current = private->graph;
+		current->refcount++;
+		rogitfs_graph_unref(graph);
+		pthread_mutex_unlock(&private->graph_lock);
+		rogitfs_graph_free(new_graph);
+		graph = current;
+		if (rogitfs_graph_lookup(graph, need, &index) == 0) {
+			return graph;
+		}
+	}
+}
+
+void rogitfs_graph_release(struct rogitfs_private *private, struct rogitfs_graph *graph) {
+
+	if (graph == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&private->graph_lock);
+	rogitfs_graph_unref(graph);
+	pthread_mutex_unlock(&private->graph_lock);
+}
+
+// Bitset of index and all its ancestors, appending them to nodes in
+// breadth first order if nodes is not NULL
+static unsigned char *rogitfs_graph_reach_bits(const struct rogitfs_graph *graph, unsigned int index, unsigned int **nodes, unsigned int *capacity, unsigned int *count) {
+
+	unsigned char *bits = (unsigned char *) calloc(graph->count / 8 + 1, 1);
+	unsigned int *list = NULL;
+	unsigned int list_capacity = 0;
+	unsigned int list_count = 0;
+	if (bits == NULL || rogitfs_graph_grow((void **)&list, &list_capacity, 1, sizeof(unsigned int)) != 0) {
+		free(bits);
+		return NULL;
+	}
+	// list doubles as work list, everything before next is expanded
+	list[list_count++] = index;
+	bits[index / 8] |= 1 << (index % 8);
+	for (unsigned int next = 0; next < list_count; next++) {
+		unsigned int node = list[next];
+		for (unsigned int p = graph->parent_start[node]; p < graph->parent_start[node+1]; p++) {
+			unsigned int parent = graph->parents[p];
+			if ((bits[parent / 8] & (1 << (parent % 8))) != 0) {
+				continue;
+			}
+			bits[parent / 8] |= 1 << (parent % 8);
+			if (rogitfs_graph_grow((void **)&list, &list_capacity, list_count + 1, sizeof(unsigned int)) != 0) {
+				free(list);
+				free(bits);
+				return NULL;
+			}
+			list[list_count++] = parent;
+		}
+	}
+	if (nodes != NULL) {
+		*nodes = list;
+		*capacity = list_capacity;
+		*count = list_count;
+	} else {
+		free(list);
+	}
+	return bits;
+}
+
+// Returns whether ancestor is set in the memoized set of descendant, -1 if
+// that set is not memoized
+static int rogitfs_graph_memo_reach(struct rogitfs_graph *graph, unsigned int ancestor, unsigned int descendant) {
+
+	int found = -1;
+	pthread_mutex_lock(&graph->memo_lock);
+	for (unsigned int i = 0; i < ROGITFS_GRAPH_MEMO_SLOTS; i++) {
+		const struct rogitfs_graph_reach *reach = &graph->reach[i];
+		if (reach->bits != NULL && reach->node == descendant) {
+			found = (reach->bits[ancestor / 8] >> (ancestor % 8)) & 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&graph->memo_lock);
+	return found;
+}
+
+// Takes bits, replacing the set memoized longest ago
+static void rogitfs_graph_memo_store_reach(struct rogitfs_graph *graph, unsigned int node, unsigned char *bits) {
+
+	pthread_mutex_lock(&graph->memo_lock);
+	for (unsigned int i = 0; i < ROGITFS_GRAPH_MEMO_SLOTS; i++) {
+		if (graph->reach[i].bits != NULL && graph->reach[i].node == node) {
+			pthread_mutex_unlock(&graph->memo_lock);
+			free(bits);
+			return;
+		}
+	}
+	struct rogitfs_graph_reach *reach = &graph->reach[graph->reach_next];
+	graph->reach_next = (graph->reach_next + 1) % ROGITFS_GRAPH_MEMO_SLOTS;
+	free(reach->bits);
+	reach->node = node;
+	reach->bits = bits;
+	pthread_mutex_unlock(&graph->memo_lock);
+}
+
+// Checks ancestor against the ancestor set of descendant, which is
+// computed once and memoized, so the entries of one /ancestors directory
+// walk the history once
+int rogitfs_graph_is_ancestor(struct rogitfs_graph *graph, unsigned int ancestor, unsigned int descendant) {
+
+	if (ancestor == descendant) {
+		return 1;
+	}
+	// ancestors have lower generations
+	if (graph->generations[ancestor] >= graph->generations[descendant]) {
+		return 0;
+	}
+	int found = rogitfs_graph_memo_reach(graph, ancestor, descendant);
+	if (found != -1) {
+		return found;
+	}
+	unsigned char *bits = rogitfs_graph_reach_bits(graph, descendant, NULL, NULL, NULL);
+	if (bits == NULL) {
+		return -1;
+	}
+	found = (bits[ancestor / 8] >> (ancestor % 8)) & 1;
+	rogitfs_graph_memo_store_reach(graph, descendant, bits);
+	return found;
+}
+
+// Max-heap of nodes ordered by generation
+struct rogitfs_graph_heap {
+	unsigned int *nodes;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+static int rogitfs_graph_heap_push(struct rogitfs_graph_heap *heap, const struct rogitfs_graph *graph, unsigned int node) {
+
+	if (rogitfs_graph_grow((void **)&heap->nodes, &heap->capacity, heap->count + 1, sizeof(unsigned int)) != 0) {
+		return -1;
+	}
+	unsigned int pos = heap->count++;
+	while (pos > 0) {
+		unsigned int up = (pos - 1) / 2;
+		if (graph->generations[heap->nodes[up]] >= graph->generations[node]) {
+			break;
+		}
+		heap->nodes[pos] = heap->nodes[up];
+		pos = up;
+	}
+	heap->nodes[pos] = node;
+	return 0;
+}
+
+static unsigned int rogitfs_graph_heap_pop(struct rogitfs_graph_heap *heap, const struct rogitfs_graph *graph) {
+
+	unsigned int top = heap->nodes[0];
+	unsigned int last = heap->nodes[--heap->count];
+	unsigned int pos = 0;
+	while (1) {
+		unsigned int child = pos * 2 + 1;
+		if (child >= heap->count) {
+			break;
+		}
+		if (child + 1 < heap->count && graph->generations[heap->nodes[child+1]] > graph->generations[heap->nodes[child]]) {
+			child++;
+		}
+		if (graph->generations[heap->nodes[child]] <= graph->generations[last]) {
+			break;
+		}
+		heap->nodes[pos] = heap->nodes[child];
+		pos = child;
+	}
+	if (heap->count > 0) {
+		heap->nodes[pos] = last;
+	}
+	return top;
+}
+
+#define ROGITFS_GRAPH_PARENT1 1
+#define ROGITFS_GRAPH_PARENT2 2
+
+// Paint down from both commits in generation order, the first node
+// reached from both sides has the highest generation of all merge bases
+int rogitfs_graph_merge_base(struct rogitfs_graph *graph, unsigned int a, unsigned int b, unsigned int *result_index) {
+
+	if (a == b) {
+		*result_index = a;
+		return 0;
+	}
+	// getattr and readlink of one /mergebase entry ask for the same pair
+	unsigned int base = ROGITFS_GRAPH_NONE;
+	int memoized = 0;
+	pthread_mutex_lock(&graph->memo_lock);
+	for (unsigned int i = 0; i < ROGITFS_GRAPH_MEMO_SLOTS; i++) {
+		const struct rogitfs_graph_merge *merge = &graph->merges[i];
+		if (merge->valid && ((merge->a == a && merge->b == b) || (merge->a == b && merge->b == a))) {
+			base = merge->base;
+			memoized = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&graph->memo_lock);
+	if (memoized) {
+		*result_index = base;
+		return base == ROGITFS_GRAPH_NONE ? -1 : 0;
+	}
+
+	unsigned char *flags = (unsigned char *) calloc(graph->count, 1);
+	if (flags == NULL) {
+		return -1;
+	}
+	struct rogitfs_graph_heap heap = {};
+	flags[a] |= ROGITFS_GRAPH_PARENT1;
+	flags[b] |= ROGITFS_GRAPH_PARENT2;
+	int res = -1;
+	if (rogitfs_graph_heap_push(&heap, graph, a) != 0 || rogitfs_graph_heap_push(&heap, graph, b) != 0) {
+		goto out;
+	}
+	while (heap.count > 0) {
+		unsigned int node = rogitfs_graph_heap_pop(&heap, graph);
+		unsigned char node_flags = flags[node] & (ROGITFS_GRAPH_PARENT1 | ROGITFS_GRAPH_PARENT2);
+		if (node_flags == (ROGITFS_GRAPH_PARENT1 | ROGITFS_GRAPH_PARENT2)) {
+			base = node;
+			break;
+		}
+		for (unsigned int p = graph->parent_start[node]; p < graph->parent_start[node+1]; p++) {
+			unsigned int parent = graph->parents[p];
+			if ((flags[parent] & node_flags) == node_flags) {
+				continue;
+			}
+			flags[parent] |= node_flags;
+			if (rogitfs_graph_heap_push(&heap, graph, parent) != 0) {
+				goto out;
+			}
+		}
+	}
+	pthread_mutex_lock(&graph->memo_lock);
+	struct rogitfs_graph_merge *merge = &graph->merges[graph->merge_next];
+	graph->merge_next = (graph->merge_next + 1) % ROGITFS_GRAPH_MEMO_SLOTS;
+	merge->a = a;
+	merge->b = b;
+	merge->base = base;
+	merge->valid = 1;
+	pthread_mutex_unlock(&graph->memo_lock);
+	*result_index = base;
+	res = base == ROGITFS_GRAPH_NONE ? -1 : 0;
+
+out:
+	free(heap.nodes);
+	free(flags);
+	return res;
+}
+
+// All ancestors including index itself, or the first parent chain in order
+int rogitfs_graph_ancestors(struct rogitfs_graph *graph, unsigned int index, int first_parent, unsigned int **result_nodes, unsigned int *result_count) {
+
+	unsigned int *nodes = NULL;
+	unsigned int capacity = 0;
+	unsigned int count = 0;
+
+	if (first_parent) {
+		unsigned int node = index;
+		while (1) {
+			if (rogitfs_graph_grow((void **)&nodes, &capacity, count + 1, sizeof(unsigned int)) != 0) {
+				free(nodes);
+				return -1;
+			}
+			nodes[count++] = node;
+			if (graph->parent_start[node] == graph->parent_start[node+1]) {
+				break;
+			}
+			node = graph->parents[graph->parent_start[node]];
+		}
+		*result_nodes = nodes;
+		*result_count = count;
+		return 0;
+	}
+
+	// the set is memoized for the getattr of every listed entry
+	unsigned char *bits = rogitfs_graph_reach_bits(graph, index, &nodes, &capacity, &count);
+	if (bits == NULL) {
+		return -1;
+	}
+	rogitfs_graph_memo_store_reach(graph, index, bits);
+	*result_nodes = nodes;
+	*result_count = count;
+	return 0;
+}
@@ -0,0 +1,82 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_GRAPH_H__
+#define __ROGITFS_GRAPH_H__
+
+#include <git2.h>
+#include "rogitfs_common.h"
+#include "rogitfs_bloom.h"
+
+#define ROGITFS_GRAPH_NONE 0xffffffffu
+#define ROGITFS_GRAPH_MEMO_SLOTS 16
+
+// Ancestors of node as bitset of node indices, node included
+struct rogitfs_graph_reach {
+	unsigned int node;
+	unsigned char *bits;
+};
+
+struct rogitfs_graph_merge {
+	unsigned int a;
+	unsigned int b;
+	// ROGITFS_GRAPH_NONE without merge base
+	unsigned int base;
+	int valid;
+};
+
+// In-memory commit graph with flat arrays indexed by node.
+// Nodes come from the commit-graph files of the repository, commits
+// reachable from references but missing there are added by walking them.
+// Commits asked for later are added to a copy of the graph, so node
+// indices of the old graph stay valid in the new one.
+struct rogitfs_graph {
+	unsigned int refcount;
+	unsigned int count;
+	git_oid *oids;
+	git_oid *trees;
+	long long *times;
+	unsigned int *generations;
+	// parents of node i are parents[parent_start[i]] .. parents[parent_start[i+1]-1]
+	unsigned int *parent_start;
+	unsigned int *parents;
+	// node indices ordered by commit time, oldest first
+	unsigned int *by_time;
+	// changed-path filter of node i is bloom_data[bloom_start[i]] .. bloom_data[bloom_start[i+1]-1],
+	// empty for commits without filter
+	struct rogitfs_bloom_settings bloom_settings;
+	size_t *bloom_start;
+	unsigned char *bloom_data;
+	// open addressing table of node indices by oid
+	unsigned int *table;
+	unsigned int table_mask;
+	// ancestor sets and merge bases of recent lookups, readdir of
+	// /ancestors/<oid>/all leaves the set its entries are checked against
+	pthread_mutex_t memo_lock;
+	struct rogitfs_graph_reach reach[ROGITFS_GRAPH_MEMO_SLOTS];
+	unsigned int reach_next;
+	struct rogitfs_graph_merge merges[ROGITFS_GRAPH_MEMO_SLOTS];
+	unsigned int merge_next;
+};
+
+struct rogitfs_graph *rogitfs_graph_get(struct rogitfs_private *private, const git_oid *need);
+
+void rogitfs_graph_release(struct rogitfs_private *private, struct rogitfs_graph *graph);
+
+int rogitfs_graph_has_file(git_repository *repo);
+
+void rogitfs_graph_free(struct rogitfs_graph *graph);
+
+int rogitfs_graph_lookup(const struct rogitfs_graph *graph, const git_oid *oid, unsigned int *result_index);
+
+int rogitfs_graph_is_ancestor(struct rogitfs_graph *graph, unsigned int ancestor, unsigned int descendant);
+
+int rogitfs_graph_merge_base(struct rogitfs_graph *graph, unsigned int a, unsigned int b, unsigned int *result_index);
+
+int rogitfs_graph_bloom_maybe(const struct rogitfs_graph *graph, unsigned int index, const struct rogitfs_bloom_key *key);
+
+unsigned int rogitfs_graph_time_bound(const struct rogitfs_graph *graph, long long time);
+
+int rogitfs_graph_ancestors(struct rogitfs_graph *graph, unsigned int index, int first_parent, unsigned int **result_nodes, unsigned int *result_count);
+
+#endif
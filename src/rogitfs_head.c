@@ -5,20 +5,19 @@
 #include <string.h>
 #include "rogitfs_head.h"
 #include "rogitfs_common.h"
+#include "rogitfs_logging.h"
 
 
 
 
 int rogitfs_head_readlink(const char *path, char *buf, size_t size) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_reference *head = NULL;
 	int error = git_repository_head(&head, private->repo);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_read %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_read", error);
 		return -1;
 	}
 
@@ -0,0 +1,267 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_history.h"
+
+// Split <rev>/<path> and resolve the revision
+static int rogitfs_history_start(const char *path, git_oid *result_oid, const char **result_file, struct rogitfs_private *private) {
+
+	const char *rev_end = index(path, '/');
+	size_t rev_len = rev_end == NULL ? strlen(path) : (size_t)(rev_end - path);
+	if (rev_len == 0) {
+		return -1;
+	}
+	char revision[rev_len + 1];
+	memcpy(revision, path, rev_len);
+	revision[rev_len] = 0;
+	if (rogitfs_resolve_revision(revision, result_oid, private->repo) != 0) {
+		return -1;
+	}
+	*result_file = rev_end == NULL ? path + rev_len : rev_end + 1;
+	return 0;
+}
+
+// Entry of file in a tree, a zero entry if it does not exist there
+static void rogitfs_history_entry(const git_oid *tree_id, const char *file, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
+
+	char tree_path[GIT_OID_HEXSZ + 1 + strlen(file) + 1];
+	git_oid_tostr(tree_path, GIT_OID_HEXSZ + 1, tree_id);
+	tree_path[GIT_OID_HEXSZ] = '/';
+	strcpy(tree_path + GIT_OID_HEXSZ + 1, file);
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_resolve_path(tree_path, &entry, private) != 0) {
+		memset(&entry, 0, sizeof(entry));
+	}
+	*result_entry = entry;
+}
+
+// Returns the referenced cache entry holding the oids of all commits that changed file
+static struct rogitfs_cache_entry *rogitfs_history_get(const git_oid *start, const char *file, struct rogitfs_private *private) {
+
+	size_t file_len = strlen(file);
+	unsigned char key[1 + GIT_OID_RAWSZ + file_len];
+	key[0] = 'h';
+	memcpy(key + 1, start->id, GIT_OID_RAWSZ);
+	memcpy(key + 1 + GIT_OID_RAWSZ, file, file_len);
+
+	struct rogitfs_cache_entry *cache_entry = rogitfs_cache_get(private->changes_cache, key, sizeof(key));
+	if (cache_entry != NULL) {
+		return cache_entry;
+	}
+
+	struct rogitfs_graph *graph = rogitfs_graph_get(private, start);
+	if (graph == NULL) {
+		return NULL;
+	}
+	unsigned int index = 0;
+	unsigned int *nodes = NULL;
+	unsigned int count = 0;
+	if (rogitfs_graph_lookup(graph, start, &index) != 0 || rogitfs_graph_ancestors(graph, index, 0, &nodes, &count) != 0) {
+		rogitfs_graph_release(private, graph);
+		return NULL;
+	}
+	struct rogitfs_bloom_key bloom_key = {};
+	if (rogitfs_bloom_key_new(file, &graph->bloom_settings, &bloom_key) != 0) {
+		free(nodes);
+		rogitfs_graph_release(private, graph);
+		return NULL;
+	}
+
+	struct rogitfs_buffer result = {};
+	int error = 0;
+	for (unsigned int i = 0; i < count && error == 0; i++) {
+		unsigned int node = nodes[i];
+		// filters only exist for commits found in the commit-graph files
+		if (rogitfs_graph_bloom_maybe(graph, node, &bloom_key) == 0) {
+			continue;
+		}
+		struct rogitfs_entry parent_entry = {};
+		if (graph->parent_start[node] < graph->parent_start[node+1]) {
+			const git_oid *parent_tree = &graph->trees[graph->parents[graph->parent_start[node]]];
+			if (git_oid_equal(parent_tree, &graph->trees[node])) {
+				continue;
+			}
+			rogitfs_history_entry(parent_tree, file, &parent_entry, private);
+		}
+		struct rogitfs_entry entry = {};
+		rogitfs_history_entry(&graph->trees[node], file, &entry, private);
+		if (git_oid_equal(&entry.oid, &parent_entry.oid) && entry.mode == parent_entry.mode) {
+			continue;
+		}
+		error = rogitfs_buffer_append(&result, graph->oids[node].id, GIT_OID_RAWSZ);
+	}
+	rogitfs_bloom_key_free(&bloom_key);
+	free(nodes);
+	rogitfs_graph_release(private, graph);
+
+	if (error == 0) {
+		cache_entry = rogitfs_cache_put(private->changes_cache, key, sizeof(key), result.data, result.size);
+	}
+	rogitfs_buffer_free(&result);
+	return cache_entry;
+}
+
+// Checks whether the last component of file is a commit in the history of the rest
+static int rogitfs_history_commit(const git_oid *start, const char *file, git_oid *result_oid, struct rogitfs_private *private) {
+
+	const char *name = rindex(file, '/');
+	if (name == NULL || strlen(name + 1) != GIT_OID_HEXSZ) {
+		return -1;
+	}
+	git_oid oid = {};
+	if (git_oid_fromstr(&oid, name + 1) != 0) {
+		return -1;
+	}
+	size_t dir_len = name - file;
+	char dir[dir_len + 1];
+	memcpy(dir, file, dir_len);
+	dir[dir_len] = 0;
+
+	struct rogitfs_cache_entry *cache_entry = rogitfs_history_get(start, dir, private);
+	if (cache_entry == NULL) {
+		return -1;
+	}
+	int res = -1;
+	const unsigned char *ids = (const unsigned char *)cache_entry->data;
+	for (size_t pos = 0; pos + GIT_OID_RAWSZ <= cache_entry->data_size; pos = pos + GIT_OID_RAWSZ) {
+		if (memcmp(ids + pos, oid.id, GIT_OID_RAWSZ) == 0) {
+			res = 0;
+			break;
+		}
+	}
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	if (res == 0) {
+		git_oid_cpy(result_oid, &oid);
+	}
+	return res;
+}
+
+int rogitfs_history_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] != '/') {
+		// revisions are only reachable by name
+		return 0;
+	}
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid start = {};
+	const char *file = NULL;
+	if (rogitfs_history_start(path + 1, &start, &file, private) != 0) {
+		return -ENOENT;
+	}
+	if (file[0] == 0) {
+		// paths are only reachable by name
+		return 0;
+	}
+	struct rogitfs_cache_entry *cache_entry = rogitfs_history_get(&start, file, private);
+	if (cache_entry == NULL) {
+		return -ENOENT;
+	}
+
+	struct stat link_stat = {
+		.st_mode = S_IFLNK | 0644
+	};
+	char name[GIT_OID_HEXSZ+1] = {};
+	int res = 0;
+	const unsigned char *ids = (const unsigned char *)cache_entry->data;
+	for (size_t pos = 0; pos + GIT_OID_RAWSZ <= cache_entry->data_size; pos = pos + GIT_OID_RAWSZ) {
+		git_oid oid = {};
+		git_oid_fromraw(&oid, ids + pos);
+		git_oid_tostr(name, sizeof(name), &oid);
+		if (filler(buf, name, &link_stat, 0, 0) != 0) {
+			res = -ENOENT;
+			break;
+		}
+	}
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	return res;
+}
+
+int rogitfs_history_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid start = {};
+	const char *file = NULL;
+	if (rogitfs_history_start(path, &start, &file, private) != 0) {
+		return -ENOENT;
+	}
+
+	struct stat dir_stat = {
+		.st_mode = S_IFDIR | 0755,
+		.st_size = 1337
+	};
+	if (file[0] == 0) {
+		*stbuf = dir_stat;
+		return 0;
+	}
+
+	// paths existing in <rev> are directories without building their history
+	git_oid tree_id = {};
+	struct rogitfs_entry entry = {};
+	if (rogitfs_commit_tree_id(&start, &tree_id, private) == 0) {
+		rogitfs_history_entry(&tree_id, file, &entry, private);
+		if (git_oid_is_zero(&entry.oid) == 0) {
+			*stbuf = dir_stat;
+			return 0;
+		}
+	}
+
+	git_oid oid = {};
+	if (rogitfs_history_commit(&start, file, &oid, private) == 0) {
+		struct stat link_stat = {
+			.st_mode = S_IFLNK | 0644
+		};
+		*stbuf = link_stat;
+		return 0;
+	}
+
+	// deleted paths exist as long as some commit changed them
+	struct rogitfs_cache_entry *cache_entry = rogitfs_history_get(&start, file, private);
+	if (cache_entry == NULL) {
+		return -ENOENT;
+	}
+	size_t found = cache_entry->data_size;
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	if (found == 0) {
+		return -ENOENT;
+	}
+	*stbuf = dir_stat;
+	return 0;
+}
+
+int rogitfs_history_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid start = {};
+	const char *file = NULL;
+	if (rogitfs_history_start(path, &start, &file, private) != 0) {
+		return -ENOENT;
+	}
+	git_oid oid = {};
+	if (rogitfs_history_commit(&start, file, &oid, private) != 0) {
+		return -ENOENT;
+	}
+
+	// one step up per component and one out of /history
+	unsigned int comp_count = 0;
+	path_component_count(path, &comp_count);
+	size_t len = 0;
+	for (unsigned int i = 0; i < comp_count && len + 3 < size; i++) {
+		memcpy(buf + len, "../", 3);
+		len = len + 3;
+	}
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, sizeof(hash), &oid);
+	snprintf(buf + len, size - len, "commit/%s", hash);
+	return 0;
+}
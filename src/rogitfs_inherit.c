@@ -6,12 +6,12 @@
 #include <errno.h>
 #include "rogitfs_common.h"
 #include "rogitfs_inherit.h"
+#include "rogitfs_logging.h"
 
 
 static int rogitfs_inherit_readdir_commits(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	const char *comp = NULL;
 	unsigned int comp_size = 0;
@@ -25,15 +25,13 @@ static int rogitfs_inherit_readdir_commits(const char *path, void *buf, fuse_fil
 	git_oid oid = {};
 	error = git_oid_fromstr(&oid, comp);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_oid_fromstr %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_oid_fromstr", error);
 		return -1;
 	}
 	git_object *obj = 0;
 	error = git_object_lookup(&obj, private->repo, &oid, GIT_OBJECT_COMMIT);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_object_lookup %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_object_lookup", error);
 		return -1;
 	}
 	git_commit *commit = (git_commit *)obj;
@@ -61,8 +59,7 @@ static int rogitfs_inherit_readdir_commits(const char *path, void *buf, fuse_fil
 
 static int rogitfs_inherit_readdir_root(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	struct odb_fill_payload payload = {
 		.buf = buf,
@@ -72,8 +69,7 @@ static int rogitfs_inherit_readdir_root(const char *path, void *buf, fuse_fill_d
 	};
 	int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_foreach %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_foreach", error);
 		return -ENOENT;
 	}
 	return 0;
@@ -135,8 +131,7 @@ int rogitfs_inherit_readlink(const char *path, char *buf, size_t size) {
 		return -1;
 	}
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	const char *comp = NULL;
 	unsigned int comp_size = 0;
@@ -150,15 +145,13 @@ int rogitfs_inherit_readlink(const char *path, char *buf, size_t size) {
 	git_oid oid = {};
 	error = git_oid_fromstr(&oid, comp);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_oid_fromstr %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_oid_fromstr", error);
 		return -1;
 	}
 	git_object *obj = 0;
 	error = git_object_lookup(&obj, private->repo, &oid, GIT_OBJECT_COMMIT);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_object_lookup %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_object_lookup", error);
 		return -1;
 	}
 	git_commit *commit = (git_commit *)obj;
@@ -189,8 +182,9 @@ int rogitfs_inherit_readlink(const char *path, char *buf, size_t size) {
 	const git_oid *parent = NULL;
 	parent = git_commit_parent_id(commit, parent_index);
 	if (parent == NULL) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_commit_parent %d %s\n", giterr->klass, giterr->message);
+		char hash[GIT_OID_HEXSZ+1] = {};
+		git_oid_tostr(hash, sizeof(hash), git_commit_id(commit));
+		rogitfs_log_error("parent %u of %s not found", parent_index, hash);
 		git_object_free(obj);
 		return -1;
 	}
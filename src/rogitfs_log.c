@@ -0,0 +1,217 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "rogitfs_common.h"
+#include "rogitfs_stream.h"
+#include "rogitfs_log.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_log_state {
+	git_repository *repo;
+	git_revwalk *walk;
+	git_oid start;
+};
+
+static int rogitfs_log_start(const char *path, git_oid *result_oid, git_repository *repo) {
+
+	if (path[0] == 0 || index(path, '/') != NULL) {
+		return -1;
+	}
+	return rogitfs_resolve_revision(path, result_oid, repo);
+}
+
+static int rogitfs_log_walk(struct rogitfs_log_state *state) {
+
+	if (state->walk != NULL) {
+		git_revwalk_free(state->walk);
+		state->walk = NULL;
+	}
+	int error = git_revwalk_new(&state->walk, state->repo);
+	if (error == 0) {
+		error = git_revwalk_sorting(state->walk, GIT_SORT_TIME);
+	}
+	if (error == 0) {
+		error = git_revwalk_push(state->walk, &state->start);
+	}
+	if (error != 0) {
+		rogitfs_log_giterr("git_revwalk", error);
+		return -1;
+	}
+	return 0;
+}
+
+static int rogitfs_log_signature(struct rogitfs_buffer *out, const char *label, const git_signature *sig) {
+
+	// same date format as git log
+	time_t when = sig->when.time + sig->when.offset * 60;
+	struct tm tm = {};
+	gmtime_r(&when, &tm);
+	char date[64];
+	strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Y", &tm);
+	if (date[8] == '0') {
+		memmove(date + 8, date + 9, strlen(date + 9) + 1);
+	}
+	int offset = sig->when.offset < 0 ? -sig->when.offset : sig->when.offset;
+	char sign = sig->when.offset < 0 ? '-' : '+';
+
+	if (rogitfs_buffer_printf(out, "%s: %s <%s>\n", label, sig->name, sig->email) != 0) {
+		return -1;
+	}
+	return rogitfs_buffer_printf(out, "Date:   %s %c%02d%02d\n", date, sign, offset / 60, offset % 60);
+}
+
+// One commit per record
+static int rogitfs_log_next(struct rogitfs_stream *stream, struct rogitfs_buffer *out) {
+
+	struct rogitfs_log_state *state = (struct rogitfs_log_state *)stream->state;
+
+	git_oid oid = {};
+	int error = git_revwalk_next(&oid, state->walk);
+	if (error == GIT_ITEROVER) {
+		return 1;
+	}
+	if (error != 0) {
+		rogitfs_log_giterr("git_revwalk_next", error);
+		return -1;
+	}
+
+	git_commit *commit = NULL;
+	error = git_commit_lookup(&commit, state->repo, &oid);
+	if (error != 0) {
+		rogitfs_log_giterr("git_commit_lookup", error);
+		return -1;
+	}
+
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, GIT_OID_HEXSZ+1, &oid);
+	int res = rogitfs_buffer_printf(out, "%scommit %s\n", stream->position > 0 ? "\n" : "", hash);
+
+	unsigned int parent_count = git_commit_parentcount(commit);
+	if (res == 0 && parent_count > 1) {
+		res = rogitfs_buffer_append(out, "Merge:", 6);
+		for (unsigned int i = 0; res == 0 && i < parent_count; i++) {
+			git_oid_tostr(hash, 8, git_commit_parent_id(commit, i));
+			res = rogitfs_buffer_printf(out, " %s", hash);
+		}
+		if (res == 0) {
+			res = rogitfs_buffer_append(out, "\n", 1);
+		}
+	}
+	if (res == 0) {
+		res = rogitfs_log_signature(out, "Author", git_commit_author(commit));
+	}
+	if (res == 0) {
+		res = rogitfs_buffer_append(out, "\n", 1);
+	}
+
+	// indent message
+	const char *message = git_commit_message(commit);
+	while (res == 0 && message != NULL && message[0] != 0) {
+		const char *line_end = index(message, '\n');
+		size_t line_len = line_end == NULL ? strlen(message) : (size_t)(line_end - message);
+		if (line_len > 0) {
+			res = rogitfs_buffer_append(out, "    ", 4);
+		}
+		if (res == 0) {
+			res = rogitfs_buffer_append(out, message, line_len);
+		}
+		if (res == 0) {
+			res = rogitfs_buffer_append(out, "\n", 1);
+		}
+		message = line_end == NULL ? NULL : line_end + 1;
+	}
+
+	git_commit_free(commit);
+	return res;
+}
+
+// Restart the walk and skip commits without loading them
+static int rogitfs_log_seek(struct rogitfs_stream *stream, unsigned long long position) {
+
+	struct rogitfs_log_state *state = (struct rogitfs_log_state *)stream->state;
+
+	if (rogitfs_log_walk(state) != 0) {
+		return -1;
+	}
+	git_oid oid = {};
+	for (unsigned long long i = 0; i < position; i++) {
+		int error = git_revwalk_next(&oid, state->walk);
+		if (error != 0) {
+			break;
+		}
+	}
+	return 0;
+}
+
+static void rogitfs_log_free(void *state_data) {
+
+	struct rogitfs_log_state *state = (struct rogitfs_log_state *)state_data;
+	git_revwalk_free(state->walk);
+	free(state);
+}
+
+int rogitfs_log_open(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_log_state *state = (struct rogitfs_log_state *) calloc(1, sizeof(struct rogitfs_log_state));
+	if (state == NULL) {
+		return -ENOMEM;
+	}
+	state->repo = private->repo;
+	if (rogitfs_log_start(path, &state->start, private->repo) != 0) {
+		free(state);
+		return -ENOENT;
+	}
+	if (rogitfs_log_walk(state) != 0) {
+		rogitfs_log_free(state);
+		return -EIO;
+	}
+
+	struct rogitfs_stream *stream = rogitfs_stream_new(state, &rogitfs_log_next, &rogitfs_log_seek, &rogitfs_log_free);
+	if (stream == NULL) {
+		rogitfs_log_free(state);
+		return -ENOMEM;
+	}
+
+	fi->fh = (uint64_t)stream;
+	// size is unknown until the end is generated
+	fi->direct_io = 1;
+	return 0;
+}
+
+int rogitfs_log_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	if (fi == NULL || fi->fh == 0) {
+		return -EBADF;
+	}
+	return rogitfs_stream_read((struct rogitfs_stream *)fi->fh, buf, size, offset);
+}
+
+int rogitfs_log_release(const char *path, struct fuse_file_info *fi) {
+
+	rogitfs_stream_free((struct rogitfs_stream *)fi->fh);
+	fi->fh = 0;
+	return 0;
+}
+
+int rogitfs_log_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid oid = {};
+	if (rogitfs_log_start(path, &oid, private->repo) != 0) {
+		return -ENOENT;
+	}
+
+	struct stat log_stat = {
+		.st_mode = S_IFREG | 0444
+	};
+	*stbuf = log_stat;
+	return 0;
+}
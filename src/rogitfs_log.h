@@ -0,0 +1,22 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_LOG_H__
+#define __ROGITFS_LOG_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /log/<rev> history in `git log` format, commits are formatted while read
+
+int rogitfs_log_open(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_log_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_log_release(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_log_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+#endif
@@ -0,0 +1,303 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "rogitfs_common.h"
+#include "rogitfs_logging.h"
+
+enum rogitfs_logging_level rogitfs_logging_level = ROGITFS_LOGGING_INFO;
+
+static const char *rogitfs_logging_level_names[] = {"debug", "info", "warning", "error"};
+
+static pthread_mutex_t rogitfs_logging_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rogitfs_logging_wakeup = PTHREAD_COND_INITIALIZER;
+// rings of running and ended threads, never freed
+static struct rogitfs_logging_ring *rogitfs_logging_rings = NULL;
+static int rogitfs_logging_running = 0;
+static int rogitfs_logging_stopping = 0;
+static pthread_t rogitfs_logging_flusher;
+static pthread_once_t rogitfs_logging_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rogitfs_logging_key;
+static __thread struct rogitfs_logging_ring *rogitfs_logging_current = NULL;
+
+int rogitfs_logging_parse_level(const char *name, enum rogitfs_logging_level *result_level) {
+
+	for (unsigned int i = 0; i < sizeof(rogitfs_logging_level_names) / sizeof(rogitfs_logging_level_names[0]); i++) {
+		if (strcmp(rogitfs_logging_level_names[i], name) == 0) {
+			*result_level = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// Called when a thread ends, the flusher still writes what is left in the ring
+static void rogitfs_logging_thread_end(void *data) {
+
+	struct rogitfs_logging_ring *ring = (struct rogitfs_logging_ring *)data;
+	pthread_mutex_lock(&rogitfs_logging_lock);
+	ring->used = 0;
+	pthread_mutex_unlock(&rogitfs_logging_lock);
+}
+
+static void rogitfs_logging_key_create(void) {
+
+	pthread_key_create(&rogitfs_logging_key, &rogitfs_logging_thread_end);
+}
+
+static struct rogitfs_logging_ring *rogitfs_logging_ring_get(void) {
+
+	if (rogitfs_logging_current != NULL) {
+		return rogitfs_logging_current;
+	}
+
+	pthread_mutex_lock(&rogitfs_logging_lock);
+	struct rogitfs_logging_ring *ring = rogitfs_logging_rings;
+	while (ring != NULL && ring->used != 0) {
+		ring = ring->next;
+	}
+	if (ring == NULL) {
+		ring = (struct rogitfs_logging_ring *) calloc(1, sizeof(struct rogitfs_logging_ring));
+		if (ring == NULL) {
+			pthread_mutex_unlock(&rogitfs_logging_lock);
+			return NULL;
+		}
+		ring->next = rogitfs_logging_rings;
+		rogitfs_logging_rings = ring;
+	}
+	ring->used = 1;
+	pthread_mutex_unlock(&rogitfs_logging_lock);
+
+	pthread_once(&rogitfs_logging_once, &rogitfs_logging_key_create);
+	pthread_setspecific(rogitfs_logging_key, ring);
+	rogitfs_logging_current = ring;
+	return ring;
+}
+
+// One logfmt line per record
+static int rogitfs_logging_format(struct rogitfs_buffer *out, const struct timespec *time, enum rogitfs_logging_level level, const struct rogitfs_logging_site *site, const char *message) {
+
+	struct tm tm = {};
+	gmtime_r(&time->tv_sec, &tm);
+	char time_buffer[32];
+	strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+
+	int res = 0;
+	if (site != NULL) {
+		res = rogitfs_buffer_printf(out, "time=%s.%03ldZ level=%s site=%s:%u msg=\"", time_buffer, time->tv_nsec / 1000000, rogitfs_logging_level_names[level], site->file, site->line);
+	} else {
+		res = rogitfs_buffer_printf(out, "time=%s.%03ldZ level=%s msg=\"", time_buffer, time->tv_nsec / 1000000, rogitfs_logging_level_names[level]);
+	}
+	for (const char *cur = message; *cur != 0 && res == 0; cur++) {
+		if (*cur == '"' || *cur == '\\') {
+			res = rogitfs_buffer_printf(out, "\\%c", *cur);
+		} else if (*cur == '\n') {
+			res = rogitfs_buffer_append(out, "\\n", 2);
+		} else {
+			res = rogitfs_buffer_append(out, cur, 1);
+		}
+	}
+	if (res == 0) {
+		res = rogitfs_buffer_append(out, "\"\n", 2);
+	}
+	return res;
+}
+
+static void rogitfs_logging_output(struct rogitfs_buffer *out) {
+
+	size_t written = 0;
+	while (written < out->size) {
+		ssize_t res = write(STDERR_FILENO, out->data + written, out->size - written);
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
+		if (res <= 0) {
+			break;
+		}
+		written += res;
+	}
+	out->size = 0;
+}
+
+// Returns 0 if the site may log now, the number of messages left out before is
+// returned in result_suppressed
+static int rogitfs_logging_allow(struct rogitfs_logging_site *site, unsigned int *result_suppressed) {
+
+	struct timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	uint64_t second = now.tv_sec;
+
+	*result_suppressed = 0;
+	if (__atomic_load_n(&site->second, __ATOMIC_RELAXED) != second) {
+		__atomic_store_n(&site->second, second, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+		*result_suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+	}
+	if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >= ROGITFS_LOGGING_SITE_BURST) {
+		__atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	return 0;
+}
+
+static void rogitfs_logging_vwrite(struct rogitfs_logging_site *site, enum rogitfs_logging_level level, const char *format, va_list args) {
+
+	unsigned int suppressed = 0;
+	if (rogitfs_logging_allow(site, &suppressed) != 0) {
+		return;
+	}
+
+	char message[ROGITFS_LOGGING_MESSAGE_SIZE];
+	size_t len = 0;
+	if (suppressed > 0) {
+		len = snprintf(message, sizeof(message), "(%u similar messages suppressed) ", suppressed);
+		if (len >= sizeof(message)) {
+			len = sizeof(message) - 1;
+		}
+	}
+	vsnprintf(message + len, sizeof(message) - len, format, args);
+
+	struct timespec time = {};
+	clock_gettime(CLOCK_REALTIME, &time);
+
+	if (__atomic_load_n(&rogitfs_logging_running, __ATOMIC_ACQUIRE) == 0) {
+		struct rogitfs_buffer out = {};
+		if (rogitfs_logging_format(&out, &time, level, site, message) == 0) {
+			rogitfs_logging_output(&out);
+		}
+		rogitfs_buffer_free(&out);
+		return;
+	}
+
+	struct rogitfs_logging_ring *ring = rogitfs_logging_ring_get();
+	if (ring == NULL) {
+		return;
+	}
+	uint64_t head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ROGITFS_LOGGING_RING_SIZE) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	struct rogitfs_logging_record *record = &ring->records[head % ROGITFS_LOGGING_RING_SIZE];
+	record->time = time;
+	record->level = level;
+	record->site = site;
+	memcpy(record->message, message, sizeof(message));
+	__atomic_store_n(&record->seq, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void rogitfs_logging_write(struct rogitfs_logging_site *site, enum rogitfs_logging_level level, const char *format, ...) {
+
+	va_list args;
+	va_start(args, format);
+	rogitfs_logging_vwrite(site, level, format, args);
+	va_end(args);
+}
+
+void rogitfs_logging_giterr(struct rogitfs_logging_site *site, const char *function, int error) {
+
+	enum rogitfs_logging_level level = error == GIT_ENOTFOUND ? ROGITFS_LOGGING_DEBUG : ROGITFS_LOGGING_ERROR;
+	const git_error *giterr = git_error_last();
+	if (giterr == NULL) {
+		rogitfs_logging_write(site, level, "%s %d", function, error);
+		return;
+	}
+	rogitfs_logging_write(site, level, "%s %d %d %s", function, error, giterr->klass, giterr->message);
+}
+
+// Write the records of all rings, only called by the flusher or after it ended
+static void rogitfs_logging_drain(struct rogitfs_buffer *out) {
+
+	pthread_mutex_lock(&rogitfs_logging_lock);
+	struct rogitfs_logging_ring *rings = rogitfs_logging_rings;
+	pthread_mutex_unlock(&rogitfs_logging_lock);
+
+	// rings are only prepended and never freed, the list can be walked unlocked
+	for (struct rogitfs_logging_ring *ring = rings; ring != NULL; ring = ring->next) {
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = ring->tail;
+		for (; tail < head; tail++) {
+			struct rogitfs_logging_record *record = &ring->records[tail % ROGITFS_LOGGING_RING_SIZE];
+			if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+				break;
+			}
+			rogitfs_logging_format(out, &record->time, record->level, record->site, record->message);
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+		uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != ring->dropped_reported) {
+			char message[64];
+			snprintf(message, sizeof(message), "%llu messages dropped", (unsigned long long)(dropped - ring->dropped_reported));
+			struct timespec time = {};
+			clock_gettime(CLOCK_REALTIME, &time);
+			rogitfs_logging_format(out, &time, ROGITFS_LOGGING_WARNING, NULL, message);
+			ring->dropped_reported = dropped;
+		}
+	}
+	rogitfs_logging_output(out);
+}
+
+static void *rogitfs_logging_flush(void *data) {
+
+	struct rogitfs_buffer out = {};
+
+	pthread_mutex_lock(&rogitfs_logging_lock);
+	while (rogitfs_logging_stopping == 0) {
+		struct timespec deadline = {};
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += ROGITFS_LOGGING_FLUSH_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&rogitfs_logging_wakeup, &rogitfs_logging_lock, &deadline);
+		pthread_mutex_unlock(&rogitfs_logging_lock);
+		rogitfs_logging_drain(&out);
+		pthread_mutex_lock(&rogitfs_logging_lock);
+	}
+	pthread_mutex_unlock(&rogitfs_logging_lock);
+
+	rogitfs_buffer_free(&out);
+	return NULL;
+}
+
+// Start the flusher, after fuse has daemonized
+int rogitfs_logging_start(void) {
+
+	if (rogitfs_logging_running != 0) {
+		return 0;
+	}
+	int error = pthread_create(&rogitfs_logging_flusher, NULL, &rogitfs_logging_flush, NULL);
+	if (error != 0) {
+		fprintf(stderr, "pthread_create %d %s\n", error, strerror(error));
+		return -1;
+	}
+	__atomic_store_n(&rogitfs_logging_running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// Stop the flusher and write what is left, later messages are written directly
+void rogitfs_logging_stop(void) {
+
+	if (rogitfs_logging_running == 0) {
+		return;
+	}
+	pthread_mutex_lock(&rogitfs_logging_lock);
+	rogitfs_logging_stopping = 1;
+	pthread_cond_signal(&rogitfs_logging_wakeup);
+	pthread_mutex_unlock(&rogitfs_logging_lock);
+	pthread_join(rogitfs_logging_flusher, NULL);
+
+	__atomic_store_n(&rogitfs_logging_running, 0, __ATOMIC_RELEASE);
+	struct rogitfs_buffer out = {};
+	rogitfs_logging_drain(&out);
+	rogitfs_buffer_free(&out);
+}
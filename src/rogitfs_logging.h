@@ -0,0 +1,92 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_LOGGING_H__
+#define __ROGITFS_LOGGING_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <git2.h>
+
+// Messages of the fuse handlers, written to stderr by a flusher thread.
+//
+// Every thread formats into its own ring of records without locks, the
+// flusher collects all rings every ROGITFS_LOGGING_FLUSH_MS and writes them
+// at once. Messages below --log-level are dropped before being formatted,
+// missing objects (GIT_ENOTFOUND) are logged as debug since shells and
+// build tools probe for files all the time. Each call site writes at most
+// ROGITFS_LOGGING_SITE_BURST messages per second and reports how many it
+// left out. Until the flusher runs, messages are written directly.
+
+#define ROGITFS_LOGGING_RING_SIZE 256
+#define ROGITFS_LOGGING_MESSAGE_SIZE 224
+#define ROGITFS_LOGGING_FLUSH_MS 100
+#define ROGITFS_LOGGING_SITE_BURST 10
+
+enum rogitfs_logging_level {
+	ROGITFS_LOGGING_DEBUG,
+	ROGITFS_LOGGING_INFO,
+	ROGITFS_LOGGING_WARNING,
+	ROGITFS_LOGGING_ERROR
+};
+
+// Rate limit state of one call site, updated without lock
+struct rogitfs_logging_site {
+	const char *file;
+	unsigned int line;
+	uint64_t second;
+	unsigned int count;
+	unsigned int suppressed;
+};
+
+struct rogitfs_logging_record {
+	// index + 1 of the record once written, 0 while being written
+	uint64_t seq;
+	struct timespec time;
+	enum rogitfs_logging_level level;
+	const struct rogitfs_logging_site *site;
+	char message[ROGITFS_LOGGING_MESSAGE_SIZE];
+};
+
+struct rogitfs_logging_ring {
+	struct rogitfs_logging_ring *next;
+	int used;
+	uint64_t head;
+	// only changed by the flusher
+	uint64_t tail;
+	// records lost because the ring was full, and how many of them were reported
+	uint64_t dropped;
+	uint64_t dropped_reported;
+	struct rogitfs_logging_record records[ROGITFS_LOGGING_RING_SIZE];
+};
+
+extern enum rogitfs_logging_level rogitfs_logging_level;
+
+int rogitfs_logging_parse_level(const char *name, enum rogitfs_logging_level *result_level);
+
+void rogitfs_logging_write(struct rogitfs_logging_site *site, enum rogitfs_logging_level level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+void rogitfs_logging_giterr(struct rogitfs_logging_site *site, const char *function, int error);
+
+int rogitfs_logging_start(void);
+
+void rogitfs_logging_stop(void);
+
+#define rogitfs_log(level, ...) do { \
+	if ((level) >= rogitfs_logging_level) { \
+		static struct rogitfs_logging_site rogitfs_logging_site = {__FILE__, __LINE__}; \
+		rogitfs_logging_write(&rogitfs_logging_site, (level), __VA_ARGS__); \
+	} \
+} while (0)
+
+#define rogitfs_log_error(...) rogitfs_log(ROGITFS_LOGGING_ERROR, __VA_ARGS__)
+
+// Log the last libgit2 error of function, a missing object only at debug level
+#define rogitfs_log_giterr(function, error) do { \
+	if (((error) == GIT_ENOTFOUND ? ROGITFS_LOGGING_DEBUG : ROGITFS_LOGGING_ERROR) >= rogitfs_logging_level) { \
+		static struct rogitfs_logging_site rogitfs_logging_site = {__FILE__, __LINE__}; \
+		rogitfs_logging_giterr(&rogitfs_logging_site, (function), (error)); \
+	} \
+} while (0)
+
+#endif
@@ -0,0 +1,359 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_manifest.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_manifest_walk {
+	git_odb *odb;
+	const struct rogitfs_filter *filter;
+	enum rogitfs_manifest_format format;
+	struct rogitfs_buffer records;
+	struct rogitfs_buffer paths;
+	unsigned int count;
+	int error;
+};
+
+// Open manifest, held by the cache entry or, when too large to cache, by data
+struct rogitfs_manifest_file {
+	struct rogitfs_cache_entry *entry;
+	struct rogitfs_buffer data;
+};
+
+static void rogitfs_manifest_put32(unsigned char *dst, uint32_t value) {
+
+	for (int i = 0; i < 4; i++) {
+		dst[i] = (value >> (8 * i)) & 0xff;
+	}
+}
+
+static void rogitfs_manifest_put64(unsigned char *dst, uint64_t value) {
+
+	for (int i = 0; i < 8; i++) {
+		dst[i] = (value >> (8 * i)) & 0xff;
+	}
+}
+
+static int rogitfs_manifest_walk_cb(const char *root, const git_tree_entry *entry, void *payload) {
+
+	struct rogitfs_manifest_walk *walk = (struct rogitfs_manifest_walk *)payload;
+
+	// excluded subtrees are skipped without being read
+	if (rogitfs_filter_visible_child(walk->filter, root, git_tree_entry_name(entry)) == 0) {
+		return 1;
+	}
+
+	git_object_t type = git_tree_entry_type(entry);
+	if (type == GIT_OBJECT_TREE) {
+		// trees are only descended into, like ls-tree -r without -t
+		return 0;
+	}
+
+	struct stat entry_stat = {};
+	int error = rogitfs_tree_entry_stat(entry, walk->odb, &entry_stat);
+	if (error < 0) {
+		walk->error = -EIO;
+		return -1;
+	}
+	if (error > 0) {
+		return 0;
+	}
+
+	const git_oid *oid = git_tree_entry_id(entry);
+	git_filemode_t mode = git_tree_entry_filemode(entry);
+	const char *name = git_tree_entry_name(entry);
+	size_t size = entry_stat.st_size;
+
+	int res = 0;
+	if (walk->format == ROGITFS_MANIFEST_TEXT) {
+
+		char hash[GIT_OID_HEXSZ+1] = {};
+		git_oid_tostr(hash, GIT_OID_HEXSZ+1, oid);
+		if (type == GIT_OBJECT_BLOB) {
+			res = rogitfs_buffer_printf(&walk->records, "%06o %s %s %7zu\t%s%s\n", mode, git_object_type2string(type), hash, size, root, name);
+		} else {
+			res = rogitfs_buffer_printf(&walk->records, "%06o %s %s %7s\t%s%s\n", mode, git_object_type2string(type), hash, "-", root, name);
+		}
+
+	} else {
+
+		size_t root_len = strlen(root);
+		size_t name_len = strlen(name);
+		if (root_len + name_len > UINT32_MAX) {
+			walk->error = -EFBIG;
+			return -1;
+		}
+		unsigned char record[ROGITFS_MANIFEST_RECORD_SIZE] = {};
+		rogitfs_manifest_put32(record, mode);
+		rogitfs_manifest_put32(record+4, root_len + name_len);
+		rogitfs_manifest_put64(record+8, walk->paths.size);
+		rogitfs_manifest_put64(record+16, size);
+		memcpy(record+24, oid->id, GIT_OID_RAWSZ);
+		record[44] = type;
+		res = rogitfs_buffer_append(&walk->records, record, ROGITFS_MANIFEST_RECORD_SIZE);
+		if (res == 0) {
+			res = rogitfs_buffer_append(&walk->paths, root, root_len);
+		}
+		if (res == 0) {
+			res = rogitfs_buffer_append(&walk->paths, name, name_len + 1);
+		}
+	}
+	if (res != 0) {
+		walk->error = -ENOMEM;
+		return -1;
+	}
+	if (walk->count == UINT32_MAX) {
+		walk->error = -EFBIG;
+		return -1;
+	}
+	walk->count++;
+
+	return 0;
+}
+
+// Resolve <oid> to the root tree of the manifest, result_commit tells if it is the tree of a commit
+static int rogitfs_manifest_tree_id(const char *hash, size_t hash_len, git_oid *result_oid, int *result_commit, git_repository *repo) {
+
+	if (hash_len != GIT_OID_HEXSZ) {
+		return -1;
+	}
+	git_oid oid = {};
+	int error = git_oid_fromstrn(&oid, hash, hash_len);
+	if (error != 0) {
+		rogitfs_log_giterr("git_oid_fromstrn", error);
+		return -1;
+	}
+
+	git_object *obj = NULL;
+	error = git_object_lookup(&obj, repo, &oid, GIT_OBJECT_ANY);
+	if (error != 0) {
+		rogitfs_log_giterr("git_object_lookup", error);
+		return -1;
+	}
+
+	switch(git_object_type(obj)) {
+	case GIT_OBJECT_COMMIT:
+		git_oid_cpy(result_oid, git_commit_tree_id((git_commit *)obj));
+		*result_commit = 1;
+	break;
+	case GIT_OBJECT_TREE:
+		git_oid_cpy(result_oid, &oid);
+		*result_commit = 0;
+	break;
+	default:
+		git_object_free(obj);
+		return -1;
+	break;
+	}
+
+	git_object_free(obj);
+	return 0;
+}
+
+// Parse <oid> or <oid>.bin
+static int rogitfs_manifest_spec(const char *path, git_oid *result_tree_id, int *result_commit, enum rogitfs_manifest_format *result_format, git_repository *repo) {
+
+	size_t path_len = strlen(path);
+	enum rogitfs_manifest_format format = ROGITFS_MANIFEST_TEXT;
+	if (path_len == GIT_OID_HEXSZ + 4 && strcmp(path + GIT_OID_HEXSZ, ".bin") == 0) {
+		format = ROGITFS_MANIFEST_BINARY;
+		path_len = GIT_OID_HEXSZ;
+	}
+	if (rogitfs_manifest_tree_id(path, path_len, result_tree_id, result_commit, repo) != 0) {
+		return -1;
+	}
+	*result_format = format;
+	return 0;
+}
+
+// Build the manifest of path, returns the referenced cache entry holding it
+// or, for manifests larger than a quarter of the cache, fills result_data
+static int rogitfs_manifest_get(const char *path, struct rogitfs_cache_entry **result_entry, struct rogitfs_buffer *result_data, struct rogitfs_private *private) {
+
+	git_oid tree_id = {};
+	int commit = 0;
+	enum rogitfs_manifest_format format = ROGITFS_MANIFEST_TEXT;
+	if (rogitfs_manifest_spec(path, &tree_id, &commit, &format, private->repo) != 0) {
+		return -ENOENT;
+	}
+	// filter rules are relative to the root tree of commits, a tree given by hash is walked unfiltered
+	const struct rogitfs_filter *filter = commit ? private->filter : NULL;
+
+	unsigned char key[GIT_OID_RAWSZ + 2];
+	memcpy(key, tree_id.id, GIT_OID_RAWSZ);
+	key[GIT_OID_RAWSZ] = format;
+	key[GIT_OID_RAWSZ + 1] = filter != NULL;
+
+	struct rogitfs_cache_entry *entry = rogitfs_cache_get(private->manifest_cache, key, sizeof(key));
+	if (entry != NULL) {
+		*result_entry = entry;
+		return 0;
+	}
+
+	git_tree *tree = NULL;
+	int error = git_tree_lookup(&tree, private->repo, &tree_id);
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		return -ENOENT;
+	}
+
+	struct rogitfs_manifest_walk walk = {
+		.odb = private->odb,
+		.filter = filter,
+		.format = format
+	};
+	error = git_tree_walk(tree, GIT_TREEWALK_PRE, &rogitfs_manifest_walk_cb, &walk);
+	git_tree_free(tree);
+	if (error != 0 || walk.error != 0) {
+		rogitfs_buffer_free(&walk.records);
+		rogitfs_buffer_free(&walk.paths);
+		return walk.error != 0 ? walk.error : -EIO;
+	}
+
+	struct rogitfs_buffer data = walk.records;
+	if (format == ROGITFS_MANIFEST_BINARY) {
+		data = (struct rogitfs_buffer){};
+		unsigned char header[ROGITFS_MANIFEST_HEADER_SIZE] = {};
+		memcpy(header, ROGITFS_MANIFEST_MAGIC, 4);
+		rogitfs_manifest_put32(header+4, ROGITFS_MANIFEST_VERSION);
+		rogitfs_manifest_put32(header+8, walk.count);
+		rogitfs_manifest_put32(header+12, ROGITFS_MANIFEST_RECORD_SIZE);
+		int res = rogitfs_buffer_append(&data, header, sizeof(header));
+		if (res == 0) {
+			res = rogitfs_buffer_append(&data, walk.records.data, walk.records.size);
+		}
+		if (res == 0) {
+			res = rogitfs_buffer_append(&data, walk.paths.data, walk.paths.size);
+		}
+		rogitfs_buffer_free(&walk.records);
+		if (res != 0) {
+			rogitfs_buffer_free(&data);
+			rogitfs_buffer_free(&walk.paths);
+			return -ENOMEM;
+		}
+	}
+	rogitfs_buffer_free(&walk.paths);
+
+	// a manifest that would push most other entries out is only kept by the open file
+	if (data.size > private->manifest_cache->max_size / 4) {
+		*result_data = data;
+		return 0;
+	}
+	entry = rogitfs_cache_put(private->manifest_cache, key, sizeof(key), data.data, data.size);
+	rogitfs_buffer_free(&data);
+	if (entry == NULL) {
+		return -ENOMEM;
+	}
+	*result_entry = entry;
+	return 0;
+}
+
+int rogitfs_manifest_open(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_manifest_file *file = (struct rogitfs_manifest_file *) calloc(1, sizeof(struct rogitfs_manifest_file));
+	if (file == NULL) {
+		return -ENOMEM;
+	}
+	int res = rogitfs_manifest_get(path, &file->entry, &file->data, private);
+	if (res != 0) {
+		free(file);
+		return res;
+	}
+
+	fi->fh = (uint64_t)file;
+	// the size is not known before the tree is walked here
+	fi->direct_io = 1;
+	return 0;
+}
+
+int rogitfs_manifest_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	if (fi == NULL || fi->fh == 0) {
+		return -EBADF;
+	}
+	struct rogitfs_manifest_file *file = (struct rogitfs_manifest_file *)fi->fh;
+	const char *data = file->data.data;
+	size_t datalen = file->data.size;
+	if (file->entry != NULL) {
+		data = (const char *)file->entry->data;
+		datalen = file->entry->data_size;
+	}
+
+	if (offset >= datalen) {
+		return 0;
+	}
+	size_t toread = size;
+	if (offset + toread > datalen) {
+		toread = datalen - offset;
+	}
+	memcpy(buf, data + offset, toread);
+
+	return toread;
+}
+
+int rogitfs_manifest_release(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_manifest_file *file = (struct rogitfs_manifest_file *)fi->fh;
+	if (file != NULL) {
+		if (file->entry != NULL) {
+			rogitfs_cache_release(private->manifest_cache, file->entry);
+		}
+		rogitfs_buffer_free(&file->data);
+		free(file);
+	}
+	fi->fh = 0;
+	return 0;
+}
+
+int rogitfs_manifest_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	git_oid tree_id = {};
+	int commit = 0;
+	enum rogitfs_manifest_format format = ROGITFS_MANIFEST_TEXT;
+	if (rogitfs_manifest_spec(path, &tree_id, &commit, &format, private->repo) != 0) {
+		return -ENOENT;
+	}
+
+	// the manifest is built on open and read with direct_io, like /diff
+	struct stat manifest_stat = {
+		.st_mode = S_IFREG | 0444
+	};
+
+	*stbuf = manifest_stat;
+	return 0;
+}
+
+int rogitfs_manifest_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	if (path[0] != 0) {
+		return -ENOENT;
+	}
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct odb_fill_payload payload = {
+		.buf = buf,
+		.filler = filler,
+		.type = GIT_OBJECT_COMMIT,
+		.private = private
+	};
+	int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
+	if (error != 0) {
+		rogitfs_log_giterr("git_odb_foreach", error);
+		return -ENOENT;
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_MANIFEST_H__
+#define __ROGITFS_MANIFEST_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /manifest/<oid>      text listing like `git ls-tree -r -l`
+// /manifest/<oid>.bin  binary listing
+//
+// Binary layout, all integers little-endian:
+//   header  magic "RGFM", u32 version, u32 record count, u32 record size
+//   records u32 mode, u32 path size, u64 path offset, u64 size, u8[20] oid, u8 type, u8[3] pad
+//   paths   NUL terminated paths, offsets are relative to the start of this table
+#define ROGITFS_MANIFEST_MAGIC "RGFM"
+#define ROGITFS_MANIFEST_VERSION 2
+#define ROGITFS_MANIFEST_HEADER_SIZE 16
+#define ROGITFS_MANIFEST_RECORD_SIZE 48
+
+enum rogitfs_manifest_format {
+	ROGITFS_MANIFEST_TEXT = 0,
+	ROGITFS_MANIFEST_BINARY = 1
+};
+
+int rogitfs_manifest_open(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_manifest_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_manifest_release(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_manifest_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_manifest_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+#endif
@@ -0,0 +1,285 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <git2.h>
+#include "rogitfs_memory.h"
+#include "rogitfs_logging.h"
+
+// never lowered further by pressure events
+#define ROGITFS_MEMORY_MIN_CACHE_LIMIT (16 * 1024 * 1024)
+
+// registry, taken before the lock of any cache
+static pthread_mutex_t rogitfs_memory_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rogitfs_cache *rogitfs_memory_caches[ROGITFS_MEMORY_MAX_CACHES];
+static unsigned int rogitfs_memory_cache_count = 0;
+// --memory-limit, 0 without
+static size_t rogitfs_memory_limit = 0;
+// bytes the caches may take now, SIZE_MAX without limit
+static size_t rogitfs_memory_cache_limit = SIZE_MAX;
+// updated atomically
+static size_t rogitfs_memory_used = 0;
+static unsigned long long rogitfs_memory_reclaimed = 0;
+static unsigned long long rogitfs_memory_pressure_events = 0;
+
+static int rogitfs_memory_pressure_fd = -1;
+static int rogitfs_memory_wakeup[2] = {-1, -1};
+static pthread_t rogitfs_memory_monitor;
+
+uint64_t rogitfs_memory_now_ms(void) {
+
+	struct timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Part of the limit left to the caches
+static size_t rogitfs_memory_cache_part(size_t limit) {
+
+	if (limit == 0) {
+		return SIZE_MAX;
+	}
+	return limit - limit / ROGITFS_MEMORY_LIBGIT2_SHARE;
+}
+
+// Set before the caches are created, 0 for no limit
+void rogitfs_memory_set_limit(size_t limit) {
+
+	rogitfs_memory_limit = limit;
+	__atomic_store_n(&rogitfs_memory_cache_limit, rogitfs_memory_cache_part(limit), __ATOMIC_RELAXED);
+}
+
+size_t rogitfs_memory_get_limit(void) {
+
+	return rogitfs_memory_limit;
+}
+
+// Count the entries of cache from now on, cost is relative to other caches
+int rogitfs_memory_register(struct rogitfs_cache *cache, unsigned int cost) {
+
+	pthread_mutex_lock(&rogitfs_memory_lock);
+	if (rogitfs_memory_cache_count == ROGITFS_MEMORY_MAX_CACHES) {
+		pthread_mutex_unlock(&rogitfs_memory_lock);
+		return -1;
+	}
+	rogitfs_memory_caches[rogitfs_memory_cache_count++] = cache;
+	pthread_mutex_lock(&cache->lock);
+	cache->memory_cost = cost > 0 ? cost : 1;
+	rogitfs_memory_charge((ssize_t)cache->size);
+	pthread_mutex_unlock(&cache->lock);
+	pthread_mutex_unlock(&rogitfs_memory_lock);
+	return 0;
+}
+
+void rogitfs_memory_unregister(struct rogitfs_cache *cache) {
+
+	pthread_mutex_lock(&rogitfs_memory_lock);
+	for (unsigned int i = 0; i < rogitfs_memory_cache_count; i++) {
+		if (rogitfs_memory_caches[i] != cache) {
+			continue;
+		}
+		rogitfs_memory_caches[i] = rogitfs_memory_caches[--rogitfs_memory_cache_count];
+		pthread_mutex_lock(&cache->lock);
+		rogitfs_memory_charge(-(ssize_t)cache->size);
+		cache->memory_cost = 0;
+		pthread_mutex_unlock(&cache->lock);
+		break;
+	}
+	pthread_mutex_unlock(&rogitfs_memory_lock);
+}
+
+// Count bytes added to or, negative, removed from a registered cache
+void rogitfs_memory_charge(ssize_t size) {
+
+	__atomic_add_fetch(&rogitfs_memory_used, (size_t)size, __ATOMIC_RELAXED);
+}
+
+// Evict until the caches take at most target bytes, rogitfs_memory_lock held
+static void rogitfs_memory_reclaim(size_t target) {
+
+	uint64_t now = rogitfs_memory_now_ms();
+	size_t freed = 0;
+	while (__atomic_load_n(&rogitfs_memory_used, __ATOMIC_RELAXED) > target) {
+		struct rogitfs_cache *victim = NULL;
+		double victim_score = 0.0;
+		for (unsigned int i = 0; i < rogitfs_memory_cache_count; i++) {
+			struct rogitfs_cache *cache = rogitfs_memory_caches[i];
+			uint64_t used_ms = 0;
+			if (rogitfs_cache_oldest(cache, &used_ms) != 0) {
+				continue;
+			}
+			// idle time per unit of rebuild cost, entries of this millisecond count as 1 ms
+			double score = (double)(now > used_ms ? now - used_ms + 1 : 1) / cache->memory_cost;
+			if (victim == NULL || score > victim_score) {
+				victim = cache;
+				victim_score = score;
+			}
+		}
+		if (victim == NULL) {
+			break;
+		}
+		freed += rogitfs_cache_evict(victim);
+	}
+	__atomic_add_fetch(&rogitfs_memory_reclaimed, freed, __ATOMIC_RELAXED);
+}
+
+// Called after inserting into a registered cache, evicts while over the limit.
+// Threads arriving during an eviction wait for it.
+void rogitfs_memory_balance(void) {
+
+	if (__atomic_load_n(&rogitfs_memory_used, __ATOMIC_RELAXED) <= __atomic_load_n(&rogitfs_memory_cache_limit, __ATOMIC_RELAXED)) {
+		return;
+	}
+	pthread_mutex_lock(&rogitfs_memory_lock);
+	size_t limit = __atomic_load_n(&rogitfs_memory_cache_limit, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&rogitfs_memory_used, __ATOMIC_RELAXED) > limit) {
+		rogitfs_memory_reclaim(limit / 100 * ROGITFS_MEMORY_LOW_PERCENT);
+	}
+	pthread_mutex_unlock(&rogitfs_memory_lock);
+}
+
+// Pressure file of the cgroup of the process with a trigger, or the one of the system
+static int rogitfs_memory_pressure_open(void) {
+
+	char cgroup_path[PATH_MAX + 64] = "";
+	FILE *file = fopen("/proc/self/cgroup", "r");
+	if (file != NULL) {
+		char line[PATH_MAX];
+		while (fgets(line, sizeof(line), file) != NULL) {
+			// cgroup v2 is the line with hierarchy 0 and no controllers
+			if (strncmp(line, "0::", 3) == 0) {
+				line[strcspn(line, "\n")] = 0;
+				snprintf(cgroup_path, sizeof(cgroup_path), "/sys/fs/cgroup%s/memory.pressure", line + 3);
+				break;
+			}
+		}
+		fclose(file);
+	}
+
+	const char *paths[] = {cgroup_path, "/proc/pressure/memory"};
+	for (unsigned int i = 0; i < 2; i++) {
+		if (paths[i][0] == 0) {
+			continue;
+		}
+		int fd = open(paths[i], O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) {
+			continue;
+		}
+		if (write(fd, ROGITFS_MEMORY_PRESSURE_TRIGGER, strlen(ROGITFS_MEMORY_PRESSURE_TRIGGER) + 1) < 0) {
+			close(fd);
+			continue;
+		}
+		rogitfs_log(ROGITFS_LOGGING_DEBUG, "memory pressure events of %s", paths[i]);
+		return fd;
+	}
+	return -1;
+}
+
+static void *rogitfs_memory_monitor_thread(void *data) {
+
+	uint64_t last_event = 0;
+	struct pollfd fds[2] = {
+		{rogitfs_memory_pressure_fd, POLLPRI, 0},
+		{rogitfs_memory_wakeup[0], POLLIN, 0}
+	};
+	while (1) {
+		int n = poll(fds, 2, ROGITFS_MEMORY_RECOVER_MS);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 || fds[1].revents != 0) {
+			break;
+		}
+		if ((fds[0].revents & POLLERR) != 0) {
+			rogitfs_log(ROGITFS_LOGGING_WARNING, "memory pressure events ended");
+			break;
+		}
+		uint64_t now = rogitfs_memory_now_ms();
+		pthread_mutex_lock(&rogitfs_memory_lock);
+		size_t base = rogitfs_memory_cache_part(rogitfs_memory_limit);
+		size_t limit = rogitfs_memory_cache_limit;
+		if ((fds[0].revents & POLLPRI) != 0) {
+			__atomic_add_fetch(&rogitfs_memory_pressure_events, 1, __ATOMIC_RELAXED);
+			last_event = now;
+			size_t lowered = __atomic_load_n(&rogitfs_memory_used, __ATOMIC_RELAXED) / 4 * 3;
+			if (lowered < ROGITFS_MEMORY_MIN_CACHE_LIMIT) {
+				lowered = ROGITFS_MEMORY_MIN_CACHE_LIMIT;
+			}
+			if (lowered < limit) {
+				limit = lowered;
+				__atomic_store_n(&rogitfs_memory_cache_limit, limit, __ATOMIC_RELAXED);
+				rogitfs_log(ROGITFS_LOGGING_INFO, "memory pressure, caches limited to %zu bytes", limit);
+			}
+			rogitfs_memory_reclaim(limit);
+		} else if (limit < base && now - last_event >= ROGITFS_MEMORY_RECOVER_MS) {
+			limit = limit > base - limit / 2 ? base : limit + limit / 2;
+			__atomic_store_n(&rogitfs_memory_cache_limit, limit, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&rogitfs_memory_lock);
+	}
+	return NULL;
+}
+
+// Watch for memory pressure events, after fuse has daemonized
+int rogitfs_memory_start_monitor(void) {
+
+	rogitfs_memory_pressure_fd = rogitfs_memory_pressure_open();
+	if (rogitfs_memory_pressure_fd < 0) {
+		rogitfs_log(ROGITFS_LOGGING_INFO, "memory pressure events are not available");
+		return -1;
+	}
+	if (pipe2(rogitfs_memory_wakeup, O_CLOEXEC) != 0) {
+		rogitfs_log_error("pipe2 %s", strerror(errno));
+		close(rogitfs_memory_pressure_fd);
+		rogitfs_memory_pressure_fd = -1;
+		return -1;
+	}
+	int error = pthread_create(&rogitfs_memory_monitor, NULL, &rogitfs_memory_monitor_thread, NULL);
+	if (error != 0) {
+		rogitfs_log_error("pthread_create %d %s", error, strerror(error));
+		close(rogitfs_memory_wakeup[0]);
+		close(rogitfs_memory_wakeup[1]);
+		close(rogitfs_memory_pressure_fd);
+		rogitfs_memory_pressure_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void rogitfs_memory_stop_monitor(void) {
+
+	if (rogitfs_memory_pressure_fd < 0) {
+		return;
+	}
+	if (write(rogitfs_memory_wakeup[1], "", 1) != 1) {
+		rogitfs_log_error("waking the memory monitor failed %s", strerror(errno));
+	}
+	pthread_join(rogitfs_memory_monitor, NULL);
+	close(rogitfs_memory_wakeup[0]);
+	close(rogitfs_memory_wakeup[1]);
+	close(rogitfs_memory_pressure_fd);
+	rogitfs_memory_pressure_fd = -1;
+}
+
+int rogitfs_memory_report(struct rogitfs_buffer *out) {
+
+	ssize_t libgit2_used = 0;
+	ssize_t libgit2_max = 0;
+	git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &libgit2_used, &libgit2_max);
+	size_t cache_limit = __atomic_load_n(&rogitfs_memory_cache_limit, __ATOMIC_RELAXED);
+	return rogitfs_buffer_printf(out, "memory limit %zu cache_limit %zu caches %zu libgit2 %zd libgit2_max %zd reclaimed %llu pressure_events %llu\n",
+		rogitfs_memory_limit, cache_limit == SIZE_MAX ? 0 : cache_limit,
+		__atomic_load_n(&rogitfs_memory_used, __ATOMIC_RELAXED), libgit2_used, libgit2_max,
+		__atomic_load_n(&rogitfs_memory_reclaimed, __ATOMIC_RELAXED),
+		__atomic_load_n(&rogitfs_memory_pressure_events, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,56 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_MEMORY_H__
+#define __ROGITFS_MEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "rogitfs_cache.h"
+#include "rogitfs_common.h"
+
+// Memory governor shared by the caches of all repositories.
+//
+// Registered caches count their entries against --memory-limit, of which
+// the object cache of libgit2 gets ROGITFS_MEMORY_LIBGIT2_SHARE and the
+// caches the rest. A thread inserting while the caches take more than
+// their part evicts down to ROGITFS_MEMORY_LOW_PERCENT of it before going
+// on, so a burst of inserts is slowed to the pace of eviction instead of
+// growing the process. Each eviction takes the least recently used entry of
+// the cache where it scores highest, idle time divided by the cost of
+// rebuilding entries of that cache.
+//
+// Memory pressure events of the cgroup (PSI, memory.pressure) lower the
+// limit to three quarters of what the caches take at that moment, it grows
+// by half every ROGITFS_MEMORY_RECOVER_MS without events until it is back
+// at --memory-limit. Without --memory-limit only these events evict.
+
+#define ROGITFS_MEMORY_MAX_CACHES 16
+#define ROGITFS_MEMORY_LIBGIT2_SHARE 8
+#define ROGITFS_MEMORY_LOW_PERCENT 90
+// stalls of 150 ms within 2 s, the smallest window unprivileged processes may use
+#define ROGITFS_MEMORY_PRESSURE_TRIGGER "some 150000 2000000"
+#define ROGITFS_MEMORY_RECOVER_MS 10000
+
+uint64_t rogitfs_memory_now_ms(void);
+
+void rogitfs_memory_set_limit(size_t limit);
+
+size_t rogitfs_memory_get_limit(void);
+
+int rogitfs_memory_register(struct rogitfs_cache *cache, unsigned int cost);
+
+void rogitfs_memory_unregister(struct rogitfs_cache *cache);
+
+void rogitfs_memory_charge(ssize_t size);
+
+void rogitfs_memory_balance(void);
+
+int rogitfs_memory_start_monitor(void);
+
+void rogitfs_memory_stop_monitor(void);
+
+int rogitfs_memory_report(struct rogitfs_buffer *out);
+
+#endif
@@ -0,0 +1,464 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include "rogitfs_common.h"
+#include "rogitfs_mount.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_submodule.h"
+#include "rogitfs_pack.h"
+#include "rogitfs_trigram.h"
+#include "rogitfs_shm.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_logging.h"
+#include "rogitfs_memory.h"
+
+// Open the repository at path, caches are set up separately
+int rogitfs_private_open(struct rogitfs_private *private, const char *path) {
+
+	int error = git_repository_open(&private->repo, path);
+	if (error != 0) {
+		rogitfs_log_giterr("git_repository_open", error);
+		return -1;
+	}
+
+	error = git_repository_odb(&private->odb, private->repo);
+	if (error != 0) {
+		rogitfs_log_giterr("git_repository_odb", error);
+		git_repository_free(private->repo);
+		private->repo = NULL;
+		return -1;
+	}
+
+	private->packs = rogitfs_packs_open(git_repository_path(private->repo));
+
+	pthread_mutex_init(&private->graph_lock, NULL);
+	pthread_mutex_init(&private->repos_lock, NULL);
+	pthread_mutex_init(&private->reftree_lock, NULL);
+	return 0;
+}
+
+// Release everything but the caches, the shared cache and alternates belong to the mount
+void rogitfs_private_close(struct rogitfs_private *private) {
+
+	if (private->packs != NULL) {
+		rogitfs_packs_free(private->packs);
+		private->packs = NULL;
+	}
+
+	if (private->graph != NULL) {
+		rogitfs_graph_free(private->graph);
+		private->graph = NULL;
+	}
+	pthread_mutex_destroy(&private->graph_lock);
+
+	rogitfs_submodule_free_all(private);
+	pthread_mutex_destroy(&private->repos_lock);
+
+	if (private->reftree != NULL) {
+		rogitfs_reftree_free(private->reftree);
+		private->reftree = NULL;
+	}
+	pthread_mutex_destroy(&private->reftree_lock);
+
+	if (private->trigram_index != NULL) {
+		rogitfs_trigram_close(private->trigram_index);
+		private->trigram_index = NULL;
+	}
+
+	free(private->alternates);
+	private->alternates = NULL;
+	private->alternate_count = 0;
+
+	if (private->odb != NULL) {
+		git_odb_free(private->odb);
+		private->odb = NULL;
+	}
+
+	if (private->repo != NULL) {
+		git_repository_free(private->repo);
+		private->repo = NULL;
+	}
+}
+
+// Create the caches, a budget in bytes is split between them and the
+// object cache of libgit2, 0 keeps the default sizes. The delta cache is
+// sized by delta_cache_size of private. With a limit set by
+// rogitfs_memory_set_limit and no budget the caches grow until the memory
+// governor evicts.
+int rogitfs_caches_new(struct rogitfs_private *private, size_t budget) {
+
+	size_t limit = rogitfs_memory_get_limit();
+	size_t manifest_size = ROGITFS_MANIFEST_CACHE_SIZE;
+	size_t resolve_size = ROGITFS_RESOLVE_CACHE_SIZE;
+	size_t changes_size = ROGITFS_CHANGES_CACHE_SIZE;
+	size_t delta_size = ROGITFS_DELTA_CACHE_SIZE;
+	if (budget > 0) {
+		manifest_size = budget / 2;
+		changes_size = budget / 4;
+		resolve_size = budget / 8;
+	} else if (limit > 0) {
+		manifest_size = limit;
+		changes_size = limit;
+		resolve_size = limit;
+		delta_size = limit;
+	}
+	if (budget > 0 || limit > 0) {
+		// libgit2 limits the object caches of all repositories together
+		size_t libgit2_size = budget / 8;
+		if (limit > 0 && (libgit2_size == 0 || libgit2_size > limit / ROGITFS_MEMORY_LIBGIT2_SHARE)) {
+			libgit2_size = limit / ROGITFS_MEMORY_LIBGIT2_SHARE;
+		}
+		git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, (ssize_t)libgit2_size);
+	}
+	if (private->delta_cache_size > 0) {
+		delta_size = private->delta_cache_size;
+	}
+
+	private->manifest_cache = rogitfs_cache_new("manifest", manifest_size);
+	private->resolve_cache = rogitfs_cache_new("resolve", resolve_size);
+	private->changes_cache = rogitfs_cache_new("changes", changes_size);
+	private->delta_cache = rogitfs_cache_new("delta", delta_size);
+	if (private->manifest_cache == NULL || private->resolve_cache == NULL || private->changes_cache == NULL || private->delta_cache == NULL) {
+		rogitfs_log_error("rogitfs_cache_new failed");
+		rogitfs_caches_free(private);
+		return -1;
+	}
+	// bases shared by several chains may take half of the delta cache
+	private->delta_cache->protected_max_size = private->delta_cache->max_size / 2;
+	rogitfs_memory_register(private->manifest_cache, ROGITFS_MANIFEST_CACHE_COST);
+	rogitfs_memory_register(private->resolve_cache, ROGITFS_RESOLVE_CACHE_COST);
+	rogitfs_memory_register(private->changes_cache, ROGITFS_CHANGES_CACHE_COST);
+	rogitfs_memory_register(private->delta_cache, ROGITFS_DELTA_CACHE_COST);
+	return 0;
+}
+
+void rogitfs_caches_free(struct rogitfs_private *private) {
+
+	if (private->manifest_cache != NULL) {
+		rogitfs_memory_unregister(private->manifest_cache);
+		rogitfs_cache_free(private->manifest_cache);
+		private->manifest_cache = NULL;
+	}
+
+	if (private->resolve_cache != NULL) {
+		rogitfs_memory_unregister(private->resolve_cache);
+		rogitfs_cache_free(private->resolve_cache);
+		private->resolve_cache = NULL;
+	}
+
+	if (private->changes_cache != NULL) {
+		rogitfs_memory_unregister(private->changes_cache);
+		rogitfs_cache_free(private->changes_cache);
+		private->changes_cache = NULL;
+	}
+
+	if (private->delta_cache != NULL) {
+		rogitfs_memory_unregister(private->delta_cache);
+		rogitfs_cache_free(private->delta_cache);
+		private->delta_cache = NULL;
+	}
+}
+
+// Object database of the alternate at path, opened once for all repositories
+static git_odb *rogitfs_mount_alternate(struct rogitfs_mount *mount, const char *path) {
+
+	struct rogitfs_alternate *alternate = mount->alternates;
+	while (alternate != NULL && strcmp(alternate->path, path) != 0) {
+		alternate = alternate->next;
+	}
+	if (alternate != NULL) {
+		return alternate->odb;
+	}
+
+	git_odb *odb = NULL;
+	int error = git_odb_open(&odb, path);
+	if (error != 0) {
+		rogitfs_log_giterr("git_odb_open", error);
+		return NULL;
+	}
+	alternate = calloc(1, sizeof(struct rogitfs_alternate));
+	char *path_copy = strdup(path);
+	if (alternate == NULL || path_copy == NULL) {
+		free(alternate);
+		free(path_copy);
+		git_odb_free(odb);
+		return NULL;
+	}
+	alternate->path = path_copy;
+	alternate->odb = odb;
+	alternate->next = mount->alternates;
+	mount->alternates = alternate;
+	return odb;
+}
+
+// Attach the alternates listed in objects/info/alternates of a repository
+static int rogitfs_mount_alternates(struct rogitfs_mount *mount, struct rogitfs_private *private) {
+
+	char objects[PATH_MAX];
+	int len = snprintf(objects, sizeof(objects), "%sobjects", git_repository_path(private->repo));
+	if (len < 0 || len >= sizeof(objects)) {
+		return -1;
+	}
+	char info[PATH_MAX];
+	len = snprintf(info, sizeof(info), "%s/info/alternates", objects);
+	if (len < 0 || len >= sizeof(info)) {
+		return -1;
+	}
+	FILE *file = fopen(info, "r");
+	if (file == NULL) {
+		// no alternates
+		return 0;
+	}
+
+	char line[PATH_MAX];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		size_t line_len = strlen(line);
+		while (line_len > 0 && isspace((unsigned char)line[line_len-1])) {
+			line[--line_len] = 0;
+		}
+		if (line_len == 0 || line[0] == '#') {
+			continue;
+		}
+
+		// relative paths are relative to the objects directory
+		char joined[PATH_MAX];
+		if (line[0] == '/') {
+			len = snprintf(joined, sizeof(joined), "%s", line);
+		} else {
+			len = snprintf(joined, sizeof(joined), "%s/%s", objects, line);
+		}
+		if (len < 0 || len >= sizeof(joined)) {
+			continue;
+		}
+		char *path = realpath(joined, NULL);
+		if (path == NULL) {
+			continue;
+		}
+		git_odb *odb = rogitfs_mount_alternate(mount, path);
+		free(path);
+		if (odb == NULL) {
+			continue;
+		}
+
+		git_odb **alternates = realloc(private->alternates, (private->alternate_count + 1) * sizeof(git_odb *));
+		if (alternates == NULL) {
+			fclose(file);
+			return -1;
+		}
+		private->alternates = alternates;
+		private->alternates[private->alternate_count++] = odb;
+	}
+	fclose(file);
+	return 0;
+}
+
+// Parse `<name> <path>` lines of the configuration file
+static int rogitfs_mount_parse(struct rogitfs_mount *mount, FILE *file, char ***result_paths) {
+
+	char **paths = NULL;
+	char line[PATH_MAX + 256];
+	unsigned int line_number = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line_number++;
+		char *start = line;
+		while (isspace((unsigned char)start[0])) {
+			start++;
+		}
+		size_t len = strlen(start);
+		while (len > 0 && isspace((unsigned char)start[len-1])) {
+			start[--len] = 0;
+		}
+		if (len == 0 || start[0] == '#') {
+			continue;
+		}
+
+		char *name_end = start;
+		while (name_end[0] != 0 && isspace((unsigned char)name_end[0]) == 0) {
+			name_end++;
+		}
+		char *path = name_end;
+		while (isspace((unsigned char)path[0])) {
+			path++;
+		}
+		name_end[0] = 0;
+		if (path[0] == 0 || index(start, '/') != NULL || strcmp(start, ".") == 0 || strcmp(start, "..") == 0) {
+			fprintf(stderr, "config line %u: expected <name> <path>\n", line_number);
+			goto fail;
+		}
+		for (unsigned int i = 0; i < mount->count; i++) {
+			if (strcmp(mount->names[i], start) == 0) {
+				fprintf(stderr, "config line %u: duplicate name %s\n", line_number, start);
+				goto fail;
+			}
+		}
+
+		char **names = realloc(mount->names, (mount->count + 1) * sizeof(char *));
+		if (names == NULL) {
+			goto fail;
+		}
+		mount->names = names;
+		char **new_paths = realloc(paths, (mount->count + 1) * sizeof(char *));
+		if (new_paths == NULL) {
+			goto fail;
+		}
+		paths = new_paths;
+		mount->names[mount->count] = strdup(start);
+		paths[mount->count] = strdup(path);
+		mount->count++;
+		if (mount->names[mount->count-1] == NULL || paths[mount->count-1] == NULL) {
+			goto fail;
+		}
+	}
+	*result_paths = paths;
+	return 0;
+
+fail:
+	for (unsigned int i = 0; paths != NULL && i < mount->count; i++) {
+		free(paths[i]);
+	}
+	free(paths);
+	return -1;
+}
+
+// Load the repositories of the configuration file, settings holds the options
+// applied to every repository, the mount takes over its shared cache
+struct rogitfs_mount *rogitfs_mount_load(const char *config_path, size_t budget, const struct rogitfs_private *settings) {
+
+	struct rogitfs_shm *shm = settings->shm;
+
+	FILE *file = fopen(config_path, "r");
+	if (file == NULL) {
+		int err = errno;
+		fprintf(stderr, "fopen %s %d %s\n", config_path, err, strerror(err));
+		return NULL;
+	}
+
+	struct rogitfs_mount *mount = calloc(1, sizeof(struct rogitfs_mount));
+	if (mount == NULL) {
+		fclose(file);
+		if (shm != NULL) {
+			rogitfs_shm_detach(shm);
+		}
+		return NULL;
+	}
+	mount->shm = shm;
+	char **paths = NULL;
+	int res = rogitfs_mount_parse(mount, file, &paths);
+	fclose(file);
+	if (res != 0) {
+		rogitfs_mount_free(mount);
+		return NULL;
+	}
+	if (mount->count == 0) {
+		fprintf(stderr, "config %s: no repositories\n", config_path);
+		rogitfs_mount_free(mount);
+		return NULL;
+	}
+
+	struct rogitfs_private caches = {
+		.delta_cache_size = settings->delta_cache_size
+	};
+	mount->repos = calloc(mount->count, sizeof(struct rogitfs_private));
+	if (mount->repos == NULL || rogitfs_caches_new(&caches, budget) != 0) {
+		res = -1;
+	} else {
+		mount->manifest_cache = caches.manifest_cache;
+		mount->resolve_cache = caches.resolve_cache;
+		mount->changes_cache = caches.changes_cache;
+		mount->delta_cache = caches.delta_cache;
+	}
+
+	for (unsigned int i = 0; res == 0 && i < mount->count; i++) {
+		struct rogitfs_private *private = &mount->repos[i];
+		if (rogitfs_private_open(private, paths[i]) != 0) {
+			fprintf(stderr, "repository %s at %s could not be opened\n", mount->names[i], paths[i]);
+			res = -1;
+			break;
+		}
+		private->manifest_cache = mount->manifest_cache;
+		private->resolve_cache = mount->resolve_cache;
+		private->changes_cache = mount->changes_cache;
+		private->delta_cache = mount->delta_cache;
+		private->shm = mount->shm;
+		private->filter = settings->filter;
+		private->ref_ttl = settings->ref_ttl;
+		res = rogitfs_mount_alternates(mount, private);
+	}
+
+	for (unsigned int i = 0; i < mount->count; i++) {
+		free(paths[i]);
+	}
+	free(paths);
+	if (res != 0) {
+		rogitfs_mount_free(mount);
+		return NULL;
+	}
+	return mount;
+}
+
+void rogitfs_mount_free(struct rogitfs_mount *mount) {
+
+	for (unsigned int i = 0; mount->repos != NULL && i < mount->count; i++) {
+		if (mount->repos[i].repo != NULL) {
+			rogitfs_private_close(&mount->repos[i]);
+		}
+	}
+	free(mount->repos);
+
+	struct rogitfs_private caches = {
+		.manifest_cache = mount->manifest_cache,
+		.resolve_cache = mount->resolve_cache,
+		.changes_cache = mount->changes_cache,
+		.delta_cache = mount->delta_cache
+	};
+	rogitfs_caches_free(&caches);
+
+	if (mount->shm != NULL) {
+		rogitfs_shm_detach(mount->shm);
+	}
+
+	struct rogitfs_alternate *alternate = mount->alternates;
+	while (alternate != NULL) {
+		struct rogitfs_alternate *next = alternate->next;
+		git_odb_free(alternate->odb);
+		free(alternate->path);
+		free(alternate);
+		alternate = next;
+	}
+
+	for (unsigned int i = 0; mount->names != NULL && i < mount->count; i++) {
+		free(mount->names[i]);
+	}
+	free(mount->names);
+	free(mount);
+}
+
+// Repository named by the first component of path, result_path is the path below it
+struct rogitfs_private *rogitfs_mount_lookup(struct rogitfs_mount *mount, const char *path, const char **result_path) {
+
+	if (path[0] != '/') {
+		return NULL;
+	}
+	// the control directory describes the whole process, caches are shared
+	if (strncmp(path, "/.rogitfs", 9) == 0 && (path[9] == 0 || path[9] == '/') && mount->count > 0) {
+		*result_path = path;
+		return &mount->repos[0];
+	}
+	const char *name = path + 1;
+	const char *name_end = index(name, '/');
+	size_t name_len = name_end == NULL ? strlen(name) : name_end - name;
+
+	for (unsigned int i = 0; i < mount->count; i++) {
+		if (strlen(mount->names[i]) == name_len && strncmp(mount->names[i], name, name_len) == 0) {
+			*result_path = name_end == NULL || name_end[1] == 0 ? "/" : name_end;
+			return &mount->repos[i];
+		}
+	}
+	return NULL;
+}
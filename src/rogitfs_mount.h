@@ -0,0 +1,49 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_MOUNT_H__
+#define __ROGITFS_MOUNT_H__
+
+#include <git2.h>
+#include "rogitfs_common.h"
+
+// Several repositories served by one process below /<name>/...
+//
+// The configuration file names one repository per line as `<name> <path>`,
+// empty lines and lines starting with # are ignored.
+// All repositories share the caches, objects of alternates that are shared
+// between repositories are read through one object database.
+
+struct rogitfs_alternate {
+	char *path;
+	git_odb *odb;
+	struct rogitfs_alternate *next;
+};
+
+struct rogitfs_mount {
+	unsigned int count;
+	struct rogitfs_shm *shm;
+	char **names;
+	struct rogitfs_private *repos;
+	struct rogitfs_cache *manifest_cache;
+	struct rogitfs_cache *resolve_cache;
+	struct rogitfs_cache *changes_cache;
+	struct rogitfs_cache *delta_cache;
+	struct rogitfs_alternate *alternates;
+};
+
+int rogitfs_private_open(struct rogitfs_private *private, const char *path);
+
+void rogitfs_private_close(struct rogitfs_private *private);
+
+int rogitfs_caches_new(struct rogitfs_private *private, size_t budget);
+
+void rogitfs_caches_free(struct rogitfs_private *private);
+
+struct rogitfs_mount *rogitfs_mount_load(const char *config_path, size_t budget, const struct rogitfs_private *settings);
+
+void rogitfs_mount_free(struct rogitfs_mount *mount);
+
+struct rogitfs_private *rogitfs_mount_lookup(struct rogitfs_mount *mount, const char *path, const char **result_path);
+
+#endif
@@ -6,42 +6,40 @@
 #include <errno.h>
 #include "rogitfs_obj.h"
 #include "rogitfs_common.h"
+#include "rogitfs_xattr.h"
+#include "rogitfs_logging.h"
 
 
 int rogitfs_obj_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_oid oid = {};
 	int error = git_oid_fromstr(&oid, path);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_oid_fromstr %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_oid_fromstr", error);
 		return -1;
 	}
 
 	git_object *obj = NULL;
 	error = git_object_lookup(&obj, private->repo, &oid, GIT_OBJECT_ANY);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_object_lookup %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_object_lookup", error);
 		return -1;
 
 	}
 
 	git_odb_object *odb_obj = NULL;
-	error = git_odb_read(&odb_obj, private->odb, &oid);
+	error = rogitfs_odb_read(&odb_obj, private->odb, &oid, private);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_read %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_read", error);
 		git_odb_object_free(odb_obj);
 		return -1;
 	}
 
 	const void *data = git_odb_object_data(odb_obj);
 	if (data == NULL) {
-		fputs("git_odb_object_data is NULL\n", stderr);
+		rogitfs_log_error("git_odb_object_data is NULL");
 		git_object_free(obj);
 		git_odb_object_free(odb_obj);
 		return -1;
@@ -71,30 +69,26 @@ int rogitfs_obj_read(const char *path, char *buf, size_t size, off_t offset, str
 
 int rogitfs_obj_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_oid oid = {};
 	int error = git_oid_fromstr(&oid, path);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_oid_fromstr %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_oid_fromstr", error);
 		return -ENOENT;
 	}
 
 	git_object *obj = NULL;
 	error = git_object_lookup(&obj, private->repo, &oid, GIT_OBJECT_ANY);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_object_lookup %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_object_lookup", error);
 		return -ENOENT;
 	}
 
 	git_odb_object *odb_obj = NULL;
-	error = git_odb_read(&odb_obj, private->odb, &oid);
+	error = rogitfs_odb_read(&odb_obj, private->odb, &oid, private);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_read %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_read", error);
 		git_odb_object_free(odb_obj);
 		return -ENOENT;
 	}
@@ -113,10 +107,35 @@ int rogitfs_obj_getattr(const char *path, struct stat *stbuf, struct fuse_file_i
 	return 0;
 }
 
+int rogitfs_obj_getxattr(const char *path, const char *name, char *value, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	int error = rogitfs_resolve_component(NULL, path, &entry, private);
+	if (error != 0) {
+		return -ENOENT;
+	}
+
+	return rogitfs_xattr_get(&entry, name, value, size, private);
+}
+
+int rogitfs_obj_listxattr(const char *path, char *list, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	int error = rogitfs_resolve_component(NULL, path, &entry, private);
+	if (error != 0) {
+		return -ENOENT;
+	}
+
+	return rogitfs_xattr_list(&entry, list, size);
+}
+
 int rogitfs_obj_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	struct odb_fill_payload payload = {
 		.buf = buf,
@@ -127,8 +146,7 @@ int rogitfs_obj_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off
 
 	int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_odb_foreach %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_odb_foreach", error);
 		return -ENOENT;
 	}
 
@@ -12,6 +12,10 @@ int rogitfs_obj_read(const char *path, char *buf, size_t size, off_t offset, str
 
 int rogitfs_obj_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
 
+int rogitfs_obj_getxattr(const char *path, const char *name, char *value, size_t size);
+
+int rogitfs_obj_listxattr(const char *path, char *list, size_t size);
+
 int rogitfs_obj_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
 
 #endif
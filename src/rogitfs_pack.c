@@ -0,0 +1,817 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rogitfs_common.h"
+#include "rogitfs_cache.h"
+#include "rogitfs_pack.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_trace.h"
+#include "rogitfs_logging.h"
+
+#define ROGITFS_PACK_IDX_MAGIC 0xff744f63
+#define ROGITFS_PACK_HEADER_SIZE 12
+#define ROGITFS_PACK_TRAILER_SIZE 20
+// version 2 index: magic, version, fanout table and two checksums
+#define ROGITFS_PACK_IDX_MIN_SIZE (8 + 256 * 4 + 2 * GIT_OID_RAWSZ)
+// delta cache key: checksum of the pack and offset of the entry
+#define ROGITFS_PACK_KEY_SIZE (GIT_OID_RAWSZ + 8)
+
+static const void *rogitfs_pack_map(const char *path, size_t *result_size) {
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "open %s %s", path, strerror(errno));
+		return NULL;
+	}
+	struct stat st = {};
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "mmap %s %s", path, strerror(errno));
+		return NULL;
+	}
+	*result_size = st.st_size;
+	return map;
+}
+
+static void rogitfs_pack_file_unmap(struct rogitfs_pack_file *pack) {
+
+	if (pack->idx != NULL) {
+		munmap((void *)pack->idx, pack->idx_size);
+		pack->idx = NULL;
+	}
+	if (pack->pack != NULL) {
+		munmap((void *)pack->pack, pack->pack_size);
+		pack->pack = NULL;
+	}
+}
+
+static void rogitfs_pack_file_free(struct rogitfs_pack_file *pack) {
+
+	rogitfs_pack_file_unmap(pack);
+	pthread_mutex_destroy(&pack->lock);
+	free(pack->path);
+	free(pack);
+}
+
+// Pack of an index found in the pack directory, mapped on first use
+static struct rogitfs_pack_file *rogitfs_pack_file_new(const char *idx_path) {
+
+	struct rogitfs_pack_file *pack = (struct rogitfs_pack_file *) calloc(1, sizeof(struct rogitfs_pack_file));
+	if (pack == NULL) {
+		return NULL;
+	}
+	size_t path_size = strlen(idx_path);
+	pack->path = (char *) malloc(path_size + 2);
+	if (pack->path == NULL) {
+		free(pack);
+		return NULL;
+	}
+	// pack-<hash>.idx to pack-<hash>.pack
+	memcpy(pack->path, idx_path, path_size - 3);
+	memcpy(pack->path + path_size - 3, "pack", 5);
+	pthread_mutex_init(&pack->lock, NULL);
+	pack->state = ROGITFS_PACK_UNLOADED;
+	return pack;
+}
+
+// Map an index of version 2 and its pack
+static int rogitfs_pack_file_map(struct rogitfs_pack_file *pack, const char *idx_path) {
+
+	pack->idx = (const unsigned char *) rogitfs_pack_map(idx_path, &pack->idx_size);
+	if (pack->idx == NULL || pack->idx_size < ROGITFS_PACK_IDX_MIN_SIZE) {
+		return -1;
+	}
+	const uint32_t *header = (const uint32_t *)pack->idx;
+	if (be32toh(header[0]) != ROGITFS_PACK_IDX_MAGIC || be32toh(header[1]) != 2) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "%s is no version 2 pack index", idx_path);
+		return -1;
+	}
+	pack->fanout = header + 2;
+	pack->count = be32toh(pack->fanout[255]);
+	// object ids, crc32 and offsets of every object
+	size_t tables_size = (size_t)pack->count * (GIT_OID_RAWSZ + 4 + 4);
+	if (pack->idx_size < ROGITFS_PACK_IDX_MIN_SIZE + tables_size) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "%s is truncated", idx_path);
+		return -1;
+	}
+	pack->oids = pack->idx + 8 + 256 * 4;
+	pack->offsets = (const uint32_t *)(pack->oids + (size_t)pack->count * (GIT_OID_RAWSZ + 4));
+	pack->large_offsets = (const unsigned char *)(pack->offsets + pack->count);
+	pack->large_offset_count = (pack->idx_size - ROGITFS_PACK_IDX_MIN_SIZE - tables_size) / 8;
+
+	pack->pack = (const unsigned char *) rogitfs_pack_map(pack->path, &pack->pack_size);
+	if (pack->pack == NULL || pack->pack_size < ROGITFS_PACK_HEADER_SIZE + ROGITFS_PACK_TRAILER_SIZE) {
+		return -1;
+	}
+	const uint32_t *pack_header = (const uint32_t *)pack->pack;
+	if (memcmp(pack->pack, "PACK", 4) != 0 || be32toh(pack_header[2]) != pack->count) {
+		rogitfs_log(ROGITFS_LOGGING_WARNING, "%s does not match its index", pack->path);
+		return -1;
+	}
+	// objects are looked up all over the pack
+	madvise((void *)pack->pack, pack->pack_size, MADV_RANDOM);
+	return 0;
+}
+
+// Map the pack unless done before, by the startup threads or the first
+// read searching it. Returns 0 when the pack can be used.
+int rogitfs_pack_file_load(struct rogitfs_pack_file *pack) {
+
+	int state = __atomic_load_n(&pack->state, __ATOMIC_ACQUIRE);
+	if (state == ROGITFS_PACK_UNLOADED) {
+		pthread_mutex_lock(&pack->lock);
+		state = pack->state;
+		if (state == ROGITFS_PACK_UNLOADED) {
+			// pack-<hash>.pack to pack-<hash>.idx
+			struct rogitfs_buffer idx_path = {};
+			state = ROGITFS_PACK_LOADED;
+			if (rogitfs_buffer_printf(&idx_path, "%.*sidx", (int)strlen(pack->path) - 4, pack->path) != 0 || rogitfs_buffer_append(&idx_path, "", 1) != 0 || rogitfs_pack_file_map(pack, idx_path.data) != 0) {
+				rogitfs_pack_file_unmap(pack);
+				state = ROGITFS_PACK_FAILED;
+			}
+			rogitfs_buffer_free(&idx_path);
+			__atomic_store_n(&pack->state, state, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&pack->lock);
+	}
+	return state == ROGITFS_PACK_LOADED ? 0 : -1;
+}
+
+// Find the packs below objects/pack of gitdir, NULL if there are none.
+// Only the directory is read, packs are mapped by rogitfs_pack_file_load.
+struct rogitfs_packs *rogitfs_packs_open(const char *gitdir) {
+
+	struct rogitfs_buffer dir_path = {};
+	if (rogitfs_buffer_printf(&dir_path, "%s/objects/pack", gitdir) != 0 || rogitfs_buffer_append(&dir_path, "", 1) != 0) {
+		rogitfs_buffer_free(&dir_path);
+		return NULL;
+	}
+	DIR *dir = opendir(dir_path.data);
+	if (dir == NULL) {
+		rogitfs_buffer_free(&dir_path);
+		return NULL;
+	}
+	struct rogitfs_packs *packs = (struct rogitfs_packs *) calloc(1, sizeof(struct rogitfs_packs));
+	if (packs == NULL) {
+		closedir(dir);
+		rogitfs_buffer_free(&dir_path);
+		return NULL;
+	}
+
+	unsigned int capacity = 0;
+	struct dirent *dirent = NULL;
+	while ((dirent = readdir(dir)) != NULL) {
+		size_t name_size = strlen(dirent->d_name);
+		if (name_size < 5 || strcmp(dirent->d_name + name_size - 4, ".idx") != 0) {
+			continue;
+		}
+		if (packs->file_count == capacity) {
+			unsigned int new_capacity = capacity == 0 ? 16 : capacity * 2;
+			struct rogitfs_pack_file **files = (struct rogitfs_pack_file **) realloc(packs->files, new_capacity * sizeof(struct rogitfs_pack_file *));
+			if (files == NULL) {
+				break;
+			}
+			packs->files = files;
+			capacity = new_capacity;
+		}
+		struct rogitfs_buffer idx_path = {};
+		if (rogitfs_buffer_printf(&idx_path, "%s/%s", dir_path.data, dirent->d_name) != 0 || rogitfs_buffer_append(&idx_path, "", 1) != 0) {
+			rogitfs_buffer_free(&idx_path);
+			continue;
+		}
+		struct rogitfs_pack_file *pack = rogitfs_pack_file_new(idx_path.data);
+		rogitfs_buffer_free(&idx_path);
+		if (pack != NULL) {
+			packs->files[packs->file_count++] = pack;
+		}
+	}
+	closedir(dir);
+	rogitfs_buffer_free(&dir_path);
+	if (packs->file_count == 0) {
+		free(packs->files);
+		free(packs);
+		return NULL;
+	}
+
+	pthread_mutex_init(&packs->lock, NULL);
+	for (unsigned int i = 0; i < ROGITFS_PACK_CURSORS; i++) {
+		// streams that failed to initialize stay busy and are never used
+		if (inflateInit(&packs->cursors[i].stream) != Z_OK) {
+			packs->cursors[i].busy = 1;
+		}
+	}
+	return packs;
+}
+
+void rogitfs_packs_free(struct rogitfs_packs *packs) {
+
+	for (unsigned int i = 0; i < ROGITFS_PACK_CURSORS; i++) {
+		inflateEnd(&packs->cursors[i].stream);
+	}
+	pthread_mutex_destroy(&packs->lock);
+	for (unsigned int i = 0; i < packs->file_count; i++) {
+		rogitfs_pack_file_free(packs->files[i]);
+	}
+	free(packs->files);
+	free(packs);
+}
+
+// Offset of an object in the pack, binary search within its fanout range
+static int rogitfs_pack_find(const struct rogitfs_pack_file *pack, const git_oid *oid, uint64_t *result_offset) {
+
+	uint32_t first = oid->id[0] == 0 ? 0 : be32toh(pack->fanout[oid->id[0] - 1]);
+	uint32_t last = be32toh(pack->fanout[oid->id[0]]);
+	if (last > pack->count) {
+		return 1;
+	}
+	while (first < last) {
+		uint32_t middle = first + (last - first) / 2;
+		int cmp = memcmp(pack->oids + (size_t)middle * GIT_OID_RAWSZ, oid->id, GIT_OID_RAWSZ);
+		if (cmp == 0) {
+			uint32_t offset = be32toh(pack->offsets[middle]);
+			if ((offset & 0x80000000u) == 0) {
+				*result_offset = offset;
+				return 0;
+			}
+			offset &= 0x7fffffffu;
+			if (offset >= pack->large_offset_count) {
+				return -1;
+			}
+			uint64_t large_offset = 0;
+			memcpy(&large_offset, pack->large_offsets + (size_t)offset * 8, 8);
+			*result_offset = be64toh(large_offset);
+			return 0;
+		}
+		if (cmp < 0) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+	return 1;
+}
+
+// Type and inflated size from the header of a pack entry, and where its zlib data starts
+static int rogitfs_pack_entry(const struct rogitfs_pack_file *pack, uint64_t offset, int *result_type, uint64_t *result_size, uint64_t *result_data) {
+
+	uint64_t end = pack->pack_size - ROGITFS_PACK_TRAILER_SIZE;
+	if (offset < ROGITFS_PACK_HEADER_SIZE || offset >= end) {
+		return -1;
+	}
+	unsigned char c = pack->pack[offset++];
+	int type = (c >> 4) & 7;
+	uint64_t size = c & 15;
+	unsigned int shift = 4;
+	while ((c & 0x80) != 0) {
+		if (offset >= end || shift > 57) {
+			return -1;
+		}
+		c = pack->pack[offset++];
+		size |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	}
+	*result_type = type;
+	*result_size = size;
+	*result_data = offset;
+	return 0;
+}
+
+// Inflate the next size bytes of the object, size must not pass its end
+static int rogitfs_pack_inflate(struct rogitfs_pack_cursor *cursor, unsigned char *out, size_t size) {
+
+	z_stream *stream = &cursor->stream;
+	while (size > 0) {
+		uInt chunk = size > (1u << 30) ? (1u << 30) : (uInt)size;
+		stream->next_out = out;
+		stream->avail_out = chunk;
+		while (stream->avail_out > 0) {
+			if (stream->avail_in == 0) {
+				size_t left = cursor->input_end - stream->next_in;
+				if (left == 0) {
+					return -1;
+				}
+				stream->avail_in = left > (1u << 30) ? (1u << 30) : (uInt)left;
+			}
+			int ret = inflate(stream, Z_NO_FLUSH);
+			if (ret == Z_STREAM_END) {
+				if (stream->avail_out > 0) {
+					return -1;
+				}
+				break;
+			}
+			if (ret != Z_OK) {
+				return -1;
+			}
+		}
+		out += chunk;
+		size -= chunk;
+		cursor->position += chunk;
+	}
+	return 0;
+}
+
+// Inflate the first size bytes of the entry data starting at data_offset
+static int rogitfs_pack_inflate_at(const struct rogitfs_pack_file *pack, uint64_t data_offset, unsigned char *out, size_t size) {
+
+	struct rogitfs_pack_cursor cursor = {};
+	if (inflateInit(&cursor.stream) != Z_OK) {
+		return -1;
+	}
+	cursor.stream.next_in = (unsigned char *)pack->pack + data_offset;
+	cursor.input_end = pack->pack + pack->pack_size - ROGITFS_PACK_TRAILER_SIZE;
+	int res = rogitfs_pack_inflate(&cursor, out, size);
+	inflateEnd(&cursor.stream);
+	return res;
+}
+
+// Entry offset of the base of a delta, data_offset is moved past the base reference
+static int rogitfs_pack_delta_base(const struct rogitfs_pack_file *pack, uint64_t offset, int type, uint64_t *data_offset, uint64_t *result_base) {
+
+	uint64_t end = pack->pack_size - ROGITFS_PACK_TRAILER_SIZE;
+	uint64_t cur = *data_offset;
+	if (type == GIT_OBJECT_REF_DELTA) {
+		if (cur + GIT_OID_RAWSZ > end) {
+			return -1;
+		}
+		git_oid base_oid = {};
+		memcpy(base_oid.id, pack->pack + cur, GIT_OID_RAWSZ);
+		*data_offset = cur + GIT_OID_RAWSZ;
+		// a base in another pack is left to libgit2
+		return rogitfs_pack_find(pack, &base_oid, result_base);
+	}
+	// distance to the base, each further byte adds one before shifting
+	if (cur >= end) {
+		return -1;
+	}
+	unsigned char c = pack->pack[cur++];
+	uint64_t distance = c & 0x7f;
+	while ((c & 0x80) != 0) {
+		if (cur >= end || distance > (UINT64_MAX >> 7) - 1) {
+			return -1;
+		}
+		c = pack->pack[cur++];
+		distance = ((distance + 1) << 7) | (c & 0x7f);
+	}
+	if (distance == 0 || distance > offset) {
+		return -1;
+	}
+	*data_offset = cur;
+	*result_base = offset - distance;
+	return 0;
+}
+
+static int rogitfs_pack_delta_varint(const unsigned char **cur, const unsigned char *end, uint64_t *result) {
+
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	unsigned char c = 0;
+	do {
+		if (*cur >= end || shift > 63) {
+			return -1;
+		}
+		c = *(*cur)++;
+		value |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while ((c & 0x80) != 0);
+	*result = value;
+	return 0;
+}
+
+// Size of the object a delta produces, read from the start of its data
+static int rogitfs_pack_delta_target_size(const struct rogitfs_pack_file *pack, uint64_t data_offset, uint64_t delta_size, uint64_t *result_size) {
+
+	// two varints of at most 10 bytes
+	unsigned char header[20];
+	size_t header_size = delta_size < sizeof(header) ? delta_size : sizeof(header);
+	if (rogitfs_pack_inflate_at(pack, data_offset, header, header_size) != 0) {
+		return -1;
+	}
+	const unsigned char *cur = header;
+	uint64_t source_size = 0;
+	if (rogitfs_pack_delta_varint(&cur, header + header_size, &source_size) != 0) {
+		return -1;
+	}
+	return rogitfs_pack_delta_varint(&cur, header + header_size, result_size);
+}
+
+// Apply a delta to base, returns the allocated result or NULL if the delta
+// does not fit the base
+static unsigned char *rogitfs_pack_delta_apply(const unsigned char *base, size_t base_size, const unsigned char *delta, size_t delta_size, size_t *result_size) {
+
+	const unsigned char *cur = delta;
+	const unsigned char *end = delta + delta_size;
+	uint64_t source_size = 0;
+	uint64_t target_size = 0;
+	if (rogitfs_pack_delta_varint(&cur, end, &source_size) != 0 || rogitfs_pack_delta_varint(&cur, end, &target_size) != 0) {
+		return NULL;
+	}
+	if (source_size != base_size || target_size > SIZE_MAX - 1) {
+		return NULL;
+	}
+	unsigned char *out = (unsigned char *) malloc(target_size + 1);
+	if (out == NULL) {
+		rogitfs_log_error("rogitfs_pack_delta_apply malloc failed");
+		return NULL;
+	}
+
+	uint64_t position = 0;
+	int valid = 1;
+	while (valid && cur < end) {
+		unsigned char op = *cur++;
+		if ((op & 0x80) != 0) {
+			// copy from base, the bits tell which offset and size bytes follow
+			uint64_t copy_offset = 0;
+			uint64_t copy_size = 0;
+			for (unsigned int i = 0; valid && i < 7; i++) {
+				if ((op & (1u << i)) == 0) {
+					continue;
+				}
+				if (cur >= end) {
+					valid = 0;
+					break;
+				}
+				if (i < 4) {
+					copy_offset |= (uint64_t)*cur++ << (8 * i);
+				} else {
+					copy_size |= (uint64_t)*cur++ << (8 * (i - 4));
+				}
+			}
+			if (copy_size == 0) {
+				copy_size = 0x10000;
+			}
+			if (valid == 0 || copy_offset + copy_size > base_size || copy_size > target_size - position) {
+				valid = 0;
+				break;
+			}
+			memcpy(out + position, base + copy_offset, copy_size);
+			position += copy_size;
+		} else if (op != 0) {
+			// insert the next op bytes of the delta
+			if (op > end - cur || op > target_size - position) {
+				valid = 0;
+				break;
+			}
+			memcpy(out + position, cur, op);
+			cur += op;
+			position += op;
+		} else {
+			valid = 0;
+		}
+	}
+	if (valid == 0 || position != target_size) {
+		free(out);
+		return NULL;
+	}
+	*result_size = target_size;
+	return out;
+}
+
+static void rogitfs_pack_key(const struct rogitfs_pack_file *pack, uint64_t offset, unsigned char *key) {
+
+	memcpy(key, pack->pack + pack->pack_size - ROGITFS_PACK_TRAILER_SIZE, GIT_OID_RAWSZ);
+	memcpy(key + GIT_OID_RAWSZ, &offset, 8);
+}
+
+// Inflate a whole entry and add it to the cache under key
+static struct rogitfs_cache_entry *rogitfs_pack_cache_whole(struct rogitfs_cache *cache, const struct rogitfs_pack_file *pack, uint64_t data_offset, uint64_t size, const unsigned char *key) {
+
+	if (size > SIZE_MAX - 1) {
+		return NULL;
+	}
+	unsigned char *data = (unsigned char *) malloc(size + 1);
+	if (data == NULL) {
+		rogitfs_log_error("rogitfs_pack_cache_whole malloc failed");
+		return NULL;
+	}
+	struct rogitfs_cache_entry *entry = NULL;
+	if (rogitfs_pack_inflate_at(pack, data_offset, data, size) == 0) {
+		rogitfs_stats_count(ROGITFS_STATS_BYTES_INFLATED, size);
+		entry = rogitfs_cache_put(cache, key, ROGITFS_PACK_KEY_SIZE, data, size);
+	}
+	free(data);
+	return entry;
+}
+
+// Apply the delta entry at offset to base and add the result to the cache
+static struct rogitfs_cache_entry *rogitfs_pack_cache_delta(struct rogitfs_cache *cache, const struct rogitfs_pack_file *pack, uint64_t offset, const struct rogitfs_cache_entry *base) {
+
+	int type = 0;
+	uint64_t delta_size = 0;
+	uint64_t data_offset = 0;
+	uint64_t base_offset = 0;
+	if (rogitfs_pack_entry(pack, offset, &type, &delta_size, &data_offset) != 0 || rogitfs_pack_delta_base(pack, offset, type, &data_offset, &base_offset) != 0) {
+		return NULL;
+	}
+	if (delta_size > SIZE_MAX - 1) {
+		return NULL;
+	}
+	unsigned char *delta = (unsigned char *) malloc(delta_size + 1);
+	if (delta == NULL) {
+		rogitfs_log_error("rogitfs_pack_cache_delta malloc failed");
+		return NULL;
+	}
+	if (rogitfs_pack_inflate_at(pack, data_offset, delta, delta_size) != 0) {
+		free(delta);
+		return NULL;
+	}
+	rogitfs_stats_count(ROGITFS_STATS_BYTES_INFLATED, delta_size);
+	size_t result_size = 0;
+	unsigned char *result = rogitfs_pack_delta_apply((const unsigned char *)base->data, base->data_size, delta, delta_size, &result_size);
+	free(delta);
+	if (result == NULL) {
+		return NULL;
+	}
+	rogitfs_stats_count(ROGITFS_STATS_DELTAS_APPLIED, 1);
+	unsigned char key[ROGITFS_PACK_KEY_SIZE];
+	rogitfs_pack_key(pack, offset, key);
+	struct rogitfs_cache_entry *entry = rogitfs_cache_put(cache, key, sizeof(key), result, result_size);
+	free(result);
+	return entry;
+}
+
+// Content of the delta entry at offset as referenced entry of the delta cache.
+// The chain of bases is followed down to an object stored whole or a base
+// already cached, every object on the way back up is cached. Chains with an
+// object larger than a quarter of the cache are not resolved. A cached base
+// reached from another object is shared by chains and protected from eviction.
+// Returns 0 with the entry, 1 if the object has to be read by libgit2 and -1
+// if the pack is damaged.
+static int rogitfs_pack_resolve(struct rogitfs_cache *cache, const struct rogitfs_pack_file *pack, uint64_t offset, struct rogitfs_cache_entry **result_entry) {
+
+	unsigned char key[ROGITFS_PACK_KEY_SIZE];
+	rogitfs_pack_key(pack, offset, key);
+	struct rogitfs_cache_entry *base = rogitfs_cache_get(cache, key, sizeof(key));
+	if (base != NULL) {
+		*result_entry = base;
+		return 0;
+	}
+
+	// offsets of the deltas still to apply, the requested object first
+	uint64_t *chain = NULL;
+	unsigned int depth = 0;
+	uint64_t cur = offset;
+	int type = 0;
+	uint64_t size = 0;
+	uint64_t data_offset = 0;
+	int res = 0;
+	while (res == 0 && base == NULL) {
+		if (rogitfs_pack_entry(pack, cur, &type, &size, &data_offset) != 0) {
+			res = -1;
+			break;
+		}
+		if (type >= GIT_OBJECT_COMMIT && type <= GIT_OBJECT_TAG) {
+			break;
+		}
+		if (type != GIT_OBJECT_OFS_DELTA && type != GIT_OBJECT_REF_DELTA) {
+			res = -1;
+			break;
+		}
+		if (depth == ROGITFS_PACK_MAX_DEPTH) {
+			res = 1;
+			break;
+		}
+		uint64_t base_offset = 0;
+		res = rogitfs_pack_delta_base(pack, cur, type, &data_offset, &base_offset);
+		if (res != 0) {
+			break;
+		}
+		// every object on the chain is cached, chains with one that would push
+		// most other entries out are left to libgit2
+		uint64_t target_size = 0;
+		if (rogitfs_pack_delta_target_size(pack, data_offset, size, &target_size) != 0) {
+			res = -1;
+			break;
+		}
+		if (target_size > cache->max_size / 4) {
+			res = 1;
+			break;
+		}
+		if (depth % 64 == 0) {
+			uint64_t *new_chain = (uint64_t *) realloc(chain, (depth + 64) * sizeof(uint64_t));
+			if (new_chain == NULL) {
+				res = -1;
+				break;
+			}
+			chain = new_chain;
+		}
+		chain[depth++] = cur;
+		cur = base_offset;
+		rogitfs_pack_key(pack, cur, key);
+		base = rogitfs_cache_get(cache, key, sizeof(key));
+		if (base != NULL) {
+			rogitfs_cache_protect(cache, base);
+		}
+	}
+	if (res == 0 && base == NULL) {
+		if (size > cache->max_size / 4) {
+			res = 1;
+		} else {
+			base = rogitfs_pack_cache_whole(cache, pack, data_offset, size, key);
+			if (base == NULL) {
+				res = -1;
+			}
+		}
+	}
+
+	while (res == 0 && depth > 0) {
+		uint64_t delta_offset = chain[--depth];
+		struct rogitfs_cache_entry *next = rogitfs_pack_cache_delta(cache, pack, delta_offset, base);
+		rogitfs_cache_release(cache, base);
+		base = next;
+		if (base == NULL) {
+			res = -1;
+		}
+	}
+	free(chain);
+	if (res != 0) {
+		if (res < 0) {
+			rogitfs_log_error("%s: resolving delta at %llu failed", pack->path, (unsigned long long)offset);
+		}
+		rogitfs_cache_release(cache, base);
+		return res;
+	}
+	*result_entry = base;
+	return 0;
+}
+
+// Take the cursor that already passed least of offset of the object or the
+// least recently used one, NULL if all are in use
+static struct rogitfs_pack_cursor *rogitfs_pack_cursor_get(struct rogitfs_packs *packs, const git_oid *oid, off_t offset) {
+
+	pthread_mutex_lock(&packs->lock);
+	struct rogitfs_pack_cursor *resume = NULL;
+	struct rogitfs_pack_cursor *oldest = NULL;
+	for (unsigned int i = 0; i < ROGITFS_PACK_CURSORS; i++) {
+		struct rogitfs_pack_cursor *cursor = &packs->cursors[i];
+		if (cursor->busy) {
+			continue;
+		}
+		if (cursor->valid && cursor->position <= (uint64_t)offset && git_oid_equal(&cursor->oid, oid)) {
+			if (resume == NULL || cursor->position > resume->position) {
+				resume = cursor;
+			}
+		}
+		if (oldest == NULL || cursor->used < oldest->used) {
+			oldest = cursor;
+		}
+	}
+	struct rogitfs_pack_cursor *cursor = resume != NULL ? resume : oldest;
+	if (cursor != NULL) {
+		cursor->busy = 1;
+		cursor->used = ++packs->tick;
+		if (cursor != resume) {
+			cursor->valid = 0;
+		}
+	}
+	pthread_mutex_unlock(&packs->lock);
+	return cursor;
+}
+
+static void rogitfs_pack_cursor_put(struct rogitfs_packs *packs, struct rogitfs_pack_cursor *cursor) {
+
+	pthread_mutex_lock(&packs->lock);
+	cursor->busy = 0;
+	pthread_mutex_unlock(&packs->lock);
+}
+
+// Slice of a deltified object, resolved through the delta cache
+static int rogitfs_pack_read_delta(struct rogitfs_cache *delta_cache, const struct rogitfs_pack_file *pack, uint64_t entry_offset, char *buf, size_t size, off_t offset, size_t *result_size) {
+
+	if (delta_cache == NULL) {
+		return 1;
+	}
+	struct timespec trace_start = {};
+	rogitfs_trace_start(&trace_start);
+	struct rogitfs_cache_entry *entry = NULL;
+	int res = rogitfs_pack_resolve(delta_cache, pack, entry_offset, &entry);
+	rogitfs_trace_span("pack_delta", NULL, &trace_start);
+	if (res != 0) {
+		return res;
+	}
+	size_t want = 0;
+	if ((uint64_t)offset < entry->data_size) {
+		want = entry->data_size - offset;
+		if (want > size) {
+			want = size;
+		}
+		memcpy(buf, (const char *)entry->data + offset, want);
+	}
+	rogitfs_cache_release(delta_cache, entry);
+	rogitfs_stats_count(ROGITFS_STATS_PACK_READS, 1);
+	*result_size = want;
+	return 0;
+}
+
+// Read a slice of an object of the packs, deltas are resolved through
+// delta_cache and left to libgit2 without it.
+// Returns 0 with the number of bytes in result_size, 1 if the object has to
+// be read by libgit2 and -1 if the pack is damaged.
+int rogitfs_pack_read(struct rogitfs_packs *packs, struct rogitfs_cache *delta_cache, const git_oid *oid, char *buf, size_t size, off_t offset, size_t *result_size) {
+
+	if (packs == NULL || offset < 0) {
+		return 1;
+	}
+	const struct rogitfs_pack_file *pack = NULL;
+	uint64_t entry_offset = 0;
+	int res = 1;
+	for (unsigned int i = 0; i < packs->file_count && res == 1; i++) {
+		// waits only for packs searched before the object is found
+		if (rogitfs_pack_file_load(packs->files[i]) != 0) {
+			continue;
+		}
+		pack = packs->files[i];
+		res = rogitfs_pack_find(pack, oid, &entry_offset);
+	}
+	if (res != 0) {
+		return res;
+	}
+	int type = 0;
+	uint64_t object_size = 0;
+	uint64_t data_offset = 0;
+	if (rogitfs_pack_entry(pack, entry_offset, &type, &object_size, &data_offset) != 0) {
+		rogitfs_log_error("%s has a damaged entry at %llu", pack->path, (unsigned long long)entry_offset);
+		return -1;
+	}
+	if (type == GIT_OBJECT_OFS_DELTA || type == GIT_OBJECT_REF_DELTA) {
+		return rogitfs_pack_read_delta(delta_cache, pack, entry_offset, buf, size, offset, result_size);
+	}
+	if (type < GIT_OBJECT_COMMIT || type > GIT_OBJECT_TAG) {
+		rogitfs_log_error("%s has an entry of type %d at %llu", pack->path, type, (unsigned long long)entry_offset);
+		return -1;
+	}
+	if ((uint64_t)offset >= object_size) {
+		*result_size = 0;
+		return 0;
+	}
+	size_t want = size;
+	if (want > object_size - offset) {
+		want = object_size - offset;
+	}
+
+	struct rogitfs_pack_cursor *cursor = rogitfs_pack_cursor_get(packs, oid, offset);
+	if (cursor == NULL) {
+		return 1;
+	}
+	struct timespec trace_start = {};
+	rogitfs_trace_start(&trace_start);
+
+	if (cursor->valid == 0) {
+		inflateReset(&cursor->stream);
+		cursor->stream.next_in = (unsigned char *)pack->pack + data_offset;
+		cursor->stream.avail_in = 0;
+		cursor->input_end = pack->pack + pack->pack_size - ROGITFS_PACK_TRAILER_SIZE;
+		cursor->oid = *oid;
+		cursor->pack = pack;
+		cursor->position = 0;
+		cursor->object_size = object_size;
+		cursor->valid = 1;
+	} else if (cursor->position == (uint64_t)offset) {
+		// read front to back, have the following compressed data read ahead
+		uintptr_t page = (uintptr_t)cursor->stream.next_in & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+		size_t length = ROGITFS_PACK_READAHEAD;
+		if (page + length > (uintptr_t)cursor->input_end) {
+			length = (uintptr_t)cursor->input_end - page;
+		}
+		madvise((void *)page, length, MADV_WILLNEED);
+	}
+	uint64_t start_position = cursor->position;
+
+	res = 0;
+	unsigned char skip[16384];
+	while (res == 0 && cursor->position < (uint64_t)offset) {
+		uint64_t left = offset - cursor->position;
+		res = rogitfs_pack_inflate(cursor, skip, left > sizeof(skip) ? sizeof(skip) : left);
+	}
+	if (res == 0) {
+		res = rogitfs_pack_inflate(cursor, (unsigned char *)buf, want);
+	}
+	if (res != 0) {
+		rogitfs_log_error("inflating %s at %llu failed", pack->path, (unsigned long long)entry_offset);
+		cursor->valid = 0;
+	}
+	rogitfs_stats_count(ROGITFS_STATS_PACK_READS, 1);
+	rogitfs_stats_count(ROGITFS_STATS_BYTES_INFLATED, cursor->position - start_position);
+	rogitfs_trace_span("pack_read", NULL, &trace_start);
+	rogitfs_pack_cursor_put(packs, cursor);
+
+	if (res != 0) {
+		return -1;
+	}
+	*result_size = want;
+	return 0;
+}
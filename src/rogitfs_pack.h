@@ -0,0 +1,90 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_PACK_H__
+#define __ROGITFS_PACK_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <git2.h>
+
+struct rogitfs_cache;
+
+// Blobs read straight from the packs of the repository.
+//
+// The .idx and .pack files found when the repository is opened are mapped
+// by the startup threads or the first read searching them. Objects stored
+// whole (not as delta) are inflated from the mapping directly into the
+// buffer of the read, without copying the object first. Loose objects and
+// packs written later are left to libgit2.
+//
+// Deltas are applied here and the results kept in the delta cache keyed by
+// pack and offset, so reading the versions of a file one after another
+// applies one delta each instead of the whole chain. Bases that serve more
+// than one object are protected from eviction by results read once.
+//
+// Inflating resumes where the last read of an object stopped, so files read
+// front to back are inflated once. ROGITFS_PACK_CURSORS reads can run at the
+// same time, further reads go through libgit2. Packs are mapped for random
+// access, sequential reads ask the kernel to read ahead of them.
+
+#define ROGITFS_PACK_CURSORS 16
+#define ROGITFS_PACK_READAHEAD (1024 * 1024)
+// longer chains are left to libgit2
+#define ROGITFS_PACK_MAX_DEPTH 4096
+
+#define ROGITFS_PACK_UNLOADED 0
+#define ROGITFS_PACK_LOADED 1
+#define ROGITFS_PACK_FAILED 2
+
+struct rogitfs_pack_file {
+	char *path;
+	// taken while mapping, state is read without lock once it is not UNLOADED
+	pthread_mutex_t lock;
+	int state;
+	const unsigned char *idx;
+	size_t idx_size;
+	const unsigned char *pack;
+	size_t pack_size;
+	uint32_t count;
+	// big endian tables of the version 2 index
+	const uint32_t *fanout;
+	const unsigned char *oids;
+	const uint32_t *offsets;
+	// 4 byte aligned only, read with memcpy
+	const unsigned char *large_offsets;
+	uint32_t large_offset_count;
+};
+
+// Inflate state of one object, kept for the next read of it
+struct rogitfs_pack_cursor {
+	int busy;
+	int valid;
+	uint64_t used;
+	git_oid oid;
+	const struct rogitfs_pack_file *pack;
+	// end of the compressed data that is not yet handed to zlib
+	const unsigned char *input_end;
+	uint64_t position;
+	uint64_t object_size;
+	z_stream stream;
+};
+
+struct rogitfs_packs {
+	struct rogitfs_pack_file **files;
+	unsigned int file_count;
+	pthread_mutex_t lock;
+	uint64_t tick;
+	struct rogitfs_pack_cursor cursors[ROGITFS_PACK_CURSORS];
+};
+
+struct rogitfs_packs *rogitfs_packs_open(const char *gitdir);
+
+void rogitfs_packs_free(struct rogitfs_packs *packs);
+
+int rogitfs_pack_file_load(struct rogitfs_pack_file *pack);
+
+int rogitfs_pack_read(struct rogitfs_packs *packs, struct rogitfs_cache *delta_cache, const git_oid *oid, char *buf, size_t size, off_t offset, size_t *result_size);
+
+#endif
@@ -0,0 +1,185 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_pathset.h"
+
+int rogitfs_pathset_add(struct rogitfs_pathset_builder *builder, const char *path, const struct rogitfs_entry *entry) {
+
+	struct rogitfs_pathset_record record = {
+		.entry = *entry,
+		.path_offset = builder->paths.size,
+		.path_size = strlen(path)
+	};
+	if (rogitfs_buffer_append(&builder->paths, path, record.path_size + 1) != 0) {
+		return -1;
+	}
+	if (rogitfs_buffer_append(&builder->records, &record, sizeof(record)) != 0) {
+		return -1;
+	}
+	builder->count++;
+	return 0;
+}
+
+static int rogitfs_pathset_compare(const void *a, const void *b, void *arg) {
+
+	const struct rogitfs_pathset_record *record_a = (const struct rogitfs_pathset_record *)a;
+	const struct rogitfs_pathset_record *record_b = (const struct rogitfs_pathset_record *)b;
+	const char *paths = (const char *)arg;
+	return strcmp(paths + record_a->path_offset, paths + record_b->path_offset);
+}
+
+// Sort the collected paths and serialize header, records and paths into result
+int rogitfs_pathset_finish(struct rogitfs_pathset_builder *builder, struct rogitfs_buffer *result) {
+
+	if (builder->count > 0) {
+		qsort_r(builder->records.data, builder->count, sizeof(struct rogitfs_pathset_record), &rogitfs_pathset_compare, builder->paths.data);
+	}
+
+	struct rogitfs_pathset_header header = {
+		.count = builder->count,
+		.paths_offset = sizeof(struct rogitfs_pathset_header) + builder->records.size
+	};
+	if (rogitfs_buffer_append(result, &header, sizeof(header)) != 0) {
+		return -1;
+	}
+	if (builder->count > 0) {
+		if (rogitfs_buffer_append(result, builder->records.data, builder->records.size) != 0) {
+			return -1;
+		}
+		if (rogitfs_buffer_append(result, builder->paths.data, builder->paths.size) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void rogitfs_pathset_builder_free(struct rogitfs_pathset_builder *builder) {
+
+	rogitfs_buffer_free(&builder->records);
+	rogitfs_buffer_free(&builder->paths);
+	builder->count = 0;
+}
+
+static const struct rogitfs_pathset_record *rogitfs_pathset_records(const void *pathset) {
+
+	return (const struct rogitfs_pathset_record *)((const char *)pathset + sizeof(struct rogitfs_pathset_header));
+}
+
+static const char *rogitfs_pathset_path(const void *pathset, const struct rogitfs_pathset_record *record) {
+
+	const struct rogitfs_pathset_header *header = (const struct rogitfs_pathset_header *)pathset;
+	return (const char *)pathset + header->paths_offset + record->path_offset;
+}
+
+// Index of the first record not less than key
+static unsigned int rogitfs_pathset_lower_bound(const void *pathset, const char *key) {
+
+	const struct rogitfs_pathset_header *header = (const struct rogitfs_pathset_header *)pathset;
+	const struct rogitfs_pathset_record *records = rogitfs_pathset_records(pathset);
+	unsigned int low = 0;
+	unsigned int high = header->count;
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+		if (strcmp(rogitfs_pathset_path(pathset, &records[mid]), key) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+// Find path in the set. Paths that only exist as parent of other paths are
+// reported as trees with a zero oid.
+int rogitfs_pathset_lookup(const void *pathset, const char *path, struct rogitfs_entry *result_entry) {
+
+	const struct rogitfs_pathset_header *header = (const struct rogitfs_pathset_header *)pathset;
+	const struct rogitfs_pathset_record *records = rogitfs_pathset_records(pathset);
+	struct rogitfs_entry dir_entry = {
+		.type = GIT_OBJECT_TREE,
+		.mode = GIT_FILEMODE_TREE
+	};
+
+	if (path[0] == 0) {
+		*result_entry = dir_entry;
+		return 0;
+	}
+
+	unsigned int index = rogitfs_pathset_lower_bound(pathset, path);
+	if (index < header->count && strcmp(rogitfs_pathset_path(pathset, &records[index]), path) == 0) {
+		*result_entry = records[index].entry;
+		return 0;
+	}
+
+	size_t path_len = strlen(path);
+	char prefix[path_len + 2];
+	memcpy(prefix, path, path_len);
+	prefix[path_len] = '/';
+	prefix[path_len+1] = 0;
+	index = rogitfs_pathset_lower_bound(pathset, prefix);
+	if (index < header->count && strncmp(rogitfs_pathset_path(pathset, &records[index]), prefix, path_len + 1) == 0) {
+		*result_entry = dir_entry;
+		return 0;
+	}
+
+	return -1;
+}
+
+// List the direct children of path
+int rogitfs_pathset_fill(const void *pathset, const char *path, void *buf, fuse_fill_dir_t filler, struct rogitfs_private *private) {
+
+	const struct rogitfs_pathset_header *header = (const struct rogitfs_pathset_header *)pathset;
+	const struct rogitfs_pathset_record *records = rogitfs_pathset_records(pathset);
+
+	size_t path_len = strlen(path);
+	char prefix[path_len + 2];
+	memcpy(prefix, path, path_len);
+	prefix[path_len] = 0;
+	if (path_len > 0) {
+		prefix[path_len] = '/';
+		prefix[path_len+1] = 0;
+		path_len++;
+	}
+
+	const char *last_dir = NULL;
+	size_t last_dir_len = 0;
+	for (unsigned int i = rogitfs_pathset_lower_bound(pathset, prefix); i < header->count; i++) {
+		const char *record_path = rogitfs_pathset_path(pathset, &records[i]);
+		if (strncmp(record_path, prefix, path_len) != 0) {
+			break;
+		}
+		const char *rest = record_path + path_len;
+		const char *slash = index(rest, '/');
+		if (slash == NULL) {
+			struct stat entry_stat = {};
+			if (rogitfs_entry_stat(&records[i].entry, private, &entry_stat) != 0) {
+				return -1;
+			}
+			if (filler(buf, rest, &entry_stat, 0, 0) != 0) {
+				return -1;
+			}
+			continue;
+		}
+
+		size_t dir_len = slash - rest;
+		if (last_dir != NULL && last_dir_len == dir_len && strncmp(last_dir, rest, dir_len) == 0) {
+			continue;
+		}
+		last_dir = rest;
+		last_dir_len = dir_len;
+
+		char name[dir_len + 1];
+		memcpy(name, rest, dir_len);
+		name[dir_len] = 0;
+		struct stat dir_stat = {.st_mode = S_IFDIR | 0755};
+		if (filler(buf, name, &dir_stat, 0, 0) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_PATHSET_H__
+#define __ROGITFS_PATHSET_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+#include "rogitfs_common.h"
+
+// Flat, sorted set of paths with their tree entries, used to present
+// a selection of paths as a directory hierarchy.
+// The serialized set is position independent and can be kept in a cache.
+struct rogitfs_pathset_record {
+	struct rogitfs_entry entry;
+	unsigned int path_offset;
+	unsigned int path_size;
+};
+
+struct rogitfs_pathset_header {
+	unsigned int count;
+	unsigned int paths_offset;
+};
+
+struct rogitfs_pathset_builder {
+	struct rogitfs_buffer records;
+	struct rogitfs_buffer paths;
+	unsigned int count;
+};
+
+int rogitfs_pathset_add(struct rogitfs_pathset_builder *builder, const char *path, const struct rogitfs_entry *entry);
+
+int rogitfs_pathset_finish(struct rogitfs_pathset_builder *builder, struct rogitfs_buffer *result);
+
+void rogitfs_pathset_builder_free(struct rogitfs_pathset_builder *builder);
+
+int rogitfs_pathset_lookup(const void *pathset, const char *path, struct rogitfs_entry *result_entry);
+
+int rogitfs_pathset_fill(const void *pathset, const char *path, void *buf, fuse_fill_dir_t filler, struct rogitfs_private *private);
+
+#endif
@@ -0,0 +1,115 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "rogitfs_record.h"
+#include "rogitfs_logging.h"
+
+// the log is written out after this many operations and when a new second starts
+#define ROGITFS_RECORD_FLUSH_COUNT 256
+
+int rogitfs_record_enabled = 0;
+
+static FILE *rogitfs_record_file = NULL;
+static pthread_mutex_t rogitfs_record_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec rogitfs_record_start = {};
+static struct timespec rogitfs_record_flushed = {};
+static unsigned int rogitfs_record_pending = 0;
+// path of the operation as asked by the kernel, set by mounts of several repositories
+static __thread const char *rogitfs_record_path = NULL;
+static __thread pid_t rogitfs_record_tid = 0;
+
+// Open the log before fuse daemonizes, a relative path is still valid then
+int rogitfs_record_open(const char *path) {
+
+	rogitfs_record_file = fopen(path, "w");
+	if (rogitfs_record_file == NULL) {
+		fprintf(stderr, "fopen %s %s\n", path, strerror(errno));
+		return -1;
+	}
+	setvbuf(rogitfs_record_file, NULL, _IOFBF, 64 << 10);
+	if (fwrite(ROGITFS_RECORD_MAGIC, 1, ROGITFS_RECORD_MAGIC_SIZE, rogitfs_record_file) != ROGITFS_RECORD_MAGIC_SIZE) {
+		fprintf(stderr, "writing %s failed\n", path);
+		fclose(rogitfs_record_file);
+		rogitfs_record_file = NULL;
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &rogitfs_record_start);
+	rogitfs_record_flushed = rogitfs_record_start;
+	rogitfs_record_enabled = 1;
+	return 0;
+}
+
+void rogitfs_record_close(void) {
+
+	pthread_mutex_lock(&rogitfs_record_lock);
+	rogitfs_record_enabled = 0;
+	if (rogitfs_record_file != NULL) {
+		if (fclose(rogitfs_record_file) != 0) {
+			rogitfs_log_error("closing record failed %s", strerror(errno));
+		}
+		rogitfs_record_file = NULL;
+	}
+	pthread_mutex_unlock(&rogitfs_record_lock);
+}
+
+// Record path instead of the path within the repository until set to NULL
+void rogitfs_record_set_path(const char *path) {
+
+	rogitfs_record_path = path;
+}
+
+void rogitfs_record_write(enum rogitfs_stats_op op, const char *path, const char *name, uint64_t offset, uint32_t size, const struct timespec *start, int res) {
+
+	struct timespec end = {};
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (rogitfs_record_tid == 0) {
+		rogitfs_record_tid = (pid_t)syscall(SYS_gettid);
+	}
+	if (rogitfs_record_path != NULL) {
+		path = rogitfs_record_path;
+	}
+
+	size_t path_size = strlen(path);
+	size_t name_size = name != NULL ? strlen(name) + 1 : 0;
+	if (path_size + name_size > UINT16_MAX) {
+		return;
+	}
+	uint64_t duration_ns = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000000ull + end.tv_nsec - start->tv_nsec;
+	struct rogitfs_record_entry entry = {
+		.start_ns = (uint64_t)(start->tv_sec - rogitfs_record_start.tv_sec) * 1000000000ull + start->tv_nsec - rogitfs_record_start.tv_nsec,
+		.offset = offset,
+		.duration_ns = duration_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_ns,
+		.size = size,
+		.thread = (uint32_t)rogitfs_record_tid,
+		.result = res,
+		.path_size = (uint16_t)(path_size + name_size),
+		.op = (uint8_t)op
+	};
+
+	pthread_mutex_lock(&rogitfs_record_lock);
+	if (rogitfs_record_file != NULL) {
+		fwrite(&entry, sizeof(entry), 1, rogitfs_record_file);
+		fwrite(path, 1, path_size, rogitfs_record_file);
+		if (name != NULL) {
+			fputc(0, rogitfs_record_file);
+			fwrite(name, 1, name_size - 1, rogitfs_record_file);
+		}
+		rogitfs_record_pending++;
+		if (rogitfs_record_pending >= ROGITFS_RECORD_FLUSH_COUNT || end.tv_sec > rogitfs_record_flushed.tv_sec) {
+			if (fflush(rogitfs_record_file) != 0) {
+				rogitfs_log_error("writing record failed %s", strerror(errno));
+			}
+			rogitfs_record_pending = 0;
+			rogitfs_record_flushed = end;
+		}
+	}
+	pthread_mutex_unlock(&rogitfs_record_lock);
+}
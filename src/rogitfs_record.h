@@ -0,0 +1,54 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_RECORD_H__
+#define __ROGITFS_RECORD_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "rogitfs_stats.h"
+
+// Log of the fuse operations of a mount, written by --record=<file> and
+// replayed by rogitfs-replay.
+//
+// The file starts with ROGITFS_RECORD_MAGIC, followed by one entry per
+// finished operation: the fixed size header and path_size bytes of path,
+// for getxattr followed by a NUL and the attribute name. Paths are the ones
+// the kernel asked for, times are nanoseconds since the mount started.
+// Entries are appended under a lock, recording is off by default.
+
+#define ROGITFS_RECORD_MAGIC "rogitfs-record-1"
+#define ROGITFS_RECORD_MAGIC_SIZE 16
+
+struct rogitfs_record_entry {
+	uint64_t start_ns;
+	uint64_t offset;
+	uint32_t duration_ns;
+	uint32_t size;
+	uint32_t thread;
+	int32_t result;
+	uint16_t path_size;
+	// enum rogitfs_stats_op
+	uint8_t op;
+	uint8_t reserved;
+} __attribute__((packed));
+
+extern int rogitfs_record_enabled;
+
+int rogitfs_record_open(const char *path);
+
+void rogitfs_record_close(void);
+
+void rogitfs_record_set_path(const char *path);
+
+void rogitfs_record_write(enum rogitfs_stats_op op, const char *path, const char *name, uint64_t offset, uint32_t size, const struct timespec *start, int res);
+
+// Record an operation that started at start, ends now
+static inline void rogitfs_record(enum rogitfs_stats_op op, const char *path, const char *name, uint64_t offset, uint32_t size, const struct timespec *start, int res) {
+
+	if (rogitfs_record_enabled) {
+		rogitfs_record_write(op, path, name, offset, size, start, res);
+	}
+}
+
+#endif
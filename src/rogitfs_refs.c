@@ -5,18 +5,17 @@
 #include <string.h>
 #include "rogitfs_refs.h"
 #include "rogitfs_common.h"
+#include "rogitfs_logging.h"
 
 int rogitfs_refs_readdir_refs(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_strarray array = {};
 
 	int error = git_reference_list(&array, private->repo);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_reference_list %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_reference_list", error);
 		return -1;
 	}
 
@@ -146,15 +145,13 @@ int rogitfs_refs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, of
 
 int rogitfs_refs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_strarray array = {};
 
 	int error = git_reference_list(&array, private->repo);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_reference_list %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_reference_list", error);
 		return -1;
 	}
 
@@ -229,15 +226,13 @@ int rogitfs_refs_getattr(const char *path, struct stat *stbuf, struct fuse_file_
 
 int rogitfs_refs_readlink(const char *path, char *buf, size_t size) {
 
-	struct fuse_context *context = fuse_get_context();
-	struct rogitfs_private *private = (struct rogitfs_private*)context->private_data;
+	struct rogitfs_private *private = rogitfs_private_get();
 
 	git_strarray array = {};
 
 	int error = git_reference_list(&array, private->repo);
 	if (error != 0) {
-		const git_error *giterr = git_error_last();
-		fprintf(stderr, "git_reference_list %d %s\n", giterr->klass, giterr->message);
+		rogitfs_log_giterr("git_reference_list", error);
 		return -1;
 	}
 
@@ -254,15 +249,31 @@ int rogitfs_refs_readlink(const char *path, char *buf, size_t size) {
 			git_oid oid = {};
 			error = git_reference_name_to_id(&oid, private->repo, orig_ref);
 			if (error != 0) {
-				const git_error *giterr = git_error_last();
-				fprintf(stderr, "git_reference_name_to_id %d %s\n", giterr->klass, giterr->message);
+				rogitfs_log_giterr("git_reference_name_to_id", error);
 				git_strarray_free(&array);
 				return -1;
 			}
+			// annotated tags link to the commit or tree they point to
+			struct rogitfs_entry entry = {};
+			char hash[GIT_OID_HEXSZ+1] = {};
+			git_oid_tostr(hash, GIT_OID_HEXSZ+1, &oid);
+			error = rogitfs_resolve_component(NULL, hash, &entry, private);
+			if (error == 0 && entry.type == GIT_OBJECT_TAG) {
+				error = rogitfs_peel_tag(&oid, &entry, private);
+			}
+			if (error != 0) {
+				git_strarray_free(&array);
+				return -1;
+			}
+			const char *dir = "commit/";
+			if (entry.type == GIT_OBJECT_TREE) {
+				dir = "tree-obj/";
+			}
+			size_t dir_len = strlen(dir);
 			unsigned int ref_comp_count = 0;
 			error = path_component_count(ref, &ref_comp_count);
 			if (error != 0) {
-				fprintf(stderr, "path_component_count %d \n", error);
+				rogitfs_log_error("path_component_count %d", error);
 				continue;
 			}
 			char *cur = buf;
@@ -275,13 +286,13 @@ int rogitfs_refs_readlink(const char *path, char *buf, size_t size) {
 				}
 			}
 			size_t towrite = size - (cur-buf) - 1;
-			if (towrite > 7) {
-				strncpy(cur, "commit/", 7);
-				cur = cur+7;
+			if (towrite > dir_len) {
+				strncpy(cur, dir, dir_len);
+				cur = cur+dir_len;
 			}
 			towrite = size - (cur-buf) - 1;
 			if (towrite > 0) {
-				git_oid_tostr(cur, towrite, &oid);
+				git_oid_tostr(cur, towrite, &entry.oid);
 				cur = cur+towrite;
 			}
 			cur[0] = 0;
@@ -0,0 +1,549 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "rogitfs_common.h"
+#include "rogitfs_commit.h"
+#include "rogitfs_reftree.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_reftree_item {
+	char *name;
+	git_oid target;
+};
+
+static int rogitfs_reftree_compare(const void *a, const void *b) {
+
+	return strcmp(((const struct rogitfs_reftree_item *)a)->name, ((const struct rogitfs_reftree_item *)b)->name);
+}
+
+void rogitfs_reftree_free(struct rogitfs_reftree_snapshot *snapshot) {
+
+	for (unsigned int i = 0; i < snapshot->count; i++) {
+		free(snapshot->names[i]);
+	}
+	free(snapshot->names);
+	free(snapshot->targets);
+	free(snapshot);
+}
+
+// Peel a reference to its commit, or to a tree for tags of trees
+static int rogitfs_reftree_target(git_reference *ref, git_oid *result_oid) {
+
+	git_object *obj = NULL;
+	int error = git_reference_peel(&obj, ref, GIT_OBJECT_COMMIT);
+	if (error != 0) {
+		error = git_reference_peel(&obj, ref, GIT_OBJECT_TREE);
+	}
+	if (error != 0) {
+		return -1;
+	}
+	git_oid_cpy(result_oid, git_object_id(obj));
+	git_object_free(obj);
+	return 0;
+}
+
+static int rogitfs_reftree_add(struct rogitfs_reftree_item **items, unsigned int *count, unsigned int *capacity, const char *name, git_reference *ref) {
+
+	git_oid target = {};
+	if (rogitfs_reftree_target(ref, &target) != 0) {
+		// references to blobs, or unborn HEAD
+		return 0;
+	}
+	if (*count == *capacity) {
+		unsigned int new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+		struct rogitfs_reftree_item *new_items = (struct rogitfs_reftree_item *) realloc(*items, new_capacity * sizeof(struct rogitfs_reftree_item));
+		if (new_items == NULL) {
+			return -1;
+		}
+		*items = new_items;
+		*capacity = new_capacity;
+	}
+	char *name_copy = strdup(name);
+	if (name_copy == NULL) {
+		return -1;
+	}
+	(*items)[*count].name = name_copy;
+	git_oid_cpy(&(*items)[*count].target, &target);
+	(*count)++;
+	return 0;
+}
+
+static struct rogitfs_reftree_snapshot *rogitfs_reftree_build(git_repository *repo) {
+
+	struct rogitfs_reftree_item *items = NULL;
+	unsigned int count = 0;
+	unsigned int capacity = 0;
+	int res = 0;
+
+	git_reference *head = NULL;
+	if (git_repository_head(&head, repo) == 0) {
+		res = rogitfs_reftree_add(&items, &count, &capacity, "HEAD", head);
+		git_reference_free(head);
+	}
+
+	git_reference_iterator *iter = NULL;
+	int error = git_reference_iterator_new(&iter, repo);
+	if (error != 0) {
+		rogitfs_log_giterr("git_reference_iterator_new", error);
+		res = -1;
+	}
+	git_reference *ref = NULL;
+	while (res == 0 && git_reference_next(&ref, iter) == 0) {
+		const char *name = git_reference_name(ref);
+		if (strncmp(name, "refs/", 5) == 0) {
+			res = rogitfs_reftree_add(&items, &count, &capacity, name + 5, ref);
+		}
+		git_reference_free(ref);
+	}
+	git_reference_iterator_free(iter);
+
+	struct rogitfs_reftree_snapshot *snapshot = NULL;
+	if (res == 0) {
+		snapshot = (struct rogitfs_reftree_snapshot *) calloc(1, sizeof(struct rogitfs_reftree_snapshot));
+	}
+	if (snapshot != NULL) {
+		snapshot->names = (char **) calloc(count + 1, sizeof(char *));
+		snapshot->targets = (git_oid *) calloc(count + 1, sizeof(git_oid));
+		if (snapshot->names == NULL || snapshot->targets == NULL) {
+			free(snapshot->names);
+			free(snapshot->targets);
+			free(snapshot);
+			snapshot = NULL;
+		}
+	}
+	if (snapshot == NULL) {
+		for (unsigned int i = 0; i < count; i++) {
+			free(items[i].name);
+		}
+		free(items);
+		return NULL;
+	}
+
+	qsort(items, count, sizeof(struct rogitfs_reftree_item), &rogitfs_reftree_compare);
+	for (unsigned int i = 0; i < count; i++) {
+		snapshot->names[i] = items[i].name;
+		git_oid_cpy(&snapshot->targets[i], &items[i].target);
+	}
+	snapshot->count = count;
+	free(items);
+	clock_gettime(CLOCK_MONOTONIC, &snapshot->created);
+	return snapshot;
+}
+
+static void rogitfs_reftree_mix(uint64_t *stamp, uint64_t value) {
+
+	*stamp = (*stamp ^ value) * 0x100000001b3ULL;
+}
+
+// Mix inode, size and modification time of path into stamp, a missing file counts as well.
+// Returns -1 if path was modified within the last second, a later change in the same
+// second might not show in the modification time.
+static int rogitfs_reftree_stamp_file(const char *path, time_t now, uint64_t *stamp, struct stat *result_stat) {
+
+	struct stat path_stat = {};
+	if (lstat(path, &path_stat) != 0) {
+		rogitfs_reftree_mix(stamp, 0);
+		memset(result_stat, 0, sizeof(struct stat));
+		return 0;
+	}
+	rogitfs_reftree_mix(stamp, path_stat.st_ino);
+	rogitfs_reftree_mix(stamp, path_stat.st_size);
+	rogitfs_reftree_mix(stamp, path_stat.st_mtim.tv_sec);
+	rogitfs_reftree_mix(stamp, path_stat.st_mtim.tv_nsec);
+	*result_stat = path_stat;
+	if (path_stat.st_mtim.tv_sec >= now - 1) {
+		return -1;
+	}
+	return 0;
+}
+
+// Loose references are written to a lock file and renamed, which changes the directory
+static int rogitfs_reftree_stamp_dir(char *path, size_t path_len, time_t now, uint64_t *stamp) {
+
+	struct stat dir_stat = {};
+	if (rogitfs_reftree_stamp_file(path, now, stamp, &dir_stat) != 0) {
+		return -1;
+	}
+	if (S_ISDIR(dir_stat.st_mode) == 0) {
+		return 0;
+	}
+	DIR *dir = opendir(path);
+	if (dir == NULL) {
+		return -1;
+	}
+	int res = 0;
+	struct dirent *dirent = NULL;
+	while (res == 0 && (dirent = readdir(dir)) != NULL) {
+		if (dirent->d_type != DT_DIR && dirent->d_type != DT_UNKNOWN) {
+			continue;
+		}
+		if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
+			continue;
+		}
+		size_t name_len = strlen(dirent->d_name);
+		if (path_len + 1 + name_len >= PATH_MAX) {
+			res = -1;
+			break;
+		}
+		path[path_len] = '/';
+		memcpy(path + path_len + 1, dirent->d_name, name_len + 1);
+		res = rogitfs_reftree_stamp_dir(path, path_len + 1 + name_len, now, stamp);
+		path[path_len] = 0;
+	}
+	closedir(dir);
+	return res;
+}
+
+// Stamp of HEAD, packed-refs and the directories of loose references, 0 if it can not be trusted
+static uint64_t rogitfs_reftree_stamp(git_repository *repo) {
+
+	time_t now = time(NULL);
+	uint64_t stamp = 0xcbf29ce484222325ULL;
+	struct stat path_stat = {};
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%sHEAD", git_repository_path(repo));
+	if (rogitfs_reftree_stamp_file(path, now, &stamp, &path_stat) != 0) {
+		return 0;
+	}
+	snprintf(path, sizeof(path), "%spacked-refs", git_repository_commondir(repo));
+	if (rogitfs_reftree_stamp_file(path, now, &stamp, &path_stat) != 0) {
+		return 0;
+	}
+	int len = snprintf(path, sizeof(path), "%srefs", git_repository_commondir(repo));
+	if (len < 0 || len >= (int)sizeof(path) || rogitfs_reftree_stamp_dir(path, len, now, &stamp) != 0) {
+		return 0;
+	}
+	return stamp != 0 ? stamp : 1;
+}
+
+// Drop a reference, called with reftree_lock held
+static void rogitfs_reftree_unref(struct rogitfs_reftree_snapshot *snapshot) {
+
+	snapshot->refcount--;
+	if (snapshot->refcount == 0) {
+		rogitfs_reftree_free(snapshot);
+	}
+}
+
+// Returns the referenced snapshot. Once the current one is older than the ttl the reference
+// files are checked and only if they changed the references are read again, without the lock
+// and by one thread while the others keep using the current snapshot.
+struct rogitfs_reftree_snapshot *rogitfs_reftree_get(struct rogitfs_private *private) {
+
+	struct timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&private->reftree_lock);
+	struct rogitfs_reftree_snapshot *snapshot = private->reftree;
+	if (snapshot != NULL) {
+		snapshot->refcount++;
+		if (snapshot->refreshing || now.tv_sec - snapshot->created.tv_sec < private->ref_ttl) {
+			pthread_mutex_unlock(&private->reftree_lock);
+			return snapshot;
+		}
+		snapshot->refreshing = 1;
+	}
+	pthread_mutex_unlock(&private->reftree_lock);
+
+	uint64_t stamp = rogitfs_reftree_stamp(private->repo);
+	struct rogitfs_reftree_snapshot *new_snapshot = NULL;
+	if (snapshot == NULL || stamp == 0 || stamp != snapshot->stamp) {
+		new_snapshot = rogitfs_reftree_build(private->repo);
+	}
+
+	pthread_mutex_lock(&private->reftree_lock);
+	if (snapshot != NULL) {
+		snapshot->refreshing = 0;
+	}
+	if (new_snapshot == NULL) {
+		// unchanged, or keep serving the old epoch
+		if (snapshot != NULL) {
+			snapshot->created = now;
+		}
+		pthread_mutex_unlock(&private->reftree_lock);
+		return snapshot;
+	}
+	new_snapshot->stamp = stamp;
+	if (private->reftree != snapshot) {
+		// another thread took the first snapshot
+		rogitfs_reftree_free(new_snapshot);
+		new_snapshot = private->reftree;
+		new_snapshot->refcount++;
+	} else {
+		if (snapshot != NULL) {
+			rogitfs_reftree_unref(snapshot);
+		}
+		private->reftree = new_snapshot;
+		new_snapshot->refcount = 2;
+	}
+	if (snapshot != NULL) {
+		rogitfs_reftree_unref(snapshot);
+	}
+	pthread_mutex_unlock(&private->reftree_lock);
+	return new_snapshot;
+}
+
+void rogitfs_reftree_put(struct rogitfs_private *private, struct rogitfs_reftree_snapshot *snapshot) {
+
+	pthread_mutex_lock(&private->reftree_lock);
+	rogitfs_reftree_unref(snapshot);
+	pthread_mutex_unlock(&private->reftree_lock);
+}
+
+// First name that is not smaller than prefix
+static unsigned int rogitfs_reftree_lower_bound(const struct rogitfs_reftree_snapshot *snapshot, const char *prefix, size_t prefix_len) {
+
+	unsigned int low = 0;
+	unsigned int high = snapshot->count;
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+		if (strncmp(snapshot->names[mid], prefix, prefix_len) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+// Whether names starting with prefix exist
+static int rogitfs_reftree_has_prefix(const struct rogitfs_reftree_snapshot *snapshot, const char *prefix, size_t prefix_len) {
+
+	unsigned int index = rogitfs_reftree_lower_bound(snapshot, prefix, prefix_len);
+	return index < snapshot->count && strncmp(snapshot->names[index], prefix, prefix_len) == 0;
+}
+
+// Split path into a reference and the path below its tree.
+// Returns 0 and the target for a reference, 1 for a directory of reference names, -1 otherwise
+static int rogitfs_reftree_split(const struct rogitfs_reftree_snapshot *snapshot, const char *path, git_oid *result_target, const char **result_rest) {
+
+	size_t path_len = strlen(path);
+	while (path_len > 0 && path[path_len-1] == '/') {
+		path_len--;
+	}
+	char prefix[path_len + 2];
+	for (size_t end = 1; end <= path_len; end++) {
+		if (end < path_len && path[end] != '/') {
+			continue;
+		}
+		unsigned int index = rogitfs_reftree_lower_bound(snapshot, path, end);
+		if (index < snapshot->count && strlen(snapshot->names[index]) == end && strncmp(snapshot->names[index], path, end) == 0) {
+			git_oid_cpy(result_target, &snapshot->targets[index]);
+			*result_rest = end < path_len ? path + end + 1 : "";
+			return 0;
+		}
+		memcpy(prefix, path, end);
+		prefix[end] = '/';
+		if (rogitfs_reftree_has_prefix(snapshot, prefix, end + 1) == 0) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+// Map /tree/<ref>/<rest> to <hash>/<rest> below /commit
+static int rogitfs_reftree_commit_path(const char *path, struct rogitfs_buffer *result_path, struct rogitfs_private *private) {
+
+	struct rogitfs_reftree_snapshot *snapshot = rogitfs_reftree_get(private);
+	if (snapshot == NULL) {
+		return -1;
+	}
+	git_oid target = {};
+	const char *rest = NULL;
+	int res = rogitfs_reftree_split(snapshot, path, &target, &rest);
+	rogitfs_reftree_put(private, snapshot);
+	if (res != 0) {
+		return res;
+	}
+
+	char hash[GIT_OID_HEXSZ+1] = {};
+	git_oid_tostr(hash, GIT_OID_HEXSZ+1, &target);
+	if (rogitfs_buffer_printf(result_path, rest[0] != 0 ? "%s/%s" : "%s", hash, rest) != 0
+		|| rogitfs_buffer_append(result_path, "", 1) != 0) {
+		rogitfs_buffer_free(result_path);
+		return -1;
+	}
+	return 0;
+}
+
+int rogitfs_reftree_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	int res = rogitfs_reftree_commit_path(path, &commit_path, private);
+	if (res < 0) {
+		return -ENOENT;
+	}
+	if (res > 0) {
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = dir_stat;
+		return 0;
+	}
+	res = rogitfs_commit_getattr(commit_path.data, stbuf, fi);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
+
+int rogitfs_reftree_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_reftree_snapshot *snapshot = rogitfs_reftree_get(private);
+	if (snapshot == NULL) {
+		return -ENOENT;
+	}
+	git_oid target = {};
+	const char *rest = NULL;
+	int res = rogitfs_reftree_split(snapshot, path, &target, &rest);
+	if (res < 0) {
+		rogitfs_reftree_put(private, snapshot);
+		return -ENOENT;
+	}
+
+	if (res == 0) {
+		rogitfs_reftree_put(private, snapshot);
+
+		struct rogitfs_buffer commit_path = {};
+		char hash[GIT_OID_HEXSZ+1] = {};
+		git_oid_tostr(hash, GIT_OID_HEXSZ+1, &target);
+		if (rogitfs_buffer_printf(&commit_path, rest[0] != 0 ? "/%s/%s" : "/%s", hash, rest) != 0
+			|| rogitfs_buffer_append(&commit_path, "", 1) != 0) {
+			rogitfs_buffer_free(&commit_path);
+			return -ENOENT;
+		}
+		res = rogitfs_commit_readdir(commit_path.data, buf, filler, offset, fi, flags);
+		rogitfs_buffer_free(&commit_path);
+		return res;
+	}
+
+	// next component of the reference names below path
+	size_t path_len = strlen(path);
+	while (path_len > 0 && path[path_len-1] == '/') {
+		path_len--;
+	}
+	size_t prefix_len = path_len > 0 ? path_len + 1 : 0;
+	struct stat dir_stat = {
+		.st_mode = S_IFDIR | 0755,
+		.st_size = 1337
+	};
+	const char *last = NULL;
+	size_t last_len = 0;
+	for (unsigned int i = rogitfs_reftree_lower_bound(snapshot, path, path_len); i < snapshot->count; i++) {
+		const char *name = snapshot->names[i];
+		if (strncmp(name, path, path_len) != 0) {
+			break;
+		}
+		if (path_len > 0 && name[path_len] != '/') {
+			continue;
+		}
+		const char *comp = name + prefix_len;
+		const char *comp_end = index(comp, '/');
+		size_t comp_len = comp_end != NULL ? comp_end - comp : strlen(comp);
+		if (last != NULL && last_len == comp_len && strncmp(last, comp, comp_len) == 0) {
+			continue;
+		}
+		last = comp;
+		last_len = comp_len;
+		char comp_buffer[comp_len + 1];
+		memcpy(comp_buffer, comp, comp_len);
+		comp_buffer[comp_len] = 0;
+		if (filler(buf, comp_buffer, &dir_stat, 0, 0) != 0) {
+			rogitfs_reftree_put(private, snapshot);
+			return -ENOENT;
+		}
+	}
+	rogitfs_reftree_put(private, snapshot);
+	return 0;
+}
+
+// The path below /commit is resolved once, so all reads see the same commit
+int rogitfs_reftree_open(const char *path, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	int res = rogitfs_reftree_commit_path(path, &commit_path, private);
+	if (res < 0) {
+		return -ENOENT;
+	}
+	if (res > 0) {
+		return -EISDIR;
+	}
+	fi->fh = (uint64_t)commit_path.data;
+	return 0;
+}
+
+int rogitfs_reftree_release(const char *path, struct fuse_file_info *fi) {
+
+	free((char *)fi->fh);
+	fi->fh = 0;
+	return 0;
+}
+
+int rogitfs_reftree_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	if (fi != NULL && fi->fh != 0) {
+		return rogitfs_commit_read((const char *)fi->fh, buf, size, offset, fi);
+	}
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	if (rogitfs_reftree_commit_path(path, &commit_path, private) != 0) {
+		return -ENOENT;
+	}
+	int res = rogitfs_commit_read(commit_path.data, buf, size, offset, fi);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
+
+int rogitfs_reftree_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	if (rogitfs_reftree_commit_path(path, &commit_path, private) != 0) {
+		return -ENOENT;
+	}
+	int res = rogitfs_commit_readlink(commit_path.data, buf, size);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
+
+int rogitfs_reftree_getxattr(const char *path, const char *name, char *value, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	if (rogitfs_reftree_commit_path(path, &commit_path, private) != 0) {
+		return -ENODATA;
+	}
+	int res = rogitfs_commit_getxattr(commit_path.data, name, value, size);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
+
+int rogitfs_reftree_listxattr(const char *path, char *list, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_buffer commit_path = {};
+	if (rogitfs_reftree_commit_path(path, &commit_path, private) != 0) {
+		return 0;
+	}
+	int res = rogitfs_commit_listxattr(commit_path.data, list, size);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
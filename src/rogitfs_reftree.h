@@ -0,0 +1,61 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_REFTREE_H__
+#define __ROGITFS_REFTREE_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+#include <time.h>
+#include <stdint.h>
+#include "rogitfs_common.h"
+
+// /tree/HEAD/...          content of the commit HEAD points to
+// /tree/<ref>/...         content of refs/<ref>, like heads/main or tags/v1.0
+//
+// References are resolved together into a snapshot that is reused until it
+// is older than --ref-ttl, the content is then served like /commit/<hash>.
+// An old snapshot is kept as long as HEAD, packed-refs and the directories of
+// loose references are unchanged. Open files stay at the commit they were opened at.
+
+#define ROGITFS_REFTREE_DEFAULT_TTL 1
+
+struct rogitfs_reftree_snapshot {
+	unsigned int refcount;
+	struct timespec created;
+	// of the reference files when the snapshot was taken, 0 if unknown
+	uint64_t stamp;
+	// a thread is checking if the references changed
+	int refreshing;
+	unsigned int count;
+	// sorted names relative to refs/ and HEAD
+	char **names;
+	// commit the reference peels to, or tree for tags of trees
+	git_oid *targets;
+};
+
+void rogitfs_reftree_free(struct rogitfs_reftree_snapshot *snapshot);
+
+struct rogitfs_reftree_snapshot *rogitfs_reftree_get(struct rogitfs_private *private);
+
+void rogitfs_reftree_put(struct rogitfs_private *private, struct rogitfs_reftree_snapshot *snapshot);
+
+int rogitfs_reftree_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_reftree_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+int rogitfs_reftree_open(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_reftree_release(const char *path, struct fuse_file_info *fi);
+
+int rogitfs_reftree_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_reftree_readlink(const char *path, char *buf, size_t size);
+
+int rogitfs_reftree_getxattr(const char *path, const char *name, char *value, size_t size);
+
+int rogitfs_reftree_listxattr(const char *path, char *list, size_t size);
+
+#endif
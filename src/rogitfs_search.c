@@ -0,0 +1,294 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_pathset.h"
+#include "rogitfs_trigram.h"
+#include "rogitfs_search.h"
+#include "rogitfs_filter.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_search_walk {
+	struct rogitfs_private *private;
+	const struct rogitfs_filter *filter;
+	const char *query;
+	size_t query_size;
+	uint32_t *trigrams;
+	unsigned int trigram_count;
+	// records of blobs that were not indexed yet
+	struct rogitfs_buffer records;
+	struct rogitfs_pathset_builder builder;
+	int error;
+};
+
+static int rogitfs_search_walk_cb(const char *root, const git_tree_entry *entry, void *payload) {
+
+	struct rogitfs_search_walk *walk = (struct rogitfs_search_walk *)payload;
+
+	// excluded subtrees are skipped without being read
+	if (rogitfs_filter_visible_child(walk->filter, root, git_tree_entry_name(entry)) == 0) {
+		return 1;
+	}
+
+	git_filemode_t mode = git_tree_entry_filemode(entry);
+	if (mode != GIT_FILEMODE_BLOB && mode != GIT_FILEMODE_BLOB_EXECUTABLE) {
+		return 0;
+	}
+	const git_oid *oid = git_tree_entry_id(entry);
+
+	struct rogitfs_trigram_index *index = walk->private->trigram_index;
+	int candidate = 1;
+	if (index != NULL) {
+		candidate = rogitfs_trigram_lookup(index, oid, walk->trigrams, walk->trigram_count);
+		if (candidate == 0) {
+			return 0;
+		}
+	}
+
+	git_blob *blob = NULL;
+	int error = git_blob_lookup(&blob, walk->private->repo, oid);
+	if (error != 0) {
+		rogitfs_log_giterr("git_blob_lookup", error);
+		walk->error = -1;
+		return -1;
+	}
+	const char *data = (const char *)git_blob_rawcontent(blob);
+	size_t size = git_blob_rawsize(blob);
+
+	if (candidate < 0) {
+		// index the blob now, it is read anyway
+		size_t start = walk->records.size;
+		if (rogitfs_trigram_record(&walk->records, oid, data, size) != 0) {
+			git_blob_free(blob);
+			walk->error = -1;
+			return -1;
+		}
+		candidate = rogitfs_trigram_record_match((const unsigned char *)walk->records.data + start, walk->trigrams, walk->trigram_count);
+	}
+
+	int match = 0;
+	if (candidate && rogitfs_trigram_is_binary(data, size) == 0) {
+		match = memmem(data, size, walk->query, walk->query_size) != NULL;
+	}
+	git_blob_free(blob);
+	if (match == 0) {
+		return 0;
+	}
+
+	const char *name = git_tree_entry_name(entry);
+	size_t root_len = strlen(root);
+	size_t name_len = strlen(name);
+	char path[root_len + name_len + 1];
+	memcpy(path, root, root_len);
+	memcpy(path + root_len, name, name_len + 1);
+	struct rogitfs_entry path_entry = {
+		.type = GIT_OBJECT_BLOB,
+		.mode = mode
+	};
+	git_oid_cpy(&path_entry.oid, oid);
+	if (rogitfs_pathset_add(&walk->builder, path, &path_entry) != 0) {
+		walk->error = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static struct rogitfs_cache_entry *rogitfs_search_build(const git_oid *tree_id, const struct rogitfs_filter *filter, const char *query, struct rogitfs_private *private) {
+
+	size_t query_size = strlen(query);
+	// the same tree is searched filtered as root of a commit and unfiltered by its own hash
+	unsigned char key[2 + GIT_OID_RAWSZ + query_size];
+	key[0] = 's';
+	key[1] = filter != NULL;
+	memcpy(key+2, tree_id->id, GIT_OID_RAWSZ);
+	memcpy(key+2+GIT_OID_RAWSZ, query, query_size);
+
+	struct rogitfs_cache_entry *entry = rogitfs_cache_get(private->changes_cache, key, sizeof(key));
+	if (entry != NULL) {
+		return entry;
+	}
+
+	git_tree *tree = NULL;
+	int error = git_tree_lookup(&tree, private->repo, tree_id);
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		return NULL;
+	}
+
+	struct rogitfs_search_walk walk = {
+		.private = private,
+		.filter = filter,
+		.query = query,
+		.query_size = query_size
+	};
+	if (rogitfs_trigram_query(query, query_size, &walk.trigrams, &walk.trigram_count) != 0) {
+		git_tree_free(tree);
+		return NULL;
+	}
+	error = git_tree_walk(tree, GIT_TREEWALK_PRE, &rogitfs_search_walk_cb, &walk);
+	git_tree_free(tree);
+	free(walk.trigrams);
+
+	if (private->trigram_index != NULL) {
+		// records are kept even if the search failed later on
+		rogitfs_trigram_append(private->trigram_index, &walk.records);
+	}
+	rogitfs_buffer_free(&walk.records);
+
+	if (error == 0 && walk.error == 0) {
+		struct rogitfs_buffer data = {};
+		if (rogitfs_pathset_finish(&walk.builder, &data) == 0) {
+			entry = rogitfs_cache_put(private->changes_cache, key, sizeof(key), data.data, data.size);
+		}
+		rogitfs_buffer_free(&data);
+	}
+	rogitfs_pathset_builder_free(&walk.builder);
+
+	return entry;
+}
+
+// Split path into <oid>/<query> and the path inside the results
+static struct rogitfs_cache_entry *rogitfs_search_get(const char *path, const char **result_rest, struct rogitfs_private *private) {
+
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	if (path_component(path, 0, &comp, &comp_size) != 0 || comp_size != GIT_OID_HEXSZ) {
+		return NULL;
+	}
+	char hash[GIT_OID_HEXSZ+1];
+	memcpy(hash, comp, GIT_OID_HEXSZ);
+	hash[GIT_OID_HEXSZ] = 0;
+	git_oid tree_id = {};
+	const struct rogitfs_filter *filter = NULL;
+	if (rogitfs_resolve_tree_id(hash, &tree_id, &filter, private) != 0) {
+		return NULL;
+	}
+
+	if (path_component(path, 1, &comp, &comp_size) != 0) {
+		return NULL;
+	}
+	char query[comp_size + 1];
+	memcpy(query, comp, comp_size);
+	query[comp_size] = 0;
+
+	const char *rest = comp + comp_size;
+	if (rest[0] == '/') {
+		rest++;
+	}
+	*result_rest = rest;
+	return rogitfs_search_build(&tree_id, filter, query, private);
+}
+
+static int rogitfs_search_lookup(const char *path, struct rogitfs_entry *result_entry, struct rogitfs_private *private) {
+
+	const char *rest = NULL;
+	struct rogitfs_cache_entry *cache_entry = rogitfs_search_get(path, &rest, private);
+	if (cache_entry == NULL) {
+		return -1;
+	}
+	int res = rogitfs_pathset_lookup(cache_entry->data, rest, result_entry);
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	return res;
+}
+
+int rogitfs_search_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_search_lookup(path, &entry, private) != 0) {
+		return -ENOENT;
+	}
+	if (entry.type != GIT_OBJECT_BLOB) {
+		return -1;
+	}
+
+	return rogitfs_blob_read(&entry.oid, buf, size, offset, private);
+}
+
+int rogitfs_search_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	unsigned int comp_count = 0;
+	if (path_component_count(path, &comp_count) != 0) {
+		return -ENOENT;
+	}
+	if (comp_count == 1) {
+		// queries are only reachable by name
+		const char *comp = NULL;
+		unsigned int comp_size = 0;
+		git_oid tree_id = {};
+		if (path_component(path, 0, &comp, &comp_size) != 0 || comp_size != GIT_OID_HEXSZ || rogitfs_resolve_tree_id(path, &tree_id, NULL, private) != 0) {
+			return -ENOENT;
+		}
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755,
+			.st_size = 1337
+		};
+		*stbuf = dir_stat;
+		return 0;
+	}
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_search_lookup(path, &entry, private) != 0) {
+		return -ENOENT;
+	}
+	if (entry.type == GIT_OBJECT_TREE) {
+		struct stat dir_stat = {
+			.st_mode = S_IFDIR | 0755
+		};
+		*stbuf = dir_stat;
+		return 0;
+	}
+	if (rogitfs_entry_stat(&entry, private, stbuf) != 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+int rogitfs_search_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (path[0] != '/') {
+		struct odb_fill_payload payload = {
+			.buf = buf,
+			.filler = filler,
+			.type = GIT_OBJECT_COMMIT,
+			.private = private
+		};
+		int error = git_odb_foreach(private->odb, &rogitfs_readdir_odb_fill, &payload);
+		if (error != 0) {
+			rogitfs_log_giterr("git_odb_foreach", error);
+			return -ENOENT;
+		}
+		return 0;
+	}
+
+	unsigned int comp_count = 0;
+	if (path_component_count(path+1, &comp_count) != 0 || comp_count < 1) {
+		return -ENOENT;
+	}
+	if (comp_count == 1) {
+		// queries are only reachable by name
+		return 0;
+	}
+
+	const char *rest = NULL;
+	struct rogitfs_cache_entry *cache_entry = rogitfs_search_get(path+1, &rest, private);
+	if (cache_entry == NULL) {
+		return -ENOENT;
+	}
+	int res = rogitfs_pathset_fill(cache_entry->data, rest, buf, filler, private);
+	rogitfs_cache_release(private->changes_cache, cache_entry);
+	if (res != 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
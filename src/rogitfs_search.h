@@ -0,0 +1,20 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_SEARCH_H__
+#define __ROGITFS_SEARCH_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /search/<oid>/<query>/...  files of a commit or tree containing <query>, in their directories
+
+int rogitfs_search_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_search_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_search_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+#endif
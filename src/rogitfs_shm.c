@@ -0,0 +1,326 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rogitfs_shm.h"
+
+// Slots and data start at multiples of the page size, the segment size is
+// a multiple of the huge page size
+#define ROGITFS_SHM_ALIGN 4096
+#define ROGITFS_SHM_HUGE_ALIGN (2 * 1024 * 1024)
+
+static size_t rogitfs_shm_align(size_t size) {
+
+	return (size + ROGITFS_SHM_ALIGN - 1) & ~((size_t)ROGITFS_SHM_ALIGN - 1);
+}
+
+static size_t rogitfs_shm_slots_size(uint32_t slot_count) {
+
+	return rogitfs_shm_align((size_t)slot_count * sizeof(struct rogitfs_shm_slot));
+}
+
+// Names starting with / are files, for example on hugetlbfs, others are POSIX shared memory objects
+static int rogitfs_shm_open(const char *name) {
+
+	if (name[0] == '/') {
+		return open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	}
+	char shm_name[256];
+	int len = snprintf(shm_name, sizeof(shm_name), "/rogitfs-%s", name);
+	if (len < 0 || len >= sizeof(shm_name) || index(name, '/') != NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	return shm_open(shm_name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+struct rogitfs_shm *rogitfs_shm_attach(const char *name, size_t size) {
+
+	int fd = rogitfs_shm_open(name);
+	if (fd == -1) {
+		int err = errno;
+		fprintf(stderr, "shm_open %s %d %s\n", name, err, strerror(err));
+		return NULL;
+	}
+	// the first process creates the segment, the others wait and use its geometry
+	if (flock(fd, LOCK_EX) != 0) {
+		int err = errno;
+		fprintf(stderr, "flock %s %d %s\n", name, err, strerror(err));
+		close(fd);
+		return NULL;
+	}
+
+	struct stat file_stat = {};
+	if (fstat(fd, &file_stat) != 0) {
+		int err = errno;
+		fprintf(stderr, "fstat %s %d %s\n", name, err, strerror(err));
+		close(fd);
+		return NULL;
+	}
+
+	struct rogitfs_shm_header header = {};
+	if (file_stat.st_size == 0) {
+		memcpy(header.magic, ROGITFS_SHM_MAGIC, 4);
+		header.version = ROGITFS_SHM_VERSION;
+		header.slot_size = ROGITFS_SHM_SLOT_SIZE;
+		header.slot_count = size / (ROGITFS_SHM_SLOT_SIZE + sizeof(struct rogitfs_shm_slot));
+		if (header.slot_count < ROGITFS_SHM_PROBES) {
+			header.slot_count = ROGITFS_SHM_PROBES;
+		}
+	} else {
+		if (file_stat.st_size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| memcmp(header.magic, ROGITFS_SHM_MAGIC, 4) != 0 || header.version != ROGITFS_SHM_VERSION
+			|| header.slot_count < ROGITFS_SHM_PROBES || header.slot_size == 0) {
+			fprintf(stderr, "shared cache %s has an unknown format\n", name);
+			close(fd);
+			return NULL;
+		}
+	}
+
+	size_t map_size = ROGITFS_SHM_ALIGN + rogitfs_shm_slots_size(header.slot_count) + (size_t)header.slot_count * header.slot_size;
+	map_size = (map_size + ROGITFS_SHM_HUGE_ALIGN - 1) & ~((size_t)ROGITFS_SHM_HUGE_ALIGN - 1);
+	if (file_stat.st_size == 0) {
+		// the new segment is zero filled, every slot is empty
+		if (ftruncate(fd, map_size) != 0) {
+			int err = errno;
+			fprintf(stderr, "ftruncate %s %d %s\n", name, err, strerror(err));
+			close(fd);
+			return NULL;
+		}
+	} else if (file_stat.st_size < map_size) {
+		fprintf(stderr, "shared cache %s is truncated\n", name);
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		int err = errno;
+		fprintf(stderr, "mmap %s %d %s\n", name, err, strerror(err));
+		close(fd);
+		return NULL;
+	}
+	// transparent huge pages for shmem, hugetlbfs files use huge pages anyway
+	madvise(map, map_size, MADV_HUGEPAGE);
+
+	if (file_stat.st_size == 0) {
+		// magic last, a segment without it was not completely set up
+		struct rogitfs_shm_header *map_header = (struct rogitfs_shm_header *)map;
+		map_header->version = header.version;
+		map_header->slot_count = header.slot_count;
+		map_header->slot_size = header.slot_size;
+		memcpy(map_header->magic, header.magic, 4);
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+
+	struct rogitfs_shm *shm = calloc(1, sizeof(struct rogitfs_shm));
+	if (shm == NULL) {
+		munmap(map, map_size);
+		return NULL;
+	}
+	shm->map = map;
+	shm->map_size = map_size;
+	shm->slots = (struct rogitfs_shm_slot *)((unsigned char *)map + ROGITFS_SHM_ALIGN);
+	shm->data = (unsigned char *)map + ROGITFS_SHM_ALIGN + rogitfs_shm_slots_size(header.slot_count);
+	shm->slot_count = header.slot_count;
+	shm->slot_size = header.slot_size;
+	return shm;
+}
+
+void rogitfs_shm_detach(struct rogitfs_shm *shm) {
+
+	munmap(shm->map, shm->map_size);
+	free(shm);
+}
+
+static uint32_t rogitfs_shm_home(const struct rogitfs_shm *shm, const git_oid *oid) {
+
+	uint64_t hash = 0;
+	memcpy(&hash, oid->id, sizeof(hash));
+	return hash % shm->slot_count;
+}
+
+static uint32_t rogitfs_shm_now(void) {
+
+	struct timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+// Take a reader reference if the slot is ready, returns the state after taking it
+static int rogitfs_shm_acquire(struct rogitfs_shm_slot *slot, uint64_t *result_state) {
+
+	uint64_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+	while ((state & ROGITFS_SHM_READY) != 0 && (state & ROGITFS_SHM_REFS) != ROGITFS_SHM_REFS) {
+		uint64_t next = (state + 1) | ROGITFS_SHM_USED;
+		if (atomic_compare_exchange_weak_explicit(&slot->state, &state, next, memory_order_acquire, memory_order_acquire)) {
+			atomic_store_explicit(&slot->touched, rogitfs_shm_now(), memory_order_relaxed);
+			*result_state = next;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// Drop a reader reference, unless the slot was taken over since
+static void rogitfs_shm_release(struct rogitfs_shm_slot *slot, uint32_t generation) {
+
+	uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+	while (ROGITFS_SHM_GENERATION(state) == generation && (state & ROGITFS_SHM_REFS) != 0) {
+		if (atomic_compare_exchange_weak_explicit(&slot->state, &state, state - 1, memory_order_release, memory_order_relaxed)) {
+			return;
+		}
+	}
+}
+
+// Copy a slice of a cached blob, returns the number of bytes read or -1 if the blob is not cached
+int rogitfs_shm_read(struct rogitfs_shm *shm, const git_oid *oid, char *buf, size_t size, off_t offset) {
+
+	uint32_t home = rogitfs_shm_home(shm, oid);
+	for (uint32_t probe = 0; probe < ROGITFS_SHM_PROBES; probe++) {
+		uint32_t index = (home + probe) % shm->slot_count;
+		struct rogitfs_shm_slot *slot = &shm->slots[index];
+		uint64_t state = 0;
+		if (rogitfs_shm_acquire(slot, &state) != 0) {
+			continue;
+		}
+		uint32_t generation = ROGITFS_SHM_GENERATION(state);
+		if (memcmp(slot->oid, oid->id, GIT_OID_RAWSZ) != 0 || slot->size > shm->slot_size) {
+			rogitfs_shm_release(slot, generation);
+			continue;
+		}
+
+		size_t objlen = slot->size;
+		size_t toread = 0;
+		if (offset < objlen) {
+			toread = objlen - offset < size ? objlen - offset : size;
+			memcpy(buf, shm->data + (size_t)index * shm->slot_size + offset, toread);
+		}
+		// the slot was taken over after the lease ran out, the copy may be mixed
+		atomic_thread_fence(memory_order_acquire);
+		if (ROGITFS_SHM_GENERATION(atomic_load_explicit(&slot->state, memory_order_relaxed)) != generation) {
+			return -1;
+		}
+		rogitfs_shm_release(slot, generation);
+		return toread;
+	}
+	return -1;
+}
+
+// Slots left behind by processes that died while writing or reading
+static int rogitfs_shm_stale(struct rogitfs_shm_slot *slot, uint64_t state, uint32_t now) {
+
+	uint32_t idle = now - atomic_load(&slot->touched);
+	if ((state & ROGITFS_SHM_WRITING) != 0) {
+		uint64_t owner = atomic_load(&slot->owner);
+		if ((uint32_t)owner == ROGITFS_SHM_GENERATION(state)) {
+			pid_t pid = owner >> 32;
+			return kill(pid, 0) == -1 && errno == ESRCH;
+		}
+		// the writer died between claiming and recording its pid
+		return idle > ROGITFS_SHM_LEASE;
+	}
+	return (state & ROGITFS_SHM_READY) != 0 && (state & ROGITFS_SHM_REFS) != 0 && idle > ROGITFS_SHM_LEASE;
+}
+
+// Move a slot to writing with the next generation
+static int rogitfs_shm_take(struct rogitfs_shm_slot *slot, uint64_t state, uint32_t now, uint32_t *result_generation) {
+
+	uint32_t generation = ROGITFS_SHM_GENERATION(state) + 1;
+	// before the state, so others see a fresh claim until the owner is recorded
+	atomic_store(&slot->touched, now);
+	if (!atomic_compare_exchange_strong(&slot->state, &state, ((uint64_t)generation << 32) | ROGITFS_SHM_WRITING)) {
+		return -1;
+	}
+	atomic_store(&slot->owner, ((uint64_t)getpid() << 32) | generation);
+	*result_generation = generation;
+	return 0;
+}
+
+// Claim a slot for writing, empty and stale slots first, then ready slots
+// without readers that were not used since the last pass
+static struct rogitfs_shm_slot *rogitfs_shm_claim(struct rogitfs_shm *shm, uint32_t home, uint32_t *result_index, uint32_t *result_generation) {
+
+	uint32_t now = rogitfs_shm_now();
+	for (int pass = 0; pass < 3; pass++) {
+		for (uint32_t probe = 0; probe < ROGITFS_SHM_PROBES; probe++) {
+			uint32_t index = (home + probe) % shm->slot_count;
+			struct rogitfs_shm_slot *slot = &shm->slots[index];
+			uint64_t state = atomic_load(&slot->state);
+			if (pass == 0) {
+				if (((state & ROGITFS_SHM_FLAGS) == 0 || rogitfs_shm_stale(slot, state, now))
+					&& rogitfs_shm_take(slot, state, now, result_generation) == 0) {
+					*result_index = index;
+					return slot;
+				}
+				continue;
+			}
+			if ((state & ROGITFS_SHM_READY) == 0 || (state & ROGITFS_SHM_REFS) != 0) {
+				continue;
+			}
+			if ((state & ROGITFS_SHM_USED) != 0) {
+				atomic_compare_exchange_strong(&slot->state, &state, state & ~(uint64_t)ROGITFS_SHM_USED);
+				continue;
+			}
+			if (rogitfs_shm_take(slot, state, now, result_generation) == 0) {
+				*result_index = index;
+				return slot;
+			}
+		}
+	}
+	return NULL;
+}
+
+// Whether another slot holds the oid, ready or written by a racing process
+// at a lower index, so exactly one of the racing processes keeps its copy
+static int rogitfs_shm_duplicate(struct rogitfs_shm *shm, const git_oid *oid, uint32_t home, uint32_t own_index) {
+
+	for (uint32_t probe = 0; probe < ROGITFS_SHM_PROBES; probe++) {
+		uint32_t index = (home + probe) % shm->slot_count;
+		uint64_t state = atomic_load(&shm->slots[index].state);
+		if ((state & ROGITFS_SHM_READY) == 0 && ((state & ROGITFS_SHM_WRITING) == 0 || index >= own_index)) {
+			continue;
+		}
+		if (index != own_index && memcmp(shm->slots[index].oid, oid->id, GIT_OID_RAWSZ) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Store a blob, blobs larger than a slot are not cached
+void rogitfs_shm_insert(struct rogitfs_shm *shm, const git_oid *oid, const void *data, size_t size) {
+
+	if (size > shm->slot_size) {
+		return;
+	}
+	uint32_t home = rogitfs_shm_home(shm, oid);
+	uint32_t index = 0;
+	uint32_t generation = 0;
+	struct rogitfs_shm_slot *slot = rogitfs_shm_claim(shm, home, &index, &generation);
+	if (slot == NULL) {
+		return;
+	}
+	uint64_t writing = ((uint64_t)generation << 32) | ROGITFS_SHM_WRITING;
+	// the oid is visible to racing inserts before they look for duplicates
+	memcpy(slot->oid, oid->id, GIT_OID_RAWSZ);
+	atomic_thread_fence(memory_order_seq_cst);
+	if (rogitfs_shm_duplicate(shm, oid, home, index)) {
+		atomic_compare_exchange_strong(&slot->state, &writing, (uint64_t)generation << 32);
+		return;
+	}
+	memcpy(shm->data + (size_t)index * shm->slot_size, data, size);
+	slot->size = size;
+	atomic_compare_exchange_strong_explicit(&slot->state, &writing, ((uint64_t)generation << 32) | ROGITFS_SHM_READY, memory_order_release, memory_order_relaxed);
+}
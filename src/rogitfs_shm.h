@@ -0,0 +1,81 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_SHM_H__
+#define __ROGITFS_SHM_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <git2.h>
+
+// Blob content cache in shared memory, attached by every rogitfs process
+// using the same name, so blobs are inflated once per host.
+//
+// Layout:
+//   header  magic "RGSC", u32 version, u32 slot count, u32 slot size
+//   slots   state word, owner, size and oid per slot, open addressing by oid
+//   data    slot count * slot size bytes of blob content
+//
+// A slot is claimed by moving its state from empty, or from ready without
+// readers, to writing. Readers take a reference on ready slots before
+// comparing the oid, so content is never replaced while it is copied.
+//
+// Every claim increments the generation in the state word. Slots left
+// behind by dead processes are claimed again: writing slots whose owner
+// pid no longer exists, and ready slots whose references are older than
+// the lease. Readers check the generation after copying, so a reader that
+// outlived its lease sees the slot was taken over and discards the copy.
+// All processes sharing a cache have to see the same pids.
+#define ROGITFS_SHM_MAGIC "RGSC"
+#define ROGITFS_SHM_VERSION 2
+#define ROGITFS_SHM_SLOT_SIZE (64 * 1024)
+#define ROGITFS_SHM_PROBES 8
+#define ROGITFS_SHM_DEFAULT_SIZE (256 * 1024 * 1024)
+// seconds after which references on a slot are considered leaked
+#define ROGITFS_SHM_LEASE 10
+
+#define ROGITFS_SHM_READY   0x80000000u
+#define ROGITFS_SHM_WRITING 0x40000000u
+// second chance bit, set by readers and cleared by eviction
+#define ROGITFS_SHM_USED    0x20000000u
+#define ROGITFS_SHM_REFS    0x1fffffffu
+#define ROGITFS_SHM_FLAGS   0xffffffffu
+#define ROGITFS_SHM_GENERATION(state) ((uint32_t)((state) >> 32))
+
+struct rogitfs_shm_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size;
+};
+
+struct rogitfs_shm_slot {
+	// generation << 32 | ready, writing, used and reader count
+	_Atomic uint64_t state;
+	// pid << 32 | generation of the writing process
+	_Atomic uint64_t owner;
+	// CLOCK_MONOTONIC seconds of the last claim or reader reference
+	_Atomic uint32_t touched;
+	uint32_t size;
+	unsigned char oid[GIT_OID_RAWSZ];
+};
+
+struct rogitfs_shm {
+	void *map;
+	size_t map_size;
+	struct rogitfs_shm_slot *slots;
+	unsigned char *data;
+	uint32_t slot_count;
+	uint32_t slot_size;
+};
+
+struct rogitfs_shm *rogitfs_shm_attach(const char *name, size_t size);
+
+void rogitfs_shm_detach(struct rogitfs_shm *shm);
+
+int rogitfs_shm_read(struct rogitfs_shm *shm, const git_oid *oid, char *buf, size_t size, off_t offset);
+
+void rogitfs_shm_insert(struct rogitfs_shm *shm, const git_oid *oid, const void *data, size_t size);
+
+#endif
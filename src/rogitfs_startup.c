@@ -0,0 +1,142 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "rogitfs_startup.h"
+#include "rogitfs_pack.h"
+#include "rogitfs_graph.h"
+#include "rogitfs_logging.h"
+
+struct rogitfs_startup_item {
+	struct rogitfs_private *private;
+	// NULL for the commit graph and the libgit2 pack indexes of private
+	struct rogitfs_pack_file *pack;
+};
+
+static struct rogitfs_startup_item *rogitfs_startup_items = NULL;
+static unsigned int rogitfs_startup_item_count = 0;
+// next item to take and items not finished, updated atomically
+static unsigned int rogitfs_startup_next = 0;
+static unsigned int rogitfs_startup_left = 0;
+static int rogitfs_startup_stopping = 0;
+static pthread_t rogitfs_startup_threads[ROGITFS_STARTUP_MAX_THREADS];
+static unsigned int rogitfs_startup_thread_count = 0;
+static struct timespec rogitfs_startup_begin = {};
+
+static void rogitfs_startup_odb(git_odb *odb) {
+
+	// looking for a missing object makes libgit2 open the index of every pack
+	git_oid missing;
+	memset(&missing, 0xff, sizeof(missing));
+	git_odb_exists_ext(odb, &missing, GIT_ODB_LOOKUP_NO_REFRESH);
+}
+
+static void rogitfs_startup_repository(struct rogitfs_private *private) {
+
+	// without a commit-graph file the graph needs a walk of the whole history,
+	// which is left to the first request using it and would hold up unmounting
+	if (rogitfs_graph_has_file(private->repo)) {
+		rogitfs_graph_release(private, rogitfs_graph_get(private, NULL));
+	}
+	rogitfs_startup_odb(private->odb);
+	for (unsigned int i = 0; i < private->alternate_count; i++) {
+		rogitfs_startup_odb(private->alternates[i]);
+	}
+}
+
+static void *rogitfs_startup_worker(void *data) {
+
+	while (__atomic_load_n(&rogitfs_startup_stopping, __ATOMIC_ACQUIRE) == 0) {
+		unsigned int index = __atomic_fetch_add(&rogitfs_startup_next, 1, __ATOMIC_RELAXED);
+		if (index >= rogitfs_startup_item_count) {
+			break;
+		}
+		struct rogitfs_startup_item *item = &rogitfs_startup_items[index];
+		if (item->pack != NULL) {
+			rogitfs_pack_file_load(item->pack);
+		} else {
+			rogitfs_startup_repository(item->private);
+		}
+		if (__atomic_sub_fetch(&rogitfs_startup_left, 1, __ATOMIC_ACQ_REL) == 0) {
+			struct timespec end = {};
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			unsigned long long ms = (unsigned long long)(end.tv_sec - rogitfs_startup_begin.tv_sec) * 1000 + (end.tv_nsec - rogitfs_startup_begin.tv_nsec) / 1000000;
+			rogitfs_log(ROGITFS_LOGGING_INFO, "repositories loaded after %llu ms", ms);
+		}
+	}
+	return NULL;
+}
+
+// Load the packs and commit graphs of repos with threads, 0 takes one per
+// processor. Start after fuse has daemonized, stop before closing repos.
+int rogitfs_startup_start(struct rogitfs_private *repos, unsigned int count, unsigned int threads) {
+
+	if (threads == 0) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = processors > 0 ? (unsigned int)processors : 1;
+	}
+	if (threads > ROGITFS_STARTUP_MAX_THREADS) {
+		threads = ROGITFS_STARTUP_MAX_THREADS;
+	}
+
+	// packs of all repositories first, they are needed by the first reads
+	unsigned int item_count = count;
+	for (unsigned int i = 0; i < count; i++) {
+		if (repos[i].packs != NULL) {
+			item_count += repos[i].packs->file_count;
+		}
+	}
+	struct rogitfs_startup_item *items = (struct rogitfs_startup_item *) calloc(item_count, sizeof(struct rogitfs_startup_item));
+	if (items == NULL) {
+		rogitfs_log_error("rogitfs_startup_start calloc failed");
+		return -1;
+	}
+	unsigned int item = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		for (unsigned int p = 0; repos[i].packs != NULL && p < repos[i].packs->file_count; p++) {
+			items[item].private = &repos[i];
+			items[item].pack = repos[i].packs->files[p];
+			item++;
+		}
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		items[item++].private = &repos[i];
+	}
+
+	rogitfs_startup_items = items;
+	rogitfs_startup_item_count = item_count;
+	rogitfs_startup_next = 0;
+	rogitfs_startup_left = item_count;
+	rogitfs_startup_stopping = 0;
+	clock_gettime(CLOCK_MONOTONIC, &rogitfs_startup_begin);
+	if (threads > item_count) {
+		threads = item_count;
+	}
+	for (rogitfs_startup_thread_count = 0; rogitfs_startup_thread_count < threads; rogitfs_startup_thread_count++) {
+		int error = pthread_create(&rogitfs_startup_threads[rogitfs_startup_thread_count], NULL, &rogitfs_startup_worker, NULL);
+		if (error != 0) {
+			// whatever is left is loaded when first needed
+			rogitfs_log_error("pthread_create %d %s", error, strerror(error));
+			break;
+		}
+	}
+	return 0;
+}
+
+// Stop taking items and wait for the ones being loaded
+void rogitfs_startup_stop(void) {
+
+	__atomic_store_n(&rogitfs_startup_stopping, 1, __ATOMIC_RELEASE);
+	for (unsigned int i = 0; i < rogitfs_startup_thread_count; i++) {
+		pthread_join(rogitfs_startup_threads[i], NULL);
+	}
+	rogitfs_startup_thread_count = 0;
+	free(rogitfs_startup_items);
+	rogitfs_startup_items = NULL;
+	rogitfs_startup_item_count = 0;
+}
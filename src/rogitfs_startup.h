@@ -0,0 +1,24 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_STARTUP_H__
+#define __ROGITFS_STARTUP_H__
+
+#include "rogitfs_common.h"
+
+// Loading of the repositories after mounting.
+//
+// rogitfs mounts as soon as the repositories are opened, which only lists
+// their pack directories. Threads started by the init handler then map the
+// packs of all repositories, build the commit graphs of repositories with a
+// commit-graph file and have libgit2 open its pack indexes, several at a time. A request needing a pack or graph
+// that is not ready loads it itself or waits for the thread loading it,
+// requests needing neither are not held up.
+
+#define ROGITFS_STARTUP_MAX_THREADS 64
+
+int rogitfs_startup_start(struct rogitfs_private *repos, unsigned int count, unsigned int threads);
+
+void rogitfs_startup_stop(void);
+
+#endif
@@ -0,0 +1,294 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "rogitfs_common.h"
+#include "rogitfs_cache.h"
+#include "rogitfs_stats.h"
+#include "rogitfs_memory.h"
+
+static const char *rogitfs_stats_op_names[ROGITFS_STATS_OP_COUNT] = {
+	"getattr", "readdir", "read", "readlink", "getxattr", "listxattr", "open"
+};
+
+static const char *rogitfs_stats_counter_names[ROGITFS_STATS_COUNTER_COUNT] = {
+	"odb_reads", "bytes_inflated", "bytes_served", "shm_hits", "shm_misses", "negative_hits", "pack_reads", "deltas_applied"
+};
+
+// index 0 counts unknown paths, index 1 the root directory
+static const char *rogitfs_stats_tree_names[ROGITFS_STATS_TREE_COUNT] = {
+	"other", "root", "commit", "obj", "refs", "inherit", "HEAD", "manifest", "changes", "diff",
+	"log", "ancestors", "mergebase", "by-date", "history", "search", "tree", "tree-obj", ".rogitfs"
+};
+
+static pthread_mutex_t rogitfs_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+// blocks of running threads
+static struct rogitfs_stats_thread *rogitfs_stats_threads = NULL;
+// sum of blocks of threads that ended
+static struct rogitfs_stats_thread rogitfs_stats_retired = {};
+static pthread_once_t rogitfs_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rogitfs_stats_key;
+static __thread struct rogitfs_stats_thread *rogitfs_stats_current = NULL;
+
+// Only the owning thread writes its block, the report reads it concurrently
+static inline void rogitfs_stats_add(uint64_t *counter, uint64_t value) {
+
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static void rogitfs_stats_merge(struct rogitfs_stats_thread *sum, struct rogitfs_stats_thread *block) {
+
+	for (unsigned int i = 0; i < ROGITFS_STATS_COUNTER_COUNT; i++) {
+		sum->counters[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+	}
+	for (unsigned int op = 0; op < ROGITFS_STATS_OP_COUNT; op++) {
+		for (unsigned int tree = 0; tree < ROGITFS_STATS_TREE_COUNT; tree++) {
+			struct rogitfs_stats_latency *to = &sum->latency[op][tree];
+			struct rogitfs_stats_latency *from = &block->latency[op][tree];
+			if (__atomic_load_n(&from->count, __ATOMIC_RELAXED) == 0) {
+				continue;
+			}
+			to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+			to->errors += __atomic_load_n(&from->errors, __ATOMIC_RELAXED);
+			to->total_ns += __atomic_load_n(&from->total_ns, __ATOMIC_RELAXED);
+			uint64_t max_ns = __atomic_load_n(&from->max_ns, __ATOMIC_RELAXED);
+			if (max_ns > to->max_ns) {
+				to->max_ns = max_ns;
+			}
+			for (unsigned int i = 0; i < ROGITFS_STATS_BUCKETS; i++) {
+				to->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+			}
+		}
+	}
+}
+
+// Called when a thread ends, its counts are kept in the retired block
+static void rogitfs_stats_thread_end(void *data) {
+
+	struct rogitfs_stats_thread *block = (struct rogitfs_stats_thread *)data;
+
+	pthread_mutex_lock(&rogitfs_stats_lock);
+	struct rogitfs_stats_thread **cur = &rogitfs_stats_threads;
+	while (*cur != NULL && *cur != block) {
+		cur = &(*cur)->next;
+	}
+	if (*cur != NULL) {
+		*cur = block->next;
+	}
+	rogitfs_stats_merge(&rogitfs_stats_retired, block);
+	pthread_mutex_unlock(&rogitfs_stats_lock);
+
+	free(block);
+}
+
+static void rogitfs_stats_key_create(void) {
+
+	pthread_key_create(&rogitfs_stats_key, &rogitfs_stats_thread_end);
+}
+
+static struct rogitfs_stats_thread *rogitfs_stats_thread_get(void) {
+
+	if (rogitfs_stats_current != NULL) {
+		return rogitfs_stats_current;
+	}
+	struct rogitfs_stats_thread *block = (struct rogitfs_stats_thread *) calloc(1, sizeof(struct rogitfs_stats_thread));
+	if (block == NULL) {
+		return NULL;
+	}
+	pthread_once(&rogitfs_stats_once, &rogitfs_stats_key_create);
+	pthread_setspecific(rogitfs_stats_key, block);
+
+	pthread_mutex_lock(&rogitfs_stats_lock);
+	block->next = rogitfs_stats_threads;
+	rogitfs_stats_threads = block;
+	pthread_mutex_unlock(&rogitfs_stats_lock);
+
+	rogitfs_stats_current = block;
+	return block;
+}
+
+static unsigned int rogitfs_stats_tree(const char *path) {
+
+	if (path[0] == '/') {
+		path++;
+	}
+	if (path[0] == 0) {
+		return 1;
+	}
+	const char *end = index(path, '/');
+	size_t len = end == NULL ? strlen(path) : end - path;
+	for (unsigned int i = 2; i < ROGITFS_STATS_TREE_COUNT; i++) {
+		if (strlen(rogitfs_stats_tree_names[i]) == len && strncmp(rogitfs_stats_tree_names[i], path, len) == 0) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+// Four buckets per power of two, the first four hold single units
+static unsigned int rogitfs_stats_bucket(uint64_t ns) {
+
+	uint64_t value = ns >> ROGITFS_STATS_UNIT_SHIFT;
+	if (value < 4) {
+		return value;
+	}
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int bucket = 4 * (msb - 1) + ((value >> (msb - 2)) & 3);
+	return bucket < ROGITFS_STATS_BUCKETS ? bucket : ROGITFS_STATS_BUCKETS - 1;
+}
+
+// First nanosecond value of a bucket
+static uint64_t rogitfs_stats_bucket_start(unsigned int bucket) {
+
+	if (bucket < 4) {
+		return (uint64_t)bucket << ROGITFS_STATS_UNIT_SHIFT;
+	}
+	unsigned int msb = bucket / 4 + 1;
+	return ((uint64_t)(4 + bucket % 4) << (msb - 2)) << ROGITFS_STATS_UNIT_SHIFT;
+}
+
+// Upper bound of the bucket holding the given percentile, at most the maximum
+static uint64_t rogitfs_stats_percentile(const struct rogitfs_stats_latency *latency, unsigned int percent) {
+
+	uint64_t target = (latency->count * percent + 99) / 100;
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < ROGITFS_STATS_BUCKETS; i++) {
+		seen += latency->buckets[i];
+		if (seen >= target) {
+			uint64_t end = rogitfs_stats_bucket_start(i + 1);
+			return end < latency->max_ns ? end : latency->max_ns;
+		}
+	}
+	return latency->max_ns;
+}
+
+const char *rogitfs_stats_op_name(enum rogitfs_stats_op op) {
+
+	return rogitfs_stats_op_names[op];
+}
+
+void rogitfs_stats_count(enum rogitfs_stats_counter counter, uint64_t value) {
+
+	struct rogitfs_stats_thread *block = rogitfs_stats_thread_get();
+	if (block == NULL) {
+		return;
+	}
+	rogitfs_stats_add(&block->counters[counter], value);
+}
+
+void rogitfs_stats_start(struct timespec *start) {
+
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void rogitfs_stats_finish(enum rogitfs_stats_op op, const char *path, const struct timespec *start, int res) {
+
+	struct timespec end = {};
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	uint64_t ns = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000000ull + end.tv_nsec - start->tv_nsec;
+
+	struct rogitfs_stats_thread *block = rogitfs_stats_thread_get();
+	if (block == NULL) {
+		return;
+	}
+	struct rogitfs_stats_latency *latency = &block->latency[op][rogitfs_stats_tree(path)];
+	rogitfs_stats_add(&latency->count, 1);
+	if (res < 0) {
+		rogitfs_stats_add(&latency->errors, 1);
+	}
+	rogitfs_stats_add(&latency->total_ns, ns);
+	if (ns > latency->max_ns) {
+		__atomic_store_n(&latency->max_ns, ns, __ATOMIC_RELAXED);
+	}
+	rogitfs_stats_add(&latency->buckets[rogitfs_stats_bucket(ns)], 1);
+}
+
+static int rogitfs_stats_report_cache(struct rogitfs_buffer *out, struct rogitfs_cache *cache) {
+
+	if (cache == NULL) {
+		return 0;
+	}
+	pthread_mutex_lock(&cache->lock);
+	unsigned long long hits = cache->hits;
+	unsigned long long misses = cache->misses;
+	unsigned int entries = cache->entry_count;
+	size_t size = cache->size;
+	size_t max_size = cache->max_size;
+	size_t protected_size = cache->protected_size;
+	pthread_mutex_unlock(&cache->lock);
+
+	double hit_percent = hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+	return rogitfs_buffer_printf(out, "cache %s hits %llu misses %llu hit_percent %.1f entries %u size %zu max_size %zu protected_size %zu\n",
+		cache->name, hits, misses, hit_percent, entries, size, max_size, protected_size);
+}
+
+// Text report of all counters, one record per line
+int rogitfs_stats_report(struct rogitfs_buffer *out, struct rogitfs_private *private) {
+
+	struct rogitfs_stats_thread *sum = (struct rogitfs_stats_thread *) calloc(1, sizeof(struct rogitfs_stats_thread));
+	if (sum == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&rogitfs_stats_lock);
+	rogitfs_stats_merge(sum, &rogitfs_stats_retired);
+	for (struct rogitfs_stats_thread *cur = rogitfs_stats_threads; cur != NULL; cur = cur->next) {
+		rogitfs_stats_merge(sum, cur);
+	}
+	pthread_mutex_unlock(&rogitfs_stats_lock);
+
+	int res = 0;
+	for (unsigned int i = 0; i < ROGITFS_STATS_COUNTER_COUNT && res == 0; i++) {
+		res = rogitfs_buffer_printf(out, "counter %s %llu\n", rogitfs_stats_counter_names[i], (unsigned long long)sum->counters[i]);
+	}
+	if (res == 0) {
+		res = rogitfs_stats_report_cache(out, private->manifest_cache);
+	}
+	if (res == 0) {
+		res = rogitfs_stats_report_cache(out, private->resolve_cache);
+	}
+	if (res == 0) {
+		res = rogitfs_stats_report_cache(out, private->changes_cache);
+	}
+	if (res == 0) {
+		res = rogitfs_stats_report_cache(out, private->delta_cache);
+	}
+	if (res == 0) {
+		res = rogitfs_memory_report(out);
+	}
+
+	for (unsigned int op = 0; op < ROGITFS_STATS_OP_COUNT && res == 0; op++) {
+		for (unsigned int tree = 0; tree < ROGITFS_STATS_TREE_COUNT && res == 0; tree++) {
+			const struct rogitfs_stats_latency *latency = &sum->latency[op][tree];
+			if (latency->count == 0) {
+				continue;
+			}
+			res = rogitfs_buffer_printf(out, "op %s %s count %llu errors %llu mean_ns %llu p50_ns %llu p90_ns %llu p99_ns %llu max_ns %llu\n",
+				rogitfs_stats_op_names[op], rogitfs_stats_tree_names[tree],
+				(unsigned long long)latency->count, (unsigned long long)latency->errors,
+				(unsigned long long)(latency->total_ns / latency->count),
+				(unsigned long long)rogitfs_stats_percentile(latency, 50),
+				(unsigned long long)rogitfs_stats_percentile(latency, 90),
+				(unsigned long long)rogitfs_stats_percentile(latency, 99),
+				(unsigned long long)latency->max_ns);
+			// non-empty buckets as <upper bound in ns>:<count>
+			if (res == 0) {
+				res = rogitfs_buffer_printf(out, "histogram %s %s", rogitfs_stats_op_names[op], rogitfs_stats_tree_names[tree]);
+			}
+			for (unsigned int i = 0; i < ROGITFS_STATS_BUCKETS && res == 0; i++) {
+				if (latency->buckets[i] == 0) {
+					continue;
+				}
+				res = rogitfs_buffer_printf(out, " %llu:%llu", (unsigned long long)rogitfs_stats_bucket_start(i + 1), (unsigned long long)latency->buckets[i]);
+			}
+			if (res == 0) {
+				res = rogitfs_buffer_append(out, "\n", 1);
+			}
+		}
+	}
+
+	free(sum);
+	return res;
+}
@@ -0,0 +1,76 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_STATS_H__
+#define __ROGITFS_STATS_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "rogitfs_common.h"
+
+// Operation counters and latency histograms of the whole process.
+//
+// Every thread counts into its own block, blocks are summed when the report
+// is generated, so counting takes no lock and shares no cache line.
+// Latencies are kept in log-linear buckets of ROGITFS_STATS_UNIT_SHIFT
+// nanosecond units, four buckets per power of two.
+
+enum rogitfs_stats_op {
+	ROGITFS_STATS_GETATTR,
+	ROGITFS_STATS_READDIR,
+	ROGITFS_STATS_READ,
+	ROGITFS_STATS_READLINK,
+	ROGITFS_STATS_GETXATTR,
+	ROGITFS_STATS_LISTXATTR,
+	ROGITFS_STATS_OPEN,
+	ROGITFS_STATS_OP_COUNT
+};
+
+enum rogitfs_stats_counter {
+	// objects read from object databases
+	ROGITFS_STATS_ODB_READS,
+	// size of objects read from object databases
+	ROGITFS_STATS_BYTES_INFLATED,
+	// bytes returned by read
+	ROGITFS_STATS_BYTES_SERVED,
+	ROGITFS_STATS_SHM_HITS,
+	ROGITFS_STATS_SHM_MISSES,
+	// names found missing in a tree by the resolve cache
+	ROGITFS_STATS_NEGATIVE_HITS,
+	// reads served from mapped packs without libgit2
+	ROGITFS_STATS_PACK_READS,
+	// deltas applied for the delta cache
+	ROGITFS_STATS_DELTAS_APPLIED,
+	ROGITFS_STATS_COUNTER_COUNT
+};
+
+// first path components with their own histograms, others count as other
+#define ROGITFS_STATS_TREE_COUNT 19
+#define ROGITFS_STATS_UNIT_SHIFT 6
+#define ROGITFS_STATS_BUCKETS 112
+
+struct rogitfs_stats_latency {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[ROGITFS_STATS_BUCKETS];
+};
+
+struct rogitfs_stats_thread {
+	struct rogitfs_stats_thread *next;
+	uint64_t counters[ROGITFS_STATS_COUNTER_COUNT];
+	struct rogitfs_stats_latency latency[ROGITFS_STATS_OP_COUNT][ROGITFS_STATS_TREE_COUNT];
+};
+
+const char *rogitfs_stats_op_name(enum rogitfs_stats_op op);
+
+void rogitfs_stats_count(enum rogitfs_stats_counter counter, uint64_t value);
+
+void rogitfs_stats_start(struct timespec *start);
+
+void rogitfs_stats_finish(enum rogitfs_stats_op op, const char *path, const struct timespec *start, int res);
+
+int rogitfs_stats_report(struct rogitfs_buffer *out, struct rogitfs_private *private);
+
+#endif
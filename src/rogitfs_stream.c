@@ -0,0 +1,135 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_stream.h"
+
+struct rogitfs_stream *rogitfs_stream_new(void *state, rogitfs_stream_next_cb next, rogitfs_stream_seek_cb seek, rogitfs_stream_free_cb free_state) {
+
+	struct rogitfs_stream *stream = (struct rogitfs_stream *) calloc(1, sizeof(struct rogitfs_stream));
+	if (stream == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&stream->lock, NULL);
+	stream->state = state;
+	stream->next = next;
+	stream->seek = seek;
+	stream->free_state = free_state;
+	return stream;
+}
+
+void rogitfs_stream_free(struct rogitfs_stream *stream) {
+
+	if (stream == NULL) {
+		return;
+	}
+	if (stream->free_state != NULL) {
+		stream->free_state(stream->state);
+	}
+	rogitfs_buffer_free(&stream->window);
+	free(stream->checkpoints);
+	pthread_mutex_destroy(&stream->lock);
+	free(stream);
+}
+
+static int rogitfs_stream_checkpoint(struct rogitfs_stream *stream, off_t offset) {
+
+	if (stream->checkpoint_count > 0) {
+		struct rogitfs_stream_checkpoint *last = &stream->checkpoints[stream->checkpoint_count - 1];
+		if (offset < last->offset + ROGITFS_STREAM_CHECKPOINT_INTERVAL) {
+			return 0;
+		}
+	}
+	if (stream->checkpoint_count == stream->checkpoint_capacity) {
+		unsigned int new_capacity = stream->checkpoint_capacity == 0 ? 16 : stream->checkpoint_capacity * 2;
+		struct rogitfs_stream_checkpoint *new_checkpoints = (struct rogitfs_stream_checkpoint *) realloc(stream->checkpoints, new_capacity * sizeof(struct rogitfs_stream_checkpoint));
+		if (new_checkpoints == NULL) {
+			return -1;
+		}
+		stream->checkpoints = new_checkpoints;
+		stream->checkpoint_capacity = new_capacity;
+	}
+	stream->checkpoints[stream->checkpoint_count].offset = offset;
+	stream->checkpoints[stream->checkpoint_count].position = stream->position;
+	stream->checkpoint_count++;
+	return 0;
+}
+
+// Restart from the last checkpoint at or before offset
+static int rogitfs_stream_rewind(struct rogitfs_stream *stream, off_t offset) {
+
+	struct rogitfs_stream_checkpoint start = {};
+	for (unsigned int i = 0; i < stream->checkpoint_count; i++) {
+		if (stream->checkpoints[i].offset > offset) {
+			break;
+		}
+		start = stream->checkpoints[i];
+	}
+	if (stream->seek(stream, start.position) != 0) {
+		return -1;
+	}
+	stream->window.size = 0;
+	stream->window_offset = start.offset;
+	stream->position = start.position;
+	stream->finished = 0;
+	return 0;
+}
+
+int rogitfs_stream_read(struct rogitfs_stream *stream, char *buf, size_t size, off_t offset) {
+
+	pthread_mutex_lock(&stream->lock);
+
+	if (offset < stream->window_offset) {
+		if (rogitfs_stream_rewind(stream, offset) != 0) {
+			pthread_mutex_unlock(&stream->lock);
+			return -EIO;
+		}
+	}
+
+	// generate until the requested range is available
+	while (stream->finished == 0 && stream->window_offset + (off_t)stream->window.size < offset + (off_t)size) {
+
+		off_t record_offset = stream->window_offset + stream->window.size;
+		if (rogitfs_stream_checkpoint(stream, record_offset) != 0) {
+			pthread_mutex_unlock(&stream->lock);
+			return -ENOMEM;
+		}
+
+		int res = stream->next(stream, &stream->window);
+		if (res < 0) {
+			pthread_mutex_unlock(&stream->lock);
+			return -EIO;
+		}
+		if (res > 0) {
+			stream->finished = 1;
+			break;
+		}
+		stream->position++;
+
+		// drop data far behind the reader
+		off_t keep_from = offset - ROGITFS_STREAM_KEEP;
+		if (keep_from > stream->window_offset) {
+			size_t drop = keep_from - stream->window_offset;
+			if (drop > stream->window.size) {
+				drop = stream->window.size;
+			}
+			memmove(stream->window.data, stream->window.data + drop, stream->window.size - drop);
+			stream->window.size -= drop;
+			stream->window_offset += drop;
+		}
+	}
+
+	int toread = 0;
+	off_t window_end = stream->window_offset + stream->window.size;
+	if (offset < window_end) {
+		size_t available = window_end - offset;
+		toread = size < available ? size : available;
+		memcpy(buf, stream->window.data + (offset - stream->window_offset), toread);
+	}
+
+	pthread_mutex_unlock(&stream->lock);
+	return toread;
+}
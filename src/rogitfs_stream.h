@@ -0,0 +1,54 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_STREAM_H__
+#define __ROGITFS_STREAM_H__
+
+#include <sys/types.h>
+#include <pthread.h>
+#include "rogitfs_common.h"
+
+// Distance in bytes between checkpoints the generator can be restarted from
+#define ROGITFS_STREAM_CHECKPOINT_INTERVAL (256 * 1024)
+// Already read bytes kept for small backward seeks
+#define ROGITFS_STREAM_KEEP (1024 * 1024)
+
+struct rogitfs_stream;
+
+// Append the record at the current position to out.
+// Returns 0 if a record was produced, 1 at the end and -1 on error.
+typedef int (*rogitfs_stream_next_cb)(struct rogitfs_stream *stream, struct rogitfs_buffer *out);
+
+// Restart generation so the next record produced is the one at position
+typedef int (*rogitfs_stream_seek_cb)(struct rogitfs_stream *stream, unsigned long long position);
+
+typedef void (*rogitfs_stream_free_cb)(void *state);
+
+struct rogitfs_stream_checkpoint {
+	off_t offset;
+	unsigned long long position;
+};
+
+// Content generated incrementally while a file handle is read
+struct rogitfs_stream {
+	pthread_mutex_t lock;
+	void *state;
+	rogitfs_stream_next_cb next;
+	rogitfs_stream_seek_cb seek;
+	rogitfs_stream_free_cb free_state;
+	struct rogitfs_buffer window;
+	off_t window_offset;
+	unsigned long long position;
+	int finished;
+	struct rogitfs_stream_checkpoint *checkpoints;
+	unsigned int checkpoint_count;
+	unsigned int checkpoint_capacity;
+};
+
+struct rogitfs_stream *rogitfs_stream_new(void *state, rogitfs_stream_next_cb next, rogitfs_stream_seek_cb seek, rogitfs_stream_free_cb free_state);
+
+void rogitfs_stream_free(struct rogitfs_stream *stream);
+
+int rogitfs_stream_read(struct rogitfs_stream *stream, char *buf, size_t size, off_t offset);
+
+#endif
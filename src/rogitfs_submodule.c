@@ -0,0 +1,251 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "rogitfs_common.h"
+#include "rogitfs_submodule.h"
+#include "rogitfs_logging.h"
+
+// Trim whitespace and surrounding quotes of a .gitmodules value
+static void rogitfs_submodule_trim(const char **start, size_t *len) {
+
+	const char *s = *start;
+	size_t l = *len;
+	while (l > 0 && isspace((unsigned char)s[0])) {
+		s++;
+		l--;
+	}
+	while (l > 0 && isspace((unsigned char)s[l-1])) {
+		l--;
+	}
+	if (l >= 2 && s[0] == '"' && s[l-1] == '"') {
+		s++;
+		l -= 2;
+	}
+	*start = s;
+	*len = l;
+}
+
+// Find the name of the submodule at path in .gitmodules content.
+// Only the subset of the config format written by git submodule is understood.
+static int rogitfs_submodule_name(const char *data, size_t size, const char *path, size_t path_len, struct rogitfs_buffer *result_name) {
+
+	const char *name = NULL;
+	size_t name_len = 0;
+	const char *end = data + size;
+	const char *line = data;
+
+	while (line < end) {
+		const char *line_end = memchr(line, '\n', end - line);
+		if (line_end == NULL) {
+			line_end = end;
+		}
+		const char *s = line;
+		size_t len = line_end - line;
+		rogitfs_submodule_trim(&s, &len);
+		line = line_end + 1;
+
+		if (len == 0 || s[0] == '#' || s[0] == ';') {
+			continue;
+		}
+		if (s[0] == '[') {
+			// [submodule "name"]
+			name = NULL;
+			if (len > 13 && strncmp(s, "[submodule \"", 12) == 0 && s[len-1] == ']' && s[len-2] == '"') {
+				name = s + 12;
+				name_len = len - 14;
+			}
+			continue;
+		}
+		if (name == NULL) {
+			continue;
+		}
+		const char *eq = memchr(s, '=', len);
+		if (eq == NULL) {
+			continue;
+		}
+		const char *key = s;
+		size_t key_len = eq - s;
+		rogitfs_submodule_trim(&key, &key_len);
+		if (key_len != 4 || strncasecmp(key, "path", 4) != 0) {
+			continue;
+		}
+		const char *value = eq + 1;
+		size_t value_len = s + len - value;
+		rogitfs_submodule_trim(&value, &value_len);
+		while (value_len > 0 && value[value_len-1] == '/') {
+			value_len--;
+		}
+		if (value_len != path_len || memcmp(value, path, path_len) != 0) {
+			continue;
+		}
+
+		// name becomes a directory below modules/
+		if (name_len == 0 || name[0] == '/' || memmem(name, name_len, "..", 2) != NULL) {
+			return -1;
+		}
+		if (rogitfs_buffer_append(result_name, name, name_len) != 0 || rogitfs_buffer_append(result_name, "", 1) != 0) {
+			return -1;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+// Returns the repository at gitdir, opening it on first use
+static struct rogitfs_repo *rogitfs_submodule_open(const char *gitdir, struct rogitfs_private *private) {
+
+	pthread_mutex_lock(&private->repos_lock);
+	struct rogitfs_repo *repo = private->repos;
+	while (repo != NULL && strcmp(repo->gitdir, gitdir) != 0) {
+		repo = repo->next;
+	}
+	if (repo != NULL) {
+		pthread_mutex_unlock(&private->repos_lock);
+		return repo;
+	}
+
+	git_repository *git_repo = NULL;
+	int error = git_repository_open_bare(&git_repo, gitdir);
+	if (error != 0) {
+		// submodule not initialized
+		pthread_mutex_unlock(&private->repos_lock);
+		return NULL;
+	}
+	git_odb *odb = NULL;
+	error = git_repository_odb(&odb, git_repo);
+	if (error != 0) {
+		rogitfs_log_giterr("git_repository_odb", error);
+		git_repository_free(git_repo);
+		pthread_mutex_unlock(&private->repos_lock);
+		return NULL;
+	}
+	repo = calloc(1, sizeof(struct rogitfs_repo));
+	char *gitdir_copy = strdup(gitdir);
+	if (repo == NULL || gitdir_copy == NULL) {
+		free(repo);
+		free(gitdir_copy);
+		git_odb_free(odb);
+		git_repository_free(git_repo);
+		pthread_mutex_unlock(&private->repos_lock);
+		return NULL;
+	}
+	repo->repo = git_repo;
+	repo->odb = odb;
+	repo->gitdir = gitdir_copy;
+	repo->next = private->repos;
+	private->repos = repo;
+	pthread_mutex_unlock(&private->repos_lock);
+
+	return repo;
+}
+
+// Find the repository of the submodule at path below the tree of root
+static struct rogitfs_repo *rogitfs_submodule_find(const struct rogitfs_entry *root, const char *path, size_t path_len, struct rogitfs_private *private) {
+
+	git_oid tree_id = {};
+	if (rogitfs_entry_tree_id(root, &tree_id, private) != 0) {
+		return NULL;
+	}
+
+	// the same tree can be part of several repositories, with different submodules
+	git_repository *containing = rogitfs_entry_repo(root, private);
+	size_t key_len = 1 + sizeof(git_repository *) + GIT_OID_RAWSZ + path_len;
+	unsigned char key[key_len];
+	key[0] = 'm';
+	memcpy(key+1, &containing, sizeof(git_repository *));
+	memcpy(key+1+sizeof(git_repository *), tree_id.id, GIT_OID_RAWSZ);
+	memcpy(key+1+sizeof(git_repository *)+GIT_OID_RAWSZ, path, path_len);
+	struct rogitfs_repo *repo = NULL;
+	if (rogitfs_cache_lookup(private->resolve_cache, key, key_len, &repo, sizeof(repo)) == 0) {
+		return repo;
+	}
+
+	git_tree *tree = NULL;
+	int error = git_tree_lookup(&tree, containing, &tree_id);
+	if (error != 0) {
+		rogitfs_log_giterr("git_tree_lookup", error);
+		return NULL;
+	}
+	const git_tree_entry *modules_entry = git_tree_entry_byname(tree, ".gitmodules");
+	if (modules_entry == NULL || git_tree_entry_type(modules_entry) != GIT_OBJECT_BLOB) {
+		git_tree_free(tree);
+		return NULL;
+	}
+	git_odb_object *modules = NULL;
+	error = git_odb_read(&modules, rogitfs_entry_odb(root, private), git_tree_entry_id(modules_entry));
+	git_tree_free(tree);
+	if (error != 0) {
+		rogitfs_log_giterr("git_odb_read", error);
+		return NULL;
+	}
+
+	struct rogitfs_buffer name = {};
+	error = rogitfs_submodule_name(git_odb_object_data(modules), git_odb_object_size(modules), path, path_len, &name);
+	git_odb_object_free(modules);
+	if (error != 0) {
+		rogitfs_buffer_free(&name);
+		return NULL;
+	}
+
+	// git_repository_path ends with a slash
+	struct rogitfs_buffer gitdir = {};
+	if (rogitfs_buffer_printf(&gitdir, "%smodules/%s", git_repository_path(containing), name.data) != 0
+		|| rogitfs_buffer_append(&gitdir, "", 1) != 0) {
+		rogitfs_buffer_free(&name);
+		rogitfs_buffer_free(&gitdir);
+		return NULL;
+	}
+	rogitfs_buffer_free(&name);
+
+	repo = rogitfs_submodule_open(gitdir.data, private);
+	rogitfs_buffer_free(&gitdir);
+	if (repo != NULL) {
+		// repositories are kept until unmount, the pointer stays valid
+		rogitfs_cache_insert(private->resolve_cache, key, key_len, &repo, sizeof(repo));
+	}
+	return repo;
+}
+
+// Resolve the gitlink entry at path below root into its submodule repository
+int rogitfs_submodule_enter(const struct rogitfs_entry *root, const char *path, size_t path_len, struct rogitfs_entry *entry, struct rogitfs_private *private) {
+
+	if (entry->mode != GIT_FILEMODE_COMMIT) {
+		return -1;
+	}
+	if ((entry->flags & ROGITFS_ENTRY_SUBMODULE) != 0) {
+		return 0;
+	}
+
+	struct rogitfs_repo *repo = rogitfs_submodule_find(root, path, path_len, private);
+	if (repo == NULL) {
+		return -1;
+	}
+	// the recorded commit may not have been fetched
+	if (git_odb_exists(repo->odb, &entry->oid) == 0) {
+		return -1;
+	}
+
+	entry->repo = repo;
+	entry->flags |= ROGITFS_ENTRY_SUBMODULE;
+	return 0;
+}
+
+void rogitfs_submodule_free_all(struct rogitfs_private *private) {
+
+	struct rogitfs_repo *repo = private->repos;
+	while (repo != NULL) {
+		struct rogitfs_repo *next = repo->next;
+		git_odb_free(repo->odb);
+		git_repository_free(repo->repo);
+		free(repo->gitdir);
+		free(repo);
+		repo = next;
+	}
+	private->repos = NULL;
+}
@@ -0,0 +1,19 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_SUBMODULE_H__
+#define __ROGITFS_SUBMODULE_H__
+
+#include <git2.h>
+#include "rogitfs_common.h"
+
+// Gitlink entries are resolved through the .gitmodules file of the tree they
+// are found in. The submodule named there is opened from <gitdir>/modules/<name>,
+// where <gitdir> is the repository containing the gitlink.
+// Submodules that are not checked out or miss the commit stay empty directories.
+
+int rogitfs_submodule_enter(const struct rogitfs_entry *root, const char *path, size_t path_len, struct rogitfs_entry *entry, struct rogitfs_private *private);
+
+void rogitfs_submodule_free_all(struct rogitfs_private *private);
+
+#endif
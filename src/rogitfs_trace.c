@@ -0,0 +1,267 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include "rogitfs_common.h"
+#include "rogitfs_trace.h"
+#include "rogitfs_logging.h"
+
+int rogitfs_trace_enabled = 0;
+
+static unsigned int rogitfs_trace_capacity = 0;
+static char *rogitfs_trace_dump_path = NULL;
+static pthread_mutex_t rogitfs_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+// rings of running and ended threads, never freed
+static struct rogitfs_trace_ring *rogitfs_trace_rings = NULL;
+static pthread_once_t rogitfs_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rogitfs_trace_key;
+static __thread struct rogitfs_trace_ring *rogitfs_trace_current = NULL;
+static __thread pid_t rogitfs_trace_tid = 0;
+
+// Called when a thread ends, its spans stay readable until another thread takes the ring
+static void rogitfs_trace_thread_end(void *data) {
+
+	struct rogitfs_trace_ring *ring = (struct rogitfs_trace_ring *)data;
+	pthread_mutex_lock(&rogitfs_trace_lock);
+	ring->used = 0;
+	pthread_mutex_unlock(&rogitfs_trace_lock);
+}
+
+static void rogitfs_trace_key_create(void) {
+
+	pthread_key_create(&rogitfs_trace_key, &rogitfs_trace_thread_end);
+}
+
+static struct rogitfs_trace_ring *rogitfs_trace_ring_get(void) {
+
+	if (rogitfs_trace_current != NULL) {
+		return rogitfs_trace_current;
+	}
+
+	pthread_mutex_lock(&rogitfs_trace_lock);
+	struct rogitfs_trace_ring *ring = rogitfs_trace_rings;
+	while (ring != NULL && ring->used != 0) {
+		ring = ring->next;
+	}
+	if (ring == NULL) {
+		ring = (struct rogitfs_trace_ring *) calloc(1, sizeof(struct rogitfs_trace_ring));
+		if (ring != NULL) {
+			ring->events = (struct rogitfs_trace_event *) calloc(rogitfs_trace_capacity, sizeof(struct rogitfs_trace_event));
+			if (ring->events == NULL) {
+				free(ring);
+				ring = NULL;
+			}
+		}
+		if (ring == NULL) {
+			pthread_mutex_unlock(&rogitfs_trace_lock);
+			return NULL;
+		}
+		ring->next = rogitfs_trace_rings;
+		rogitfs_trace_rings = ring;
+	}
+	ring->used = 1;
+	pthread_mutex_unlock(&rogitfs_trace_lock);
+
+	pthread_once(&rogitfs_trace_once, &rogitfs_trace_key_create);
+	pthread_setspecific(rogitfs_trace_key, ring);
+	rogitfs_trace_current = ring;
+	rogitfs_trace_tid = (pid_t)syscall(SYS_gettid);
+	return ring;
+}
+
+void rogitfs_trace_record(const char *name, const char *detail, const struct timespec *start) {
+
+	struct timespec end = {};
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	struct rogitfs_trace_ring *ring = rogitfs_trace_ring_get();
+	if (ring == NULL) {
+		return;
+	}
+
+	uint64_t head = ring->head;
+	struct rogitfs_trace_event *event = &ring->events[head % rogitfs_trace_capacity];
+	// readers skip the slot until seq is set again
+	__atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	event->start_ns = (uint64_t)start->tv_sec * 1000000000ull + start->tv_nsec;
+	event->duration_ns = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000000ull + end.tv_nsec - start->tv_nsec;
+	event->name = name;
+	event->tid = rogitfs_trace_tid;
+	if (detail != NULL) {
+		strncpy(event->detail, detail, ROGITFS_TRACE_DETAIL_SIZE - 1);
+		event->detail[ROGITFS_TRACE_DETAIL_SIZE - 1] = 0;
+	} else {
+		event->detail[0] = 0;
+	}
+	__atomic_store_n(&event->seq, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static int rogitfs_trace_append_detail(struct rogitfs_buffer *out, const char *detail) {
+
+	int res = rogitfs_buffer_append(out, ",\"args\":{\"path\":\"", 17);
+	for (const char *cur = detail; *cur != 0 && res == 0; cur++) {
+		unsigned char c = *cur;
+		if (c == '"' || c == '\\') {
+			res = rogitfs_buffer_printf(out, "\\%c", c);
+		} else if (c < 0x20) {
+			res = rogitfs_buffer_printf(out, "\\u%04x", c);
+		} else {
+			res = rogitfs_buffer_append(out, cur, 1);
+		}
+	}
+	if (res == 0) {
+		res = rogitfs_buffer_append(out, "\"}", 2);
+	}
+	return res;
+}
+
+// Chrome trace JSON of all rings, spans being overwritten while copied are left out
+int rogitfs_trace_report(struct rogitfs_buffer *out, struct rogitfs_private *private) {
+
+	int res = rogitfs_buffer_printf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	int first = 1;
+	pid_t pid = getpid();
+
+	pthread_mutex_lock(&rogitfs_trace_lock);
+	struct rogitfs_trace_ring *rings = rogitfs_trace_rings;
+	pthread_mutex_unlock(&rogitfs_trace_lock);
+
+	// rings are only prepended and never freed, the list can be walked unlocked
+	for (struct rogitfs_trace_ring *ring = rings; ring != NULL && res == 0; ring = ring->next) {
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t begin = head > rogitfs_trace_capacity ? head - rogitfs_trace_capacity : 0;
+		for (uint64_t i = begin; i < head && res == 0; i++) {
+			struct rogitfs_trace_event *slot = &ring->events[i % rogitfs_trace_capacity];
+			if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1) {
+				continue;
+			}
+			struct rogitfs_trace_event event = *slot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != i + 1) {
+				continue;
+			}
+			event.detail[ROGITFS_TRACE_DETAIL_SIZE - 1] = 0;
+
+			res = rogitfs_buffer_printf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+				first ? "" : ",", event.name, (int)pid, (int)event.tid,
+				(unsigned long long)(event.start_ns / 1000), (unsigned long long)(event.start_ns % 1000),
+				(unsigned long long)(event.duration_ns / 1000), (unsigned long long)(event.duration_ns % 1000));
+			if (res == 0 && event.detail[0] != 0) {
+				res = rogitfs_trace_append_detail(out, event.detail);
+			}
+			if (res == 0) {
+				res = rogitfs_buffer_append(out, "}", 1);
+			}
+			first = 0;
+		}
+	}
+	if (res == 0) {
+		res = rogitfs_buffer_printf(out, "\n]}\n");
+	}
+	return res;
+}
+
+// Enable tracing with rings of the given number of spans, SIGUSR1 is blocked
+// here so threads created later leave it to the dump thread
+int rogitfs_trace_setup(unsigned int events, const char *dump_path) {
+
+	if (events == 0) {
+		return 0;
+	}
+	rogitfs_trace_capacity = events;
+	if (dump_path != NULL) {
+		rogitfs_trace_dump_path = strdup(dump_path);
+	} else {
+		char path[64];
+		snprintf(path, sizeof(path), "/tmp/rogitfs-trace-%d.json", (int)getpid());
+		rogitfs_trace_dump_path = strdup(path);
+	}
+	if (rogitfs_trace_dump_path == NULL) {
+		return -1;
+	}
+
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	int error = pthread_sigmask(SIG_BLOCK, &set, NULL);
+	if (error != 0) {
+		fprintf(stderr, "pthread_sigmask %d %s\n", error, strerror(error));
+		return -1;
+	}
+
+	rogitfs_trace_enabled = 1;
+	return 0;
+}
+
+static int rogitfs_trace_dump(void) {
+
+	struct rogitfs_buffer content = {};
+	if (rogitfs_trace_report(&content, NULL) != 0) {
+		rogitfs_buffer_free(&content);
+		return -1;
+	}
+
+	// written next to the target and renamed, readers never see a partial trace
+	struct rogitfs_buffer tmp_path = {};
+	if (rogitfs_buffer_printf(&tmp_path, "%s.tmp", rogitfs_trace_dump_path) != 0 || rogitfs_buffer_append(&tmp_path, "", 1) != 0) {
+		rogitfs_buffer_free(&tmp_path);
+		rogitfs_buffer_free(&content);
+		return -1;
+	}
+	int res = -1;
+	FILE *file = fopen(tmp_path.data, "w");
+	if (file == NULL) {
+		rogitfs_log_error("fopen %s %s", tmp_path.data, strerror(errno));
+	} else {
+		size_t written = fwrite(content.data, 1, content.size, file);
+		if (fclose(file) == 0 && written == content.size && rename(tmp_path.data, rogitfs_trace_dump_path) == 0) {
+			res = 0;
+		} else {
+			rogitfs_log_error("writing trace %s failed", rogitfs_trace_dump_path);
+		}
+	}
+	rogitfs_buffer_free(&tmp_path);
+	rogitfs_buffer_free(&content);
+	return res;
+}
+
+static void *rogitfs_trace_dumper(void *data) {
+
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	while (1) {
+		int sig = 0;
+		if (sigwait(&set, &sig) != 0) {
+			break;
+		}
+		rogitfs_trace_dump();
+	}
+	return NULL;
+}
+
+// Start the thread writing the trace on SIGUSR1, after fuse has daemonized
+int rogitfs_trace_start_dumper(void) {
+
+	if (rogitfs_trace_enabled == 0) {
+		return 0;
+	}
+	pthread_t thread;
+	int error = pthread_create(&thread, NULL, &rogitfs_trace_dumper, NULL);
+	if (error != 0) {
+		rogitfs_log_error("pthread_create %d %s", error, strerror(error));
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,64 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_TRACE_H__
+#define __ROGITFS_TRACE_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "rogitfs_common.h"
+
+// Spans of fuse operations and of libgit2 calls, enabled by --trace=<n>.
+//
+// Every thread writes into its own ring of the last n spans without locks,
+// the rings are written as Chrome trace JSON (readable by Perfetto) to
+// /.rogitfs/trace and, on SIGUSR1, to the file given by --trace-file.
+// Disabled tracing costs one load and branch per span.
+
+#define ROGITFS_TRACE_DETAIL_SIZE 64
+
+struct rogitfs_trace_event {
+	// index + 1 of the span once written, 0 while being written
+	uint64_t seq;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	const char *name;
+	pid_t tid;
+	char detail[ROGITFS_TRACE_DETAIL_SIZE];
+};
+
+struct rogitfs_trace_ring {
+	struct rogitfs_trace_ring *next;
+	// owned by a running thread, free rings are taken over by new threads
+	int used;
+	uint64_t head;
+	struct rogitfs_trace_event *events;
+};
+
+extern int rogitfs_trace_enabled;
+
+int rogitfs_trace_setup(unsigned int events, const char *dump_path);
+
+int rogitfs_trace_start_dumper(void);
+
+void rogitfs_trace_record(const char *name, const char *detail, const struct timespec *start);
+
+int rogitfs_trace_report(struct rogitfs_buffer *out, struct rogitfs_private *private);
+
+static inline void rogitfs_trace_start(struct timespec *start) {
+
+	if (rogitfs_trace_enabled) {
+		clock_gettime(CLOCK_MONOTONIC, start);
+	}
+}
+
+// Record a span from start until now, name must be a string constant
+static inline void rogitfs_trace_span(const char *name, const char *detail, const struct timespec *start) {
+
+	if (rogitfs_trace_enabled) {
+		rogitfs_trace_record(name, detail, start);
+	}
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_common.h"
+#include "rogitfs_commit.h"
+#include "rogitfs_treeobj.h"
+
+// Check that the first component names a tree, the rest is resolved like /commit
+static int rogitfs_treeobj_check(const char *path, struct rogitfs_private *private) {
+
+	const char *comp = NULL;
+	unsigned int comp_size = 0;
+	if (path_component(path, 0, &comp, &comp_size) != 0 || comp_size != GIT_OID_HEXSZ) {
+		return -1;
+	}
+	char hash[GIT_OID_HEXSZ+1] = {};
+	memcpy(hash, comp, GIT_OID_HEXSZ);
+
+	struct rogitfs_entry entry = {};
+	if (rogitfs_resolve_component(NULL, hash, &entry, private) != 0) {
+		return -1;
+	}
+	if (entry.type == GIT_OBJECT_TAG && rogitfs_peel_tag(&entry.oid, &entry, private) != 0) {
+		return -1;
+	}
+	if (entry.type != GIT_OBJECT_TREE) {
+		return -1;
+	}
+	return 0;
+}
+
+int rogitfs_treeobj_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+	return rogitfs_commit_getattr(path, stbuf, fi);
+}
+
+int rogitfs_treeobj_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (path[0] == 0) {
+		return 0;
+	}
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+
+	struct rogitfs_buffer commit_path = {};
+	if (rogitfs_buffer_printf(&commit_path, "/%s", path) != 0 || rogitfs_buffer_append(&commit_path, "", 1) != 0) {
+		rogitfs_buffer_free(&commit_path);
+		return -ENOENT;
+	}
+	int res = rogitfs_commit_readdir(commit_path.data, buf, filler, offset, fi, flags);
+	rogitfs_buffer_free(&commit_path);
+	return res;
+}
+
+int rogitfs_treeobj_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+	return rogitfs_commit_read(path, buf, size, offset, fi);
+}
+
+int rogitfs_treeobj_readlink(const char *path, char *buf, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+	return rogitfs_commit_readlink(path, buf, size);
+}
+
+int rogitfs_treeobj_getxattr(const char *path, const char *name, char *value, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+	return rogitfs_commit_getxattr(path, name, value, size);
+}
+
+int rogitfs_treeobj_listxattr(const char *path, char *list, size_t size) {
+
+	struct rogitfs_private *private = rogitfs_private_get();
+
+	if (rogitfs_treeobj_check(path, private) != 0) {
+		return -ENOENT;
+	}
+	return rogitfs_commit_listxattr(path, list, size);
+}
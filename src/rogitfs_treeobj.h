@@ -0,0 +1,28 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_TREEOBJ_H__
+#define __ROGITFS_TREEOBJ_H__
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse.h>
+#include <git2.h>
+
+// /tree-obj/<hash>/...    content of a tree, or of a tag pointing to a tree
+//
+// Trees are not listed below /tree-obj, they are only found by hash.
+
+int rogitfs_treeobj_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+
+int rogitfs_treeobj_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+
+int rogitfs_treeobj_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
+
+int rogitfs_treeobj_readlink(const char *path, char *buf, size_t size);
+
+int rogitfs_treeobj_getxattr(const char *path, const char *name, char *value, size_t size);
+
+int rogitfs_treeobj_listxattr(const char *path, char *list, size_t size);
+
+#endif
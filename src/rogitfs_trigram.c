@@ -0,0 +1,356 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rogitfs_trigram.h"
+#include "rogitfs_logging.h"
+
+static uint32_t rogitfs_trigram_get32(const unsigned char *data) {
+
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void rogitfs_trigram_put32(unsigned char *dst, uint32_t value) {
+
+	for (int i = 0; i < 4; i++) {
+		dst[i] = (value >> (8 * i)) & 0xff;
+	}
+}
+
+static int rogitfs_trigram_compare(const void *a, const void *b) {
+
+	uint32_t value_a = *(const uint32_t *)a;
+	uint32_t value_b = *(const uint32_t *)b;
+	return value_a < value_b ? -1 : (value_a > value_b);
+}
+
+// Sorted unique trigrams of data, NULL if there are none
+static uint32_t *rogitfs_trigram_collect(const char *data, size_t size, unsigned int *result_count) {
+
+	*result_count = 0;
+	if (size < 3) {
+		return NULL;
+	}
+	uint32_t *trigrams = (uint32_t *) malloc((size - 2) * sizeof(uint32_t));
+	if (trigrams == NULL) {
+		return NULL;
+	}
+	const unsigned char *cur = (const unsigned char *)data;
+	for (size_t i = 0; i + 2 < size; i++) {
+		trigrams[i] = ((uint32_t)cur[i] << 16) | ((uint32_t)cur[i+1] << 8) | cur[i+2];
+	}
+	qsort(trigrams, size - 2, sizeof(uint32_t), &rogitfs_trigram_compare);
+	unsigned int count = 1;
+	for (size_t i = 1; i < size - 2; i++) {
+		if (trigrams[i] != trigrams[count-1]) {
+			trigrams[count++] = trigrams[i];
+		}
+	}
+	*result_count = count;
+	return trigrams;
+}
+
+int rogitfs_trigram_query(const char *query, size_t query_size, uint32_t **result_trigrams, unsigned int *result_count) {
+
+	unsigned int count = 0;
+	uint32_t *trigrams = rogitfs_trigram_collect(query, query_size, &count);
+	if (trigrams == NULL && query_size >= 3) {
+		return -1;
+	}
+	*result_trigrams = trigrams;
+	*result_count = count;
+	return 0;
+}
+
+int rogitfs_trigram_is_binary(const char *data, size_t size) {
+
+	size_t check = size < ROGITFS_TRIGRAM_BINARY_CHECK ? size : ROGITFS_TRIGRAM_BINARY_CHECK;
+	return memchr(data, 0, check) != NULL;
+}
+
+// Append the record of a blob to records
+int rogitfs_trigram_record(struct rogitfs_buffer *records, const git_oid *oid, const char *data, size_t size) {
+
+	unsigned char header[ROGITFS_TRIGRAM_RECORD_HEADER_SIZE];
+	memcpy(header, oid->id, GIT_OID_RAWSZ);
+
+	if (rogitfs_trigram_is_binary(data, size)) {
+		rogitfs_trigram_put32(header + GIT_OID_RAWSZ, ROGITFS_TRIGRAM_BINARY);
+		return rogitfs_buffer_append(records, header, sizeof(header));
+	}
+	if (size > ROGITFS_TRIGRAM_MAX_BLOB) {
+		rogitfs_trigram_put32(header + GIT_OID_RAWSZ, ROGITFS_TRIGRAM_UNINDEXED);
+		return rogitfs_buffer_append(records, header, sizeof(header));
+	}
+
+	unsigned int count = 0;
+	uint32_t *trigrams = rogitfs_trigram_collect(data, size, &count);
+	if (trigrams == NULL && size >= 3) {
+		return -1;
+	}
+	rogitfs_trigram_put32(header + GIT_OID_RAWSZ, count);
+	int res = rogitfs_buffer_append(records, header, sizeof(header));
+	for (unsigned int i = 0; i < count && res == 0; i++) {
+		unsigned char value[4];
+		rogitfs_trigram_put32(value, trigrams[i]);
+		res = rogitfs_buffer_append(records, value, sizeof(value));
+	}
+	free(trigrams);
+	return res;
+}
+
+static size_t rogitfs_trigram_record_size(const unsigned char *record) {
+
+	uint32_t count = rogitfs_trigram_get32(record + GIT_OID_RAWSZ);
+	if (count == ROGITFS_TRIGRAM_BINARY || count == ROGITFS_TRIGRAM_UNINDEXED) {
+		return ROGITFS_TRIGRAM_RECORD_HEADER_SIZE;
+	}
+	return ROGITFS_TRIGRAM_RECORD_HEADER_SIZE + (size_t)count * 4;
+}
+
+// Returns 1 if the blob of record contains all trigrams and may match, 0 if not
+int rogitfs_trigram_record_match(const unsigned char *record, const uint32_t *trigrams, unsigned int count) {
+
+	uint32_t record_count = rogitfs_trigram_get32(record + GIT_OID_RAWSZ);
+	if (record_count == ROGITFS_TRIGRAM_BINARY) {
+		return 0;
+	}
+	if (record_count == ROGITFS_TRIGRAM_UNINDEXED) {
+		return 1;
+	}
+	const unsigned char *values = record + ROGITFS_TRIGRAM_RECORD_HEADER_SIZE;
+	unsigned int low = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		// trigrams are sorted, so the search continues where the last one ended
+		unsigned int high = record_count;
+		while (low < high) {
+			unsigned int mid = low + (high - low) / 2;
+			if (rogitfs_trigram_get32(values + (size_t)mid * 4) < trigrams[i]) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (low >= record_count || rogitfs_trigram_get32(values + (size_t)low * 4) != trigrams[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static unsigned int rogitfs_trigram_hash(const unsigned char *oid) {
+
+	return ((unsigned int)oid[0] << 24) | ((unsigned int)oid[1] << 16) | ((unsigned int)oid[2] << 8) | (unsigned int)oid[3];
+}
+
+static size_t rogitfs_trigram_find(const struct rogitfs_trigram_index *index, const unsigned char *oid) {
+
+	if (index->table == NULL || index->map == NULL) {
+		return 0;
+	}
+	unsigned int slot = rogitfs_trigram_hash(oid) & index->table_mask;
+	while (index->table[slot] != 0) {
+		if (memcmp(index->map + index->table[slot], oid, GIT_OID_RAWSZ) == 0) {
+			return index->table[slot];
+		}
+		slot = (slot + 1) & index->table_mask;
+	}
+	return 0;
+}
+
+static int rogitfs_trigram_insert(struct rogitfs_trigram_index *index, size_t offset) {
+
+	if (rogitfs_trigram_find(index, index->map + offset) != 0) {
+		return 0;
+	}
+	if (index->table == NULL || (index->table_count + 1) * 2 > index->table_mask + 1) {
+		unsigned int size = index->table == NULL ? 4096 : (index->table_mask + 1) * 2;
+		size_t *table = (size_t *) calloc(size, sizeof(size_t));
+		if (table == NULL) {
+			return -1;
+		}
+		for (unsigned int i = 0; index->table != NULL && i <= index->table_mask; i++) {
+			if (index->table[i] == 0) {
+				continue;
+			}
+			unsigned int slot = rogitfs_trigram_hash(index->map + index->table[i]) & (size - 1);
+			while (table[slot] != 0) {
+				slot = (slot + 1) & (size - 1);
+			}
+			table[slot] = index->table[i];
+		}
+		free(index->table);
+		index->table = table;
+		index->table_mask = size - 1;
+	}
+	unsigned int slot = rogitfs_trigram_hash(index->map + offset) & index->table_mask;
+	while (index->table[slot] != 0) {
+		slot = (slot + 1) & index->table_mask;
+	}
+	index->table[slot] = offset;
+	index->table_count++;
+	return 0;
+}
+
+static int rogitfs_trigram_map(struct rogitfs_trigram_index *index, size_t size) {
+
+	if (index->map != NULL) {
+		munmap((void *)index->map, index->map_size);
+		index->map = NULL;
+		index->map_size = 0;
+	}
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, index->fd, 0);
+	if (map == MAP_FAILED) {
+		int err = errno;
+		rogitfs_log_error("mmap %d %s", err, strerror(err));
+		return -1;
+	}
+	index->map = (const unsigned char *)map;
+	index->map_size = size;
+	return 0;
+}
+
+// Add all complete records between start and the end of the mapping, returns the end of the last one
+static size_t rogitfs_trigram_scan(struct rogitfs_trigram_index *index, size_t start) {
+
+	size_t offset = start;
+	while (offset + ROGITFS_TRIGRAM_RECORD_HEADER_SIZE <= index->map_size) {
+		size_t record_size = rogitfs_trigram_record_size(index->map + offset);
+		if (offset + record_size > index->map_size) {
+			break;
+		}
+		if (rogitfs_trigram_insert(index, offset) != 0) {
+			break;
+		}
+		offset = offset + record_size;
+	}
+	return offset;
+}
+
+struct rogitfs_trigram_index *rogitfs_trigram_open(const char *path) {
+
+	struct rogitfs_trigram_index *index = (struct rogitfs_trigram_index *) calloc(1, sizeof(struct rogitfs_trigram_index));
+	if (index == NULL) {
+		return NULL;
+	}
+	index->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (index->fd < 0) {
+		int err = errno;
+		rogitfs_log_error("open %s %d %s", path, err, strerror(err));
+		free(index);
+		return NULL;
+	}
+	pthread_rwlock_init(&index->lock, NULL);
+
+	struct stat file_stat = {};
+	if (fstat(index->fd, &file_stat) != 0) {
+		rogitfs_trigram_close(index);
+		return NULL;
+	}
+	if (file_stat.st_size == 0) {
+		unsigned char header[ROGITFS_TRIGRAM_HEADER_SIZE];
+		memcpy(header, ROGITFS_TRIGRAM_MAGIC, 4);
+		rogitfs_trigram_put32(header + 4, ROGITFS_TRIGRAM_VERSION);
+		if (pwrite(index->fd, header, sizeof(header), 0) != sizeof(header)) {
+			rogitfs_trigram_close(index);
+			return NULL;
+		}
+		file_stat.st_size = sizeof(header);
+	}
+	if (rogitfs_trigram_map(index, file_stat.st_size) != 0) {
+		rogitfs_trigram_close(index);
+		return NULL;
+	}
+	if (index->map_size < ROGITFS_TRIGRAM_HEADER_SIZE || memcmp(index->map, ROGITFS_TRIGRAM_MAGIC, 4) != 0 || rogitfs_trigram_get32(index->map + 4) != ROGITFS_TRIGRAM_VERSION) {
+		rogitfs_log_error("unsupported trigram index %s", path);
+		rogitfs_trigram_close(index);
+		return NULL;
+	}
+
+	size_t end = rogitfs_trigram_scan(index, ROGITFS_TRIGRAM_HEADER_SIZE);
+	if (end < index->map_size) {
+		// drop a record torn by an interrupted append
+		if (ftruncate(index->fd, end) != 0 || rogitfs_trigram_map(index, end) != 0) {
+			rogitfs_trigram_close(index);
+			return NULL;
+		}
+	}
+	return index;
+}
+
+void rogitfs_trigram_close(struct rogitfs_trigram_index *index) {
+
+	if (index == NULL) {
+		return;
+	}
+	if (index->map != NULL) {
+		munmap((void *)index->map, index->map_size);
+	}
+	close(index->fd);
+	pthread_rwlock_destroy(&index->lock);
+	free(index->table);
+	free(index);
+}
+
+// Returns 1 if the blob may contain all trigrams, 0 if not and -1 if it is not indexed yet
+int rogitfs_trigram_lookup(struct rogitfs_trigram_index *index, const git_oid *oid, const uint32_t *trigrams, unsigned int count) {
+
+	pthread_rwlock_rdlock(&index->lock);
+	size_t offset = index->failed ? 0 : rogitfs_trigram_find(index, oid->id);
+	int res = -1;
+	if (offset != 0) {
+		res = rogitfs_trigram_record_match(index->map + offset, trigrams, count);
+	}
+	pthread_rwlock_unlock(&index->lock);
+	return res;
+}
+
+// Write records built by rogitfs_trigram_record to the end of the file
+int rogitfs_trigram_append(struct rogitfs_trigram_index *index, const struct rogitfs_buffer *records) {
+
+	if (records->size == 0) {
+		return 0;
+	}
+	pthread_rwlock_wrlock(&index->lock);
+	if (index->failed) {
+		pthread_rwlock_unlock(&index->lock);
+		return -1;
+	}
+
+	size_t start = index->map_size;
+	size_t written = 0;
+	while (written < records->size) {
+		ssize_t res = pwrite(index->fd, records->data + written, records->size - written, start + written);
+		if (res <= 0) {
+			int err = errno;
+			rogitfs_log_error("pwrite %d %s", err, strerror(err));
+			// keep the file at the last complete record
+			if (ftruncate(index->fd, start) != 0) {
+				err = errno;
+				rogitfs_log_error("ftruncate %d %s, trigram index disabled", err, strerror(err));
+				index->failed = 1;
+			}
+			pthread_rwlock_unlock(&index->lock);
+			return -1;
+		}
+		written = written + res;
+	}
+	int res = rogitfs_trigram_map(index, start + records->size);
+	if (res == 0) {
+		rogitfs_trigram_scan(index, start);
+	} else {
+		// the old mapping is gone, the next append would not know the end
+		rogitfs_log_error("trigram index disabled");
+		index->failed = 1;
+	}
+
+	pthread_rwlock_unlock(&index->lock);
+	return res;
+}
@@ -0,0 +1,59 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_TRIGRAM_H__
+#define __ROGITFS_TRIGRAM_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <git2.h>
+#include "rogitfs_common.h"
+
+// Trigram sets of blobs, kept in an append-only file that is mapped into memory.
+// Blobs are indexed on first search, so commits sharing blobs share their records.
+//
+// File layout, all integers little-endian:
+//   header  magic "RGTI", u32 version
+//   records u8[20] blob oid, u32 count, count sorted u32 trigrams
+#define ROGITFS_TRIGRAM_MAGIC "RGTI"
+#define ROGITFS_TRIGRAM_VERSION 1
+#define ROGITFS_TRIGRAM_HEADER_SIZE 8
+#define ROGITFS_TRIGRAM_RECORD_HEADER_SIZE (GIT_OID_RAWSZ + 4)
+// record counts with special meaning
+#define ROGITFS_TRIGRAM_BINARY 0xffffffffu
+#define ROGITFS_TRIGRAM_UNINDEXED 0xfffffffeu
+// larger blobs are not indexed and always searched
+#define ROGITFS_TRIGRAM_MAX_BLOB (16 * 1024 * 1024)
+// blobs with a NUL byte in this prefix are binary and never match
+#define ROGITFS_TRIGRAM_BINARY_CHECK 8000
+
+struct rogitfs_trigram_index {
+	pthread_rwlock_t lock;
+	int fd;
+	const unsigned char *map;
+	size_t map_size;
+	// open addressing table of record offsets by oid, 0 is empty
+	size_t *table;
+	unsigned int table_count;
+	unsigned int table_mask;
+	// set when a failed append could not be undone, the file is not used any more
+	int failed;
+};
+
+struct rogitfs_trigram_index *rogitfs_trigram_open(const char *path);
+
+void rogitfs_trigram_close(struct rogitfs_trigram_index *index);
+
+int rogitfs_trigram_query(const char *query, size_t query_size, uint32_t **result_trigrams, unsigned int *result_count);
+
+int rogitfs_trigram_is_binary(const char *data, size_t size);
+
+int rogitfs_trigram_record(struct rogitfs_buffer *records, const git_oid *oid, const char *data, size_t size);
+
+int rogitfs_trigram_record_match(const unsigned char *record, const uint32_t *trigrams, unsigned int count);
+
+int rogitfs_trigram_lookup(struct rogitfs_trigram_index *index, const git_oid *oid, const uint32_t *trigrams, unsigned int count);
+
+int rogitfs_trigram_append(struct rogitfs_trigram_index *index, const struct rogitfs_buffer *records);
+
+#endif
@@ -0,0 +1,150 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "rogitfs_xattr.h"
+#include "rogitfs_logging.h"
+
+// Commit metadata is available on commit directories and on submodules that were resolved
+static int rogitfs_xattr_is_commit(const struct rogitfs_entry *entry) {
+
+	return entry->type == GIT_OBJECT_COMMIT && (entry->mode != GIT_FILEMODE_COMMIT || (entry->flags & ROGITFS_ENTRY_SUBMODULE) != 0);
+}
+
+// Copy value following the getxattr size protocol
+static int rogitfs_xattr_reply(const char *data, size_t len, char *value, size_t size) {
+
+	if (size == 0) {
+		return len;
+	}
+	if (size < len) {
+		return -ERANGE;
+	}
+	memcpy(value, data, len);
+	return len;
+}
+
+static int rogitfs_xattr_signature(const git_signature *sig, char *value, size_t size) {
+
+	struct rogitfs_buffer buffer = {};
+	int res = rogitfs_buffer_printf(&buffer, "%s <%s>", sig->name, sig->email);
+	if (res != 0) {
+		rogitfs_buffer_free(&buffer);
+		return -ENOMEM;
+	}
+	res = rogitfs_xattr_reply(buffer.data, buffer.size, value, size);
+	rogitfs_buffer_free(&buffer);
+	return res;
+}
+
+static int rogitfs_xattr_commit(const struct rogitfs_entry *entry, const char *name, char *value, size_t size, struct rogitfs_private *private) {
+
+	git_commit *commit = NULL;
+	int error = git_commit_lookup(&commit, rogitfs_entry_repo(entry, private), &entry->oid);
+	if (error != 0) {
+		rogitfs_log_giterr("git_commit_lookup", error);
+		return -ENODATA;
+	}
+
+	int res = -ENODATA;
+	if (strcmp(name, ROGITFS_XATTR_AUTHOR) == 0) {
+
+		res = rogitfs_xattr_signature(git_commit_author(commit), value, size);
+
+	} else if (strcmp(name, ROGITFS_XATTR_COMMITTER) == 0) {
+
+		res = rogitfs_xattr_signature(git_commit_committer(commit), value, size);
+
+	} else if (strcmp(name, ROGITFS_XATTR_TIME) == 0) {
+
+		char buffer[32];
+		int len = snprintf(buffer, sizeof(buffer), "%lld", (long long)git_commit_time(commit));
+		res = rogitfs_xattr_reply(buffer, len, value, size);
+
+	} else if (strcmp(name, ROGITFS_XATTR_PARENTS) == 0) {
+
+		unsigned int parent_count = git_commit_parentcount(commit);
+		char buffer[parent_count * (GIT_OID_HEXSZ + 1) + 1];
+		char *cur = buffer;
+		for (unsigned int i = 0; i < parent_count; i++) {
+			if (i > 0) {
+				cur[0] = ' ';
+				cur++;
+			}
+			git_oid_tostr(cur, GIT_OID_HEXSZ + 1, git_commit_parent_id(commit, i));
+			cur = cur + GIT_OID_HEXSZ;
+		}
+		res = rogitfs_xattr_reply(buffer, cur - buffer, value, size);
+	}
+
+	git_commit_free(commit);
+	return res;
+}
+
+int rogitfs_xattr_get(const struct rogitfs_entry *entry, const char *name, char *value, size_t size, struct rogitfs_private *private) {
+
+	if (strcmp(name, ROGITFS_XATTR_OID) == 0) {
+
+		char hash[GIT_OID_HEXSZ+1] = {};
+		git_oid_tostr(hash, GIT_OID_HEXSZ+1, &entry->oid);
+		return rogitfs_xattr_reply(hash, GIT_OID_HEXSZ, value, size);
+
+	} else if (strcmp(name, ROGITFS_XATTR_TYPE) == 0) {
+
+		const char *type = git_object_type2string(entry->type);
+		return rogitfs_xattr_reply(type, strlen(type), value, size);
+
+	} else if (strcmp(name, ROGITFS_XATTR_MODE) == 0) {
+
+		if (entry->mode == 0) {
+			return -ENODATA;
+		}
+		char buffer[16];
+		int len = snprintf(buffer, sizeof(buffer), "%06o", entry->mode);
+		return rogitfs_xattr_reply(buffer, len, value, size);
+
+	} else if (rogitfs_xattr_is_commit(entry)) {
+
+		return rogitfs_xattr_commit(entry, name, value, size, private);
+
+	}
+
+	return -ENODATA;
+}
+
+int rogitfs_xattr_list(const struct rogitfs_entry *entry, char *list, size_t size) {
+
+	const char *names[7];
+	unsigned int name_count = 0;
+	names[name_count++] = ROGITFS_XATTR_OID;
+	names[name_count++] = ROGITFS_XATTR_TYPE;
+	if (entry->mode != 0) {
+		names[name_count++] = ROGITFS_XATTR_MODE;
+	}
+	if (rogitfs_xattr_is_commit(entry)) {
+		names[name_count++] = ROGITFS_XATTR_AUTHOR;
+		names[name_count++] = ROGITFS_XATTR_COMMITTER;
+		names[name_count++] = ROGITFS_XATTR_TIME;
+		names[name_count++] = ROGITFS_XATTR_PARENTS;
+	}
+
+	size_t len = 0;
+	for (unsigned int i = 0; i < name_count; i++) {
+		len += strlen(names[i]) + 1;
+	}
+	if (size == 0) {
+		return len;
+	}
+	if (size < len) {
+		return -ERANGE;
+	}
+	char *cur = list;
+	for (unsigned int i = 0; i < name_count; i++) {
+		size_t name_len = strlen(names[i]) + 1;
+		memcpy(cur, names[i], name_len);
+		cur = cur + name_len;
+	}
+	return len;
+}
@@ -0,0 +1,22 @@
+// Copyright 2019, aw32
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef __ROGITFS_XATTR_H__
+#define __ROGITFS_XATTR_H__
+
+#include <git2.h>
+#include "rogitfs_common.h"
+
+#define ROGITFS_XATTR_OID "user.git.oid"
+#define ROGITFS_XATTR_TYPE "user.git.type"
+#define ROGITFS_XATTR_MODE "user.git.mode"
+#define ROGITFS_XATTR_AUTHOR "user.git.author"
+#define ROGITFS_XATTR_COMMITTER "user.git.committer"
+#define ROGITFS_XATTR_TIME "user.git.time"
+#define ROGITFS_XATTR_PARENTS "user.git.parents"
+
+int rogitfs_xattr_get(const struct rogitfs_entry *entry, const char *name, char *value, size_t size, struct rogitfs_private *private);
+
+int rogitfs_xattr_list(const struct rogitfs_entry *entry, char *list, size_t size);
+
+#endif